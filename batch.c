@@ -0,0 +1,260 @@
+// ---------------------------------------------------------------------------
+// Batch Mode
+// ---------------------------------------------------------------------------
+// NOTE(shaw): batch mode solves many systems in one process, so process
+// startup, arena reservation and the cpu frequency estimate are paid once
+// instead of once per system. The inputs come from a directory (every regular
+// file in it) or from a manifest (a text file with one input path per line,
+// empty lines and lines starting with # are skipped). Every thread of the pool
+// takes the next unsolved system until none are left, parsing and solving it
+// on its own with its scratch arena, which is reset between systems. The
+// kernels of a solve then run serially on that thread, see
+// thread_pool_thread_count, so batches are meant for many small systems
+// rather than a few large ones.
+//
+// Each input gets OUTPUT/<index>_<input file name>.out with one line per
+// right hand side, like the output of a single solve, where index is its
+// position in the list so inputs of the same name in different directories
+// do not overwrite each other. OUTPUT/summary.txt gets one line per input with
+// the name of its output. A system that fails to load or solve is recorded in the
+// summary and the batch carries on, see fatal_handler.
+
+typedef enum {
+	BATCH_SOLVED,
+	BATCH_NOT_CONVERGED,
+	BATCH_FAILED,
+	BATCH_STATUS_COUNT,
+} BatchStatus;
+
+static char *batch_status_names[BATCH_STATUS_COUNT] = {
+	[BATCH_SOLVED]        = "solved",
+	[BATCH_NOT_CONVERGED] = "not_converged",
+	[BATCH_FAILED]        = "failed",
+};
+
+typedef struct {
+	char *input_path;
+	char *output_name; // file name in the output directory
+	BatchStatus status;
+	U64 num_rows;
+	U64 num_vectors;
+	U64 ticks;
+	char message[512]; // why a failed system failed, see FatalHandler
+} BatchSystem;
+
+typedef struct {
+	BatchSystem *systems;
+	U64 count;
+	char *output_dir;
+	volatile U64 next; // systems claimed so far
+} Batch;
+
+typedef struct {
+	Arena *arena;
+	char *dir;
+	char **paths;
+	U64 count;
+	U64 cap;
+} BatchInputList;
+
+static void batch_add_input(BatchInputList *list, char *path) {
+	if (list->count == list->cap) {
+		list->cap = MAX(64, 2 * list->cap);
+		char **paths = arena_push_n(list->arena, char*, list->cap);
+		if (list->count) memcpy(paths, list->paths, list->count * sizeof(char*));
+		list->paths = paths;
+	}
+	U64 size = strlen(path) + 1;
+	char *copy = arena_push_n_no_zero(list->arena, char, size);
+	memcpy(copy, path, size);
+	list->paths[list->count++] = copy;
+}
+
+static void batch_add_directory_entry(void *data, char *name) {
+	BatchInputList *list = data;
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", list->dir, name);
+	batch_add_input(list, path);
+}
+
+static int compare_batch_paths(const void *a, const void *b) {
+	return strcmp(*(char**)a, *(char**)b);
+}
+
+// the input paths of a directory (sorted, so runs are repeatable) or manifest
+static char **batch_collect_inputs(Arena *arena, char *path, U64 *count) {
+	PROFILE_FUNCTION_BEGIN;
+	BatchInputList list = { .arena = arena, .dir = path };
+	if (os_is_directory(path)) {
+		if (!os_list_directory(path, batch_add_directory_entry, &list)) {
+			fatal("Failed to read the directory %s", path);
+		}
+		qsort(list.paths, list.count, sizeof(char*), compare_batch_paths);
+	} else {
+		char *data;
+		U64 size;
+		if (!read_entire_file(arena, path, &data, &size)) {
+			fatal("Failed to read the manifest %s", path);
+		}
+		for (char *line = data; *line;) {
+			char *end = line;
+			while (*end && *end != '\n') ++end;
+			char *next = *end ? end + 1 : end;
+			while (end > line && isspace((unsigned char)end[-1])) --end;
+			while (line < end && isspace((unsigned char)*line)) ++line;
+			if (line < end && *line != '#') {
+				*end = 0;
+				batch_add_input(&list, line);
+			}
+			line = next;
+		}
+	}
+	*count = list.count;
+	PROFILE_FUNCTION_END;
+	return list.paths;
+}
+
+static char *batch_file_name(char *path) {
+	char *name = path;
+	for (char *c = path; *c; ++c) {
+		if (*c == '/' || *c == '\\') name = c + 1;
+	}
+	return name;
+}
+
+static void batch_write_solution(char *output_dir, char *output_name, Vector *solution, U64 num_rows, U64 num_vectors) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", output_dir, output_name);
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		fatal("Failed to open %s for writing", path);
+	}
+	for (U64 i=0; i<num_vectors; ++i) {
+		Vector column = vec_slice(solution, i * num_rows, num_rows);
+		vec_fprint(f, &column);
+	}
+	if (fclose(f) != 0) {
+		fatal("Failed to write %s", path);
+	}
+}
+
+static void batch_solve_system(Batch *batch, BatchSystem *system) {
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	U64 start = os_read_timer();
+
+	FatalHandler handler;
+	fatal_handler_begin(&handler);
+	if (setjmp(handler.jump) == 0) {
+		ParseResult input;
+		PreparedSystem prepared;
+		if (is_binary_file(system->input_path)) {
+			input = load_binary_file(scratch.arena, system->input_path);
+			prepared = prepare_system(scratch.arena, input.solver, input.matrix);
+		} else if (cache_dir) {
+			input = parse_input_cached(scratch.arena, system->input_path, &prepared);
+		} else {
+			input = parse_input(scratch.arena, system->input_path);
+			prepared = prepare_system(scratch.arena, input.solver, input.matrix);
+		}
+		system->num_rows = input.matrix->num_rows;
+		system->num_vectors = input.num_vectors;
+
+		Vector *solution = vec_alloc(scratch.arena, input.vector->precision, input.vector->num_values);
+		bool converged = solve_prepared(&prepared, input.vector, input.initial_guess, solution);
+		batch_write_solution(batch->output_dir, system->output_name, solution, system->num_rows, system->num_vectors);
+		system->status = converged ? BATCH_SOLVED : BATCH_NOT_CONVERGED;
+
+		if (input.mapping) {
+			unload_binary_file(&input);
+		}
+	} else {
+		snprintf(system->message, sizeof(system->message), "%s", handler.message);
+		system->status = BATCH_FAILED;
+	}
+	fatal_handler = NULL;
+
+	system->ticks = os_read_timer() - start;
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+}
+
+static void batch_task(void *data, U64 range_index, U64 start, U64 end) {
+	(void)range_index; (void)start; (void)end;
+	Batch *batch = data;
+	for (;;) {
+		U64 index = os_atomic_increment(&batch->next) - 1;
+		if (index >= batch->count) break;
+		batch_solve_system(batch, &batch->systems[index]);
+	}
+}
+
+// solves every input listed by input_path (a directory or manifest) and
+// writes the results to output_dir. returns the number of systems that were
+// not solved
+static U64 solve_batch(char *input_path, char *output_dir) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 start = os_read_timer();
+	Arena *arena = arena_alloc();
+	if (!arena) {
+		fatal("Failed to allocate an arena for the batch");
+	}
+	if (!os_make_directory(output_dir)) {
+		fatal("Failed to create the output directory %s", output_dir);
+	}
+
+	U64 count;
+	char **paths = batch_collect_inputs(arena, input_path, &count);
+	Batch batch = {
+		.systems = arena_push_n(arena, BatchSystem, count),
+		.count = count,
+		.output_dir = output_dir,
+	};
+	for (U64 i=0; i<count; ++i) {
+		BatchSystem *system = &batch.systems[i];
+		system->input_path = paths[i];
+		char *name = batch_file_name(paths[i]);
+		U64 size = snprintf(NULL, 0, "%llu_%s.out", i, name) + 1;
+		system->output_name = arena_push_n_no_zero(arena, char, size);
+		snprintf(system->output_name, size, "%llu_%s.out", i, name);
+	}
+
+	// one range per thread, the ranges themselves are ignored and the
+	// systems handed out one at a time, their sizes vary too much to split
+	// them up front
+	thread_pool_run(batch_task, &batch, MIN(count, thread_pool_thread_count()), 1);
+
+	U64 status_counts[BATCH_STATUS_COUNT] = {0};
+	char summary_path[4096];
+	snprintf(summary_path, sizeof(summary_path), "%s/summary.txt", output_dir);
+	FILE *summary = fopen(summary_path, "wb");
+	if (!summary) {
+		fatal("Failed to open %s for writing", summary_path);
+	}
+	F64 ticks_per_ms = os_timer_freq() / 1000.0;
+	for (U64 i=0; i<count; ++i) {
+		BatchSystem *system = &batch.systems[i];
+		++status_counts[system->status];
+		fprintf(summary, "%s %s rows=%llu vectors=%llu time=%.3fms", system->input_path, batch_status_names[system->status],
+			system->num_rows, system->num_vectors, system->ticks / ticks_per_ms);
+		if (system->status == BATCH_FAILED) {
+			fprintf(summary, " error=\"%s\"", system->message);
+		} else {
+			fprintf(summary, " output=%s", system->output_name);
+		}
+		fprintf(summary, "\n");
+	}
+	F64 total_ms = (os_read_timer() - start) / ticks_per_ms;
+	fprintf(summary, "total: %llu systems, %llu solved, %llu not converged, %llu failed in %.3fms\n",
+		count, status_counts[BATCH_SOLVED], status_counts[BATCH_NOT_CONVERGED], status_counts[BATCH_FAILED], total_ms);
+	if (fclose(summary) != 0) {
+		fatal("Failed to write %s", summary_path);
+	}
+
+	printf("%llu systems, %llu solved, %llu not converged, %llu failed in %.3fms, see %s\n",
+		count, status_counts[BATCH_SOLVED], status_counts[BATCH_NOT_CONVERGED], status_counts[BATCH_FAILED], total_ms, summary_path);
+
+	arena_release(arena);
+	PROFILE_FUNCTION_END;
+	return count - status_counts[BATCH_SOLVED];
+}
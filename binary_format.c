@@ -0,0 +1,571 @@
+// ---------------------------------------------------------------------------
+// Binary Input Format
+// ---------------------------------------------------------------------------
+// NOTE(shaw): a binary file holds the same problem as a text input file, with
+// the matrix already in its storage layout (compressed sparse rows, symmetric,
+// diagonal or sliced). The file is a header
+// followed by sections, every section starts on a BINARY_SECTION_ALIGNMENT
+// boundary. Loading maps the file and points the SparseMatrix and Vector
+// arrays straight into the mapping, nothing is parsed or copied. The header
+// describes the machine it was written on (little endian, 64 bit offsets),
+// files are not portable to anything else. The column indices are written
+// in the encoding the matrix has, see SparseIndexEncoding, a file has
+// exactly one of the column sections.
+//
+//   BinaryHeader
+//   BinarySection sections[section_count]
+//   section data...
+//
+// Readers skip sections with kinds they do not know, so new sections can be
+// added without bumping the version. The version changes when the meaning of
+// an existing section or header field changes.
+
+#define BINARY_MAGIC "SPSOLVER"
+#define BINARY_VERSION 3
+#define BINARY_SECTION_ALIGNMENT 64
+
+typedef enum {
+	BINARY_SECTION_NONE,
+	BINARY_SECTION_ROW_OFFSETS,   // U64[num_rows + 1]
+	BINARY_SECTION_COLS,          // U64[num_values]
+	BINARY_SECTION_MATRIX_VALUES, // F32/F64[num_values]
+	BINARY_SECTION_VECTOR,        // F32/F64[num_rows * num_vectors], one vector after the other
+	BINARY_SECTION_SOLUTION,      // F32/F64[num_rows * num_vectors], optional
+	BINARY_SECTION_DIAGONAL_OFFSETS, // S64[num_values / num_rows], diagonal layout only
+	BINARY_SECTION_CHUNK_OFFSETS,    // U64[num_chunks + 1], sliced layout only
+	BINARY_SECTION_CHUNK_ROWS,       // U64[num_chunks * chunk_height], sliced layout only
+	// the incomplete Cholesky factor of the matrix in compressed rows,
+	// optional, only written to cache entries (see cache.c)
+	BINARY_SECTION_FACTOR_ROW_OFFSETS, // U64[num_rows + 1]
+	BINARY_SECTION_FACTOR_COLS,        // U64[factor values]
+	BINARY_SECTION_FACTOR_VALUES,      // F32/F64[factor values]
+	BINARY_SECTION_INITIAL_GUESS, // F32/F64[num_rows * num_vectors], optional
+	BINARY_SECTION_PERMUTATION,   // U64[num_rows], SparseMatrix.permutation, optional
+	BINARY_SECTION_COLS32,           // U32[num_values], instead of COLS
+	BINARY_SECTION_COL_BYTES,        // U8[col_byte_offsets[num_rows]], instead of COLS
+	BINARY_SECTION_COL_BYTE_OFFSETS, // U64[num_rows + 1], along with COL_BYTES
+	BINARY_SECTION_COUNT,
+} BinarySectionKind;
+
+typedef struct {
+	U32 kind;
+	U32 reserved;
+	U64 offset; // from the start of the file
+	U64 size;   // in bytes
+} BinarySection;
+
+typedef struct {
+	char magic[8];
+	U32 version;
+	U32 section_count;
+	U32 precision; // FloatPrecision
+	U32 solver;    // SolverKind
+	U32 layout;    // SparseLayout
+	U32 chunk_height; // sliced layout only, 0 otherwise
+	U64 num_rows;
+	U64 num_values;
+} BinaryHeader;
+
+typedef struct {
+	BinarySectionKind kind;
+	void *data;
+	U64 size;
+} BinaryPart;
+
+static bool is_binary_file(char *file_path) {
+	char magic[sizeof(BINARY_MAGIC) - 1] = {0};
+	FILE *f = fopen(file_path, "rb");
+	if (!f) return false;
+	U64 bytes_read = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+	return bytes_read == sizeof(magic) && memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0;
+}
+
+static void write_section(FILE *f, U64 *pos, BinarySection *section, void *data) {
+	U8 zeros[BINARY_SECTION_ALIGNMENT] = {0};
+	U64 padding = section->offset - *pos;
+	assert(padding < BINARY_SECTION_ALIGNMENT);
+	if (fwrite(zeros, 1, padding, f) != padding || fwrite(data, 1, section->size, f) != section->size) {
+		fatal("Failed to write binary file");
+	}
+	*pos = section->offset + section->size;
+}
+
+// appends the sections holding the column indices of m to parts, returns how
+// many there are
+static U32 binary_cols_parts(SparseMatrix *m, BinaryPart *parts) {
+	switch (m->index_encoding) {
+		case SPARSE_INDEX_U32:
+			parts[0] = (BinaryPart){ BINARY_SECTION_COLS32, m->cols32, m->num_values * sizeof(U32) };
+			return 1;
+		case SPARSE_INDEX_DELTA:
+			parts[0] = (BinaryPart){ BINARY_SECTION_COL_BYTES, m->col_bytes, m->col_byte_offsets[m->num_rows] };
+			parts[1] = (BinaryPart){ BINARY_SECTION_COL_BYTE_OFFSETS, m->col_byte_offsets, (m->num_rows + 1) * sizeof(U64) };
+			return 2;
+		default:
+			parts[0] = (BinaryPart){ BINARY_SECTION_COLS, m->cols, m->num_values * sizeof(U64) };
+			return 1;
+	}
+}
+
+// appends the sections holding m to parts, returns how many there are
+static U32 binary_matrix_parts(SparseMatrix *m, BinaryPart *parts) {
+	U64 value_size = m->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+	// the diagonal layout replaces the row offsets and columns with the
+	// diagonal offsets, the sliced one the row offsets with its chunks
+	U32 count = 0;
+	if (m->layout == SPARSE_LAYOUT_DIAGONAL) {
+		parts[count++] = (BinaryPart){ BINARY_SECTION_DIAGONAL_OFFSETS, m->diagonal_offsets, m->num_diagonals * sizeof(S64) };
+	} else if (m->layout == SPARSE_LAYOUT_SLICED) {
+		parts[count++] = (BinaryPart){ BINARY_SECTION_CHUNK_OFFSETS, m->chunk_offsets, (m->num_chunks + 1) * sizeof(U64) };
+		parts[count++] = (BinaryPart){ BINARY_SECTION_CHUNK_ROWS, m->chunk_rows, m->num_chunks * m->chunk_height * sizeof(U64) };
+		count += binary_cols_parts(m, parts + count);
+	} else {
+		assert(m->row_offsets);
+		parts[count++] = (BinaryPart){ BINARY_SECTION_ROW_OFFSETS, m->row_offsets, (m->num_rows + 1) * sizeof(U64) };
+		count += binary_cols_parts(m, parts + count);
+	}
+	parts[count++] = (BinaryPart){ BINARY_SECTION_MATRIX_VALUES, m->valuesF64, m->num_values * value_size };
+	if (m->permutation) {
+		parts[count++] = (BinaryPart){ BINARY_SECTION_PERMUTATION, m->permutation, m->num_rows * sizeof(U64) };
+	}
+	return count;
+}
+
+// writes the header for m and solver followed by parts to file_path
+static void write_binary_parts(char *file_path, SparseMatrix *m, SolverKind solver, BinaryPart *parts, U32 section_count) {
+	PROFILE_FUNCTION_BEGIN;
+	BinaryHeader header = {
+		.version = BINARY_VERSION,
+		.section_count = section_count,
+		.precision = m->precision,
+		.solver = solver,
+		.layout = m->layout,
+		.chunk_height = (U32)m->chunk_height,
+		.num_rows = m->num_rows,
+		.num_values = m->num_values,
+	};
+	memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+
+	BinarySection sections[BINARY_SECTION_COUNT] = {0};
+	assert(section_count <= ARRAY_COUNT(sections));
+	U64 offset = sizeof(BinaryHeader) + section_count * sizeof(BinarySection);
+	for (U32 i=0; i<section_count; ++i) {
+		offset = ALIGN_UP(offset, BINARY_SECTION_ALIGNMENT);
+		sections[i].kind = parts[i].kind;
+		sections[i].offset = offset;
+		sections[i].size = parts[i].size;
+		offset += parts[i].size;
+	}
+
+	FILE *f = fopen(file_path, "wb");
+	if (!f) {
+		fatal("Failed to open %s for writing", file_path);
+	}
+	if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+	    fwrite(sections, sizeof(BinarySection), section_count, f) != section_count) {
+		fatal("Failed to write binary file %s", file_path);
+	}
+	U64 pos = sizeof(BinaryHeader) + section_count * sizeof(BinarySection);
+	for (U32 i=0; i<section_count; ++i) {
+		write_section(f, &pos, &sections[i], parts[i].data);
+	}
+	if (fclose(f) != 0) {
+		fatal("Failed to write binary file %s", file_path);
+	}
+	PROFILE_FUNCTION_END;
+}
+
+static void write_binary_file(char *file_path, ParseResult *input) {
+	PROFILE_FUNCTION_BEGIN;
+	SparseMatrix *m = input->matrix;
+	U64 value_size = m->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+
+	// the optional initial guess and solution always go last
+	BinaryPart parts[BINARY_SECTION_COUNT] = {0};
+	U32 section_count = binary_matrix_parts(m, parts);
+	parts[section_count++] = (BinaryPart){ BINARY_SECTION_VECTOR, input->vector->valuesF64, input->vector->num_values * value_size };
+	if (input->initial_guess) {
+		parts[section_count++] = (BinaryPart){ BINARY_SECTION_INITIAL_GUESS, input->initial_guess->valuesF64, input->initial_guess->num_values * value_size };
+	}
+	if (input->solution) {
+		parts[section_count++] = (BinaryPart){ BINARY_SECTION_SOLUTION, input->solution->valuesF64, input->solution->num_values * value_size };
+	}
+	write_binary_parts(file_path, m, input->solver, parts, section_count);
+	PROFILE_FUNCTION_END;
+}
+
+// returns the size of the section with the given kind, 0 if the file does not
+// have one
+static U64 binary_section_size(BinarySection *sections, U32 section_count, BinarySectionKind kind) {
+	for (U32 i=0; i<section_count; ++i) {
+		if (sections[i].kind == kind) return sections[i].size;
+	}
+	return 0;
+}
+
+// returns the data of the section with the given kind, or NULL if the file
+// does not have one. expected_size is checked against the section size
+static void *binary_section(char *file_path, U8 *data, BinarySection *sections, U32 section_count,
+                            BinarySectionKind kind, U64 expected_size) {
+	for (U32 i=0; i<section_count; ++i) {
+		if (sections[i].kind != kind) continue;
+		if (sections[i].size != expected_size) {
+			fatal("%s: binary section %u has size %llu, expected %llu", file_path, kind, sections[i].size, expected_size);
+		}
+		return data + sections[i].offset;
+	}
+	return NULL;
+}
+
+// points the column indices of m at the column sections of the file and checks
+// them, m needs its layout and for compressed rows its row offsets
+static void load_binary_cols(char *file_path, U8 *data, BinarySection *sections, U32 count, SparseMatrix *m) {
+	U64 num_rows = m->num_rows;
+	U64 num_values = m->num_values;
+	m->cols = binary_section(file_path, data, sections, count, BINARY_SECTION_COLS, num_values * sizeof(U64));
+	m->cols32 = binary_section(file_path, data, sections, count, BINARY_SECTION_COLS32, num_values * sizeof(U32));
+	m->col_byte_offsets = binary_section(file_path, data, sections, count, BINARY_SECTION_COL_BYTE_OFFSETS, (num_rows + 1) * sizeof(U64));
+	if (m->col_byte_offsets) {
+		m->col_bytes = binary_section(file_path, data, sections, count, BINARY_SECTION_COL_BYTES, m->col_byte_offsets[num_rows]);
+	}
+	if ((m->cols != NULL) + (m->cols32 != NULL) + (m->col_bytes != NULL) != 1) {
+		fatal("%s: binary file needs exactly one encoding of the column indices", file_path);
+	}
+
+	if (m->cols) {
+		m->index_encoding = SPARSE_INDEX_U64;
+		for (U64 i=0; i<num_values; ++i) {
+			if (m->cols[i] >= num_rows) {
+				fatal("%s: column %llu is outside of the %llux%llu matrix", file_path, m->cols[i], num_rows, num_rows);
+			}
+		}
+	} else if (m->cols32) {
+		m->index_encoding = SPARSE_INDEX_U32;
+		if (num_rows > SPARSE_INDEX_U32_MAX_ROWS) {
+			fatal("%s: %llu rows are too many for 32 bit column indices", file_path, num_rows);
+		}
+		for (U64 i=0; i<num_values; ++i) {
+			if (m->cols32[i] >= num_rows) {
+				fatal("%s: column %u is outside of the %llux%llu matrix", file_path, m->cols32[i], num_rows, num_rows);
+			}
+		}
+	} else {
+		m->index_encoding = SPARSE_INDEX_DELTA;
+		if (m->layout != SPARSE_LAYOUT_CSR || num_rows > SPARSE_INDEX_U32_MAX_ROWS) {
+			fatal("%s: delta encoded column indices need compressed rows", file_path);
+		}
+		// sparse_delta_next trusts its input, so every row is decoded here
+		// with bounds checks first
+		if (m->col_byte_offsets[0] != 0) {
+			fatal("%s: column bytes do not start at row 0", file_path);
+		}
+		for (U64 row=0; row<num_rows; ++row) {
+			if (m->col_byte_offsets[row] > m->col_byte_offsets[row+1]) {
+				fatal("%s: column byte offsets are not increasing at row %llu", file_path, row);
+			}
+		}
+		for (U64 row=0; row<num_rows; ++row) {
+			U64 pos = m->col_byte_offsets[row];
+			U64 end = m->col_byte_offsets[row+1];
+			U64 col = row;
+			for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+				U64 value = 0;
+				U8 byte;
+				U64 shift = 0;
+				do {
+					if (pos == end || shift > 63) {
+						fatal("%s: column bytes of row %llu are truncated", file_path, row);
+					}
+					byte = m->col_bytes[pos++];
+					value |= (U64)(byte & 0x7f) << shift;
+					shift += 7;
+				} while (byte & 0x80);
+				col += (value >> 1) ^ (0 - (value & 1));
+				if (col >= num_rows) {
+					fatal("%s: column %llu is outside of the %llux%llu matrix", file_path, col, num_rows, num_rows);
+				}
+			}
+			if (pos != end) {
+				fatal("%s: row %llu has column bytes past its entries", file_path, row);
+			}
+		}
+	}
+}
+
+// checks the header and section directory of the file_size bytes of a binary
+// file at data and points a matrix into them. data must be aligned to
+// BINARY_SECTION_ALIGNMENT and outlive the matrix. file_path is only used in
+// error messages
+static SparseMatrix *load_binary_matrix(Arena *arena, char *file_path, U8 *data, U64 file_size) {
+	PROFILE_FUNCTION_BEGIN;
+	if ((uintptr_t)data % BINARY_SECTION_ALIGNMENT != 0) {
+		fatal("%s: binary data is not aligned to %d bytes", file_path, BINARY_SECTION_ALIGNMENT);
+	}
+
+	BinaryHeader *header = (BinaryHeader*)data;
+	if (file_size < sizeof(BinaryHeader) || memcmp(header->magic, BINARY_MAGIC, sizeof(header->magic)) != 0) {
+		fatal("%s is not a binary input file", file_path);
+	}
+	if (header->version != BINARY_VERSION) {
+		fatal("%s: unsupported binary format version %u, expected %u", file_path, header->version, BINARY_VERSION);
+	}
+	if (header->precision != PRECISION_F32 && header->precision != PRECISION_F64) {
+		fatal("%s: invalid float precision %u", file_path, header->precision);
+	}
+	if (header->solver <= SOLVER_NONE || header->solver >= SOLVER_COUNT) {
+		fatal("%s: invalid solver %u", file_path, header->solver);
+	}
+	if (header->layout >= SPARSE_LAYOUT_COUNT) {
+		fatal("%s: invalid matrix layout %u", file_path, header->layout);
+	}
+
+	BinarySection *sections = (BinarySection*)(header + 1);
+	U64 sections_end = sizeof(BinaryHeader) + (U64)header->section_count * sizeof(BinarySection);
+	if (sections_end > file_size) {
+		fatal("%s: section directory is truncated", file_path);
+	}
+	for (U32 i=0; i<header->section_count; ++i) {
+		BinarySection *s = &sections[i];
+		if (s->offset % BINARY_SECTION_ALIGNMENT != 0 || s->offset < sections_end ||
+		    s->offset > file_size || s->size > file_size - s->offset) {
+			fatal("%s: section %u is out of bounds", file_path, i);
+		}
+	}
+
+	FloatPrecision precision = header->precision;
+	U64 num_rows = header->num_rows;
+	U64 num_values = header->num_values;
+	U64 value_size = precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+	U32 count = header->section_count;
+	// every row and value takes at least 8 bytes of the file, this also keeps
+	// the section size computations below from overflowing
+	if (num_rows >= file_size || num_values >= file_size) {
+		fatal("%s: header sizes do not fit the file", file_path);
+	}
+
+	SparseMatrix *m = arena_push_n(arena, SparseMatrix, 1);
+	m->precision = precision;
+	m->num_values = num_values;
+	m->num_rows = num_rows;
+	m->layout = header->layout;
+	m->valuesF64 = binary_section(file_path, data, sections, count, BINARY_SECTION_MATRIX_VALUES, num_values * value_size);
+	if (!m->valuesF64) {
+		fatal("%s: binary file is missing matrix sections", file_path);
+	}
+
+	// the kernels index with these without any checks, so a corrupt file has
+	// to be caught here
+	if (m->layout == SPARSE_LAYOUT_DIAGONAL) {
+		if (num_rows == 0 || num_values % num_rows != 0) {
+			fatal("%s: %llu matrix values do not make whole diagonals of %llu rows", file_path, num_values, num_rows);
+		}
+		m->num_diagonals = num_values / num_rows;
+		m->diagonal_offsets = binary_section(file_path, data, sections, count, BINARY_SECTION_DIAGONAL_OFFSETS, m->num_diagonals * sizeof(S64));
+		if (!m->diagonal_offsets) {
+			fatal("%s: binary file is missing matrix sections", file_path);
+		}
+		for (U64 d=0; d<m->num_diagonals; ++d) {
+			S64 offset = m->diagonal_offsets[d];
+			if ((offset < 0 ? (U64)-offset : (U64)offset) >= num_rows) {
+				fatal("%s: diagonal offset %lld is outside of the %llux%llu matrix", file_path, offset, num_rows, num_rows);
+			}
+			if (d > 0 && offset <= m->diagonal_offsets[d-1]) {
+				fatal("%s: diagonal offsets are not increasing at diagonal %llu", file_path, d);
+			}
+		}
+	} else if (m->layout == SPARSE_LAYOUT_SLICED) {
+		U64 height = header->chunk_height;
+		if (height == 0 || height > SLICED_MAX_CHUNK_HEIGHT) {
+			fatal("%s: invalid chunk height %llu", file_path, height);
+		}
+		m->chunk_height = height;
+		m->num_chunks = (num_rows + height - 1) / height;
+		m->chunk_offsets = binary_section(file_path, data, sections, count, BINARY_SECTION_CHUNK_OFFSETS, (m->num_chunks + 1) * sizeof(U64));
+		m->chunk_rows = binary_section(file_path, data, sections, count, BINARY_SECTION_CHUNK_ROWS, m->num_chunks * height * sizeof(U64));
+		if (!m->chunk_offsets || !m->chunk_rows) {
+			fatal("%s: binary file is missing matrix sections", file_path);
+		}
+		if (m->chunk_offsets[0] != 0 || m->chunk_offsets[m->num_chunks] != num_values) {
+			fatal("%s: chunk offsets do not cover the %llu matrix values", file_path, num_values);
+		}
+		for (U64 c=0; c<m->num_chunks; ++c) {
+			if (m->chunk_offsets[c] > m->chunk_offsets[c+1] || (m->chunk_offsets[c+1] - m->chunk_offsets[c]) % height != 0) {
+				fatal("%s: chunk %llu does not hold whole rows of %llu slots", file_path, c, height);
+			}
+		}
+		load_binary_cols(file_path, data, sections, count, m);
+		// every row has to be in exactly one slot, the kernels write through
+		// chunk_rows and the padding slots past the last row are skipped
+		ArenaTemp scratch = scratch_begin(&arena, 1);
+		bool *seen = arena_push_n(scratch.arena, bool, num_rows);
+		for (U64 slot=0; slot<num_rows; ++slot) {
+			U64 row = m->chunk_rows[slot];
+			if (row >= num_rows || seen[row]) {
+				fatal("%s: chunk rows are not a permutation of the rows at slot %llu", file_path, slot);
+			}
+			seen[row] = true;
+		}
+		scratch_end(scratch);
+		sparse_mat_compute_row_slots(arena, m);
+	} else {
+		m->row_offsets = binary_section(file_path, data, sections, count, BINARY_SECTION_ROW_OFFSETS, (num_rows + 1) * sizeof(U64));
+		if (!m->row_offsets) {
+			fatal("%s: binary file is missing matrix sections", file_path);
+		}
+		if (m->row_offsets[0] != 0 || m->row_offsets[num_rows] != num_values) {
+			fatal("%s: row offsets do not cover the %llu matrix values", file_path, num_values);
+		}
+		for (U64 row=0; row<num_rows; ++row) {
+			if (m->row_offsets[row] > m->row_offsets[row+1]) {
+				fatal("%s: row offsets are not increasing at row %llu", file_path, row);
+			}
+		}
+		load_binary_cols(file_path, data, sections, count, m);
+	}
+	if (m->layout == SPARSE_LAYOUT_SYMMETRIC) {
+		for (U64 row=0; row<num_rows; ++row) {
+			for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+				if (sparse_mat_col(m, i) < row) {
+					fatal("%s: symmetric matrix has entry (%llu, %llu) below the diagonal", file_path, row, sparse_mat_col(m, i));
+				}
+			}
+		}
+		sparse_mat_compute_bandwidth(m);
+	}
+
+	// solve_prepared indexes the vectors with it, so it has to be a
+	// permutation too
+	m->permutation = binary_section(file_path, data, sections, count, BINARY_SECTION_PERMUTATION, num_rows * sizeof(U64));
+	if (m->permutation) {
+		ArenaTemp scratch = scratch_begin(&arena, 1);
+		bool *seen = arena_push_n(scratch.arena, bool, num_rows);
+		for (U64 i=0; i<num_rows; ++i) {
+			U64 row = m->permutation[i];
+			if (row >= num_rows || seen[row]) {
+				fatal("%s: the row permutation is not a permutation at row %llu", file_path, i);
+			}
+			seen[row] = true;
+		}
+		scratch_end(scratch);
+	}
+	PROFILE_FUNCTION_END;
+	return m;
+}
+
+// the incomplete Cholesky factor of m stored along with it, NULL if the file
+// has none. data and file_size are the ones m was loaded from
+static SparseMatrix *load_binary_factor(Arena *arena, char *file_path, U8 *data, U64 file_size, SparseMatrix *m) {
+	PROFILE_FUNCTION_BEGIN;
+	BinaryHeader *header = (BinaryHeader*)data;
+	BinarySection *sections = (BinarySection*)(header + 1);
+	U32 count = header->section_count;
+	U64 n = m->num_rows;
+	U64 value_size = m->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+	U64 *row_offsets = binary_section(file_path, data, sections, count, BINARY_SECTION_FACTOR_ROW_OFFSETS, (n + 1) * sizeof(U64));
+	if (!row_offsets) {
+		PROFILE_FUNCTION_END;
+		return NULL;
+	}
+	U64 num_values = row_offsets[n];
+	if (row_offsets[0] != 0 || num_values >= file_size) {
+		fatal("%s: factor row offsets do not fit the file", file_path);
+	}
+
+	SparseMatrix *L = arena_push_n(arena, SparseMatrix, 1);
+	L->precision = m->precision;
+	L->layout = SPARSE_LAYOUT_CSR;
+	L->num_rows = n;
+	L->num_values = num_values;
+	L->row_offsets = row_offsets;
+	L->cols = binary_section(file_path, data, sections, count, BINARY_SECTION_FACTOR_COLS, num_values * sizeof(U64));
+	L->valuesF64 = binary_section(file_path, data, sections, count, BINARY_SECTION_FACTOR_VALUES, num_values * value_size);
+	if (!L->cols || !L->valuesF64) {
+		fatal("%s: binary file is missing factor sections", file_path);
+	}
+	// the triangular solves rely on the columns being below the diagonal and
+	// the diagonal being last in every row
+	for (U64 row=0; row<n; ++row) {
+		U64 start = row_offsets[row], end = row_offsets[row+1];
+		if (start >= end || end > num_values || L->cols[end-1] != row) {
+			fatal("%s: factor row %llu does not end in its diagonal", file_path, row);
+		}
+		for (U64 i=start; i<end-1; ++i) {
+			if (L->cols[i] >= row) {
+				fatal("%s: factor entry (%llu, %llu) is not below the diagonal", file_path, row, L->cols[i]);
+			}
+		}
+	}
+	PROFILE_FUNCTION_END;
+	return L;
+}
+
+// points the result into the file_size bytes of a binary file at data, see
+// load_binary_matrix
+static ParseResult load_binary_data(Arena *arena, char *file_path, U8 *data, U64 file_size) {
+	PROFILE_FUNCTION_BEGIN;
+	ParseResult result = {0};
+	SparseMatrix *m = load_binary_matrix(arena, file_path, data, file_size);
+	BinaryHeader *header = (BinaryHeader*)data;
+	BinarySection *sections = (BinarySection*)(header + 1);
+	U32 count = header->section_count;
+	U64 num_rows = m->num_rows;
+	U64 value_size = m->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+	FloatPrecision precision = m->precision;
+
+	result.solver = header->solver;
+	result.matrix = m;
+
+	// the vector section holds every right hand side, its size says how many
+	U64 vector_size = binary_section_size(sections, count, BINARY_SECTION_VECTOR);
+	result.num_vectors = num_rows > 0 ? MAX(vector_size / (num_rows * value_size), 1) : 1;
+	result.vector = arena_push_n(arena, Vector, 1);
+	result.vector->precision = precision;
+	result.vector->num_values = num_rows * result.num_vectors;
+	result.vector->valuesF64 = binary_section(file_path, data, sections, count, BINARY_SECTION_VECTOR, result.vector->num_values * value_size);
+	if (!result.vector->valuesF64) {
+		fatal("%s: binary file is missing the vector section", file_path);
+	}
+
+	void *initial_guess = binary_section(file_path, data, sections, count, BINARY_SECTION_INITIAL_GUESS, result.vector->num_values * value_size);
+	if (initial_guess) {
+		result.initial_guess = arena_push_n(arena, Vector, 1);
+		result.initial_guess->precision = precision;
+		result.initial_guess->num_values = result.vector->num_values;
+		result.initial_guess->valuesF64 = initial_guess;
+	}
+
+	void *solution = binary_section(file_path, data, sections, count, BINARY_SECTION_SOLUTION, result.vector->num_values * value_size);
+	if (solution) {
+		result.solution = arena_push_n(arena, Vector, 1);
+		result.solution->precision = precision;
+		result.solution->num_values = result.vector->num_values;
+		result.solution->valuesF64 = solution;
+	}
+
+	PROFILE_FUNCTION_END;
+	return result;
+}
+
+static ParseResult load_binary_file(Arena *arena, char *file_path) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 file_size = 0;
+	U8 *data = os_file_map(file_path, &file_size);
+	if (!data) {
+		fatal("Failed to map input file %s", file_path);
+	}
+	ParseResult result = load_binary_data(arena, file_path, data, file_size);
+	result.mapping = data;
+	result.mapping_size = file_size;
+	PROFILE_FUNCTION_END;
+	return result;
+}
+
+// the matrix and vectors of input point into the mapping and must not be used
+// after this
+static void unload_binary_file(ParseResult *input) {
+	assert(input->mapping);
+	os_file_unmap(input->mapping, input->mapping_size);
+	input->mapping = NULL;
+	input->mapping_size = 0;
+}
@@ -0,0 +1,191 @@
+// ---------------------------------------------------------------------------
+// Matrix Cache
+// ---------------------------------------------------------------------------
+// NOTE(shaw): with --cache DIR the matrix of a text input is stored in DIR
+// after it has been parsed and converted to its storage layout, together with
+// its incomplete Cholesky factor if the solver uses one. Entries are binary
+// files (see binary_format.c) named after a 128 bit hash of everything in
+// front of the first vector section, i.e. the format, solver, storage and
+// matrix lines, plus whatever else decides the layout: the number of rows,
+// whether there are several right hand sides, the sliced settings, whether
+// the layout is detected at all and the number of thread ranges the rows are
+// split into, which decides whether symmetric storage pays off. A later run
+// on the same matrix only hashes those bytes, parses the vectors and maps the
+// entry, the matrix section is never tokenized.
+//
+// The matrix lines hold nothing but numbers, so the first "vector" after the
+// matrix keyword is where the vectors start. Entries are written to a
+// temporary file and renamed, concurrent runs never see half an entry. An
+// entry that fails to load is ignored with a warning and the input parsed as
+// if there was none. Nothing is ever evicted, clearing DIR is up to the user.
+
+static char *cache_dir; // NULL disables the cache
+static volatile U64 cache_hits;
+static volatile U64 cache_misses;
+
+// everything the cached matrix depends on
+typedef struct {
+	U64 digest[2]; // of the input in front of the vectors
+	U64 num_rows;
+	U64 several_vectors; // picks compressed rows over symmetric storage
+	U64 chunk_height;
+	U64 sort_window;
+	U64 detect_storage;
+	U64 reorder_rows;
+	U64 index_encoding;
+	U64 row_ranges; // see sparse_mat_symmetric_pays_off
+	U64 version;
+} CacheKey;
+
+static char *cache_find_vectors(char *start, char *end) {
+	for (char *c = start; (c = memchr(c, 'v', end - c)); ++c) {
+		if (end - c >= 6 && memcmp(c, "vector", 6) == 0) return c;
+	}
+	return NULL;
+}
+
+static void cache_entry_path(char *path, U64 path_size, char *source, U64 source_size, U64 num_rows, U64 num_vectors) {
+	CacheKey key = {
+		.num_rows = num_rows,
+		.several_vectors = num_vectors > 1,
+		.chunk_height = sliced_chunk_height,
+		.sort_window = sliced_sort_window,
+		.detect_storage = detect_storage,
+		.reorder_rows = reorder_rows,
+		.index_encoding = index_encoding,
+		.row_ranges = thread_pool_range_count(num_rows, KERNEL_MIN_ITEMS_PER_THREAD),
+		.version = BINARY_VERSION,
+	};
+	hash_bytes(source, source_size, key.digest);
+	U64 digest[2];
+	hash_bytes(&key, sizeof(key), digest);
+	snprintf(path, path_size, "%s/%016llx%016llx.bin", cache_dir, digest[0], digest[1]);
+}
+
+// maps the entry at path into result and sets up prepared from it, false if
+// there is no usable entry
+static bool cache_load(Arena *arena, char *path, ParseResult *result, PreparedSystem *prepared) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 size;
+	U8 *data = os_file_map(path, &size);
+	if (!data) {
+		PROFILE_FUNCTION_END;
+		return false;
+	}
+
+	FatalHandler handler;
+	FatalHandler *previous = fatal_handler_begin(&handler);
+	if (setjmp(handler.jump) != 0) {
+		fatal_handler = previous;
+		fprintf(stderr, "warning: ignoring cache entry: %s\n", handler.message);
+		os_file_unmap(data, size);
+		PROFILE_FUNCTION_END;
+		return false;
+	}
+	SparseMatrix *m = load_binary_matrix(arena, path, data, size);
+	BinaryHeader *header = (BinaryHeader*)data;
+	if (m->precision != result->vector->precision || m->num_rows * result->num_vectors != result->vector->num_values ||
+	    header->solver != result->solver) {
+		fatal("%s does not match the input", path);
+	}
+	SparseMatrix *L = load_binary_factor(arena, path, data, size, m);
+	fatal_handler = previous;
+
+	result->matrix = m;
+	result->mapping = data;
+	result->mapping_size = size;
+	if (result->solver == SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS && L) {
+		*prepared = (PreparedSystem){ .kind = result->solver, .A = m, .L = L };
+	} else {
+		*prepared = prepare_system(arena, result->solver, m);
+	}
+	PROFILE_FUNCTION_END;
+	return true;
+}
+
+static void cache_store(char *path, ParseResult *input, PreparedSystem *prepared) {
+	PROFILE_FUNCTION_BEGIN;
+	SparseMatrix *m = input->matrix;
+	BinaryPart parts[BINARY_SECTION_COUNT];
+	U32 count = binary_matrix_parts(m, parts);
+	SparseMatrix *L = prepared->L;
+	if (L) {
+		U64 value_size = L->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+		parts[count++] = (BinaryPart){ BINARY_SECTION_FACTOR_ROW_OFFSETS, L->row_offsets, (L->num_rows + 1) * sizeof(U64) };
+		parts[count++] = (BinaryPart){ BINARY_SECTION_FACTOR_COLS, L->cols, L->num_values * sizeof(U64) };
+		parts[count++] = (BinaryPart){ BINARY_SECTION_FACTOR_VALUES, L->valuesF64, L->num_values * value_size };
+	}
+
+	char temp_path[4200];
+	snprintf(temp_path, sizeof(temp_path), "%s.%llx.tmp", path, os_read_timer());
+	FatalHandler handler;
+	FatalHandler *previous = fatal_handler_begin(&handler);
+	if (setjmp(handler.jump) == 0) {
+		write_binary_parts(temp_path, m, input->solver, parts, count);
+		// another run may have stored the same entry in the meantime
+		if (rename(temp_path, path) != 0) {
+			remove(temp_path);
+		}
+	} else {
+		fprintf(stderr, "warning: failed to store cache entry: %s\n", handler.message);
+		remove(temp_path);
+	}
+	fatal_handler = previous;
+	PROFILE_FUNCTION_END;
+}
+
+// parses file_name like parse_input, with the matrix taken from the cache if
+// it is there and stored in it otherwise. prepared is set up for solving the
+// result, with the cached incomplete Cholesky factor if there is one
+static ParseResult parse_input_cached(Arena *arena, char *file_name, PreparedSystem *prepared) {
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	char *data;
+	U64 size;
+	if (!read_entire_file(scratch.arena, file_name, &data, &size)) {
+		fatal("Failed to read input file %s", file_name);
+	}
+	// size includes the NUL terminator read_entire_file appends
+	char *end = data + size - 1;
+
+	ParseResult result = {0};
+	init_parse(file_name, data, end, NULL);
+	FloatPrecision format = parse_format();
+	result.solver = parse_solver();
+	parse_storage();
+	char *vectors = is_token_name(keyword_matrix) ? cache_find_vectors(stream, end) : NULL;
+	char path[4096];
+	if (vectors) {
+		skip_to(vectors);
+		result.vector = parse_vectors(arena, keyword_vector, format, &result.num_vectors);
+		parse_solutions(arena, &result, format);
+		cache_entry_path(path, sizeof(path), data, vectors - data, result.vector->num_values / result.num_vectors, result.num_vectors);
+		if (cache_load(arena, path, &result, prepared)) {
+			os_atomic_increment(&cache_hits);
+			scratch_end(scratch);
+			PROFILE_FUNCTION_END;
+			return result;
+		}
+	}
+
+	os_atomic_increment(&cache_misses);
+	init_parse(file_name, data, end, NULL);
+	result = parse_source(arena);
+	*prepared = prepare_system(arena, result.solver, result.matrix);
+	if (vectors) {
+		cache_store(path, &result, prepared);
+	}
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return result;
+}
+
+static void print_cache_diagnostics(void) {
+#ifdef DIAGNOSTICS
+	if (cache_dir) {
+		printf("Cache Diagnostics:\n");
+		printf("\t%llu hits\n", cache_hits);
+		printf("\t%llu misses\n", cache_misses);
+	}
+#endif
+}
@@ -9,6 +9,12 @@
 #define ALIGN_DOWN_PTR(p, a) ((void *)ALIGN_DOWN((uintptr_t)(p), (a)))
 #define ALIGN_UP_PTR(p, a) ((void *)ALIGN_UP((uintptr_t)(p), (a)))
 
+#if _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
 #define KILOBYTE (1024)
 #define MEGABYTE (1024 * KILOBYTE)
 #define GIGABYTE (1024 * MEGABYTE)
@@ -16,11 +22,13 @@
 typedef uint8_t  U8;
 typedef uint16_t U16;
 typedef uint32_t U32;
-typedef uint64_t U64;
+// NOTE(shaw): 64 bit types are long long rather than (u)int64_t so that %llu
+// and %lld are the right format specifiers on every platform
+typedef unsigned long long U64;
 typedef int8_t  S8;
 typedef int16_t S16;
 typedef int32_t S32;
-typedef int64_t S64;
+typedef long long S64;
 typedef float F32;
 typedef double F64;
 
@@ -35,16 +43,27 @@ typedef enum {
 	SOLVER_STEEPEST_DESCENT,
 	SOLVER_CONJUGATE_DIRECTIONS,
 	SOLVER_CONJUGATE_GRADIENTS,
+	SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS,
+	SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS,
+	SOLVER_MIXED_PRECISION_CONJUGATE_GRADIENTS,
+	SOLVER_PIPELINED_CONJUGATE_GRADIENTS,
+	SOLVER_COUNT,
 } SolverKind;
 
 // ---------------------------------------------------------------------------
 // OS Specific Functions
 // ---------------------------------------------------------------------------
+// the most sockets os_socket_wait waits on at once
+#define OS_MAX_WAIT_SOCKETS 64
+
 #if _WIN32
 #pragma warning (push, 0)
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <winsock2.h>
+#include <afunix.h>
 #pragma warning (pop)
+#pragma comment(lib, "ws2_32.lib")
 
 U64 os_timer_freq(void) {
 	LARGE_INTEGER Freq;
@@ -64,6 +83,60 @@ U64 os_file_size(char *filepath) {
 	return stat.st_size;
 }
 
+// maps a whole file copy-on-write, writes to the mapping never reach the file.
+// returns NULL if the file cannot be opened or is empty
+void *os_file_map(char *filepath, U64 *size) {
+	HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE) return NULL;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return NULL;
+	}
+	HANDLE mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+	CloseHandle(file);
+	if (!mapping) return NULL;
+	// the view keeps the mapping object alive
+	void *data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data) *size = file_size.QuadPart;
+	return data;
+}
+
+void os_file_unmap(void *data, U64 size) {
+	(void) size; // unused on windows
+	UnmapViewOfFile(data);
+}
+
+bool os_is_directory(char *path) {
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+// succeeds if the directory already exists
+bool os_make_directory(char *path) {
+	return CreateDirectoryA(path, 0) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+typedef void OSDirectoryFunc(void *data, char *name);
+
+// calls func with the name of every regular file in the directory at path,
+// in no particular order. returns false if the directory cannot be read
+bool os_list_directory(char *path, OSDirectoryFunc *func, void *data) {
+	char pattern[MAX_PATH];
+	snprintf(pattern, sizeof(pattern), "%s\\*", path);
+	WIN32_FIND_DATAA find;
+	HANDLE handle = FindFirstFileA(pattern, &find);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	do {
+		if (!(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			func(data, find.cFileName);
+		}
+	} while (FindNextFileA(handle, &find));
+	FindClose(handle);
+	return true;
+}
+
 U32 os_get_page_size(void) {
 	SYSTEM_INFO system_info;
 	GetSystemInfo(&system_info);
@@ -87,6 +160,614 @@ bool os_memory_release(void *addr, U64 size) {
 	return VirtualFree(addr, 0, MEM_RELEASE);
 }
 
+// NOTE(shaw): windows only hands out large pages for memory that is reserved
+// and committed in one go (and with SeLockMemoryPrivilege), which does not
+// fit the reserve/commit arenas. Large pages are not supported here.
+U64 os_get_large_page_size(void) {
+	return 0;
+}
+
+void *os_memory_commit_large(void *addr, U64 size) {
+	(void) addr; (void) size;
+	return NULL;
+}
+
+bool os_memory_decommit_large(void *addr, U64 size) {
+	(void) addr; (void) size;
+	return false;
+}
+
+void os_memory_advise_large(void *addr, U64 size) {
+	(void) addr; (void) size;
+}
+
+U32 os_get_processor_count(void) {
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	return system_info.dwNumberOfProcessors;
+}
+
+typedef HANDLE OSSemaphore;
+
+bool os_semaphore_init(OSSemaphore *sem, U32 initial_count) {
+	*sem = CreateSemaphoreA(0, initial_count, MAXLONG, 0);
+	return *sem != NULL;
+}
+
+void os_semaphore_signal(OSSemaphore *sem) {
+	ReleaseSemaphore(*sem, 1, 0);
+}
+
+void os_semaphore_wait(OSSemaphore *sem) {
+	WaitForSingleObject(*sem, INFINITE);
+}
+
+// returns the incremented value
+U64 os_atomic_increment(volatile U64 *value) {
+	return (U64)InterlockedIncrement64((volatile LONG64*)value);
+}
+
+typedef void OSThreadFunc(void *data);
+
+typedef struct {
+	OSThreadFunc *func;
+	void *data;
+} OSThreadStart;
+
+static DWORD WINAPI os_thread_entry(LPVOID param) {
+	OSThreadStart start = *(OSThreadStart*)param;
+	free(param);
+	start.func(start.data);
+	return 0;
+}
+
+// NOTE(shaw): unix domain sockets need Windows 10 1803 or later
+typedef SOCKET OSSocket;
+#define OS_INVALID_SOCKET INVALID_SOCKET
+
+static bool os_socket_startup(void) {
+	static bool started;
+	WSADATA data;
+	if (!started && WSAStartup(MAKEWORD(2, 2), &data) == 0) {
+		started = true;
+	}
+	return started;
+}
+
+static bool os_socket_address(char *path, struct sockaddr_un *address) {
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address->sun_path)) return false;
+	strcpy(address->sun_path, path);
+	return true;
+}
+
+// a stream socket listening on the unix domain socket path, a stale socket
+// file left at path is replaced
+OSSocket os_socket_listen(char *path) {
+	struct sockaddr_un address;
+	if (!os_socket_startup() || !os_socket_address(path, &address)) return OS_INVALID_SOCKET;
+	SOCKET s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET) return OS_INVALID_SOCKET;
+	DeleteFileA(path);
+	if (bind(s, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(s, SOMAXCONN) != 0) {
+		closesocket(s);
+		return OS_INVALID_SOCKET;
+	}
+	return s;
+}
+
+OSSocket os_socket_connect(char *path) {
+	struct sockaddr_un address;
+	if (!os_socket_startup() || !os_socket_address(path, &address)) return OS_INVALID_SOCKET;
+	SOCKET s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s == INVALID_SOCKET) return OS_INVALID_SOCKET;
+	if (connect(s, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		closesocket(s);
+		return OS_INVALID_SOCKET;
+	}
+	return s;
+}
+
+OSSocket os_socket_accept(OSSocket listener) {
+	return accept(listener, 0, 0);
+}
+
+// reads at most size bytes, returns the number read, 0 once the other end
+// has closed the connection and -1 on errors
+S64 os_socket_read(OSSocket s, void *buffer, U64 size) {
+	int result = recv(s, buffer, (int)MIN(size, 1u << 30), 0);
+	return result == SOCKET_ERROR ? -1 : result;
+}
+
+bool os_socket_write(OSSocket s, void *data, U64 size) {
+	for (U8 *p = data; size > 0;) {
+		int written = send(s, (char*)p, (int)MIN(size, 1u << 30), 0);
+		if (written == SOCKET_ERROR) return false;
+		p += written;
+		size -= written;
+	}
+	return true;
+}
+
+void os_socket_close(OSSocket s) {
+	closesocket(s);
+}
+
+// blocks until one of the sockets can be read from (or accept a connection)
+// and returns its index
+U64 os_socket_wait(OSSocket *sockets, U64 count) {
+	WSAPOLLFD fds[OS_MAX_WAIT_SOCKETS];
+	assert(count <= OS_MAX_WAIT_SOCKETS);
+	for (U64 i=0; i<count; ++i) {
+		fds[i] = (WSAPOLLFD){ .fd = sockets[i], .events = POLLRDNORM };
+	}
+	for (;;) {
+		if (WSAPoll(fds, (ULONG)count, -1) > 0) {
+			for (U64 i=0; i<count; ++i) {
+				if (fds[i].revents) return i;
+			}
+		}
+	}
+}
+
+// threads are detached, they are expected to live until the process exits
+bool os_thread_create(OSThreadFunc *func, void *data) {
+	OSThreadStart *start = malloc(sizeof(OSThreadStart));
+	if (!start) return false;
+	start->func = func;
+	start->data = data;
+	HANDLE thread = CreateThread(0, 0, os_thread_entry, start, 0, 0);
+	if (!thread) {
+		free(start);
+		return false;
+	}
+	CloseHandle(thread);
+	return true;
+}
+
+// shared memory, futexes and processes for the multi-process solve, see
+// multiprocess.c. Windows has no fork, os_process_fork always fails and the
+// solve stays in one process
+typedef S64 OSProcess;
+#define OS_INVALID_PROCESS (-1)
+
+// zeroed memory shared with the processes forked after it was allocated
+void *os_shared_memory_alloc(U64 size) {
+	HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, 0);
+	if (!mapping) return NULL;
+	void *result = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	CloseHandle(mapping);
+	return result;
+}
+
+void os_shared_memory_release(void *addr, U64 size) {
+	(void)size;
+	UnmapViewOfFile(addr);
+}
+
+// returns the incremented value
+U32 os_atomic_increment_u32(volatile U32 *value) {
+	return (U32)InterlockedIncrement((volatile LONG*)value);
+}
+
+U32 os_atomic_load_u32(volatile U32 *value) {
+	return (U32)InterlockedOr((volatile LONG*)value, 0);
+}
+
+// blocks while *addr == expected, may return early
+void os_futex_wait(volatile U32 *addr, U32 expected) {
+	(void)addr; (void)expected;
+	SwitchToThread();
+}
+
+void os_futex_wake_all(volatile U32 *addr) {
+	(void)addr;
+}
+
+OSProcess os_process_fork(void) {
+	return OS_INVALID_PROCESS;
+}
+
+// blocks until one of the processes exits and returns its index, or count
+// if there is none left to wait for. success is whether it exited with code 0
+U64 os_process_wait_any(OSProcess *processes, U64 count, bool *success) {
+	(void)processes;
+	*success = false;
+	return count;
+}
+
+void os_process_kill(OSProcess process) {
+	(void)process;
+}
+
+// ends the calling process without running exit handlers or flushing stdio,
+// for forked processes that must not repeat what their parent does at exit
+void os_process_exit(int code) {
+	ExitProcess(code);
+}
+
+#elif __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+U64 os_timer_freq(void) {
+	return 1000000000ull;
+}
+
+U64 os_read_timer(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (U64)time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+U64 os_file_size(char *filepath) {
+	struct stat st = {0};
+	stat(filepath, &st);
+	return st.st_size;
+}
+
+// maps a whole file copy-on-write, writes to the mapping never reach the file.
+// returns NULL if the file cannot be opened or is empty
+void *os_file_map(char *filepath, U64 *size) {
+	int fd = open(filepath, O_RDONLY);
+	if (fd < 0) return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	// the mapping keeps the file open
+	void *data = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return NULL;
+	*size = st.st_size;
+	return data;
+}
+
+void os_file_unmap(void *data, U64 size) {
+	munmap(data, size);
+}
+
+bool os_is_directory(char *path) {
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// succeeds if the directory already exists
+bool os_make_directory(char *path) {
+	return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+typedef void OSDirectoryFunc(void *data, char *name);
+
+// calls func with the name of every regular file in the directory at path,
+// in no particular order. returns false if the directory cannot be read
+bool os_list_directory(char *path, OSDirectoryFunc *func, void *data) {
+	DIR *dir = opendir(path);
+	if (!dir) return false;
+	for (struct dirent *entry; (entry = readdir(dir)) != NULL;) {
+		char file_path[4096];
+		snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
+		struct stat st;
+		if (stat(file_path, &st) == 0 && S_ISREG(st.st_mode)) {
+			func(data, entry->d_name);
+		}
+	}
+	closedir(dir);
+	return true;
+}
+
+U32 os_get_page_size(void) {
+	return (U32)sysconf(_SC_PAGESIZE);
+}
+
+// NOTE(shaw): reserved memory is mapped PROT_NONE and committed by changing
+// the protection, the kernel only backs pages with memory once they are
+// touched. Only explicit huge pages replace the mapping, see
+// os_memory_commit_large. Reservations are aligned to OS_LARGE_PAGE_SIZE so that
+// transparent huge pages can back them from the first byte.
+#define OS_LARGE_PAGE_SIZE (2 * MEGABYTE)
+
+void *os_memory_reserve(U64 size) {
+	U64 padded_size = size + OS_LARGE_PAGE_SIZE;
+	U8 *data = mmap(0, padded_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (data == MAP_FAILED) return NULL;
+	U8 *aligned = ALIGN_UP_PTR(data, OS_LARGE_PAGE_SIZE);
+	if (aligned > data) munmap(data, aligned - data);
+	munmap(aligned + size, (data + padded_size) - (aligned + size));
+	return aligned;
+}
+
+// the range keeps its mapping, so the transparent huge page advice of the
+// reservation still applies
+void *os_memory_commit(void *addr, U64 size) {
+	if (mprotect(addr, size, PROT_READ | PROT_WRITE) != 0) return NULL;
+	return addr;
+}
+
+bool os_memory_decommit(void *addr, U64 size) {
+	if (madvise(addr, size, MADV_DONTNEED) != 0) return false;
+	return mprotect(addr, size, PROT_NONE) == 0;
+}
+
+bool os_memory_release(void *addr, U64 size) {
+	return munmap(addr, size) == 0;
+}
+
+// size of the pages os_memory_commit_large commits
+U64 os_get_large_page_size(void) {
+	return OS_LARGE_PAGE_SIZE;
+}
+
+// decommits memory committed with os_memory_commit_large. the huge pages are
+// only returned to the pool with their mapping, so it is replaced with a
+// fresh reservation
+bool os_memory_decommit_large(void *addr, U64 size) {
+	void *result = mmap(addr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+	return result != MAP_FAILED;
+}
+
+// commits reserved memory backed by explicit huge pages from the hugetlbfs
+// pool (see /proc/sys/vm/nr_hugepages). addr and size must be multiples of
+// the large page size. returns NULL if the pool does not have enough free
+// pages, the caller can then commit normal pages instead
+void *os_memory_commit_large(void *addr, U64 size) {
+	void *result = mmap(addr, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+	if (result == MAP_FAILED) {
+		// a failed MAP_FIXED can leave the range unmapped, reserve it again
+		os_memory_decommit_large(addr, size);
+		return NULL;
+	}
+	return result;
+}
+
+// asks for transparent huge pages for reserved memory
+void os_memory_advise_large(void *addr, U64 size) {
+	madvise(addr, size, MADV_HUGEPAGE);
+}
+
+U32 os_get_processor_count(void) {
+	return (U32)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+typedef sem_t OSSemaphore;
+
+bool os_semaphore_init(OSSemaphore *sem, U32 initial_count) {
+	return sem_init(sem, 0, initial_count) == 0;
+}
+
+void os_semaphore_signal(OSSemaphore *sem) {
+	sem_post(sem);
+}
+
+void os_semaphore_wait(OSSemaphore *sem) {
+	// retry when interrupted by a signal
+	while (sem_wait(sem) != 0) {}
+}
+
+// returns the incremented value
+U64 os_atomic_increment(volatile U64 *value) {
+	return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+typedef void OSThreadFunc(void *data);
+
+typedef struct {
+	OSThreadFunc *func;
+	void *data;
+} OSThreadStart;
+
+static void *os_thread_entry(void *param) {
+	OSThreadStart start = *(OSThreadStart*)param;
+	free(param);
+	start.func(start.data);
+	return NULL;
+}
+
+typedef int OSSocket;
+#define OS_INVALID_SOCKET (-1)
+
+static bool os_socket_address(char *path, struct sockaddr_un *address) {
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address->sun_path)) return false;
+	strcpy(address->sun_path, path);
+	return true;
+}
+
+// a stream socket listening on the unix domain socket path, a stale socket
+// file left at path is replaced
+OSSocket os_socket_listen(char *path) {
+	struct sockaddr_un address;
+	if (!os_socket_address(path, &address)) return OS_INVALID_SOCKET;
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0) return OS_INVALID_SOCKET;
+	unlink(path);
+	if (bind(s, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(s, SOMAXCONN) != 0) {
+		close(s);
+		return OS_INVALID_SOCKET;
+	}
+	return s;
+}
+
+OSSocket os_socket_connect(char *path) {
+	struct sockaddr_un address;
+	if (!os_socket_address(path, &address)) return OS_INVALID_SOCKET;
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0) return OS_INVALID_SOCKET;
+	if (connect(s, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		close(s);
+		return OS_INVALID_SOCKET;
+	}
+	return s;
+}
+
+OSSocket os_socket_accept(OSSocket listener) {
+	int s;
+	while ((s = accept(listener, 0, 0)) < 0 && errno == EINTR) {}
+	return s;
+}
+
+// reads at most size bytes, returns the number read, 0 once the other end
+// has closed the connection and -1 on errors
+S64 os_socket_read(OSSocket s, void *buffer, U64 size) {
+	ssize_t result;
+	while ((result = recv(s, buffer, size, 0)) < 0 && errno == EINTR) {}
+	return result;
+}
+
+bool os_socket_write(OSSocket s, void *data, U64 size) {
+	for (U8 *p = data; size > 0;) {
+		// no SIGPIPE when the other end is gone, the write just fails
+		ssize_t written = send(s, p, size, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		p += written;
+		size -= written;
+	}
+	return true;
+}
+
+void os_socket_close(OSSocket s) {
+	close(s);
+}
+
+// blocks until one of the sockets can be read from (or accept a connection)
+// and returns its index
+U64 os_socket_wait(OSSocket *sockets, U64 count) {
+	struct pollfd fds[OS_MAX_WAIT_SOCKETS];
+	assert(count <= OS_MAX_WAIT_SOCKETS);
+	for (U64 i=0; i<count; ++i) {
+		fds[i] = (struct pollfd){ .fd = sockets[i], .events = POLLIN };
+	}
+	for (;;) {
+		if (poll(fds, count, -1) > 0) {
+			for (U64 i=0; i<count; ++i) {
+				if (fds[i].revents) return i;
+			}
+		}
+	}
+}
+
+// threads are detached, they are expected to live until the process exits
+bool os_thread_create(OSThreadFunc *func, void *data) {
+	OSThreadStart *start = malloc(sizeof(OSThreadStart));
+	if (!start) return false;
+	start->func = func;
+	start->data = data;
+	pthread_t thread;
+	if (pthread_create(&thread, 0, os_thread_entry, start) != 0) {
+		free(start);
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+// shared memory, futexes and processes for the multi-process solve, see
+// multiprocess.c
+typedef S64 OSProcess;
+#define OS_INVALID_PROCESS (-1)
+
+// zeroed memory shared with the processes forked after it was allocated. the
+// POSIX shared memory object is unlinked right away, the mappings keep it
+// alive and nothing is left behind in /dev/shm when the processes exit
+void *os_shared_memory_alloc(U64 size) {
+	static volatile U64 counter;
+	char name[64];
+	snprintf(name, sizeof(name), "/linear_solver.%d.%llu", (int)getpid(), os_atomic_increment(&counter));
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) return NULL;
+	shm_unlink(name);
+	void *result = NULL;
+	if (ftruncate(fd, size) == 0) {
+		result = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (result == MAP_FAILED) result = NULL;
+	}
+	close(fd);
+	return result;
+}
+
+void os_shared_memory_release(void *addr, U64 size) {
+	munmap(addr, size);
+}
+
+// returns the incremented value
+U32 os_atomic_increment_u32(volatile U32 *value) {
+	return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+U32 os_atomic_load_u32(volatile U32 *value) {
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+// blocks while *addr == expected, may return early. the futexes are not
+// private, they work across processes on shared memory
+void os_futex_wait(volatile U32 *addr, U32 expected) {
+	syscall(SYS_futex, addr, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+void os_futex_wake_all(volatile U32 *addr) {
+	syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+// returns 0 in the child and the child's id in the parent. only the calling
+// thread exists in the child, the thread pool does not survive
+OSProcess os_process_fork(void) {
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	return pid < 0 ? OS_INVALID_PROCESS : pid;
+}
+
+// blocks until one of the processes exits and returns its index, or count
+// if there is none left to wait for. success is whether it exited with code 0
+U64 os_process_wait_any(OSProcess *processes, U64 count, bool *success) {
+	for (;;) {
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR) continue;
+			*success = false;
+			return count;
+		}
+		for (U64 i=0; i<count; ++i) {
+			if (processes[i] == pid) {
+				*success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+				return i;
+			}
+		}
+	}
+}
+
+void os_process_kill(OSProcess process) {
+	kill((pid_t)process, SIGKILL);
+}
+
+// ends the calling process without running exit handlers or flushing stdio,
+// for forked processes that must not repeat what their parent does at exit
+void os_process_exit(int code) {
+	_exit(code);
+}
+
 #else
 #error "This operating system is currently not supported."
 #endif
@@ -121,9 +802,40 @@ void *xrealloc(void *ptr, U64 size) {
     return result;
 }
 
+// NOTE(shaw): fatal normally ends the process. A thread that can carry on
+// after a failure (batch mode, where one bad input out of thousands should
+// not stop the rest) points fatal_handler at a handler it has setjmp'd,
+// fatal then leaves the message there and jumps back instead. Whatever was
+// pushed on arenas in between is the handler's to pop, open files and
+// mappings of the failed work leak. The jump skips the ends of the profile
+// blocks in between, so fatal puts the profiler back at the block the handler
+// was set in, set handlers with fatal_handler_begin.
+typedef struct {
+	jmp_buf jump;
+	char message[512];
+	U64 profile_block_index;
+} FatalHandler;
+
+static THREAD_LOCAL FatalHandler *fatal_handler;
+extern THREAD_LOCAL U64 current_profile_block_index;
+
+// points fatal_handler at handler and returns the previous one
+static FatalHandler *fatal_handler_begin(FatalHandler *handler) {
+	FatalHandler *previous = fatal_handler;
+	handler->profile_block_index = current_profile_block_index;
+	fatal_handler = handler;
+	return previous;
+}
+
 void fatal(char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
+	if (fatal_handler) {
+		vsnprintf(fatal_handler->message, sizeof(fatal_handler->message), fmt, args);
+		va_end(args);
+		current_profile_block_index = fatal_handler->profile_block_index;
+		longjmp(fatal_handler->jump, 1);
+	}
     printf("FATAL: ");
     vprintf(fmt, args);
     printf("\n");
@@ -141,22 +853,70 @@ typedef struct {
 	U64 cap;
 	U64 committed;
 	U64 page_size;
+	bool large_pages;
 } Arena;
 
+// NOTE(shaw): large pages cut down on TLB misses when kernels stream through
+// big arrays. With transparent huge pages the kernel is only asked to back the
+// arena with them, with explicit huge pages the arena commits memory in large
+// page units from the hugetlbfs pool and falls back to normal pages once the
+// pool runs out. Explicit mode commits at least one large page per arena, so
+// it is meant for runs with few, big arenas.
+typedef enum {
+	LARGE_PAGES_OFF,
+	LARGE_PAGES_TRANSPARENT,
+	LARGE_PAGES_EXPLICIT,
+	LARGE_PAGES_COUNT,
+} LargePageMode;
+
+static LargePageMode global_large_page_mode;
+
+// applies to arenas allocated afterwards. returns false if the os does not
+// support the mode
+bool arena_set_large_page_mode(LargePageMode mode) {
+	if (mode != LARGE_PAGES_OFF && os_get_large_page_size() == 0) {
+		return false;
+	}
+	global_large_page_mode = mode;
+	return true;
+}
+
+static void *arena_commit(void *addr, U64 size, bool large_pages) {
+	if (large_pages) {
+		void *result = os_memory_commit_large(addr, size);
+		if (result) return result;
+	}
+	return os_memory_commit(addr, size);
+}
+
+// pages committed by arena_commit with large_pages set may be huge or normal
+// pages, os_memory_decommit_large returns either
+static bool arena_decommit(void *addr, U64 size, bool large_pages) {
+	if (large_pages) {
+		return os_memory_decommit_large(addr, size);
+	}
+	return os_memory_decommit(addr, size);
+}
+
 typedef struct {
 	Arena *arena;
 	U64 pos;
 } ArenaTemp;
 
 Arena *arena_alloc(void) {
-	U64 page_size = os_get_page_size();
+	LargePageMode mode = global_large_page_mode;
+	bool large_pages = mode == LARGE_PAGES_EXPLICIT;
+	U64 page_size = large_pages ? os_get_large_page_size() : os_get_page_size();
 	
 	Arena *reserved = os_memory_reserve(ARENA_RESERVE_SIZE);
 	if (!reserved) return NULL;
+	if (mode == LARGE_PAGES_TRANSPARENT) {
+		os_memory_advise_large(reserved, ARENA_RESERVE_SIZE);
+	}
 
-	Arena *arena = os_memory_commit(reserved, page_size);
+	Arena *arena = arena_commit(reserved, page_size, large_pages);
 	if (!arena) {
-		os_memory_release(reserved, 0);
+		os_memory_release(reserved, ARENA_RESERVE_SIZE);
 		return NULL;
 	}
 
@@ -164,6 +924,7 @@ Arena *arena_alloc(void) {
 	arena->cap = ARENA_RESERVE_SIZE;
 	arena->committed = page_size;
 	arena->page_size = page_size;
+	arena->large_pages = large_pages;
 
 	return arena;
 }
@@ -176,7 +937,7 @@ void arena_pop_to(Arena *arena, U64 pos) {
 	U64 pos_aligned_to_page_size = ALIGN_UP(pos, arena->page_size);
 	U64 to_decommit = arena->committed - pos_aligned_to_page_size;
 	if (to_decommit > 0) {
-		os_memory_decommit((U8*)arena + pos_aligned_to_page_size, to_decommit);
+		arena_decommit((U8*)arena + pos_aligned_to_page_size, to_decommit, arena->large_pages);
 		arena->committed -= to_decommit;
 	}
 	arena->pos = MAX(pos, sizeof(Arena));
@@ -188,7 +949,7 @@ void arena_clear(Arena *arena) {
 
 void arena_release(Arena *arena) {
 	if (arena) {
-		os_memory_release(arena, 0);
+		os_memory_release(arena, arena->cap);
 	}
 }
 
@@ -198,11 +959,18 @@ void *arena_push(Arena *arena, U64 size, U64 alignment, bool zero) {
 	U64 pad_bytes = (U64)start_aligned - (U64)start;
 	size += pad_bytes;
 
+	// NOTE(shaw): commits map over the range with MAP_FIXED on Linux, so
+	// growing past the reservation would replace whatever is mapped after it
+	if (size > arena->cap - arena->pos) {
+		fatal("arena_push: out of reserved memory, %llu bytes requested with %llu of %llu in use", size, arena->pos, arena->cap);
+	}
+
 	// commit more memory if needed
-	if (arena->pos + size >= arena->committed) {
-		U64 to_commit = ALIGN_UP(arena->pos + size, arena->page_size);
-		void *ok = os_memory_commit(arena, to_commit);
-		assert(ok);
+	if (arena->pos + size > arena->committed) {
+		U64 to_commit = MIN(ALIGN_UP(arena->pos + size, arena->page_size), arena->cap);
+		if (!arena_commit((U8*)arena + arena->committed, to_commit - arena->committed, arena->large_pages)) {
+			fatal("arena_push: failed to commit %llu bytes", to_commit);
+		}
 		arena->committed = to_commit;
 	}
 
@@ -213,16 +981,19 @@ void *arena_push(Arena *arena, U64 size, U64 alignment, bool zero) {
 	arena->pos += size;
 	return start_aligned;
 }
-#define arena_push_n(arena, type, count) (type*)(arena_push(arena, sizeof(type)*count, _Alignof(type), true))
-#define arena_push_n_no_zero(arena, type, count) (type*)(arena_push(arena, sizeof(type)*count, _Alignof(type), false))
+#define arena_push_n(arena, type, count) (type*)(arena_push(arena, sizeof(type)*(count), _Alignof(type), true))
+#define arena_push_n_no_zero(arena, type, count) (type*)(arena_push(arena, sizeof(type)*(count), _Alignof(type), false))
 
-// TODO(shaw): in a multi-threaded environment there should be thread local
-// scratch arenas
-static Arena *global_scratch_arenas[2];
+// NOTE(shaw): scratch arenas are thread local, every thread that uses scratch
+// memory has to call init_scratch once when it starts
+static THREAD_LOCAL Arena *global_scratch_arenas[2];
 
 void init_scratch(void) {
 	for (U64 i=0; i<ARRAY_COUNT(global_scratch_arenas); ++i) {
 		global_scratch_arenas[i] = arena_alloc();
+		if (!global_scratch_arenas[i]) {
+			fatal("init_scratch: failed to allocate scratch arena");
+		}
 	}
 }
 
@@ -249,6 +1020,130 @@ void scratch_end(ArenaTemp scratch) {
 	arena_pop_to(scratch.arena, scratch.pos);
 }
 
+// ---------------------------------------------------------------------------
+// Thread Pool
+// ---------------------------------------------------------------------------
+#define MAX_THREADS 256
+
+// called once per range of a task, range_index is in [0, number of ranges)
+typedef void ThreadTaskFunc(void *data, U64 range_index, U64 start, U64 end);
+
+typedef struct {
+	OSSemaphore start;
+	U64 index;
+} ThreadPoolWorker;
+
+// NOTE(shaw): workers are persistent and sleep on their own semaphore between
+// tasks. The thread calling thread_pool_run always takes range 0 itself, so a
+// pool with a thread_count of 1 (or an uninitialized pool) runs everything
+// serially on the calling thread without any synchronization.
+typedef struct {
+	U64 thread_count;
+	ThreadPoolWorker workers[MAX_THREADS];
+	OSSemaphore done;
+
+	// the task currently being run
+	ThreadTaskFunc *func;
+	void *data;
+	U64 count;
+	U64 range_count;
+} ThreadPool;
+
+static ThreadPool global_thread_pool;
+
+// the range_index-th of range_count contiguous ranges splitting [0, count)
+static void thread_pool_range(U64 count, U64 range_count, U64 range_index, U64 *start, U64 *end) {
+	*start = count * range_index / range_count;
+	*end = count * (range_index + 1) / range_count;
+}
+
+// set while a thread runs a range of a task, see thread_pool_thread_count
+static THREAD_LOCAL bool thread_pool_in_task;
+
+static void thread_pool_run_range(ThreadPool *pool, U64 range_index) {
+	U64 start, end;
+	thread_pool_range(pool->count, pool->range_count, range_index, &start, &end);
+	thread_pool_in_task = true;
+	pool->func(pool->data, range_index, start, end);
+	thread_pool_in_task = false;
+}
+
+static void thread_pool_worker(void *data) {
+	ThreadPoolWorker *worker = data;
+	ThreadPool *pool = &global_thread_pool;
+	init_scratch();
+	for (;;) {
+		os_semaphore_wait(&worker->start);
+		thread_pool_run_range(pool, worker->index);
+		os_semaphore_signal(&pool->done);
+	}
+}
+
+// starts thread_count - 1 worker threads, the calling thread is the remaining one
+void thread_pool_init(U64 thread_count) {
+	ThreadPool *pool = &global_thread_pool;
+	assert(pool->thread_count == 0 && "thread pool is already initialized");
+	thread_count = MAX(1, MIN(thread_count, MAX_THREADS));
+
+	if (!os_semaphore_init(&pool->done, 0)) {
+		fatal("thread_pool_init: failed to create semaphore");
+	}
+	for (U64 i=1; i<thread_count; ++i) {
+		ThreadPoolWorker *worker = &pool->workers[i];
+		worker->index = i;
+		if (!os_semaphore_init(&worker->start, 0)) {
+			fatal("thread_pool_init: failed to create semaphore");
+		}
+		if (!os_thread_create(thread_pool_worker, worker)) {
+			fatal("thread_pool_init: failed to create worker thread %llu", i);
+		}
+	}
+	pool->thread_count = thread_count;
+}
+
+// a task run from inside another one (a solve inside a batch worker) sees a
+// pool of one thread and runs serially, the other threads are busy with the
+// outer task
+U64 thread_pool_thread_count(void) {
+	if (thread_pool_in_task) return 1;
+	return MAX(1, global_thread_pool.thread_count);
+}
+
+// the number of ranges thread_pool_run splits count items into, the ranges
+// themselves are given by thread_pool_range
+U64 thread_pool_range_count(U64 count, U64 min_items_per_range) {
+	U64 range_count = MIN(thread_pool_thread_count(), count / MAX(1, min_items_per_range));
+	return MAX(1, range_count);
+}
+
+// splits [0, count) into contiguous ranges of at least min_items_per_range
+// items (unless count itself is smaller), runs func on every range and waits
+// for all of them to finish. returns the number of ranges used.
+U64 thread_pool_run(ThreadTaskFunc *func, void *data, U64 count, U64 min_items_per_range) {
+	ThreadPool *pool = &global_thread_pool;
+	U64 range_count = thread_pool_range_count(count, min_items_per_range);
+
+	if (range_count == 1) {
+		func(data, 0, 0, count);
+		return 1;
+	}
+
+	pool->func = func;
+	pool->data = data;
+	pool->count = count;
+	pool->range_count = range_count;
+
+	for (U64 i=1; i<range_count; ++i) {
+		os_semaphore_signal(&pool->workers[i].start);
+	}
+	thread_pool_run_range(pool, 0);
+	for (U64 i=1; i<range_count; ++i) {
+		os_semaphore_wait(&pool->done);
+	}
+
+	return range_count;
+}
+
 // ---------------------------------------------------------------------------
 // Hash Map
 // ---------------------------------------------------------------------------
@@ -281,6 +1176,52 @@ uint64_t str_hash_range(char *start, char *end) {
 	return hash;
 }
 
+static U64 hash_rotate(U64 x, int bits) {
+	return (x << bits) | (x >> (64 - bits));
+}
+
+static U64 hash_lane(U64 lane, U64 word) {
+	lane ^= hash_rotate(word * 0x87c37b91114253d5ull, 31) * 0x4cf5ad432745937full;
+	return hash_rotate(lane, 27) * 5 + 0x52dce729;
+}
+
+static U64 hash_finish(U64 x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+// NOTE(shaw): a 128 bit digest of size bytes for content addressing, see
+// cache.c. str_hash_range takes a dependent multiply per byte, this runs four
+// independent lanes over 8 byte words, so large inputs hash many times
+// faster, and 128 bits make an accidental collision between two inputs
+// nothing to worry about. not cryptographic
+void hash_bytes(void *data, U64 size, U64 digest[2]) {
+	U64 lanes[4] = { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0xcbf29ce484222325ull };
+	U8 *p = data;
+	U64 remaining = size;
+	for (; remaining >= 32; p += 32, remaining -= 32) {
+		for (int i=0; i<4; ++i) {
+			U64 word;
+			memcpy(&word, p + 8*i, sizeof(word));
+			lanes[i] = hash_lane(lanes[i], word);
+		}
+	}
+	// the tail is zero padded, the size below tells inputs apart that only
+	// differ in trailing zeros
+	U8 tail[32] = {0};
+	memcpy(tail, p, remaining);
+	for (int i=0; i<4; ++i) {
+		U64 word;
+		memcpy(&word, tail + 8*i, sizeof(word));
+		lanes[i] = hash_lane(lanes[i], word);
+	}
+	digest[0] = hash_finish(lanes[0] ^ hash_rotate(lanes[1], 17) ^ hash_rotate(lanes[2], 31) ^ hash_rotate(lanes[3], 47) ^ size);
+	digest[1] = hash_finish(lanes[3] + hash_rotate(lanes[2], 13) + hash_rotate(lanes[1], 29) + hash_rotate(lanes[0], 41) + digest[0]);
+}
+
 void *map_get(Map *map, void *key) {
 	if (map->len == 0) {
 		return NULL;
@@ -377,8 +1318,9 @@ struct InternStr {
     char str[];
 };
 
-static Arena *intern_arena;
-static Map interns;
+// per thread, so that batch workers can parse inputs concurrently
+static THREAD_LOCAL Arena *intern_arena;
+static THREAD_LOCAL Map interns;
 
 void init_str_intern(void) {
 	if (intern_arena == NULL) {
@@ -444,6 +1386,174 @@ bool read_entire_file(Arena *arena, char *file_path, char **file_data, U64 *out_
 	return true;
 }
 
+// NOTE(shaw): reads a file (or stdin) front to back on a background thread
+// into two alternating buffers, so reading the next buffer overlaps with
+// processing the current one and memory use does not depend on the file size.
+// Every buffer has STREAM_MAX_CARRY bytes of room in front of its data, the
+// unprocessed tail of the previous buffer is copied there so that whatever
+// was split across the buffer boundary (a token, a line) is contiguous again.
+#define STREAM_MAX_CARRY (64 * KILOBYTE)
+
+typedef struct {
+	FILE *file;
+	U64 buffer_size;
+	char *buffers[2];
+	U64 sizes[2];
+	bool error;
+	OSSemaphore filled; // buffers ready for the consumer
+	OSSemaphore empty;  // buffers free for the reader thread
+
+	// consumer side
+	U64 index;  // buffer held by the consumer, or ~0 before the first one
+	bool done;  // the consumer holds the last buffer
+} StreamReader;
+
+static void stream_reader_thread(void *data) {
+	StreamReader *reader = data;
+	for (U64 i=0;; i ^= 1) {
+		os_semaphore_wait(&reader->empty);
+		U64 size = fread(reader->buffers[i] + STREAM_MAX_CARRY, 1, reader->buffer_size, reader->file);
+		reader->sizes[i] = size;
+		bool last = size < reader->buffer_size;
+		if (last) {
+			reader->error = ferror(reader->file) != 0;
+			if (reader->file != stdin) fclose(reader->file);
+		}
+		os_semaphore_signal(&reader->filled);
+		if (last) break;
+	}
+}
+
+// file_path "-" reads stdin. returns false if the file cannot be opened
+bool stream_reader_open(Arena *arena, StreamReader *reader, char *file_path, U64 buffer_size) {
+	memset(reader, 0, sizeof(*reader));
+	reader->file = strcmp(file_path, "-") == 0 ? stdin : fopen(file_path, "rb");
+	if (!reader->file) return false;
+
+	reader->buffer_size = buffer_size;
+	reader->index = ~0ull;
+	for (U64 i=0; i<ARRAY_COUNT(reader->buffers); ++i) {
+		reader->buffers[i] = arena_push_n_no_zero(arena, char, STREAM_MAX_CARRY + buffer_size + 1);
+	}
+	if (!os_semaphore_init(&reader->filled, 0) || !os_semaphore_init(&reader->empty, 2)) {
+		fatal("stream_reader_open: failed to create semaphore");
+	}
+	if (!os_thread_create(stream_reader_thread, reader)) {
+		fatal("stream_reader_open: failed to create reader thread");
+	}
+	return true;
+}
+
+// hands the current buffer back to the reader thread and returns the next
+// one, with the tail_size bytes at tail (the unprocessed end of the current
+// buffer) in front of the new data. *end is set to the NUL terminator after
+// the data. Must not be called again once reader->done is set.
+char *stream_reader_next(StreamReader *reader, char *tail, U64 tail_size, char **end) {
+	assert(!reader->done);
+	if (tail_size > STREAM_MAX_CARRY) {
+		fatal("stream_reader_next: %llu unprocessed bytes do not fit in front of the next buffer", tail_size);
+	}
+
+	os_semaphore_wait(&reader->filled);
+	U64 next = reader->index == ~0ull ? 0 : reader->index ^ 1;
+	char *data = reader->buffers[next] + STREAM_MAX_CARRY;
+	char *start = data - tail_size;
+	if (tail_size) memmove(start, tail, tail_size);
+	if (reader->index != ~0ull) {
+		os_semaphore_signal(&reader->empty);
+	}
+	reader->index = next;
+
+	U64 size = reader->sizes[next];
+	if (size < reader->buffer_size) {
+		reader->done = true;
+		if (reader->error) {
+			fatal("Failed to read input stream");
+		}
+	}
+	*end = data + size;
+	**end = 0;
+	return start;
+}
+
+// reads up to the end of the file, so the reader thread is finished with the
+// buffers before their memory is reused
+void stream_reader_close(StreamReader *reader) {
+	while (!reader->done) {
+		char *end;
+		stream_reader_next(reader, NULL, 0, &end);
+	}
+}
+
+// ---------------------------------------------------------------------------
+// CPU Features
+// ---------------------------------------------------------------------------
+#if _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+typedef enum {
+	SIMD_LEVEL_SCALAR,
+	SIMD_LEVEL_SSE2,
+	SIMD_LEVEL_AVX2,   // AVX2 + FMA
+	SIMD_LEVEL_AVX512, // AVX-512 F
+	SIMD_LEVEL_COUNT,
+} SimdLevel;
+
+static char *simd_level_names[SIMD_LEVEL_COUNT] = {
+	[SIMD_LEVEL_SCALAR] = "scalar",
+	[SIMD_LEVEL_SSE2]   = "sse2",
+	[SIMD_LEVEL_AVX2]   = "avx2",
+	[SIMD_LEVEL_AVX512] = "avx512",
+};
+
+static void cpuid(U32 leaf, U32 subleaf, U32 regs[4]) {
+#if _MSC_VER
+	__cpuidex((int*)regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static U64 read_xcr0(void) {
+#if _MSC_VER
+	return _xgetbv(0);
+#else
+	U32 lo, hi;
+	__asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((U64)hi << 32) | lo;
+#endif
+}
+
+// the widest instruction set that both the cpu and the os (register state
+// saving) support
+SimdLevel cpu_simd_level(void) {
+	U32 regs[4];
+	cpuid(0, 0, regs);
+	U32 max_leaf = regs[0];
+
+	cpuid(1, 0, regs);
+	bool sse2    = regs[3] & (1u << 26);
+	bool fma     = regs[2] & (1u << 12);
+	bool osxsave = regs[2] & (1u << 27);
+	bool avx     = regs[2] & (1u << 28);
+	if (!sse2) return SIMD_LEVEL_SCALAR;
+	if (!osxsave || !avx || !fma || max_leaf < 7) return SIMD_LEVEL_SSE2;
+
+	U64 xcr0 = read_xcr0();
+	if ((xcr0 & 0x6) != 0x6) return SIMD_LEVEL_SSE2; // xmm and ymm state
+
+	cpuid(7, 0, regs);
+	bool avx2    = regs[1] & (1u << 5);
+	bool avx512f = regs[1] & (1u << 16);
+	if (!avx2) return SIMD_LEVEL_SSE2;
+	if (!avx512f || (xcr0 & 0xe6) != 0xe6) return SIMD_LEVEL_AVX2; // opmask and zmm state
+
+	return SIMD_LEVEL_AVX512;
+}
+
 // ---------------------------------------------------------------------------
 // Profiling
 // ---------------------------------------------------------------------------
@@ -469,16 +1579,19 @@ U64 estimate_cpu_freq(void) {
 }
 
 typedef struct {
-	char *name;
+	const char *name; // __func__ is const
 	U64 count;
 	U64 ticks_exclusive; // without children
 	U64 ticks_inclusive; // with children
 	U64 processed_byte_count;
 } ProfileBlock;
 
-ProfileBlock profile_blocks[4096];
+// NOTE(shaw): every thread profiles into its own blocks, thread pool workers
+// run profiled functions concurrently with the main thread. the report only
+// shows the thread that calls profile_end
+THREAD_LOCAL ProfileBlock profile_blocks[4096];
 U64 profile_start; 
-U64 current_profile_block_index;
+THREAD_LOCAL U64 current_profile_block_index;
 
 #ifdef PROFILE
 
@@ -488,7 +1601,7 @@ U64 current_profile_block_index;
 // However, in most cases you either already have separate scopes, or you
 // should trivially be able to open a new scope {}.
 #define PROFILE_BLOCK_BEGIN(block_name) \
-	char *__block_name = block_name; \
+	const char *__block_name = block_name; \
 	U64 __block_index = __COUNTER__ + 1; \
 	ProfileBlock *__block = &profile_blocks[__block_index]; \
 	U64 __top_level_sum = __block->ticks_inclusive; \
@@ -3,6 +3,7 @@
 #include <ctype.h>
 #include <float.h>
 #include <math.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <sys/stat.h>
@@ -10,35 +11,215 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <immintrin.h>
 
 #include "common.c"
 #include "sparse_linear_algebra.c"
+#include "parse_number.c"
 #include "parse.c"
+#include "binary_format.c"
 #include "solver.c"
+#include "cache.c"
+#include "batch.c"
+#include "server.c"
+#include "multiprocess.c"
+
+static char *large_page_mode_names[LARGE_PAGES_COUNT] = {
+	[LARGE_PAGES_OFF]         = "off",
+	[LARGE_PAGES_TRANSPARENT] = "transparent",
+	[LARGE_PAGES_EXPLICIT]    = "explicit",
+};
+
+static char *index_encoding_names[SPARSE_INDEX_COUNT] = {
+	[SPARSE_INDEX_U64]   = "u64",
+	[SPARSE_INDEX_U32]   = "u32",
+	[SPARSE_INDEX_DELTA] = "delta",
+};
+
+static void print_usage(char *program) {
+	printf("Usage: %s [--threads N] [--simd LEVEL] [--huge-pages MODE] [--chunk-height C] [--sort-window S]\n"
+	       "          [--cache DIR] [--processes N] [--reorder] [--indices ENCODING]\n"
+	       "          [--convert OUTPUT | --batch OUTPUT] FILENAME\n"
+	       "       %s [--threads N] [--simd LEVEL] [--huge-pages MODE] --serve SOCKET\n", program, program);
+	printf("  --threads N   number of threads used by the solver (default: number of processors)\n");
+	printf("  --simd LEVEL  widest instruction set the kernels may use, one of\n");
+	printf("                [scalar, sse2, avx2, avx512] (default: detected from the cpu)\n");
+	printf("  --huge-pages MODE  back arenas with huge pages, one of\n");
+	printf("                     [off, transparent, explicit] (default: off)\n");
+	printf("  --chunk-height C  rows per chunk of storage: sliced, at most %d (default: %d)\n",
+		SLICED_MAX_CHUNK_HEIGHT, SLICED_DEFAULT_CHUNK_HEIGHT);
+	printf("  --sort-window S   rows sorted by length together for storage: sliced (default: %d)\n",
+		SLICED_DEFAULT_SORT_WINDOW);
+	printf("  --cache DIR   keep parsed matrices (and their preconditioner) in DIR and reuse\n");
+	printf("                them for later inputs with the same matrix\n");
+	printf("  --processes N     solve with conjugate gradients split over N worker processes\n");
+	printf("                    sharing memory, inputs without a storage line keep compressed\n");
+	printf("                    rows (at most %d, linux only)\n", MAX_PROCESSES);
+	printf("  --reorder         renumber the rows of text inputs in reverse Cuthill-McKee order\n");
+	printf("                    to bring the matrix entries closer to the diagonal\n");
+	printf("  --indices ENCODING  how text inputs store the column indices of the matrix, one\n");
+	printf("                    of [u64, u32, delta], u32 and delta fall back to a wider\n");
+	printf("                    encoding where the matrix does not fit them (default: u32)\n");
+	printf("  --convert OUTPUT  write the text input file FILENAME to OUTPUT in the binary\n");
+	printf("                    format instead of solving it\n");
+	printf("  --batch OUTPUT    solve every input in the directory FILENAME, or listed one per\n");
+	printf("                    line in the file FILENAME, and write the solutions and a\n");
+	printf("                    summary to the directory OUTPUT\n");
+	printf("  --serve SOCKET    keep running and solve the systems clients send to the unix\n");
+	printf("                    domain socket SOCKET, see server.c for the protocol\n");
+	printf("  FILENAME      input file, - reads a text input from stdin\n");
+	exit(1);
+}
 
 int main(int argc, char **argv) {
-	if (argc < 2) {
-		printf("Usage: %s [FILENAME]\n", argv[0]);
-		exit(1);
+	char *filename = NULL;
+	char *convert_path = NULL;
+	char *batch_output = NULL;
+	char *socket_path = NULL;
+	U64 process_count = 1;
+	U64 thread_count = os_get_processor_count();
+	SimdLevel simd_level = SIMD_LEVEL_COUNT - 1;
+	LargePageMode large_page_mode = LARGE_PAGES_OFF;
+
+	for (int i=1; i<argc; ++i) {
+		if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+			thread_count = strtoull(argv[++i], NULL, 10);
+			if (thread_count == 0 || thread_count > MAX_THREADS) {
+				printf("--threads must be between 1 and %d\n", MAX_THREADS);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "--simd") == 0 && i+1 < argc) {
+			char *name = argv[++i];
+			for (simd_level = 0; simd_level < SIMD_LEVEL_COUNT; ++simd_level) {
+				if (strcmp(name, simd_level_names[simd_level]) == 0) break;
+			}
+			if (simd_level == SIMD_LEVEL_COUNT) {
+				print_usage(argv[0]);
+			}
+		} else if (strcmp(argv[i], "--huge-pages") == 0 && i+1 < argc) {
+			char *name = argv[++i];
+			for (large_page_mode = 0; large_page_mode < LARGE_PAGES_COUNT; ++large_page_mode) {
+				if (strcmp(name, large_page_mode_names[large_page_mode]) == 0) break;
+			}
+			if (large_page_mode == LARGE_PAGES_COUNT) {
+				print_usage(argv[0]);
+			}
+		} else if (strcmp(argv[i], "--chunk-height") == 0 && i+1 < argc) {
+			sliced_chunk_height = strtoull(argv[++i], NULL, 10);
+			if (sliced_chunk_height == 0 || sliced_chunk_height > SLICED_MAX_CHUNK_HEIGHT) {
+				printf("--chunk-height must be between 1 and %d\n", SLICED_MAX_CHUNK_HEIGHT);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "--sort-window") == 0 && i+1 < argc) {
+			sliced_sort_window = strtoull(argv[++i], NULL, 10);
+			if (sliced_sort_window == 0) {
+				printf("--sort-window must be at least 1\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "--cache") == 0 && i+1 < argc) {
+			cache_dir = argv[++i];
+		} else if (strcmp(argv[i], "--processes") == 0 && i+1 < argc) {
+			process_count = strtoull(argv[++i], NULL, 10);
+			if (process_count == 0 || process_count > MAX_PROCESSES) {
+				printf("--processes must be between 1 and %d\n", MAX_PROCESSES);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "--reorder") == 0) {
+			reorder_rows = true;
+		} else if (strcmp(argv[i], "--indices") == 0 && i+1 < argc) {
+			char *name = argv[++i];
+			for (index_encoding = 0; index_encoding < SPARSE_INDEX_COUNT; ++index_encoding) {
+				if (strcmp(name, index_encoding_names[index_encoding]) == 0) break;
+			}
+			if (index_encoding == SPARSE_INDEX_COUNT) {
+				print_usage(argv[0]);
+			}
+		} else if (strcmp(argv[i], "--convert") == 0 && i+1 < argc) {
+			convert_path = argv[++i];
+		} else if (strcmp(argv[i], "--batch") == 0 && i+1 < argc) {
+			batch_output = argv[++i];
+		} else if (strcmp(argv[i], "--serve") == 0 && i+1 < argc) {
+			socket_path = argv[++i];
+		} else if (!filename && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0)) {
+			filename = argv[i];
+		} else {
+			print_usage(argv[0]);
+		}
 	}
-	char *filename = argv[1];
+	if (socket_path ? (filename || convert_path || batch_output) : (!filename || (convert_path && batch_output))) {
+		print_usage(argv[0]);
+	}
+	if (process_count > 1 && (socket_path || batch_output)) {
+		print_usage(argv[0]);
+	}
+	detect_storage = process_count == 1;
 
 	profile_begin();
 
+	// before any arena is allocated
+	if (!arena_set_large_page_mode(large_page_mode)) {
+		fprintf(stderr, "huge pages are not supported on this platform, continuing without them\n");
+	}
 	init_scratch();
+	thread_pool_init(thread_count);
+	init_kernels(simd_level);
+	if (cache_dir && !os_make_directory(cache_dir)) {
+		fatal("Failed to create the cache directory %s", cache_dir);
+	}
+
+	if (socket_path) {
+		serve(socket_path);
+		profile_end();
+		return 0;
+	}
+
+	if (batch_output) {
+		U64 unsolved = solve_batch(filename, batch_output);
+		print_cache_diagnostics();
+		profile_end();
+		return unsolved ? 1 : 0;
+	}
+
 	ArenaTemp scratch = scratch_begin(NULL, 0);
 	
-	ParseResult parse_result = parse_input(scratch.arena, filename);
+	// binary files are recognized by their magic, anything else (including
+	// stdin) is parsed as text while it is being read. the cache needs the
+	// whole file, it reads it up front
+	ParseResult parse_result;
+	PreparedSystem prepared = {0};
+	if (is_binary_file(filename)) {
+		parse_result = load_binary_file(scratch.arena, filename);
+	} else if (cache_dir && !convert_path && strcmp(filename, "-") != 0) {
+		parse_result = parse_input_cached(scratch.arena, filename, &prepared);
+	} else {
+		parse_result = parse_input_stream(scratch.arena, filename, PARSE_STREAM_BUFFER_SIZE);
+	}
+
+	if (convert_path) {
+		write_binary_file(convert_path, &parse_result);
+		scratch_end(scratch);
+		profile_end();
+		return 0;
+	}
 
 	Vector *solution = vec_alloc(scratch.arena, parse_result.vector->precision, parse_result.vector->num_values);
-	if (!solve(parse_result.solver, parse_result.matrix, parse_result.vector, solution)) {
+	if (!prepared.A) {
+		prepared = prepare_system(scratch.arena, parse_result.solver, parse_result.matrix);
+	}
+	if (!solve_processes(&prepared, parse_result.vector, parse_result.initial_guess, solution, process_count)) {
 		fatal("Solver did not to converge to a solution\n");
 	}
 
-	vec_print(solution);
+	// one line per right hand side
+	U64 num_rows = parse_result.matrix->num_rows;
+	for (U64 i=0; i<parse_result.num_vectors; ++i) {
+		Vector column = vec_slice(solution, i * num_rows, num_rows);
+		vec_print(&column);
+	}
 
 	scratch_end(scratch);
 
+	print_cache_diagnostics();
 	profile_end();
 	return 0;
 }
@@ -0,0 +1,295 @@
+// ---------------------------------------------------------------------------
+// Multi-Process Solve
+// ---------------------------------------------------------------------------
+// NOTE(shaw): with --processes N conjugate gradients runs in N forked worker
+// processes instead of on the thread pool, for matrices that need the memory
+// bandwidth of more than one socket. Each worker owns a block of rows with
+// about the same number of entries and copies its rows of A into its own
+// memory, where the kernel puts the pages on the NUMA node the worker touches
+// them from. Its slices of the residual and of q = A * p are private too.
+//
+// The solution x and the search direction p live in a POSIX shared memory
+// segment set up before the fork. Every worker writes its own rows of them
+// and its product reads the rows of p its columns reach into (the halo)
+// straight from the segment once a barrier has passed, the exchange needs no
+// copy. Reductions go through the segment as well: each worker stores its
+// partial sum in its slot, and after the barrier every worker adds all slots
+// up in worker order, so all of them get the same bits and stop at the same
+// iteration. Barriers spin for a while and then sleep on a futex.
+//
+// An iteration has three barriers, one per dot product and one after the
+// update of p. Workers run the kernels on their one thread, a forked child
+// only has the thread that forked. The parent just waits, a worker that fails
+// gets the others killed and the solve fails. Only plain conjugate gradients
+// on compressed rows is split up, anything else prints a warning and is
+// solved in this process, like every solve on Windows, which cannot fork.
+
+#define MAX_PROCESSES 64
+
+// how long a barrier spins before it sleeps, in pause instructions
+#define PROCESS_BARRIER_SPINS 4096
+
+typedef struct {
+	volatile U32 arrived;
+	volatile U32 generation;
+} ProcessBarrier;
+
+// a partial sum, one cache line per worker so the stores do not contend
+typedef struct {
+	F64 value;
+	U8 padding[56];
+} ProcessSlot;
+
+// the start of the shared segment, x and p follow it
+typedef struct {
+	ProcessBarrier barrier;
+	U8 padding[56];
+	// a reduction writes one set while the workers may still read the
+	// previous one, see process_allreduce
+	ProcessSlot sums[2][MAX_PROCESSES];
+	// written by worker 0
+	U64 iterations;
+	F64 residual;
+} ProcessShared;
+
+typedef struct {
+	ProcessShared *shared;
+	U64 rank;
+	U64 count;
+	U64 reductions; // so far, picks the set of slots
+} ProcessWorker;
+
+static void process_barrier_wait(ProcessBarrier *barrier, U32 count) {
+	U32 generation = os_atomic_load_u32(&barrier->generation);
+	if (os_atomic_increment_u32(&barrier->arrived) == count) {
+		barrier->arrived = 0;
+		os_atomic_increment_u32(&barrier->generation);
+		os_futex_wake_all(&barrier->generation);
+		return;
+	}
+	for (U32 spin=0; os_atomic_load_u32(&barrier->generation) == generation; ++spin) {
+		if (spin < PROCESS_BARRIER_SPINS) {
+			_mm_pause();
+		} else {
+			os_futex_wait(&barrier->generation, generation);
+		}
+	}
+}
+
+// the sum of value over all workers. the barrier also publishes every store
+// the workers made to the segment before it
+static F64 process_allreduce(ProcessWorker *worker, F64 value) {
+	ProcessSlot *slots = worker->shared->sums[worker->reductions++ % 2];
+	slots[worker->rank].value = value;
+	process_barrier_wait(&worker->shared->barrier, (U32)worker->count);
+	F64 sum = 0;
+	for (U64 i=0; i<worker->count; ++i) {
+		sum += slots[i].value;
+	}
+	return sum;
+}
+
+// runs func over [0, count) on the calling thread
+static F64 process_kernel(KernelFunc *func, KernelArgs *args, U64 count) {
+	KernelRange range = { .start = 0, .end = count };
+	func(args, &range);
+	return range.sum;
+}
+
+// the first row of worker rank, rows are split so every worker gets about
+// the same number of entries
+static U64 process_first_row(SparseMatrix *A, U64 rank, U64 count) {
+	U64 target = A->num_values * rank / count;
+	U64 low = 0;
+	U64 high = A->num_rows;
+	while (low < high) {
+		U64 mid = low + (high - low) / 2;
+		if (A->row_offsets[mid] < target) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return rank == 0 ? 0 : low;
+}
+
+// conjugate gradients on the rows of worker->rank for every column of b, x
+// and p are the vectors in the shared segment
+static void process_solve(ProcessWorker *worker, SparseMatrix *A, Vector *b, Vector *x, Vector *p) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 n = A->num_rows;
+	U64 start = process_first_row(A, worker->rank, worker->count);
+	U64 end = process_first_row(A, worker->rank + 1, worker->count);
+	if (worker->rank + 1 == worker->count) end = n;
+	U64 rows = end - start;
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	SparseMatrix *block = sparse_mat_row_block(scratch.arena, A, start, end);
+	LinearAlgebraKernels *k = get_kernels(A->precision);
+	KernelFunc *mul_vec = sparse_kernel(k, block, SPARSE_OP_MUL_VEC);
+	KernelFunc *residual_dot = sparse_kernel(k, block, SPARSE_OP_RESIDUAL_DOT);
+	Vector *residual = vec_alloc(scratch.arena, A->precision, rows);
+	Vector *q = vec_alloc(scratch.arena, A->precision, rows);
+	Vector own_p = vec_slice(p, start, rows);
+	U64 max_iterations = 0;
+	F64 max_delta = 0;
+
+	for (U64 j=0; j<b->num_values / n; ++j) {
+		Vector own_b = vec_slice(b, j * n + start, rows);
+		Vector column_x = vec_slice(x, j * n, n);
+		Vector own_x = vec_slice(x, j * n + start, rows);
+
+		// residual = b - A * x, x holds the initial guess
+		F64 partial = process_kernel(residual_dot, &(KernelArgs){ .A = block, .result = residual, .a = &column_x, .b = &own_b }, rows);
+		vec_copy_values(&own_p, residual);
+		F64 delta = process_allreduce(worker, partial);
+
+		U64 i;
+		for (i = 0; i < MAX_ITERATIONS && delta > TOLERANCE; ++i) {
+			// q = A * p, every row of p was published by the last barrier
+			process_kernel(mul_vec, &(KernelArgs){ .A = block, .result = q, .a = p }, rows);
+			partial = process_kernel(k->vec_dot, &(KernelArgs){ .a = &own_p, .b = q }, rows);
+			F64 step_amount = delta / process_allreduce(worker, partial);
+
+			// x = x + step_amount * p
+			process_kernel(k->vec_axpy, &(KernelArgs){ .result = &own_x, .a = &own_p, .scalar = step_amount }, rows);
+
+			if (((i+1) % ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE) == 0) {
+				// residual = b - A * x, once every worker has updated its x
+				process_barrier_wait(&worker->shared->barrier, (U32)worker->count);
+				partial = process_kernel(residual_dot, &(KernelArgs){ .A = block, .result = residual, .a = &column_x, .b = &own_b }, rows);
+			} else {
+				// residual = residual - step_amount * q
+				partial = process_kernel(k->vec_axpy_dot, &(KernelArgs){ .result = residual, .a = q, .scalar = -step_amount }, rows);
+			}
+			F64 delta_old = delta;
+			delta = process_allreduce(worker, partial);
+
+			// p = residual + beta * p, the other workers are done reading p
+			process_kernel(k->vec_xpay, &(KernelArgs){ .result = &own_p, .a = residual, .scalar = delta / delta_old }, rows);
+			process_barrier_wait(&worker->shared->barrier, (U32)worker->count);
+		}
+		max_iterations = MAX(max_iterations, i);
+		max_delta = MAX(max_delta, delta);
+	}
+
+	if (worker->rank == 0) {
+		worker->shared->iterations = max_iterations;
+		worker->shared->residual = max_delta;
+	}
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+}
+
+// solve_prepared with the work split over process_count worker processes,
+// see the note above. falls back to solve_prepared for what it cannot split
+//
+// result and v must be distinct vectors, initial_guess may be result
+static bool solve_processes(PreparedSystem *system, Vector *v, Vector *initial_guess, Vector *result, U64 process_count) {
+	PROFILE_FUNCTION_BEGIN;
+	SparseMatrix *A = system->A;
+	U64 n = A->num_rows;
+	if (system->kind != SOLVER_CONJUGATE_GRADIENTS || A->layout != SPARSE_LAYOUT_CSR || process_count < 2) {
+		if (process_count > 1) {
+			fprintf(stderr, "warning: only conjugate gradients on compressed rows runs in several processes, solving in this one\n");
+		}
+		bool success = solve_prepared(system, v, initial_guess, result);
+		PROFILE_FUNCTION_END;
+		return success;
+	}
+	if (process_count > MAX_PROCESSES) {
+		fatal("solve: at most %d processes, got %llu", MAX_PROCESSES, process_count);
+	}
+	if (result->num_values != v->num_values || n == 0 || v->num_values % n != 0) {
+		fatal("solve: vector sizes do not match the %llux%llu matrix", n, n);
+	}
+	if (result == v) {
+		fatal("solve: result and v must be distinct vectors");
+	}
+	if (initial_guess && (initial_guess->precision != result->precision || initial_guess->num_values != result->num_values)) {
+		fatal("solve: the initial guess does not match the right hand sides");
+	}
+	Vector first_v = vec_slice(v, 0, n);
+	Vector first_result = vec_slice(result, 0, n);
+	check_solver_arguments("solve", A, &first_v, &first_result);
+
+	U64 value_size = A->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+	U64 x_offset = ALIGN_UP(sizeof(ProcessShared), 64);
+	U64 p_offset = ALIGN_UP(x_offset + result->num_values * value_size, 64);
+	U64 size = p_offset + n * value_size;
+	U8 *segment = os_shared_memory_alloc(size);
+	if (!segment) {
+		fatal("solve: failed to allocate %llu bytes of shared memory", size);
+	}
+	ProcessShared *shared = (ProcessShared*)segment;
+	Vector x = { .precision = result->precision, .valuesF64 = (F64*)(segment + x_offset), .num_values = result->num_values };
+	Vector p = { .precision = result->precision, .valuesF64 = (F64*)(segment + p_offset), .num_values = n };
+	if (initial_guess) {
+		vec_copy_values(&x, initial_guess);
+	}
+	// v and result are numbered like the input, A like its reordering, see
+	// solve_prepared. the workers fork with the permuted v
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	Vector *b = A->permutation ? vec_alloc(scratch.arena, v->precision, v->num_values) : v;
+	if (A->permutation) {
+		vec_permute_rows(b, v, A->permutation, n, false);
+		Vector *guess = vec_copy(scratch.arena, &x);
+		vec_permute_rows(&x, guess, A->permutation, n, false);
+	}
+
+	OSProcess processes[MAX_PROCESSES];
+	U64 started = 0;
+	for (; started < process_count; ++started) {
+		OSProcess process = os_process_fork();
+		if (process == 0) {
+			// NOTE(shaw): a worker that fails must not unwind into its
+			// parent's code, it reports through its exit code instead
+			FatalHandler handler;
+			fatal_handler_begin(&handler);
+			if (setjmp(handler.jump) != 0) {
+				fprintf(stderr, "worker %llu: %s\n", started, handler.message);
+				os_process_exit(1);
+			}
+			ProcessWorker worker = { .shared = shared, .rank = started, .count = process_count };
+			process_solve(&worker, A, b, &x, &p);
+			os_process_exit(0);
+		}
+		if (process == OS_INVALID_PROCESS) break;
+		processes[started] = process;
+	}
+
+	bool failed = started < process_count;
+	if (failed) {
+		for (U64 i=0; i<started; ++i) {
+			os_process_kill(processes[i]);
+		}
+	}
+	for (U64 remaining = started; remaining > 0; --remaining) {
+		bool success;
+		U64 index = os_process_wait_any(processes, started, &success);
+		if (index == started) break;
+		if (!success && !failed) {
+			failed = true;
+			for (U64 i=0; i<started; ++i) {
+				if (i != index) os_process_kill(processes[i]);
+			}
+		}
+	}
+	scratch_end(scratch);
+	if (failed) {
+		os_shared_memory_release(segment, size);
+		fatal("solve: a worker process failed");
+	}
+
+	if (A->permutation) {
+		vec_permute_rows(result, &x, A->permutation, n, true);
+	} else {
+		vec_copy_values(result, &x);
+	}
+	solver_stats = (SolverStats){0};
+	record_solver_stats(shared->iterations, shared->residual);
+	bool success = shared->residual <= TOLERANCE;
+	os_shared_memory_release(segment, size);
+	PROFILE_FUNCTION_END;
+	return success;
+}
@@ -27,34 +27,66 @@ typedef struct {
 typedef struct {
 	SolverKind solver;
 	SparseMatrix *matrix;
+	// the right hand sides (and their initial guesses and solutions) one
+	// after the other, each as long as the matrix has rows. initial_guess
+	// and solution are NULL if the input has none
 	Vector *vector;
+	Vector *initial_guess;
 	Vector *solution;
+	U64 num_vectors;
+	// mapped file the arrays point into, only set for binary input files
+	void *mapping;
+	U64 mapping_size;
 	// bool failed;
 	// char *error;
 } ParseResult;
 
-static char *stream;
-static Token token;
-static int current_line;
-
-static char *keyword_format;
-static char *keyword_float;
-static char *keyword_double;
-static char *keyword_solver;
-static char *keyword_steepest_descent;
-static char *keyword_conjugate_directions;
-static char *keyword_conjugate_gradients;
-static char *keyword_matrix;
-static char *keyword_vector;
-static char *keyword_solution;
+// NOTE(shaw): when streaming, [stream, stream_end) is only the part of the
+// input that is currently buffered. next_token refills it whenever less than
+// PARSE_LOOKAHEAD bytes are left, so no token (or matrix line) shorter than
+// that is ever cut off at the end of the buffer.
+#define PARSE_LOOKAHEAD 4096
+#define PARSE_STREAM_BUFFER_SIZE (32 * MEGABYTE)
+
+// NOTE(shaw): the parser state is per thread so that batch workers can parse
+// inputs concurrently. the keywords point into the per thread intern table
+static THREAD_LOCAL char *stream;
+static THREAD_LOCAL char *stream_end; // the NUL terminator of the buffered input
+static THREAD_LOCAL StreamReader *stream_reader; // NULL when the whole input is in memory
+static THREAD_LOCAL U64 stream_refills;
+static THREAD_LOCAL Token token;
+static THREAD_LOCAL int current_line;
+
+static THREAD_LOCAL char *keyword_format;
+static THREAD_LOCAL char *keyword_float;
+static THREAD_LOCAL char *keyword_double;
+static THREAD_LOCAL char *keyword_solver;
+static THREAD_LOCAL char *keyword_steepest_descent;
+static THREAD_LOCAL char *keyword_conjugate_directions;
+static THREAD_LOCAL char *keyword_conjugate_gradients;
+static THREAD_LOCAL char *keyword_preconditioned_conjugate_gradients;
+static THREAD_LOCAL char *keyword_incomplete_cholesky_conjugate_gradients;
+static THREAD_LOCAL char *keyword_mixed_precision_conjugate_gradients;
+static THREAD_LOCAL char *keyword_pipelined_conjugate_gradients;
+static THREAD_LOCAL char *keyword_storage;
+static THREAD_LOCAL char *keyword_general;
+static THREAD_LOCAL char *keyword_symmetric;
+static THREAD_LOCAL char *keyword_sliced;
+static THREAD_LOCAL char *keyword_matrix;
+static THREAD_LOCAL char *keyword_vector;
+static THREAD_LOCAL char *keyword_initial_guess;
+static THREAD_LOCAL char *keyword_solution;
 
 static void parse_error(char *fmt, ...) {
+	char message[256];
     va_list args;
     va_start(args, fmt);
-    fprintf(stderr, "%s:%d: parse error: ", token.pos.filepath, token.pos.line);
-    vfprintf(stderr, fmt, args);
-    fprintf(stderr, "\n");
+	vsnprintf(message, sizeof(message), fmt, args);
     va_end(args);
+	if (fatal_handler) {
+		fatal("%s:%d: parse error: %s", token.pos.filepath, token.pos.line, message);
+	}
+    fprintf(stderr, "%s:%d: parse error: %s\n", token.pos.filepath, token.pos.line, message);
     exit(1);
 }
 
@@ -67,19 +99,45 @@ static void init_keywords(void) {
 	keyword_steepest_descent = str_intern("steepest_descent");
 	keyword_conjugate_directions = str_intern("conjugate_directions");
 	keyword_conjugate_gradients = str_intern("conjugate_gradients");
+	keyword_preconditioned_conjugate_gradients = str_intern("preconditioned_conjugate_gradients");
+	keyword_incomplete_cholesky_conjugate_gradients = str_intern("incomplete_cholesky_conjugate_gradients");
+	keyword_mixed_precision_conjugate_gradients = str_intern("mixed_precision_conjugate_gradients");
+	keyword_pipelined_conjugate_gradients = str_intern("pipelined_conjugate_gradients");
+	keyword_storage = str_intern("storage");
+	keyword_general = str_intern("general");
+	keyword_symmetric = str_intern("symmetric");
+	keyword_sliced = str_intern("sliced");
 	keyword_matrix = str_intern("matrix");
 	keyword_vector = str_intern("vector");
+	keyword_initial_guess = str_intern("initial_guess");
 	keyword_solution = str_intern("solution");
 	PROFILE_FUNCTION_END;
 }
 
+// true once the rest of the input is all in [stream, stream_end)
+static bool stream_complete(void) {
+	return !stream_reader || stream_reader->done;
+}
+
+static void refill_stream(void) {
+	while (!stream_complete() && stream_end - stream < PARSE_LOOKAHEAD) {
+		stream = stream_reader_next(stream_reader, stream, stream_end - stream, &stream_end);
+		++stream_refills;
+	}
+}
+
 static void next_token(void) {
 	PROFILE_FUNCTION_BEGIN;
 repeat:
+	if (stream_end - stream < PARSE_LOOKAHEAD) {
+		refill_stream();
+	}
 	token.start = stream;
 	token.pos.line = current_line;
 	if (*stream == 0) { 
 		token.kind = TOKEN_EOF;
+		token.end = stream;
+		PROFILE_FUNCTION_END;
 		return;
 	}
 	switch (*stream) {
@@ -95,16 +153,20 @@ repeat:
 		case '-':
 		case '0': case '1': case '2': case '3': case '4':
 		case '5': case '6': case '7': case '8': case '9': {
-			if (*stream == '-') ++stream;
-            while (isdigit(*stream)) ++stream;
-            char c = *stream;
-            stream = token.start;
-            if (c == '.' || tolower(c) == 'e') {
+			Number number;
+			char *end = parse_number(stream, &number);
+			if (end == stream) {
+				// a '-' that does not start a number
+				token.kind = *stream;
+				++stream;
+			} else if (number.is_float) {
 				token.kind = TOKEN_FLOAT;
-				token.float_val = strtod(stream, &stream);
+				token.float_val = number.float_val;
+				stream = end;
 			} else {
 				token.kind = TOKEN_INT;
-				token.int_val = strtoll(stream, &stream, 10);
+				token.int_val = number.int_val;
+				stream = end;
 			}
             break;
 		}
@@ -133,21 +195,42 @@ repeat:
 			break;
         }
 	}
+	if (stream == stream_end && !stream_complete()) {
+		parse_error("token is longer than %d characters", PARSE_LOOKAHEAD);
+	}
     token.end = stream;
 	PROFILE_FUNCTION_END;
 }
 
-static void init_parse(char *source_path, char *source) {
+// reader is NULL if source is the whole input, otherwise source is the
+// start of what has been read so far
+static void init_parse(char *source_path, char *source, char *source_end, StreamReader *reader) {
 	PROFILE_FUNCTION_BEGIN;
+	assert(*source_end == 0);
 	init_str_intern();
 	init_keywords();
 	stream = source;
+	stream_end = source_end;
+	stream_reader = reader;
+	stream_refills = 0;
 	token.pos.filepath = str_intern(source_path);
 	current_line = 1;
 	next_token();
 	PROFILE_FUNCTION_END;
 }
 
+// moves the tokenizer forward to position without tokenizing what is
+// skipped, position has to be past the current token and in the whole input
+// (reader is NULL). lines are still counted for error messages
+static void skip_to(char *position) {
+	assert(!stream_reader && position >= stream && position <= stream_end);
+	for (char *c = stream; (c = memchr(c, '\n', position - c)); ++c) {
+		++current_line;
+	}
+	stream = position;
+	next_token();
+}
+
 // used for error messages
 static char *token_kind_to_str(TokenKind kind) {
 	PROFILE_FUNCTION_BEGIN;
@@ -274,13 +357,316 @@ static SolverKind parse_solver(void) {
 		solver = SOLVER_CONJUGATE_DIRECTIONS;
 	} else if (name == keyword_steepest_descent) {
 		solver = SOLVER_STEEPEST_DESCENT;
+	} else if (name == keyword_preconditioned_conjugate_gradients) {
+		solver = SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS;
+	} else if (name == keyword_incomplete_cholesky_conjugate_gradients) {
+		solver = SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS;
+	} else if (name == keyword_mixed_precision_conjugate_gradients) {
+		solver = SOLVER_MIXED_PRECISION_CONJUGATE_GRADIENTS;
+	} else if (name == keyword_pipelined_conjugate_gradients) {
+		solver = SOLVER_PIPELINED_CONJUGATE_GRADIENTS;
 	} else {
-		parse_error("expected one of [conjugate_gradients, conjugate_directions, steepest_descent], got %s", name);
+		parse_error("expected one of [conjugate_gradients, preconditioned_conjugate_gradients, "
+			"incomplete_cholesky_conjugate_gradients, mixed_precision_conjugate_gradients, "
+			"pipelined_conjugate_gradients, conjugate_directions, steepest_descent], got %s", name);
 	}
 	PROFILE_FUNCTION_END;
 	return solver;
 }
 
+// chunk height and sort window of storage: sliced, main sets them from the
+// command line
+static U64 sliced_chunk_height = SLICED_DEFAULT_CHUNK_HEIGHT;
+static U64 sliced_sort_window = SLICED_DEFAULT_SORT_WINDOW;
+
+// main clears this for --processes, which only splits up compressed rows.
+// inputs without a storage line then keep compressed rows
+static bool detect_storage = true;
+
+// main sets this for --reorder, the matrix is then renumbered in reverse
+// Cuthill-McKee order before its layout is built, see sparse_mat_reorder.
+// the vectors keep the numbering of the input
+static bool reorder_rows;
+
+// main sets this for --indices, the column indices of the matrix move to it
+// once its layout is built, see sparse_mat_compact_indices
+static SparseIndexEncoding index_encoding = SPARSE_INDEX_U32;
+
+typedef enum {
+	STORAGE_DETECT,    // diagonal storage if banded, else symmetric if symmetric
+	STORAGE_GENERAL,   // both triangles as listed
+	STORAGE_SYMMETRIC, // the file lists each mirrored pair once
+	STORAGE_SLICED,    // SELL-C-sigma with the sliced_* settings below
+} MatrixStorage;
+
+// the storage line is optional, without one the layout is detected
+static MatrixStorage parse_storage(void) {
+	PROFILE_FUNCTION_BEGIN;
+	MatrixStorage storage = STORAGE_DETECT;
+	if (is_token_name(keyword_storage)) {
+		next_token();
+		expect_token(':');
+		char *name = parse_name();
+		if (name == keyword_general) {
+			storage = STORAGE_GENERAL;
+		} else if (name == keyword_symmetric) {
+			storage = STORAGE_SYMMETRIC;
+		} else if (name == keyword_sliced) {
+			storage = STORAGE_SLICED;
+		} else {
+			parse_error("expected one of [general, symmetric, sliced], got %s", name);
+		}
+	}
+	PROFILE_FUNCTION_END;
+	return storage;
+}
+
+static char *skip_whitespace(char *s, int *lines) {
+	while (isspace(*s)) {
+		if (*s == '\n') ++*lines;
+		++s;
+	}
+	return s;
+}
+
+// NOTE(shaw): fast path for the "row col value" lines that make up almost all
+// of an input file. The current token is the row, the column and value are
+// read straight from the stream instead of going through next_token for each
+// of them. If the line has any other shape nothing is consumed and false is
+// returned, the caller then parses it token by token so errors are reported
+// the usual way.
+static bool parse_matrix_triplet(U64 *row, U64 *col, F64 *value) {
+	assert(is_token(TOKEN_INT));
+	int lines = 0;
+	Number col_number, value_number;
+
+	char *s = skip_whitespace(stream, &lines);
+	char *end = parse_number(s, &col_number);
+	if (end == s || col_number.is_float) return false;
+
+	s = skip_whitespace(end, &lines);
+	end = parse_number(s, &value_number);
+	if (end == s) return false;
+	// the value has to end where a token would end
+	if (*end && !isspace(*end)) return false;
+	// and must not continue in the next buffer
+	if (end == stream_end && !stream_complete()) return false;
+
+	*row = token.int_val;
+	*col = col_number.int_val;
+	*value = value_number.is_float ? value_number.float_val : (F64)value_number.int_val;
+	stream = end;
+	current_line += lines;
+	next_token();
+	return true;
+}
+
+// ---------------------------------------------------------------------------
+// Parallel Matrix Parsing
+// ---------------------------------------------------------------------------
+// NOTE(shaw): large matrix sections are split into one chunk per thread at
+// line boundaries. Every thread parses the "row col value" lines of its chunk
+// into its own arena, without touching the global tokenizer state, and stops
+// at the first line of any other shape. The triplet counts are then prefix
+// summed and the chunks copied into the matrix in parallel. The first chunk
+// that stopped early marks where the parallel part ends, the regular
+// tokenizer takes over from that line with the correct line number, so the
+// end of the matrix, unusual layouts and errors are all handled the same way
+// as before. Chunks after that one are thrown away.
+
+#define PARSE_MIN_CHUNK_SIZE (4 * MEGABYTE)
+#define PARSE_TRIPLET_BLOCK 4096
+
+typedef struct {
+	U64 row, col;
+	F64 value;
+} Triplet;
+
+typedef struct {
+	char *start, *end; // start is a line start, end is the next chunk's start
+	Arena *arena;
+	Triplet *triplets;
+	U64 count;
+	U64 offset;        // of the first triplet in the matrix
+	char *stop;        // first line that is not a triplet line, or end
+	U64 lines;         // newlines in [start, stop)
+} MatrixChunk;
+
+typedef struct {
+	MatrixChunk *chunks;
+	SparseMatrix *matrix;
+} MatrixChunks;
+
+static char *skip_blanks(char *s) {
+	while (*s == ' ' || *s == '\t' || *s == '\r') ++s;
+	return s;
+}
+
+// NOTE(shaw): runs on worker threads, so no profiling and no global state
+static void parse_matrix_chunk(MatrixChunk *chunk) {
+	U64 capacity = 0;
+	char *s = chunk->start;
+	while (s < chunk->end) {
+		char *line = s;
+		s = skip_blanks(s);
+		if (*s == '\n') {
+			++chunk->lines;
+			++s;
+			continue;
+		}
+		if (s == chunk->end) break;
+
+		Number row, col, value;
+		char *end = parse_number(s, &row);
+		if (end == s || row.is_float || (*end != ' ' && *end != '\t')) {
+			chunk->stop = line;
+			return;
+		}
+		s = skip_blanks(end);
+		end = parse_number(s, &col);
+		if (end == s || col.is_float || (*end != ' ' && *end != '\t')) {
+			chunk->stop = line;
+			return;
+		}
+		s = skip_blanks(end);
+		end = parse_number(s, &value);
+		if (end == s) {
+			chunk->stop = line;
+			return;
+		}
+		s = skip_blanks(end);
+		if (*s != '\n' && s != chunk->end) {
+			chunk->stop = line;
+			return;
+		}
+
+		if (chunk->count == capacity) {
+			// the arena only holds this array, so blocks are contiguous
+			Triplet *block = arena_push_n_no_zero(chunk->arena, Triplet, PARSE_TRIPLET_BLOCK);
+			if (!chunk->triplets) chunk->triplets = block;
+			assert(block == chunk->triplets + capacity);
+			capacity += PARSE_TRIPLET_BLOCK;
+		}
+		Triplet *t = &chunk->triplets[chunk->count++];
+		t->row = row.int_val;
+		t->col = col.int_val;
+		t->value = value.is_float ? value.float_val : (F64)value.int_val;
+
+		if (*s == '\n') {
+			++chunk->lines;
+			++s;
+		}
+	}
+	chunk->stop = chunk->end;
+}
+
+static void parse_matrix_chunks_task(void *data, U64 range_index, U64 start, U64 end) {
+	(void)range_index;
+	MatrixChunks *chunks = data;
+	for (U64 i=start; i<end; ++i) {
+		parse_matrix_chunk(&chunks->chunks[i]);
+	}
+}
+
+static void copy_matrix_chunks_task(void *data, U64 range_index, U64 start, U64 end) {
+	(void)range_index;
+	MatrixChunks *chunks = data;
+	SparseMatrix *m = chunks->matrix;
+	for (U64 i=start; i<end; ++i) {
+		MatrixChunk *chunk = &chunks->chunks[i];
+		for (U64 j=0; j<chunk->count; ++j) {
+			Triplet *t = &chunk->triplets[j];
+			U64 dst = chunk->offset + j;
+			m->rows[dst] = t->row;
+			m->cols[dst] = t->col;
+			if (m->precision == PRECISION_F32) {
+				m->valuesF32[dst] = (F32)t->value;
+			} else {
+				m->valuesF64[dst] = t->value;
+			}
+		}
+	}
+}
+
+// parses the matrix lines starting at the current token in parallel and
+// writes them to matrix starting at triplet index first. Returns the number
+// of triplets parsed. The tokenizer is left at the first token that was not
+// parsed, so the caller continues from there.
+static U64 parse_matrix_parallel(Arena *arena, SparseMatrix *matrix, U64 first) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(is_token(TOKEN_INT));
+	char *body = token.start;
+	char *body_end = stream_end;
+	if (!stream_complete()) {
+		// the last line of the buffer may continue in the next one
+		while (body_end > body && body_end[-1] != '\n') --body_end;
+	}
+	U64 body_size = body_end - body;
+	U64 chunk_count = MIN(thread_pool_thread_count(), body_size / PARSE_MIN_CHUNK_SIZE);
+	if (chunk_count < 2) {
+		PROFILE_FUNCTION_END;
+		return 0;
+	}
+
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	MatrixChunks chunks = {
+		.chunks = arena_push_n(scratch.arena, MatrixChunk, chunk_count),
+		.matrix = matrix,
+	};
+	char *start = body;
+	for (U64 i=0; i<chunk_count; ++i) {
+		char *end = body_end;
+		if (i + 1 < chunk_count) {
+			end = MAX(start, body + body_size * (i + 1) / chunk_count);
+			end = memchr(end, '\n', body_end - end);
+			end = end ? end + 1 : body_end;
+		}
+		MatrixChunk *chunk = &chunks.chunks[i];
+		chunk->start = start;
+		chunk->end = end;
+		chunk->arena = arena_alloc();
+		if (!chunk->arena) {
+			fatal("Failed to allocate an arena for parsing");
+		}
+		start = end;
+	}
+
+	thread_pool_run(parse_matrix_chunks_task, &chunks, chunk_count, 1);
+
+	// everything up to the first chunk that stopped early is matrix lines
+	U64 used_chunks = 0;
+	U64 count = 0;
+	U64 lines = 0;
+	char *stop = body;
+	for (U64 i=0; i<chunk_count; ++i) {
+		MatrixChunk *chunk = &chunks.chunks[i];
+		chunk->offset = first + count;
+		count += chunk->count;
+		lines += chunk->lines;
+		stop = chunk->stop;
+		++used_chunks;
+		if (chunk->stop != chunk->end) break;
+	}
+
+	// more values than the header says, parse sequentially from the start so
+	// the error points at the right line
+	if (first + count > matrix->num_values) {
+		count = 0;
+	} else {
+		thread_pool_run(copy_matrix_chunks_task, &chunks, used_chunks, 1);
+		stream = stop;
+		current_line = token.pos.line + (int)lines;
+		next_token();
+	}
+
+	for (U64 i=0; i<chunk_count; ++i) {
+		arena_release(chunks.chunks[i].arena);
+	}
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return count;
+}
+
 static SparseMatrix *parse_matrix(Arena *arena, FloatPrecision format) {
 	PROFILE_FUNCTION_BEGIN;
 	expect_keyword(keyword_matrix);
@@ -289,20 +675,35 @@ static SparseMatrix *parse_matrix(Arena *arena, FloatPrecision format) {
 
 	SparseMatrix *matrix = sparse_mat_alloc(arena, format, num_values);
 
-	// parse matrix values
+	// parse matrix values. the parallel parser takes everything it can from
+	// the buffered input, the loop below handles what it leaves (and, when
+	// streaming, refills the buffer for the next parallel pass)
+	U64 parallel_refill = ~0ull;
 	for (U64 i=0; is_token(TOKEN_INT); ++i) {
+		// at most one parallel pass per buffer, lines it stopped at are not
+		// handed to it over and over
+		if (parallel_refill != stream_refills) {
+			parallel_refill = stream_refills;
+			i += parse_matrix_parallel(arena, matrix, i);
+			if (!is_token(TOKEN_INT)) break;
+		}
+
 		if (i >= num_values) {
 			parse_error("expected %llu non-zero values in sparse matrix, but more were encountered", num_values);
 		}
 
-		matrix->rows[i] = parse_int();
-		matrix->cols[i] = parse_int();
+		F64 value;
+		if (!parse_matrix_triplet(&matrix->rows[i], &matrix->cols[i], &value)) {
+			matrix->rows[i] = parse_int();
+			matrix->cols[i] = parse_int();
+			value = parse_float();
+		}
 
 		if (format == PRECISION_F32) {
-			matrix->valuesF32[i] = (F32)parse_float();
+			matrix->valuesF32[i] = (F32)value;
 		} else {
 			assert(format == PRECISION_F64);
-			matrix->valuesF64[i] = parse_float();
+			matrix->valuesF64[i] = value;
 		}
 	}
 
@@ -336,32 +737,157 @@ static Vector *parse_vector(Arena *arena, char *keyword, FloatPrecision format)
 	return vector;
 }
 
-static ParseResult parse_input(Arena *arena, char *file_name) {
+// parses one or more sections of keyword in a row, all the same size, into
+// one vector holding them one after the other. count gets the number of
+// sections
+static Vector *parse_vectors(Arena *arena, char *keyword, FloatPrecision format, U64 *count) {
 	PROFILE_FUNCTION_BEGIN;
-	ParseResult result = {0};
+	Vector *first = parse_vector(arena, keyword, format);
+	*count = 1;
+	if (!is_token_name(keyword)) {
+		PROFILE_FUNCTION_END;
+		return first;
+	}
 
-	char *file_data;
-	U64 file_size;
-	if (!read_entire_file(arena, file_name, &file_data, &file_size)) {
-		fatal("Failed to read input file %s", file_name);
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	U64 capacity = 8;
+	Vector **sections = arena_push_n(scratch.arena, Vector*, capacity);
+	sections[0] = first;
+	while (is_token_name(keyword)) {
+		Vector *section = parse_vector(scratch.arena, keyword, format);
+		if (section->num_values != first->num_values) {
+			parse_error("%s has %llu values, expected %llu like the first one", keyword, section->num_values, first->num_values);
+		}
+		if (*count == capacity) {
+			Vector **grown = arena_push_n(scratch.arena, Vector*, capacity * 2);
+			memcpy(grown, sections, capacity * sizeof(Vector*));
+			sections = grown;
+			capacity *= 2;
+		}
+		sections[(*count)++] = section;
+	}
+
+	U64 n = first->num_values;
+	Vector *result = vec_alloc(arena, format, n * *count);
+	for (U64 i=0; i<*count; ++i) {
+		Vector slice = vec_slice(result, i * n, n);
+		vec_copy_values(&slice, sections[i]);
+	}
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return result;
+}
+
+// optional sections of keyword after the vectors of result, one for each
+// right hand side. NULL if there are none
+static Vector *parse_vector_extras(Arena *arena, ParseResult *result, char *keyword, FloatPrecision format) {
+	if (!is_token_name(keyword)) {
+		return NULL;
+	}
+	U64 count;
+	Vector *extras = parse_vectors(arena, keyword, format, &count);
+	if (count != result->num_vectors || extras->num_values != result->vector->num_values) {
+		parse_error("expected %llu %s sections of %llu values, one for each vector",
+			result->num_vectors, keyword, result->vector->num_values / result->num_vectors);
 	}
+	return extras;
+}
+
+// optionally an initial guess for each right hand side of result, the
+// solvers start from it instead of zero, and then a solution for each
+// (useful for writing tests)
+static void parse_solutions(Arena *arena, ParseResult *result, FloatPrecision format) {
+	result->initial_guess = parse_vector_extras(arena, result, keyword_initial_guess, format);
+	result->solution = parse_vector_extras(arena, result, keyword_solution, format);
+}
 
-	init_parse(file_name, file_data);
+static ParseResult parse_source(Arena *arena) {
+	PROFILE_FUNCTION_BEGIN;
+	ParseResult result = {0};
 
 	// TODO(shaw): allow any order for parameters in input file,
 	// format will always have to come before matrix and vector though
 
 	FloatPrecision format = parse_format();
 	result.solver = parse_solver();
+	MatrixStorage storage = parse_storage();
+	if (storage == STORAGE_DETECT && !detect_storage) {
+		storage = STORAGE_GENERAL;
+	}
 	result.matrix = parse_matrix(arena, format);
-	result.vector = parse_vector(arena, keyword_vector, format);
+	result.vector = parse_vectors(arena, keyword_vector, format, &result.num_vectors);
+	U64 num_rows = result.vector->num_values / result.num_vectors;
+	if (reorder_rows) {
+		sparse_mat_reorder(arena, result.matrix, num_rows);
+	}
+	if (storage == STORAGE_SYMMETRIC) {
+		sparse_mat_build_symmetric(arena, result.matrix, num_rows);
+	} else {
+		sparse_mat_build_csr(arena, result.matrix, num_rows);
+		// NOTE(shaw): several right hand sides are solved together with block
+		// products on compressed rows, which already read each matrix entry
+		// once for all of them, so detection does not pick symmetric storage
+		// for them. banded matrices still go to diagonal storage, its single
+		// vector product beats the compressed block product. wide matrices
+		// keep compressed rows too, see sparse_mat_symmetric_pays_off
+		if (storage == STORAGE_DETECT && !sparse_mat_convert_diagonal(arena, result.matrix)) {
+			if (result.num_vectors == 1 && sparse_mat_symmetric_pays_off(result.matrix)) {
+				sparse_mat_convert_symmetric(result.matrix);
+			}
+		} else if (storage == STORAGE_SLICED) {
+			sparse_mat_convert_sliced(arena, result.matrix, sliced_chunk_height, sliced_sort_window);
+		}
+	}
+	sparse_mat_compact_indices(arena, result.matrix, index_encoding);
+
+	parse_solutions(arena, &result, format);
+	PROFILE_FUNCTION_END;
+	return result;
+}
 
-	// optionally parse a solution vector (useful for writing tests)
-	if (is_token(TOKEN_NAME) && token.name == keyword_solution) {
-		result.solution = parse_vector(arena, keyword_solution, format);
+// reads the whole file into memory and parses it
+static ParseResult parse_input(Arena *arena, char *file_name) {
+	PROFILE_FUNCTION_BEGIN;
+	char *file_data;
+	U64 file_size;
+	if (!read_entire_file(arena, file_name, &file_data, &file_size)) {
+		fatal("Failed to read input file %s", file_name);
 	}
 
+	// file_size includes the NUL terminator read_entire_file appends
+	init_parse(file_name, file_data, file_data + file_size - 1, NULL);
+	ParseResult result = parse_source(arena);
+
 	PROFILE_FUNCTION_END;
 	return result;
 }
 
+// parses the size bytes at data, which must be followed by a NUL terminator.
+// name is only used in error messages
+static ParseResult parse_input_memory(Arena *arena, char *name, char *data, U64 size) {
+	PROFILE_FUNCTION_BEGIN;
+	init_parse(name, data, data + size, NULL);
+	ParseResult result = parse_source(arena);
+	PROFILE_FUNCTION_END;
+	return result;
+}
+
+// parses the file (or stdin if file_name is "-") while it is being read, in
+// buffers of buffer_size bytes. memory use does not depend on the file size
+static ParseResult parse_input_stream(Arena *arena, char *file_name, U64 buffer_size) {
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	StreamReader reader;
+	if (!stream_reader_open(scratch.arena, &reader, file_name, buffer_size)) {
+		fatal("Failed to open input file %s", file_name);
+	}
+
+	init_parse(strcmp(file_name, "-") == 0 ? "<stdin>" : file_name, "", "", &reader);
+	ParseResult result = parse_source(arena);
+
+	stream_reader_close(&reader);
+	stream_reader = NULL;
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return result;
+}
@@ -0,0 +1,328 @@
+// ---------------------------------------------------------------------------
+// Server Mode
+// ---------------------------------------------------------------------------
+// NOTE(shaw): server mode keeps loaded matrices and their preconditioners in
+// memory, so a client solving the same system for many right hand sides pays
+// for parsing, storage conversion and the incomplete Cholesky factorization
+// once instead of on every run. Clients talk to it over a unix domain socket,
+// every request is a text line, some followed by a payload of raw bytes:
+//
+//   load <size>\n<size bytes>
+//       an input file, text or binary, exactly as it would be on disk
+//       -> ok <handle> <rows> <value size>\n
+//          followed by the reply to solving the vectors of the file (from
+//          its initial guesses if it has any)
+//   solve <handle> <size> [guess]\n<size bytes>[<size bytes>]
+//       right hand sides one after the other, raw values of the precision of
+//       the matrix (value size bytes each, native byte order). with guess
+//       they are followed by an initial guess for each, e.g. the solution of
+//       the previous time step, otherwise the solvers start from zero
+//       -> ok <converged> <iterations> <residual> <size>\n<size bytes>
+//          the solutions in the same layout, iterations and residual (the
+//          final residual . residual) are the worst over all right hand sides
+//   free <handle>\n     -> ok\n
+//   shutdown\n          -> ok\n, the server stops after the reply
+//
+// A request that fails replies error <message>\n and the connection stays
+// usable, see fatal_handler. A malformed request line closes the connection,
+// the payload size it announced can no longer be trusted. Requests are served
+// one at a time on the calling thread, each solve still uses the whole thread
+// pool.
+
+#define SERVER_MAX_CONNECTIONS (OS_MAX_WAIT_SOCKETS - 1)
+#define SERVER_MAX_LINE 256
+// payloads live in a scratch arena, and a binary one in the arena of its
+// system too
+#define SERVER_MAX_PAYLOAD (ARENA_RESERVE_SIZE / 4)
+
+typedef struct {
+	Arena *arena; // the matrix, its preconditioner and a binary payload
+	PreparedSystem prepared;
+	U64 value_size;
+} ServerSystem;
+
+typedef struct {
+	OSSocket socket;
+	U64 pos;
+	U64 end;
+	U8 buffer[4096];
+} ServerConnection;
+
+typedef struct {
+	ServerSystem **systems; // handle - 1 -> system, NULL once freed
+	U64 system_count;
+	U64 system_cap;
+	bool shutdown;
+} Server;
+
+// reads size bytes, false if the connection ended first
+static bool server_read(ServerConnection *connection, void *data, U64 size) {
+	U8 *dest = data;
+	U64 buffered = MIN(size, connection->end - connection->pos);
+	memcpy(dest, connection->buffer + connection->pos, buffered);
+	connection->pos += buffered;
+	dest += buffered;
+	size -= buffered;
+	// large payloads go straight to their destination
+	while (size > 0) {
+		S64 bytes_read = os_socket_read(connection->socket, dest, size);
+		if (bytes_read <= 0) return false;
+		dest += bytes_read;
+		size -= bytes_read;
+	}
+	return true;
+}
+
+// reads a line without its newline, false if the connection ended first or
+// the line does not fit
+static bool server_read_line(ServerConnection *connection, char *line, U64 cap) {
+	for (U64 length = 0; length + 1 < cap; ++length) {
+		if (connection->pos == connection->end) {
+			S64 bytes_read = os_socket_read(connection->socket, connection->buffer, sizeof(connection->buffer));
+			if (bytes_read <= 0) return false;
+			connection->pos = 0;
+			connection->end = bytes_read;
+		}
+		char c = connection->buffer[connection->pos++];
+		if (c == '\n') {
+			line[length] = 0;
+			return true;
+		}
+		line[length] = c;
+	}
+	return false;
+}
+
+static bool server_reply(ServerConnection *connection, char *format, ...) {
+	char line[SERVER_MAX_LINE + 512];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	return os_socket_write(connection->socket, line, MIN((U64)length, sizeof(line) - 1));
+}
+
+static ServerSystem *server_system(Server *server, U64 handle) {
+	if (handle == 0 || handle > server->system_count || !server->systems[handle - 1]) {
+		fatal("unknown handle %llu", handle);
+	}
+	return server->systems[handle - 1];
+}
+
+static U64 server_add_system(Server *server, ServerSystem *system) {
+	// NOTE(shaw): handles are never reused, a client holding on to a freed
+	// handle gets an error instead of somebody else's matrix
+	if (server->system_count == server->system_cap) {
+		server->system_cap = MAX(16, 2 * server->system_cap);
+		server->systems = xrealloc(server->systems, server->system_cap * sizeof(ServerSystem*));
+	}
+	server->systems[server->system_count++] = system;
+	return server->system_count;
+}
+
+// solves the right hand sides in v and sends the solve reply
+static bool server_solve(ServerConnection *connection, ServerSystem *system, Vector *v, Vector *initial_guess) {
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	Vector *solution = vec_alloc(scratch.arena, v->precision, v->num_values);
+	bool converged = solve_prepared(&system->prepared, v, initial_guess, solution);
+	U64 size = solution->num_values * system->value_size;
+	bool sent = server_reply(connection, "ok %d %llu %.17g %llu\n", converged, solver_stats.iterations, solver_stats.residual, size) &&
+		os_socket_write(connection->socket, solution->valuesF64, size);
+	scratch_end(scratch);
+	return sent;
+}
+
+static bool server_load(Server *server, ServerConnection *connection, U64 size) {
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	// NUL terminated for the text parser, aligned for the binary loader
+	U8 *payload = arena_push(scratch.arena, size + 1, BINARY_SECTION_ALIGNMENT, false);
+	if (!server_read(connection, payload, size)) {
+		scratch_end(scratch);
+		PROFILE_FUNCTION_END;
+		return false;
+	}
+	payload[size] = 0;
+
+	Arena *arena = arena_alloc();
+	if (!arena) {
+		fatal("Failed to allocate an arena for a loaded system");
+	}
+	bool sent;
+	FatalHandler handler;
+	fatal_handler_begin(&handler);
+	if (setjmp(handler.jump) == 0) {
+		ParseResult input;
+		if (size >= sizeof(BINARY_MAGIC) - 1 && memcmp(payload, BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1) == 0) {
+			// the arrays point into the data, it has to live as long as the system
+			U8 *data = arena_push(arena, size, BINARY_SECTION_ALIGNMENT, false);
+			memcpy(data, payload, size);
+			input = load_binary_data(arena, "<load>", data, size);
+		} else {
+			input = parse_input_memory(arena, "<load>", (char*)payload, size);
+		}
+
+		ServerSystem *system = arena_push_n(arena, ServerSystem, 1);
+		system->arena = arena;
+		system->prepared = prepare_system(arena, input.solver, input.matrix);
+		system->value_size = input.matrix->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+		U64 handle = server_add_system(server, system);
+		fatal_handler = NULL;
+
+		sent = server_reply(connection, "ok %llu %llu %llu\n", handle, input.matrix->num_rows, system->value_size);
+		// the vectors of the file are solved with a handler of their own, a
+		// failure there still leaves the system loaded
+		fatal_handler = &handler;
+		if (sent) {
+			if (setjmp(handler.jump) == 0) {
+				sent = server_solve(connection, system, input.vector, input.initial_guess);
+			} else {
+				sent = server_reply(connection, "error %s\n", handler.message);
+			}
+		}
+	} else {
+		arena_release(arena);
+		sent = server_reply(connection, "error %s\n", handler.message);
+	}
+	fatal_handler = NULL;
+
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return sent;
+}
+
+static bool server_solve_request(Server *server, ServerConnection *connection, U64 handle, U64 size, bool guess) {
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	// the guesses start on a new cache line like every vector
+	U64 guess_offset = ALIGN_UP(size, BINARY_SECTION_ALIGNMENT);
+	U8 *payload = arena_push(scratch.arena, MAX(guess_offset + size, 1), BINARY_SECTION_ALIGNMENT, false);
+	if (!server_read(connection, payload, size) || (guess && !server_read(connection, payload + guess_offset, size))) {
+		scratch_end(scratch);
+		PROFILE_FUNCTION_END;
+		return false;
+	}
+
+	bool sent;
+	FatalHandler handler;
+	fatal_handler_begin(&handler);
+	if (setjmp(handler.jump) == 0) {
+		ServerSystem *system = server_system(server, handle);
+		U64 n = system->prepared.A->num_rows;
+		if (size == 0 || size % system->value_size != 0 || (size / system->value_size) % MAX(n, 1) != 0) {
+			fatal("expected a multiple of %llu values of %llu bytes, got %llu bytes", n, system->value_size, size);
+		}
+		Vector v = {
+			.precision = system->prepared.A->precision,
+			.valuesF64 = (F64*)payload,
+			.num_values = size / system->value_size,
+		};
+		Vector initial_guess = v;
+		initial_guess.valuesF64 = (F64*)(payload + guess_offset);
+		sent = server_solve(connection, system, &v, guess ? &initial_guess : NULL);
+	} else {
+		sent = server_reply(connection, "error %s\n", handler.message);
+	}
+	fatal_handler = NULL;
+
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return sent;
+}
+
+// serves one request, false once the connection should be closed
+static bool server_handle_request(Server *server, ServerConnection *connection) {
+	char line[SERVER_MAX_LINE];
+	if (!server_read_line(connection, line, sizeof(line))) {
+		return false;
+	}
+
+	char command[16] = {0};
+	char option[16] = {0};
+	U64 a = 0, b = 0;
+	int fields = sscanf(line, "%15s %llu %llu %15s", command, &a, &b, option);
+	bool load = fields == 2 && strcmp(command, "load") == 0;
+	bool solve = (fields == 3 || (fields == 4 && strcmp(option, "guess") == 0)) && strcmp(command, "solve") == 0;
+	// only load and solve are followed by a payload, of a and b bytes
+	if ((load && a > SERVER_MAX_PAYLOAD) || (solve && b > SERVER_MAX_PAYLOAD)) {
+		server_reply(connection, "error payloads are limited to %llu bytes\n", (U64)SERVER_MAX_PAYLOAD);
+		return false;
+	}
+	if (load) {
+		return server_load(server, connection, a);
+	} else if (solve) {
+		return server_solve_request(server, connection, a, b, fields == 4);
+	} else if (fields == 2 && strcmp(command, "free") == 0) {
+		if (a == 0 || a > server->system_count || !server->systems[a - 1]) {
+			return server_reply(connection, "error unknown handle %llu\n", a);
+		}
+		arena_release(server->systems[a - 1]->arena);
+		server->systems[a - 1] = NULL;
+		return server_reply(connection, "ok\n");
+	} else if (fields == 1 && strcmp(command, "shutdown") == 0) {
+		server->shutdown = true;
+		return server_reply(connection, "ok\n");
+	}
+	server_reply(connection, "error malformed request\n");
+	return false;
+}
+
+// serves requests on the unix domain socket at socket_path until a client
+// sends shutdown
+static void serve(char *socket_path) {
+	OSSocket listener = os_socket_listen(socket_path);
+	if (listener == OS_INVALID_SOCKET) {
+		fatal("Failed to listen on %s", socket_path);
+	}
+
+	Server server = {0};
+	ServerConnection *connections[SERVER_MAX_CONNECTIONS];
+	U64 connection_count = 0;
+	OSSocket sockets[OS_MAX_WAIT_SOCKETS];
+
+	while (!server.shutdown) {
+		sockets[0] = listener;
+		for (U64 i=0; i<connection_count; ++i) {
+			sockets[i + 1] = connections[i]->socket;
+		}
+		U64 ready = os_socket_wait(sockets, connection_count + 1);
+
+		if (ready == 0) {
+			OSSocket socket = os_socket_accept(listener);
+			if (socket == OS_INVALID_SOCKET) continue;
+			if (connection_count == SERVER_MAX_CONNECTIONS) {
+				os_socket_close(socket);
+				continue;
+			}
+			ServerConnection *connection = xmalloc(sizeof(ServerConnection));
+			connection->socket = socket;
+			connection->pos = connection->end = 0;
+			connections[connection_count++] = connection;
+			continue;
+		}
+
+		// requests already in the buffer are served before waiting again,
+		// the socket will not report them as readable
+		ServerConnection *connection = connections[ready - 1];
+		bool open;
+		do {
+			open = server_handle_request(&server, connection);
+		} while (open && !server.shutdown && connection->pos < connection->end);
+		if (!open) {
+			os_socket_close(connection->socket);
+			free(connection);
+			connections[ready - 1] = connections[--connection_count];
+		}
+	}
+
+	for (U64 i=0; i<connection_count; ++i) {
+		os_socket_close(connections[i]->socket);
+		free(connections[i]);
+	}
+	for (U64 i=0; i<server.system_count; ++i) {
+		if (server.systems[i]) arena_release(server.systems[i]->arena);
+	}
+	free(server.systems);
+	os_socket_close(listener);
+	remove(socket_path);
+}
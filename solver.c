@@ -14,90 +14,664 @@ static bool solve_conjugate_directions(SparseMatrix *A, Vector *b, Vector *resul
 	return false;
 }
 
+static void check_solver_arguments(char *prefix, SparseMatrix *A, Vector *b, Vector *result) {
+	PROFILE_FUNCTION_BEGIN;
+	check_sparse_mat_mul_vec_arguments(prefix, result, A, b);
+	PROFILE_FUNCTION_END;
+}
+
+// all of the vectors used by conjugate gradients besides the solution and
+// right hand side, and the scratch space of the products with A, allocated
+// once per solve
+typedef struct {
+	Vector *residual;
+	Vector *search_dir;
+	Vector *q;
+	Vector *preconditioned; // only used by the preconditioned solvers
+	Vector *overflow;       // see sparse_overflow_alloc
+	F64 *column_sums;       // see block_sums_alloc
+} CGWorkspace;
+
+// vec_size is a multiple of the rows of A, one column per right hand side
+static CGWorkspace cg_workspace_alloc(Arena *arena, SparseMatrix *A, FloatPrecision precision, U64 vec_size) {
+	PROFILE_FUNCTION_BEGIN;
+	CGWorkspace ws = {0};
+	ws.residual = vec_alloc(arena, precision, vec_size);
+	ws.search_dir = vec_alloc(arena, precision, vec_size);
+	ws.q = vec_alloc(arena, precision, vec_size);
+	ws.overflow = sparse_overflow_alloc(arena, A);
+	ws.column_sums = block_sums_alloc(arena, A->num_rows, vec_size / A->num_rows);
+	PROFILE_FUNCTION_END;
+	return ws;
+}
+
+// how the last solve on this thread went, over all of its right hand sides
+typedef struct {
+	U64 iterations; // the most any right hand side took
+	F64 residual;   // the largest final residual . residual
+} SolverStats;
+
+static THREAD_LOCAL SolverStats solver_stats;
+
+// called by every solver when it finishes a right hand side
+static void record_solver_stats(U64 iterations, F64 delta) {
+	solver_stats.iterations = MAX(solver_stats.iterations, iterations);
+	solver_stats.residual = MAX(solver_stats.residual, delta);
+#ifdef DIAGNOSTICS
+	printf("Solver Diagnostics:\n");
+	printf("\t%llu iterations\n", iterations);
+	printf("\t%s kernels\n", simd_level_names[kernel_simd_level]);
+	if (delta <= TOLERANCE) {
+		printf("\tconverged\n");
+	} else {
+		printf("\tdid not converge\n");
+	}
+#endif
+}
+
 // see: https://www.cs.cmu.edu/~quake-papers/painless-conjugate-gradient.pdf
-// page 50 for algorithm reference
+// page 50 for algorithm reference. iterates until residual . residual is at
+// most tolerance or after max_iterations, returns the final residual .
+// residual and the iterations taken. the arguments are not checked, see
+// solve_conjugate_gradients
+static F64 conjugate_gradients(SparseMatrix *A, Vector *b, Vector *result, F64 tolerance, U64 max_iterations, U64 *iterations) {
+	PROFILE_FUNCTION_BEGIN;
+	LinearAlgebraKernels *k = get_kernels(result->precision);
+	U64 n = b->num_values;
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	CGWorkspace ws = cg_workspace_alloc(scratch.arena, A, result->precision, n);
+
+	// residual = b - A * result, result holds the initial guess
+	F64 delta = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = A, .result = ws.residual, .a = result, .b = b, .overflow = ws.overflow }, n);
+	vec_copy_values(ws.search_dir, ws.residual);
+
+	U64 i;
+	for (i = 0; i < max_iterations && delta > tolerance; ++i) {
+		// q = A * search_dir
+		F64 step_amount = delta / run_sparse_kernel(k, SPARSE_OP_MUL_VEC_DOT, &(KernelArgs){ .A = A, .result = ws.q, .a = ws.search_dir, .overflow = ws.overflow }, n);
+
+		// result = result + step_amount * search_dir
+		run_kernel(k->vec_axpy, &(KernelArgs){ .result = result, .a = ws.search_dir, .scalar = step_amount }, n);
+
+		F64 delta_old = delta;
+		if (((i+1) % ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE) == 0) {
+			// residual = b - A * result
+			delta = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = A, .result = ws.residual, .a = result, .b = b, .overflow = ws.overflow }, n);
+		} else {
+			// residual = residual - step_amount * q
+			delta = run_kernel(k->vec_axpy_dot, &(KernelArgs){ .result = ws.residual, .a = ws.q, .scalar = -step_amount }, n);
+		}
+		F64 beta = delta / delta_old;
+
+		// search_dir = residual + beta * search_dir
+		run_kernel(k->vec_xpay, &(KernelArgs){ .result = ws.search_dir, .a = ws.residual, .scalar = beta }, n);
+	}
+
+	scratch_end(scratch);
+	*iterations = i;
+	PROFILE_FUNCTION_END;
+	return delta;
+}
+
+// conjugate gradients in the precision of A. the iteration starts from the
+// initial guess in result, like every solver below, see solve_prepared
 //
 // result and b must be distinct vectors
 static bool solve_conjugate_gradients(SparseMatrix *A, Vector *b, Vector *result) {
 	PROFILE_FUNCTION_BEGIN;
-	FloatPrecision precision = result->precision;
-	U64 vec_size = b->num_values;
+	check_solver_arguments("solve_conjugate_gradients", A, b, result);
+
+	// NOTE(shaw): arguments are validated once here, conjugate_gradients
+	// calls straight into the kernels specialized for this precision
+	U64 iterations;
+	F64 delta = conjugate_gradients(A, b, result, TOLERANCE, MAX_ITERATIONS, &iterations);
+	record_solver_stats(iterations, delta);
+
+	PROFILE_FUNCTION_END;
+	return delta <= TOLERANCE;
+}
+
+// NOTE(shaw): pipelined conjugate gradients (Ghysels and Vanroose, "Hiding
+// global synchronization latency in the preconditioned Conjugate Gradient
+// algorithm"). plain conjugate gradients needs search_dir . q before it can
+// update the residual and residual . residual before the next search
+// direction, each a reduction over every thread followed by another pass.
+// the pipelined form carries w = A * r, s = A * p and z = A * s along as
+// extra recurrences, so both dot products of an iteration come out of the
+// same pass that updates the vectors and the product q = A * w needs none.
+// an iteration is two runs on the thread pool, the product and
+// pipelined_cg_update, where plain conjugate gradients takes four. the price
+// is three more vectors to stream and recurrences that drift further from
+// the true residual, so r, w, s and z are recomputed from x and p every
+// ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE iterations and once more before
+// stopping, the solver only stops on a true residual below TOLERANCE
+
+// residual replacement, recomputes the recurrences of cg from x and p.
+// sums gets r . r and w . r, overflow is from sparse_overflow_alloc
+static void pipelined_replace_residual(LinearAlgebraKernels *k, SparseMatrix *A, Vector *b, PipelinedCG *cg, Vector *overflow, F64 sums[2]) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 n = b->num_values;
+	// r = b - A * x, w = A * r
+	sums[0] = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = A, .result = cg->r, .a = cg->x, .b = b, .overflow = overflow }, n);
+	sums[1] = run_sparse_kernel(k, SPARSE_OP_MUL_VEC_DOT, &(KernelArgs){ .A = A, .result = cg->w, .a = cg->r, .overflow = overflow }, n);
+	// s = A * p, z = A * s
+	run_sparse_kernel(k, SPARSE_OP_MUL_VEC, &(KernelArgs){ .A = A, .result = cg->s, .a = cg->p, .overflow = overflow }, n);
+	run_sparse_kernel(k, SPARSE_OP_MUL_VEC, &(KernelArgs){ .A = A, .result = cg->z, .a = cg->s, .overflow = overflow }, n);
+	PROFILE_FUNCTION_END;
+}
+
+// see the note above, same results as solve_conjugate_gradients up to
+// rounding
+//
+// result and b must be distinct vectors
+static bool solve_pipelined_conjugate_gradients(SparseMatrix *A, Vector *b, Vector *result) {
+	PROFILE_FUNCTION_BEGIN;
+	check_solver_arguments("solve_pipelined_conjugate_gradients", A, b, result);
+	LinearAlgebraKernels *k = get_kernels(result->precision);
+	U64 n = b->num_values;
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	PipelinedCG cg = {
+		.x = result,
+		.r = vec_alloc(scratch.arena, result->precision, n),
+		.w = vec_alloc(scratch.arena, result->precision, n),
+		.p = vec_alloc(scratch.arena, result->precision, n),
+		.s = vec_alloc(scratch.arena, result->precision, n),
+		.z = vec_alloc(scratch.arena, result->precision, n),
+		.q = vec_alloc(scratch.arena, result->precision, n),
+	};
+	Vector *overflow = sparse_overflow_alloc(scratch.arena, A);
+	F64 *column_sums = block_sums_alloc(scratch.arena, n, 2);
+
+	// residual = b - A * result, result holds the initial guess. p, s and z
+	// start at zero
+	F64 sums[2]; // gamma = r . r, delta = w . r
+	sums[0] = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = A, .result = cg.r, .a = result, .b = b, .overflow = overflow }, n);
+	sums[1] = run_sparse_kernel(k, SPARSE_OP_MUL_VEC_DOT, &(KernelArgs){ .A = A, .result = cg.w, .a = cg.r, .overflow = overflow }, n);
+
+	U64 i = 0;
+	U64 replaced = 0; // the iteration r was last computed from x at
+	F64 gamma_old = 0;
+	for (;;) {
+		if (sums[0] <= TOLERANCE) {
+			if (replaced == i) break;
+			pipelined_replace_residual(k, A, b, &cg, overflow, sums);
+			replaced = i;
+			continue;
+		}
+		if (i == MAX_ITERATIONS) break;
+		if (i % ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE == 0 && replaced != i) {
+			pipelined_replace_residual(k, A, b, &cg, overflow, sums);
+			replaced = i;
+		}
+
+		F64 gamma = sums[0];
+		F64 delta = sums[1];
+		cg.beta = i > 0 ? gamma / gamma_old : 0;
+		F64 denominator = delta - cg.beta * gamma / cg.alpha;
+		if (i == 0 || denominator <= 0) {
+			// a restart, p = r
+			cg.beta = 0;
+			denominator = delta;
+		}
+		cg.alpha = gamma / denominator;
+
+		// q = A * w
+		run_sparse_kernel(k, SPARSE_OP_MUL_VEC, &(KernelArgs){ .A = A, .result = cg.q, .a = cg.w, .overflow = overflow }, n);
+
+		run_block_kernel(k->pipelined_cg_update, &(KernelArgs){ .pipelined = &cg, .columns = 2, .column_sums = column_sums }, n, sums);
+		gamma_old = gamma;
+		++i;
+	}
+
+	scratch_end(scratch);
+	record_solver_stats(i, sums[0]);
+
+	PROFILE_FUNCTION_END;
+	return sums[0] <= TOLERANCE;
+}
+
+// NOTE(shaw): mixed precision iterative refinement. single precision
+// conjugate gradients cannot get residual . residual below TOLERANCE for
+// right hand sides of any size, its rounding error grows with the norm of b.
+// here the solution and residual stay in double precision and each
+// refinement only solves A * correction = residual in single precision, with
+// the residual scaled to norm 1 so the inner solve works at the same
+// relative accuracy whatever the outer residual is. every refinement shrinks
+// the double precision residual by about MIXED_INNER_TOLERANCE^(1/2), and
+// nearly all of the passes over A read the single precision values, half the
+// bytes of the double precision ones.
+//
+// the inner iterations of all refinements count against MAX_ITERATIONS and
+// are what solver_stats reports. refinement stops early when it no longer
+// reduces the residual, A is then too ill conditioned for single precision
+#define MIXED_MAX_REFINEMENTS 20
+#define MIXED_INNER_TOLERANCE 0.000001
+
+// A32 is the single precision copy of A from sparse_mat_narrow
+//
+// result and b must be distinct vectors
+static bool solve_mixed_precision_conjugate_gradients(SparseMatrix *A, SparseMatrix *A32, Vector *b, Vector *result) {
+	PROFILE_FUNCTION_BEGIN;
+	check_solver_arguments("solve_mixed_precision_conjugate_gradients", A, b, result);
+	if (A->precision != PRECISION_F64 || A32->precision != PRECISION_F32 || A32->num_rows != A->num_rows ||
+	    A32->num_values != A->num_values || A32->layout != A->layout) {
+		fatal("solve_mixed_precision_conjugate_gradients: the single precision matrix does not match the matrix");
+	}
+	LinearAlgebraKernels *k = get_kernels(PRECISION_F64);
+	U64 n = b->num_values;
 
 	ArenaTemp scratch = scratch_begin(NULL, 0);
+	Vector *residual = vec_alloc(scratch.arena, PRECISION_F64, n);
+	Vector *residual32 = vec_alloc(scratch.arena, PRECISION_F32, n);
+	Vector *correction32 = vec_alloc(scratch.arena, PRECISION_F32, n);
+	Vector *overflow = sparse_overflow_alloc(scratch.arena, A);
 
-	// initial guess for solution, start at zero
-	vec_zero(result);
+	// residual = b - A * result, result holds the initial guess
+	F64 delta = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = A, .result = residual, .a = result, .b = b, .overflow = overflow }, n);
 
-	Vector *residual = vec_alloc(scratch.arena, precision, vec_size);
-	sparse_mat_mul_vec(residual, A, result);
-	vec_sub(residual, b, residual);
+	U64 iterations = 0;
+	for (U64 i = 0; i < MIXED_MAX_REFINEMENTS && iterations < MAX_ITERATIONS && delta > TOLERANCE; ++i) {
+		// residual32 = residual / |residual|
+		F64 norm = sqrt(delta);
+		run_kernel(vec_narrow_scaled, &(KernelArgs){ .result = residual32, .a = residual, .scalar = 1.0 / norm }, n);
 
-	Vector *search_dir = vec_copy(scratch.arena, residual);
-	F64 delta = vec_dot(residual, residual);
+		// A32 * correction32 = residual32
+		U64 inner_iterations;
+		vec_zero(correction32);
+		conjugate_gradients(A32, residual32, correction32, MIXED_INNER_TOLERANCE, MAX_ITERATIONS - iterations, &inner_iterations);
+		iterations += inner_iterations;
 
-	U64 pos = arena_pos(scratch.arena);
+		// result = result + |residual| * correction32
+		run_kernel(vec_widen_axpy, &(KernelArgs){ .result = result, .a = correction32, .scalar = norm }, n);
+
+		// residual = b - A * result
+		F64 delta_old = delta;
+		delta = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = A, .result = residual, .a = result, .b = b, .overflow = overflow }, n);
+		if (delta >= delta_old) break;
+	}
+
+	scratch_end(scratch);
+	record_solver_stats(iterations, delta);
+
+	PROFILE_FUNCTION_END;
+	return delta <= TOLERANCE;
+}
+
+// applies M^-1 for the preconditioned solvers, apply has the contract
+// result = M^-1 * a, sum = a . result, and reads the rest of its inputs from
+// args
+typedef struct {
+	KernelFunc *apply;
+	KernelArgs args;
+	bool sequential; // apply can not be split into ranges
+} Preconditioner;
+
+static F64 apply_preconditioner(Preconditioner *m, Vector *result, Vector *v) {
+	KernelArgs args = m->args;
+	args.result = result;
+	args.a = v;
+	if (m->sequential) {
+		KernelRange range = { .start = 0, .end = v->num_values };
+		m->apply(&args, &range);
+		return range.sum;
+	}
+	return run_kernel(m->apply, &args, v->num_values);
+}
+
+// see: https://www.cs.cmu.edu/~quake-papers/painless-conjugate-gradient.pdf
+// page 51 for algorithm reference. convergence is still tested on
+// residual . residual so the tolerance means the same thing as for plain
+// conjugate gradients
+//
+// result and b must be distinct vectors
+static bool preconditioned_conjugate_gradients(SparseMatrix *A, Preconditioner *M, Vector *b, Vector *result) {
+	PROFILE_FUNCTION_BEGIN;
+	LinearAlgebraKernels *k = get_kernels(result->precision);
+	U64 n = b->num_values;
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	CGWorkspace ws = cg_workspace_alloc(scratch.arena, A, result->precision, n);
+	ws.preconditioned = vec_alloc(scratch.arena, result->precision, n);
+
+	// residual = b - A * result, result holds the initial guess
+	F64 delta = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = A, .result = ws.residual, .a = result, .b = b, .overflow = ws.overflow }, n);
+
+	// search_dir = M^-1 * residual, rho = residual . search_dir
+	F64 rho = apply_preconditioner(M, ws.search_dir, ws.residual);
 
 	U64 i;
 	for (i = 0; i < MAX_ITERATIONS && delta > TOLERANCE; ++i) {
-		Vector *q = vec_alloc(scratch.arena, precision, vec_size);
-		sparse_mat_mul_vec(q, A, search_dir);
-
-		F64 step_amount = delta / (vec_dot(search_dir, q));
+		// q = A * search_dir
+		F64 step_amount = rho / run_sparse_kernel(k, SPARSE_OP_MUL_VEC_DOT, &(KernelArgs){ .A = A, .result = ws.q, .a = ws.search_dir, .overflow = ws.overflow }, n);
 
-		Vector *tmp = vec_alloc(scratch.arena, precision, vec_size);
-		
-		vec_scale(tmp, search_dir, step_amount);
-		vec_add(result, result, tmp);
+		// result = result + step_amount * search_dir
+		run_kernel(k->vec_axpy, &(KernelArgs){ .result = result, .a = ws.search_dir, .scalar = step_amount }, n);
 
 		if (((i+1) % ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE) == 0) {
-			sparse_mat_mul_vec(tmp, A, result);
-			vec_sub(residual, b, tmp);
+			// residual = b - A * result
+			delta = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = A, .result = ws.residual, .a = result, .b = b, .overflow = ws.overflow }, n);
 		} else {
-			vec_scale(tmp, q, step_amount);
-			vec_sub(residual, residual, tmp);
+			// residual = residual - step_amount * q
+			delta = run_kernel(k->vec_axpy_dot, &(KernelArgs){ .result = ws.residual, .a = ws.q, .scalar = -step_amount }, n);
 		}
 
-		F64 delta_old = delta;
-		delta = vec_dot(residual, residual);
-		F64 beta = delta / delta_old;
+		// preconditioned = M^-1 * residual, rho = residual . preconditioned
+		F64 rho_old = rho;
+		rho = apply_preconditioner(M, ws.preconditioned, ws.residual);
+		F64 beta = rho / rho_old;
 
-		vec_scale(tmp, search_dir, beta);
-		vec_add(search_dir, residual, tmp);
-
-		arena_pop_to(scratch.arena, pos);
+		// search_dir = preconditioned + beta * search_dir
+		run_kernel(k->vec_xpay, &(KernelArgs){ .result = ws.search_dir, .a = ws.preconditioned, .scalar = beta }, n);
 	}
 
 	scratch_end(scratch);
+	record_solver_stats(i, delta);
 
-#ifdef DIAGNOSTICS
-	printf("Solver Diagnostics:\n");
-	printf("\t%llu iterations\n", i);
-	if (delta <= TOLERANCE) {
-		printf("\tconverged\n");
-	} else {
-		printf("did not converge\n");
+	PROFILE_FUNCTION_END;
+	return delta <= TOLERANCE;
+}
+
+// conjugate gradients with the inverse of the diagonal of A as the
+// preconditioner (Jacobi), inverse_diagonal is from
+// sparse_mat_inverse_diagonal
+//
+// result and b must be distinct vectors
+static bool solve_preconditioned_conjugate_gradients(SparseMatrix *A, Vector *inverse_diagonal, Vector *b, Vector *result) {
+	PROFILE_FUNCTION_BEGIN;
+	check_solver_arguments("solve_preconditioned_conjugate_gradients", A, b, result);
+	if (inverse_diagonal->precision != A->precision || inverse_diagonal->num_values != A->num_rows) {
+		fatal("solve_preconditioned_conjugate_gradients: diagonal does not match the matrix");
 	}
-#endif
+
+	Preconditioner M = {
+		.apply = get_kernels(result->precision)->vec_mul_dot,
+		.args = { .b = inverse_diagonal },
+	};
+	bool success = preconditioned_conjugate_gradients(A, &M, b, result);
 
 	PROFILE_FUNCTION_END;
-	return delta <= TOLERANCE;
+	return success;
 }
 
-// executes the solver specified by kind and places the solution into result 
+// conjugate gradients preconditioned with an incomplete Cholesky factor L of
+// A from sparse_mat_incomplete_cholesky, the factor can be reused for every
+// right hand side of A
+//
 // result and b must be distinct vectors
-static bool solve(SolverKind kind, SparseMatrix *A, Vector *v, Vector *result) {
+static bool solve_incomplete_cholesky_conjugate_gradients(SparseMatrix *A, SparseMatrix *L, Vector *b, Vector *result) {
+	PROFILE_FUNCTION_BEGIN;
+	check_solver_arguments("solve_incomplete_cholesky_conjugate_gradients", A, b, result);
+	if (L->precision != A->precision || L->num_rows != A->num_rows || !L->row_offsets) {
+		fatal("solve_incomplete_cholesky_conjugate_gradients: factor does not match the matrix");
+	}
+
+	Preconditioner M = {
+		.apply = get_kernels(result->precision)->sparse_cholesky_solve_dot,
+		.args = { .A = L },
+		.sequential = true,
+	};
+	bool success = preconditioned_conjugate_gradients(A, &M, b, result);
+
+	PROFILE_FUNCTION_END;
+	return success;
+}
+
+// NOTE(shaw): conjugate gradients for several right hand sides at once. each
+// column runs its own recurrence, but the columns share every pass over the
+// vectors and, more importantly, every product with A, which loads each
+// matrix entry once for all of them. this is not block CG in the sense of
+// O'Leary (search directions mixing across columns), that needs small dense
+// factorizations per iteration and breaks down when columns become
+// dependent. a column that has converged gets zero steps and stops moving
+// while the others finish
+//
+// b and result hold `columns` interleaved vectors, see KernelArgs. A must
+// have block kernels, see sparse_block_kernel
+static bool solve_block_conjugate_gradients(SparseMatrix *A, Vector *b, Vector *result, U64 columns) {
+	PROFILE_FUNCTION_BEGIN;
+	LinearAlgebraKernels *k = get_kernels(result->precision);
+	KernelFunc *mul_vec_dot = sparse_block_kernel(k, A, SPARSE_OP_MUL_VEC_DOT);
+	KernelFunc *residual_dot = sparse_block_kernel(k, A, SPARSE_OP_RESIDUAL_DOT);
+	assert(mul_vec_dot && residual_dot && columns <= BLOCK_MAX_COLUMNS);
+	U64 n = A->num_rows;
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	CGWorkspace ws = cg_workspace_alloc(scratch.arena, A, result->precision, n * columns);
+
+	F64 delta[BLOCK_MAX_COLUMNS];
+	F64 delta_old[BLOCK_MAX_COLUMNS];
+	F64 step_amount[BLOCK_MAX_COLUMNS];
+	F64 beta[BLOCK_MAX_COLUMNS];
+	F64 q_dot[BLOCK_MAX_COLUMNS];
+
+	// residual = b - A * result, result holds the initial guess
+	run_block_kernel(residual_dot, &(KernelArgs){ .A = A, .result = ws.residual, .a = result, .b = b, .columns = columns, .column_sums = ws.column_sums }, n, delta);
+	vec_copy_values(ws.search_dir, ws.residual);
+
+	U64 i;
+	F64 max_delta = 0;
+	for (i = 0; i < MAX_ITERATIONS; ++i) {
+		max_delta = 0;
+		for (U64 j=0; j<columns; ++j) {
+			max_delta = MAX(max_delta, delta[j]);
+		}
+		if (max_delta <= TOLERANCE) break;
+
+		// q = A * search_dir
+		run_block_kernel(mul_vec_dot, &(KernelArgs){ .A = A, .result = ws.q, .a = ws.search_dir, .columns = columns, .column_sums = ws.column_sums }, n, q_dot);
+		for (U64 j=0; j<columns; ++j) {
+			step_amount[j] = delta[j] > TOLERANCE ? delta[j] / q_dot[j] : 0;
+		}
+
+		// result = result + step_amount * search_dir
+		run_block_kernel(k->block_axpy, &(KernelArgs){ .result = result, .a = ws.search_dir, .scalars = step_amount, .columns = columns, .column_sums = ws.column_sums }, n, NULL);
+
+		memcpy(delta_old, delta, columns * sizeof(F64));
+		if (((i+1) % ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE) == 0) {
+			// residual = b - A * result
+			run_block_kernel(residual_dot, &(KernelArgs){ .A = A, .result = ws.residual, .a = result, .b = b, .columns = columns, .column_sums = ws.column_sums }, n, delta);
+		} else {
+			// residual = residual - step_amount * q
+			for (U64 j=0; j<columns; ++j) {
+				step_amount[j] = -step_amount[j];
+			}
+			run_block_kernel(k->block_axpy_dot, &(KernelArgs){ .result = ws.residual, .a = ws.q, .scalars = step_amount, .columns = columns, .column_sums = ws.column_sums }, n, delta);
+		}
+
+		// a column that was already converged restarts from its residual if
+		// the recomputed residual pushed it back over the tolerance
+		for (U64 j=0; j<columns; ++j) {
+			beta[j] = delta_old[j] > TOLERANCE ? delta[j] / delta_old[j] : 0;
+		}
+
+		// search_dir = residual + beta * search_dir
+		run_block_kernel(k->block_xpay, &(KernelArgs){ .result = ws.search_dir, .a = ws.residual, .scalars = beta, .columns = columns, .column_sums = ws.column_sums }, n, NULL);
+	}
+
+	scratch_end(scratch);
+	record_solver_stats(i, max_delta);
+
+	PROFILE_FUNCTION_END;
+	return max_delta <= TOLERANCE;
+}
+
+// solves for every column of b with conjugate gradients, in blocks of up to
+// BLOCK_MAX_COLUMNS columns. b and result hold the columns one after the
+// other
+static bool solve_conjugate_gradients_columns(SparseMatrix *A, Vector *b, Vector *result, U64 columns) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 n = A->num_rows;
+	bool success = true;
+	for (U64 first=0; first<columns; first += BLOCK_MAX_COLUMNS) {
+		U64 count = MIN(BLOCK_MAX_COLUMNS, columns - first);
+		ArenaTemp scratch = scratch_begin(NULL, 0);
+		Vector *block_b = vec_alloc(scratch.arena, b->precision, n * count);
+		Vector *block_result = vec_alloc(scratch.arena, b->precision, n * count);
+		Vector slice_b = vec_slice(b, first * n, count * n);
+		Vector slice_result = vec_slice(result, first * n, count * n);
+		vec_transpose(block_b, &slice_b, count, n);
+		vec_transpose(block_result, &slice_result, count, n);
+		success &= solve_block_conjugate_gradients(A, block_b, block_result, count);
+		vec_transpose(&slice_result, block_result, n, count);
+		scratch_end(scratch);
+	}
+	PROFILE_FUNCTION_END;
+	return success;
+}
+
+// NOTE(shaw): everything a solver derives from the matrix alone, computed
+// once and reused for every right hand side. solve prepares a system for the
+// columns of one call, the server keeps them for every request on a loaded
+// matrix
+typedef struct {
+	SolverKind kind;
+	SparseMatrix *A;
+	SparseMatrix *L;          // incomplete Cholesky factor
+	Vector *inverse_diagonal; // Jacobi preconditioner
+	SparseMatrix *A32;        // single precision copy for mixed precision
+} PreparedSystem;
+
+// the preconditioner lives in arena. kind can change, a failed incomplete
+// Cholesky factorization falls back to Jacobi and mixed precision on a
+// single precision matrix to plain conjugate gradients
+static PreparedSystem prepare_system(Arena *arena, SolverKind kind, SparseMatrix *A) {
+	PROFILE_FUNCTION_BEGIN;
+	PreparedSystem system = { .kind = kind, .A = A };
+	if (kind == SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS) {
+		F64 shift;
+		system.L = sparse_mat_incomplete_cholesky(arena, A, &shift);
+		if (system.L) {
+#ifdef DIAGNOSTICS
+			printf("incomplete Cholesky diagonal shift: %g\n", shift);
+#endif
+		} else {
+			// NOTE(shaw): a non-positive diagonal rules out any Cholesky
+			// factor, Jacobi is the next best thing that still runs
+			fprintf(stderr, "warning: incomplete Cholesky factorization failed, falling back to the Jacobi preconditioner\n");
+			system.kind = SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS;
+		}
+	}
+	if (system.kind == SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS) {
+		system.inverse_diagonal = sparse_mat_inverse_diagonal(arena, A);
+	}
+	if (kind == SOLVER_MIXED_PRECISION_CONJUGATE_GRADIENTS) {
+		if (A->precision == PRECISION_F64) {
+			system.A32 = sparse_mat_narrow(arena, A);
+		} else {
+			fprintf(stderr, "warning: mixed precision needs a double precision matrix, falling back to conjugate gradients\n");
+			system.kind = SOLVER_CONJUGATE_GRADIENTS;
+		}
+	}
+	PROFILE_FUNCTION_END;
+	return system;
+}
+
+// solves for the columns right hand sides of v, result holds the guesses
+static bool solve_columns(PreparedSystem *system, Vector *v, Vector *result, U64 columns) {
 	PROFILE_FUNCTION_BEGIN;
-	bool success = false;
-	switch (kind) {
-		case SOLVER_STEEPEST_DESCENT:     success = solve_steepest_descent(A, v, result);     break;
-		case SOLVER_CONJUGATE_DIRECTIONS: success = solve_conjugate_directions(A, v, result); break;
-		case SOLVER_CONJUGATE_GRADIENTS:  success = solve_conjugate_gradients(A, v, result);  break;
-		default:
-			fatal("solve: unknown solver kind (enum value = %d)", kind);
-			break;
+	SparseMatrix *A = system->A;
+	U64 n = A->num_rows;
+	if (system->kind == SOLVER_CONJUGATE_GRADIENTS && columns > 1 &&
+	    sparse_block_kernel(get_kernels(A->precision), A, SPARSE_OP_MUL_VEC_DOT)) {
+		bool success = solve_conjugate_gradients_columns(A, v, result, columns);
+		PROFILE_FUNCTION_END;
+		return success;
+	}
+
+	bool success = true;
+	for (U64 j=0; j<columns; ++j) {
+		Vector column_v = vec_slice(v, j * n, n);
+		Vector column_result = vec_slice(result, j * n, n);
+		switch (system->kind) {
+			case SOLVER_STEEPEST_DESCENT:     success &= solve_steepest_descent(A, &column_v, &column_result);     break;
+			case SOLVER_CONJUGATE_DIRECTIONS: success &= solve_conjugate_directions(A, &column_v, &column_result); break;
+			case SOLVER_CONJUGATE_GRADIENTS:  success &= solve_conjugate_gradients(A, &column_v, &column_result);  break;
+			case SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS:
+				success &= solve_preconditioned_conjugate_gradients(A, system->inverse_diagonal, &column_v, &column_result);
+				break;
+			case SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS:
+				success &= solve_incomplete_cholesky_conjugate_gradients(A, system->L, &column_v, &column_result);
+				break;
+			case SOLVER_MIXED_PRECISION_CONJUGATE_GRADIENTS:
+				success &= solve_mixed_precision_conjugate_gradients(A, system->A32, &column_v, &column_result);
+				break;
+			case SOLVER_PIPELINED_CONJUGATE_GRADIENTS:
+				success &= solve_pipelined_conjugate_gradients(A, &column_v, &column_result);
+				break;
+			default:
+				fatal("solve: unknown solver kind (enum value = %d)", system->kind);
+				break;
+		}
 	}
 	PROFILE_FUNCTION_END;
 	return success;
 }
 
+// places the solution for v into result, see solve. the solvers start from
+// initial_guess, which holds a guess for every right hand side of v like
+// result does, or from zero if it is NULL. solver_stats afterwards covers
+// every right hand side of v
+//
+// result and v must be distinct vectors, initial_guess may be result
+static bool solve_prepared(PreparedSystem *system, Vector *v, Vector *initial_guess, Vector *result) {
+	PROFILE_FUNCTION_BEGIN;
+	SparseMatrix *A = system->A;
+	U64 n = A->num_rows;
+	if (result->num_values != v->num_values || (n > 0 && v->num_values % n != 0) || (n == 0 && v->num_values != 0)) {
+		fatal("solve: vector sizes do not match the %llux%llu matrix", n, n);
+	}
+	if (result == v) {
+		fatal("solve: result and v must be distinct vectors");
+	}
+	U64 columns = n > 0 ? v->num_values / n : 1;
+	Vector first_v = vec_slice(v, 0, n);
+	Vector first_result = vec_slice(result, 0, n);
+	check_solver_arguments("solve", A, &first_v, &first_result);
+	solver_stats = (SolverStats){0};
 
+	if (!initial_guess) {
+		vec_zero(result);
+	} else if (initial_guess != result) {
+		if (initial_guess->precision != result->precision || initial_guess->num_values != result->num_values) {
+			fatal("solve: the initial guess does not match the right hand sides");
+		}
+		vec_copy_values(result, initial_guess);
+	}
+
+	bool success;
+	if (A->permutation) {
+		// v and result are numbered like the input, A like its reordering
+		ArenaTemp scratch = scratch_begin(NULL, 0);
+		Vector *permuted_v = vec_alloc(scratch.arena, v->precision, v->num_values);
+		Vector *permuted_result = vec_alloc(scratch.arena, result->precision, result->num_values);
+		vec_permute_rows(permuted_v, v, A->permutation, n, false);
+		vec_permute_rows(permuted_result, result, A->permutation, n, false);
+		success = solve_columns(system, permuted_v, permuted_result, columns);
+		vec_permute_rows(result, permuted_result, A->permutation, n, true);
+		scratch_end(scratch);
+	} else {
+		success = solve_columns(system, v, result, columns);
+	}
+	PROFILE_FUNCTION_END;
+	return success;
+}
+
+// executes the solver specified by kind and places the solution into result.
+// v can hold several right hand sides one after the other, each as long as A
+// has rows, result gets a solution for each of them. conjugate gradients
+// solves them together when the layout of A has block kernels, everything
+// else solves them one at a time. the solvers start from zero, prepare_system
+// and solve_prepared take an initial guess
+//
+// result and b must be distinct vectors
+static bool solve(SolverKind kind, SparseMatrix *A, Vector *v, Vector *result) {
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	PreparedSystem system = prepare_system(scratch.arena, kind, A);
+	bool success = solve_prepared(&system, v, NULL, result);
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return success;
+}
@@ -1,3 +1,21 @@
+// how the values of a SparseMatrix are laid out, see the fields below
+typedef enum {
+	SPARSE_LAYOUT_CSR,
+	SPARSE_LAYOUT_SYMMETRIC,
+	SPARSE_LAYOUT_DIAGONAL,
+	SPARSE_LAYOUT_SLICED,
+	SPARSE_LAYOUT_COUNT,
+} SparseLayout;
+
+// how the column indices of a SparseMatrix are stored, see
+// sparse_mat_compact_indices
+typedef enum {
+	SPARSE_INDEX_U64,   // cols
+	SPARSE_INDEX_U32,   // cols32
+	SPARSE_INDEX_DELTA, // col_bytes, compressed rows only
+	SPARSE_INDEX_COUNT,
+} SparseIndexEncoding;
+
 typedef struct {
 	FloatPrecision precision;
 	union {
@@ -7,6 +25,58 @@ typedef struct {
 	U64 *cols;
 	U64 *rows;
 	U64 num_values;
+	SparseLayout layout;
+
+	// compressed sparse row layout, filled in by sparse_mat_build_csr. the
+	// entries of row r are [row_offsets[r], row_offsets[r+1]) in cols/values.
+	// rows is only needed to build it and is NULL for matrices loaded from
+	// binary files or converted to another layout
+	U64 num_rows;
+	U64 *row_offsets;
+
+	// SPARSE_LAYOUT_SYMMETRIC is compressed rows holding only the upper
+	// triangle and the diagonal (col >= row for every entry), each
+	// off-diagonal entry stands for itself and its mirror. bandwidth is the
+	// largest col - row of the stored entries, the symmetric kernels size
+	// their scatter windows by it
+	U64 bandwidth;
+
+	// SPARSE_LAYOUT_DIAGONAL stores whole diagonals instead of entries,
+	// cols and row_offsets are NULL. diagonal d holds the entries
+	// (row, row + diagonal_offsets[d]) at values[d * num_rows + row], slots
+	// whose column falls outside the matrix are zero and never read.
+	// num_values is num_diagonals * num_rows
+	U64 num_diagonals;
+	S64 *diagonal_offsets; // ascending
+
+	// SPARSE_LAYOUT_SLICED is SELL-C-sigma: the rows are sorted by length
+	// within windows of sort_window rows, then cut into chunks of
+	// chunk_height rows. slot s of the sorted order is row chunk_rows[s] and
+	// row r sits in slot row_slots[r]. every row of a chunk is padded to the
+	// longest one and the chunk is stored column major, entry j of slot
+	// c * chunk_height + i is at chunk_offsets[c] + j * chunk_height + i in
+	// cols/values. padding has value 0 and points at column 0.
+	// row_offsets is NULL and num_values counts the padding
+	U64 chunk_height;
+	U64 num_chunks;
+	U64 *chunk_offsets; // num_chunks + 1
+	U64 *chunk_rows;    // num_chunks * chunk_height, past num_rows is padding
+	U64 *row_slots;
+
+	// row i of a matrix reordered by sparse_mat_reorder is row permutation[i]
+	// of the input, and so is column i. NULL if the rows are numbered as in
+	// the input. solve_prepared moves the vectors between the two numberings
+	U64 *permutation;
+
+	// the column indices are built in cols, sparse_mat_compact_indices may
+	// then move them to a smaller encoding and set cols to NULL. cols32
+	// holds them in 32 bits, in the same places as cols. with
+	// SPARSE_INDEX_DELTA the columns of row r are varints starting at
+	// col_bytes[col_byte_offsets[r]], see sparse_delta_next
+	SparseIndexEncoding index_encoding;
+	U32 *cols32;
+	U8 *col_bytes;
+	U64 *col_byte_offsets; // num_rows + 1
 } SparseMatrix;
 
 typedef struct {
@@ -18,21 +88,25 @@ typedef struct {
 	U64 num_values; 
 } Vector;
 
-static void vec_print(Vector *v) {
+static void vec_fprint(FILE *f, Vector *v) {
 	PROFILE_FUNCTION_BEGIN;
-	printf("{ ");
+	fprintf(f, "{ ");
 	for (U64 i=0; i<v->num_values; ++i) {
 		if (v->precision == PRECISION_F32) {
-			printf("%g ", v->valuesF32[i]);
+			fprintf(f, "%g ", v->valuesF32[i]);
 		} else {
 			assert(v->precision == PRECISION_F64);
-			printf("%g ", v->valuesF64[i]);
+			fprintf(f, "%g ", v->valuesF64[i]);
 		}
 	}
-	printf("}\n");
+	fprintf(f, "}\n");
 	PROFILE_FUNCTION_END;
 }
 
+static void vec_print(Vector *v) {
+	vec_fprint(stdout, v);
+}
+
 static Vector *vec_alloc(Arena *arena, FloatPrecision precision, U64 num_values) {
 	PROFILE_FUNCTION_BEGIN;
 	Vector *v = arena_push_n(arena, Vector, 1);
@@ -49,6 +123,21 @@ static Vector *vec_alloc(Arena *arena, FloatPrecision precision, U64 num_values)
 	return v;
 }
 
+// like vec_alloc, for vectors that are written before they are read
+static Vector *vec_alloc_no_zero(Arena *arena, FloatPrecision precision, U64 num_values) {
+	Vector *v = arena_push_n(arena, Vector, 1);
+	v->precision = precision;
+	v->num_values = num_values;
+
+	if (precision == PRECISION_F32) {
+		v->valuesF32 = arena_push_n_no_zero(arena, F32, num_values);
+	} else {
+		assert(precision == PRECISION_F64);
+		v->valuesF64 = arena_push_n_no_zero(arena, F64, num_values);
+	}
+	return v;
+}
+
 static Vector *vec_copy(Arena *arena, Vector *v) {
 	PROFILE_FUNCTION_BEGIN;
 	Vector *result = vec_alloc(arena, v->precision, v->num_values);
@@ -62,6 +151,19 @@ static Vector *vec_copy(Arena *arena, Vector *v) {
 	return result;
 }
 
+// dst and src must have the same size and precision
+static void vec_copy_values(Vector *dst, Vector *src) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(dst->precision == src->precision && dst->num_values == src->num_values);
+	if (src->precision == PRECISION_F32) {
+		memcpy(dst->valuesF32, src->valuesF32, src->num_values * sizeof(*src->valuesF32));
+	} else {
+		assert(src->precision == PRECISION_F64);
+		memcpy(dst->valuesF64, src->valuesF64, src->num_values * sizeof(*src->valuesF64));
+	}
+	PROFILE_FUNCTION_END;
+}
+
 static void vec_zero(Vector *v) {
 	PROFILE_FUNCTION_BEGIN;
 	if (v->precision == PRECISION_F32) {
@@ -73,6 +175,65 @@ static void vec_zero(Vector *v) {
 	PROFILE_FUNCTION_END;
 }
 
+// a view of count values of v starting at start, shares the values of v
+static Vector vec_slice(Vector *v, U64 start, U64 count) {
+	assert(start + count <= v->num_values);
+	Vector result = *v;
+	result.num_values = count;
+	if (v->precision == PRECISION_F32) {
+		result.valuesF32 = v->valuesF32 + start;
+	} else {
+		assert(v->precision == PRECISION_F64);
+		result.valuesF64 = v->valuesF64 + start;
+	}
+	return result;
+}
+
+// src holds rows x columns values row by row, dst gets them column by column.
+// converts between columns stored one after the other and the interleaved
+// columns of the block kernels
+static void vec_transpose(Vector *dst, Vector *src, U64 rows, U64 columns) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(dst->precision == src->precision && dst->num_values == rows * columns && src->num_values == rows * columns);
+	if (src->precision == PRECISION_F32) {
+		for (U64 r=0; r<rows; ++r) {
+			for (U64 c=0; c<columns; ++c) {
+				dst->valuesF32[c * rows + r] = src->valuesF32[r * columns + c];
+			}
+		}
+	} else {
+		assert(src->precision == PRECISION_F64);
+		for (U64 r=0; r<rows; ++r) {
+			for (U64 c=0; c<columns; ++c) {
+				dst->valuesF64[c * rows + r] = src->valuesF64[r * columns + c];
+			}
+		}
+	}
+	PROFILE_FUNCTION_END;
+}
+
+// dst and src hold columns of rows values one after the other, row i of every
+// column of dst gets row permutation[i] of the same column of src. with
+// inverse set row permutation[i] of dst gets row i of src instead, which
+// undoes the permutation. see SparseMatrix.permutation
+static void vec_permute_rows(Vector *dst, Vector *src, U64 *permutation, U64 rows, bool inverse) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(dst != src && dst->precision == src->precision && dst->num_values == src->num_values);
+	for (U64 start=0; start<src->num_values; start += rows) {
+		for (U64 i=0; i<rows; ++i) {
+			U64 to = start + (inverse ? permutation[i] : i);
+			U64 from = start + (inverse ? i : permutation[i]);
+			if (src->precision == PRECISION_F32) {
+				dst->valuesF32[to] = src->valuesF32[from];
+			} else {
+				assert(src->precision == PRECISION_F64);
+				dst->valuesF64[to] = src->valuesF64[from];
+			}
+		}
+	}
+	PROFILE_FUNCTION_END;
+}
+
 static void vec_set(Vector *v, U64 index, F64 value) {
 	PROFILE_FUNCTION_BEGIN;
 	if (index >= v->num_values) {
@@ -100,137 +261,1566 @@ static void check_vector_arguments(char *prefix, Vector *result, Vector *a, Vect
 	PROFILE_FUNCTION_END;
 }
 
-static void vec_add(Vector *result, Vector *a, Vector *b) {
+static SparseMatrix *sparse_mat_alloc(Arena *arena, FloatPrecision precision, U64 num_values) {
 	PROFILE_FUNCTION_BEGIN;
-	check_vector_arguments("vec_add", result, a, b);
-	for (U64 i=0; i < a->num_values; ++i) {
-		if (a->precision == PRECISION_F32) {
-			result->valuesF32[i] = a->valuesF32[i] + b->valuesF32[i];
+	SparseMatrix *m = arena_push_n(arena, SparseMatrix, 1);
+	m->precision = precision;
+	m->num_values = num_values;
+	m->cols = arena_push_n(arena, U64, num_values);
+	m->rows = arena_push_n(arena, U64, num_values);
+
+	if (precision == PRECISION_F32) {
+		m->valuesF32 = arena_push_n(arena, F32, num_values);
+	} else {
+		assert(precision == PRECISION_F64);
+		m->valuesF64 = arena_push_n(arena, F64, num_values);
+	}
+
+	PROFILE_FUNCTION_END;
+	return m;
+}
+
+// sorts the coordinate triplets of m by row and builds the row_offsets for
+// compressed sparse row access. this should be called once after all values
+// have been written into the matrix, num_rows is the dimension of the system
+static void sparse_mat_build_csr(Arena *arena, SparseMatrix *m, U64 num_rows) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 *row_offsets = arena_push_n(arena, U64, num_rows + 1);
+
+	bool sorted = true;
+	for (U64 i=0; i<m->num_values; ++i) {
+		U64 row = m->rows[i];
+		if (row >= num_rows || m->cols[i] >= num_rows) {
+			fatal("sparse_mat_build_csr: entry (%llu, %llu) is outside of the %llux%llu matrix",
+				row, m->cols[i], num_rows, num_rows);
+		}
+		if (i > 0 && row < m->rows[i-1]) {
+			sorted = false;
+		}
+		++row_offsets[row + 1];
+	}
+
+	for (U64 row=0; row<num_rows; ++row) {
+		row_offsets[row + 1] += row_offsets[row];
+	}
+
+	// NOTE(shaw): entries are counting sorted into scratch memory and then
+	// copied back, so the matrix keeps owning the same arrays
+	if (!sorted) {
+		ArenaTemp scratch = scratch_begin(&arena, 1);
+		U64 value_size = m->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+		U64 *cursors = arena_push_n_no_zero(scratch.arena, U64, num_rows);
+		U64 *cols = arena_push_n_no_zero(scratch.arena, U64, m->num_values);
+		U8 *values = arena_push_n_no_zero(scratch.arena, U8, m->num_values * value_size);
+		memcpy(cursors, row_offsets, num_rows * sizeof(U64));
+
+		for (U64 i=0; i<m->num_values; ++i) {
+			U64 dst = cursors[m->rows[i]]++;
+			cols[dst] = m->cols[i];
+			if (m->precision == PRECISION_F32) {
+				((F32*)values)[dst] = m->valuesF32[i];
+			} else {
+				assert(m->precision == PRECISION_F64);
+				((F64*)values)[dst] = m->valuesF64[i];
+			}
+		}
+
+		memcpy(m->cols, cols, m->num_values * sizeof(U64));
+		memcpy(m->precision == PRECISION_F32 ? (void*)m->valuesF32 : (void*)m->valuesF64, values, m->num_values * value_size);
+		for (U64 row=0; row<num_rows; ++row) {
+			for (U64 i=row_offsets[row]; i<row_offsets[row+1]; ++i) {
+				m->rows[i] = row;
+			}
+		}
+
+		scratch_end(scratch);
+	}
+
+	m->num_rows = num_rows;
+	m->row_offsets = row_offsets;
+	PROFILE_FUNCTION_END;
+}
+
+// one entry of a matrix row while it is being rearranged
+typedef struct {
+	U64 col;
+	F64 value;
+} SparseEntry;
+
+static int sparse_entry_compare(const void *a, const void *b) {
+	U64 col_a = ((SparseEntry*)a)->col;
+	U64 col_b = ((SparseEntry*)b)->col;
+	return col_a < col_b ? -1 : col_a > col_b;
+}
+
+// sorts the entries of a row by column and sums duplicates, returns the
+// number of entries left
+static U64 sparse_row_sort_merge(SparseEntry *entries, U64 count) {
+	if (count < 32) {
+		for (U64 i=1; i<count; ++i) {
+			SparseEntry e = entries[i];
+			U64 j = i;
+			for (; j > 0 && entries[j-1].col > e.col; --j) {
+				entries[j] = entries[j-1];
+			}
+			entries[j] = e;
+		}
+	} else {
+		qsort(entries, count, sizeof(SparseEntry), sparse_entry_compare);
+	}
+
+	U64 merged = 0;
+	for (U64 i=0; i<count; ++i) {
+		if (merged > 0 && entries[merged-1].col == entries[i].col) {
+			entries[merged-1].value += entries[i].value;
 		} else {
-			assert(a->precision == PRECISION_F64);
-			result->valuesF64[i] = a->valuesF64[i] + b->valuesF64[i];
+			entries[merged++] = entries[i];
+		}
+	}
+	return merged;
+}
+
+// column of entry i of m, for indices stored in cols or cols32
+static U64 sparse_mat_col(SparseMatrix *m, U64 i) {
+	assert(m->index_encoding != SPARSE_INDEX_DELTA);
+	return m->index_encoding == SPARSE_INDEX_U32 ? m->cols32[i] : m->cols[i];
+}
+
+// the column after col in a delta encoded row, *p moves past its bytes. a
+// column is stored as the zigzag encoded difference to the one before it
+// (the row itself for the first) in little endian base 128, seven bits per
+// byte with the top bit set on all but the last byte
+static inline U64 sparse_delta_next(U8 **p, U64 col) {
+	U8 *bytes = *p;
+	U64 value = *bytes++;
+	if (value >= 0x80) {
+		value &= 0x7f;
+		U64 shift = 7;
+		for (; *bytes >= 0x80; ++bytes, shift += 7) {
+			value |= (U64)(*bytes & 0x7f) << shift;
+		}
+		value |= (U64)*bytes++ << shift;
+	}
+	*p = bytes;
+	return col + ((value >> 1) ^ (0 - (value & 1)));
+}
+
+static F64 sparse_mat_value(SparseMatrix *m, U64 i) {
+	return m->precision == PRECISION_F32 ? (F64)m->valuesF32[i] : m->valuesF64[i];
+}
+
+// the most entries sparse_mat_row_entries can return for one row of m
+static U64 sparse_mat_max_row_entries(SparseMatrix *m) {
+	if (m->layout == SPARSE_LAYOUT_DIAGONAL) {
+		return m->num_diagonals;
+	}
+	U64 result = 0;
+	if (m->layout == SPARSE_LAYOUT_SLICED) {
+		for (U64 c=0; c<m->num_chunks; ++c) {
+			result = MAX(result, (m->chunk_offsets[c+1] - m->chunk_offsets[c]) / m->chunk_height);
+		}
+		return result;
+	}
+	for (U64 row=0; row<m->num_rows; ++row) {
+		result = MAX(result, m->row_offsets[row+1] - m->row_offsets[row]);
+	}
+	return result;
+}
+
+// copies the stored entries of a row of m into entries and returns how many
+// there are, in any layout. for symmetric storage that is only the upper
+// triangle, diagonal and sliced storage skip their zero slots. slow, for
+// setup code only
+static U64 sparse_mat_row_entries(SparseMatrix *m, U64 row, SparseEntry *entries) {
+	U64 count = 0;
+	if (m->layout == SPARSE_LAYOUT_DIAGONAL) {
+		for (U64 d=0; d<m->num_diagonals; ++d) {
+			U64 col = row + (U64)m->diagonal_offsets[d];
+			F64 value = sparse_mat_value(m, d * m->num_rows + row);
+			if (col < m->num_rows && value != 0) {
+				entries[count++] = (SparseEntry){ col, value };
+			}
+		}
+	} else if (m->layout == SPARSE_LAYOUT_SLICED) {
+		U64 slot = m->row_slots[row];
+		U64 c = slot / m->chunk_height;
+		for (U64 i=m->chunk_offsets[c] + slot % m->chunk_height; i<m->chunk_offsets[c+1]; i += m->chunk_height) {
+			F64 value = sparse_mat_value(m, i);
+			if (value != 0) {
+				entries[count++] = (SparseEntry){ sparse_mat_col(m, i), value };
+			}
 		}
+	} else if (m->index_encoding == SPARSE_INDEX_DELTA) {
+		U8 *bytes = m->col_bytes + m->col_byte_offsets[row];
+		U64 col = row;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			col = sparse_delta_next(&bytes, col);
+			entries[count++] = (SparseEntry){ col, sparse_mat_value(m, i) };
+		}
+	} else {
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			entries[count++] = (SparseEntry){ sparse_mat_col(m, i), sparse_mat_value(m, i) };
+		}
+	}
+	return count;
+}
+
+// replaces the compressed rows of m with the rows in entries, row r is
+// entries[bounds[r], bounds[r] + counts[r]). the new rows must not hold more
+// entries than m already has, they are written into the same arrays
+static void sparse_mat_replace_rows(SparseMatrix *m, SparseEntry *entries, U64 *bounds, U64 *counts) {
+	U64 offset = 0;
+	for (U64 row=0; row<m->num_rows; ++row) {
+		m->row_offsets[row] = offset;
+		for (U64 i=0; i<counts[row]; ++i, ++offset) {
+			SparseEntry e = entries[bounds[row] + i];
+			m->cols[offset] = e.col;
+			if (m->precision == PRECISION_F32) {
+				m->valuesF32[offset] = (F32)e.value;
+			} else {
+				assert(m->precision == PRECISION_F64);
+				m->valuesF64[offset] = e.value;
+			}
+		}
+	}
+	assert(offset <= m->num_values);
+	m->row_offsets[m->num_rows] = offset;
+	m->num_values = offset;
+	m->rows = NULL;
+}
+
+static void sparse_mat_compute_bandwidth(SparseMatrix *m) {
+	U64 bandwidth = 0;
+	for (U64 row=0; row<m->num_rows; ++row) {
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			U64 col = sparse_mat_col(m, i);
+			assert(col >= row);
+			bandwidth = MAX(bandwidth, col - row);
+		}
+	}
+	m->bandwidth = bandwidth;
+}
+
+// NOTE(shaw): CG only works on symmetric matrices, yet both triangles are
+// stored and streamed through every product. converting to half storage cuts
+// the matrix bytes per iteration roughly in half. matrices are only
+// converted when they are exactly symmetric, values are compared bit for bit
+// after duplicates are summed, anything else keeps the general storage.
+//
+// checks whether m (in compressed rows) is symmetric and converts it to
+// symmetric storage if it is. returns false and leaves m untouched if not
+static bool sparse_mat_convert_symmetric(SparseMatrix *m) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(m->layout == SPARSE_LAYOUT_CSR);
+	U64 n = m->num_rows;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+
+	// upper holds the entries with col >= row by row, lower the entries
+	// with col < row transposed, so row r of both should match for every
+	// column but the diagonal
+	U64 *upper_bounds = arena_push_n(scratch.arena, U64, n + 1);
+	U64 *lower_bounds = arena_push_n(scratch.arena, U64, n + 1);
+	for (U64 row=0; row<n; ++row) {
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			U64 col = m->cols[i];
+			if (col >= row) {
+				++upper_bounds[row + 1];
+			} else {
+				++lower_bounds[col + 1];
+			}
+		}
+	}
+	for (U64 row=0; row<n; ++row) {
+		upper_bounds[row + 1] += upper_bounds[row];
+		lower_bounds[row + 1] += lower_bounds[row];
 	}
+
+	SparseEntry *upper = arena_push_n_no_zero(scratch.arena, SparseEntry, upper_bounds[n]);
+	SparseEntry *lower = arena_push_n_no_zero(scratch.arena, SparseEntry, lower_bounds[n]);
+	U64 *upper_counts = arena_push_n(scratch.arena, U64, n);
+	U64 *lower_counts = arena_push_n(scratch.arena, U64, n);
+	for (U64 row=0; row<n; ++row) {
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			U64 col = m->cols[i];
+			if (col >= row) {
+				upper[upper_bounds[row] + upper_counts[row]++] = (SparseEntry){ col, sparse_mat_value(m, i) };
+			} else {
+				lower[lower_bounds[col] + lower_counts[col]++] = (SparseEntry){ row, sparse_mat_value(m, i) };
+			}
+		}
+	}
+
+	bool symmetric = true;
+	for (U64 row=0; row<n && symmetric; ++row) {
+		SparseEntry *u = upper + upper_bounds[row];
+		SparseEntry *l = lower + lower_bounds[row];
+		upper_counts[row] = sparse_row_sort_merge(u, upper_counts[row]);
+		lower_counts[row] = sparse_row_sort_merge(l, lower_counts[row]);
+
+		// skip the diagonal, it is the first upper entry when there is one
+		U64 diagonal = upper_counts[row] > 0 && u[0].col == row;
+		if (upper_counts[row] - diagonal != lower_counts[row]) {
+			symmetric = false;
+			break;
+		}
+		for (U64 i=0; i<lower_counts[row]; ++i) {
+			if (u[diagonal + i].col != l[i].col || u[diagonal + i].value != l[i].value) {
+				symmetric = false;
+				break;
+			}
+		}
+	}
+
+	if (symmetric) {
+		sparse_mat_replace_rows(m, upper, upper_bounds, upper_counts);
+		m->layout = SPARSE_LAYOUT_SYMMETRIC;
+		sparse_mat_compute_bandwidth(m);
+	}
+
+	scratch_end(scratch);
 	PROFILE_FUNCTION_END;
+	return symmetric;
 }
 
-static void vec_sub(Vector *result, Vector *a, Vector *b) {
+// builds symmetric storage for a matrix that lists each pair of mirrored
+// entries once, in either triangle. entries below the diagonal are moved to
+// their mirror above it, then this is the same as sparse_mat_build_csr
+static void sparse_mat_build_symmetric(Arena *arena, SparseMatrix *m, U64 num_rows) {
 	PROFILE_FUNCTION_BEGIN;
-	check_vector_arguments("vec_sub", result, a, b);
-	for (U64 i=0; i < a->num_values; ++i) {
-		if (a->precision == PRECISION_F32) {
-			result->valuesF32[i] = a->valuesF32[i] - b->valuesF32[i];
-		} else {
-			assert(a->precision == PRECISION_F64);
-			result->valuesF64[i] = a->valuesF64[i] - b->valuesF64[i];
+	for (U64 i=0; i<m->num_values; ++i) {
+		if (m->cols[i] < m->rows[i]) {
+			U64 col = m->cols[i];
+			m->cols[i] = m->rows[i];
+			m->rows[i] = col;
 		}
 	}
+	sparse_mat_build_csr(arena, m, num_rows);
+	m->rows = NULL;
+	m->layout = SPARSE_LAYOUT_SYMMETRIC;
+	sparse_mat_compute_bandwidth(m);
 	PROFILE_FUNCTION_END;
 }
 
-static F64 vec_dot(Vector *a, Vector *b) {
+// NOTE(shaw): a product reads v at the columns of each row, so how often
+// those reads hit the cache depends on how the input numbered its rows, and
+// some inputs are numbered at random. reverse Cuthill-McKee renumbers the
+// rows (and the columns the same way) so the entries gather around the
+// diagonal: a breadth first search numbers the rows level by level, starting
+// from a row at the far end of the graph of A + A^T and taking the neighbours
+// of a row in order of increasing degree, and the order is reversed at the
+// end. the rows of one level then only reach into the levels next to it,
+// which bounds the bandwidth by about twice the widest level
+typedef struct {
+	U64 num_nodes;
+	U64 *offsets;   // num_nodes + 1
+	U64 *neighbors; // of node i at [offsets[i], offsets[i+1]), by degree
+} RcmGraph;
+
+typedef struct {
+	U64 degree;
+	U64 node;
+} RcmNode;
+
+static int compare_rcm_nodes(const void *a, const void *b) {
+	RcmNode *node_a = (RcmNode*)a;
+	RcmNode *node_b = (RcmNode*)b;
+	if (node_a->degree != node_b->degree) return node_a->degree < node_b->degree ? -1 : 1;
+	return node_a->node < node_b->node ? -1 : node_a->node > node_b->node;
+}
+
+// rows this short are sorted without the overhead of qsort
+#define RCM_INSERTION_SORT_MAX 32
+
+// the graph of the off-diagonal entries of m and their mirrors, m must still
+// have its coordinate triplets. every neighbour is listed once, however many
+// times the entry and its mirror appear
+static RcmGraph rcm_graph(Arena *arena, SparseMatrix *m, U64 num_rows) {
 	PROFILE_FUNCTION_BEGIN;
-	if (a->precision != b->precision) {
-		fatal("vec_dot: vector arguments have different float precision");
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	U64 *raw_offsets = arena_push_n(scratch.arena, U64, num_rows + 1);
+	for (U64 i=0; i<m->num_values; ++i) {
+		if (m->rows[i] != m->cols[i]) {
+			++raw_offsets[m->rows[i] + 1];
+			++raw_offsets[m->cols[i] + 1];
+		}
 	}
-	if (a->num_values != b->num_values) {
-		fatal("vec_dot: vector arguments have different sizes: a=%llu, b=%llu",
-			a->num_values, b->num_values);
+	for (U64 node=0; node<num_rows; ++node) {
+		raw_offsets[node + 1] += raw_offsets[node];
+	}
+	U64 *cursors = arena_push_n_no_zero(scratch.arena, U64, num_rows);
+	memcpy(cursors, raw_offsets, num_rows * sizeof(U64));
+	U64 *raw = arena_push_n_no_zero(scratch.arena, U64, raw_offsets[num_rows]);
+	for (U64 i=0; i<m->num_values; ++i) {
+		if (m->rows[i] != m->cols[i]) {
+			raw[cursors[m->rows[i]]++] = m->cols[i];
+			raw[cursors[m->cols[i]]++] = m->rows[i];
+		}
 	}
 
-	F64 result = 0;
-	for (U64 i=0; i < a->num_values; ++i) {
-		if (a->precision == PRECISION_F32) {
-			result += (F64)a->valuesF32[i] * (F64)b->valuesF32[i];
+	// drop the repeats of every list in place, last_seen[neighbor] is the
+	// last node that listed it. the degrees the order is built from count
+	// each neighbour once
+	RcmGraph graph = { .num_nodes = num_rows };
+	graph.offsets = arena_push_n(arena, U64, num_rows + 1);
+	U64 *last_seen = cursors;
+	for (U64 node=0; node<num_rows; ++node) {
+		last_seen[node] = UINT64_MAX;
+	}
+	for (U64 node=0; node<num_rows; ++node) {
+		U64 *list = raw + raw_offsets[node];
+		U64 unique = 0;
+		for (U64 i=0; i<raw_offsets[node + 1] - raw_offsets[node]; ++i) {
+			if (last_seen[list[i]] != node) {
+				last_seen[list[i]] = node;
+				list[unique++] = list[i];
+			}
+		}
+		graph.offsets[node + 1] = graph.offsets[node] + unique;
+	}
+	graph.neighbors = arena_push_n_no_zero(arena, U64, graph.offsets[num_rows]);
+	for (U64 node=0; node<num_rows; ++node) {
+		memcpy(graph.neighbors + graph.offsets[node], raw + raw_offsets[node], (graph.offsets[node + 1] - graph.offsets[node]) * sizeof(U64));
+	}
+
+	// sorting the neighbours once up front lets every search below visit
+	// them in Cuthill-McKee order. a node has at most num_rows - 1 of them
+	RcmNode *sorted = arena_push_n_no_zero(scratch.arena, RcmNode, num_rows ? num_rows : 1);
+	for (U64 node=0; node<num_rows; ++node) {
+		U64 *neighbors = graph.neighbors + graph.offsets[node];
+		U64 count = graph.offsets[node + 1] - graph.offsets[node];
+		for (U64 i=0; i<count; ++i) {
+			U64 neighbor = neighbors[i];
+			sorted[i] = (RcmNode){ graph.offsets[neighbor + 1] - graph.offsets[neighbor], neighbor };
+		}
+		if (count > RCM_INSERTION_SORT_MAX) {
+			qsort(sorted, count, sizeof(RcmNode), compare_rcm_nodes);
 		} else {
-			assert(a->precision == PRECISION_F64);
-			result += a->valuesF64[i] * b->valuesF64[i];
+			for (U64 i=1; i<count; ++i) {
+				RcmNode key = sorted[i];
+				U64 j = i;
+				for (; j > 0 && compare_rcm_nodes(&sorted[j-1], &key) > 0; --j) {
+					sorted[j] = sorted[j-1];
+				}
+				sorted[j] = key;
+			}
 		}
+		for (U64 i=0; i<count; ++i) {
+			neighbors[i] = sorted[i].node;
+		}
+	}
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return graph;
+}
+
+#define RCM_UNREACHED UINT64_MAX
+
+// breadth first search from start over the nodes whose level is still
+// RCM_UNREACHED. writes the nodes it reaches to queue in the order it reaches
+// them and sets their levels, returns how many there are
+static U64 rcm_search(RcmGraph *graph, U64 start, U64 *queue, U64 *level) {
+	U64 count = 1;
+	queue[0] = start;
+	level[start] = 0;
+	for (U64 head=0; head<count; ++head) {
+		U64 node = queue[head];
+		for (U64 i=graph->offsets[node]; i<graph->offsets[node+1]; ++i) {
+			U64 neighbor = graph->neighbors[i];
+			if (level[neighbor] == RCM_UNREACHED) {
+				level[neighbor] = level[node] + 1;
+				queue[count++] = neighbor;
+			}
+		}
+	}
+	return count;
+}
+
+// the reverse Cuthill-McKee order of the rows of m, see the NOTE above.
+// m must still have its coordinate triplets
+static U64 *sparse_mat_rcm_permutation(Arena *arena, SparseMatrix *m, U64 num_rows) {
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	RcmGraph graph = rcm_graph(scratch.arena, m, num_rows);
+	U64 *order = arena_push_n_no_zero(scratch.arena, U64, num_rows);
+	U64 *level = arena_push_n_no_zero(scratch.arena, U64, num_rows);
+	for (U64 node=0; node<num_rows; ++node) {
+		level[node] = RCM_UNREACHED;
+	}
+
+	U64 placed = 0;
+	for (U64 first=0; first<num_rows; ++first) {
+		if (level[first] != RCM_UNREACHED) continue;
+
+		// a pseudo-peripheral start (George and Liu): move to the node of
+		// lowest degree in the deepest level of the search for as long as
+		// that makes the search deeper
+		U64 *queue = order + placed;
+		U64 start = first;
+		U64 count = rcm_search(&graph, start, queue, level);
+		for (;;) {
+			U64 depth = level[queue[count - 1]];
+			U64 next = queue[count - 1];
+			for (U64 i=count; i-- > 0 && level[queue[i]] == depth;) {
+				U64 degree = graph.offsets[queue[i] + 1] - graph.offsets[queue[i]];
+				if (degree <= graph.offsets[next + 1] - graph.offsets[next]) next = queue[i];
+			}
+			for (U64 i=0; i<count; ++i) {
+				level[queue[i]] = RCM_UNREACHED;
+			}
+			count = rcm_search(&graph, next, queue, level);
+			if (next == start || level[queue[count - 1]] <= depth) break;
+			start = next;
+		}
+		placed += count;
 	}
+	assert(placed == num_rows);
 
+	U64 *permutation = arena_push_n_no_zero(arena, U64, num_rows);
+	for (U64 i=0; i<num_rows; ++i) {
+		permutation[i] = order[num_rows - 1 - i];
+	}
+	scratch_end(scratch);
 	PROFILE_FUNCTION_END;
-	return result;
+	return permutation;
 }
 
-static void vec_scale(Vector *result, Vector *v, F64 scalar) {
+// the largest distance of an entry of m from the diagonal, from the
+// coordinate triplets
+static U64 sparse_mat_triplet_bandwidth(SparseMatrix *m) {
+	U64 bandwidth = 0;
+	for (U64 i=0; i<m->num_values; ++i) {
+		U64 row = m->rows[i];
+		U64 col = m->cols[i];
+		bandwidth = MAX(bandwidth, row > col ? row - col : col - row);
+	}
+	return bandwidth;
+}
+
+// renumbers the rows and columns of m in reverse Cuthill-McKee order and
+// records the order in m->permutation. works on the coordinate triplets, so
+// it goes between writing the values and building the storage layout
+static void sparse_mat_reorder(Arena *arena, SparseMatrix *m, U64 num_rows) {
 	PROFILE_FUNCTION_BEGIN;
-	if (result->precision != v->precision) {
-		fatal("vec_scale: vector arguments have different float precision");
+	for (U64 i=0; i<m->num_values; ++i) {
+		if (m->rows[i] >= num_rows || m->cols[i] >= num_rows) {
+			fatal("sparse_mat_reorder: entry (%llu, %llu) is outside of the %llux%llu matrix",
+				m->rows[i], m->cols[i], num_rows, num_rows);
+		}
 	}
-	if (result->num_values != v->num_values) {
-		fatal("vec_scale: vector arguments have different sizes: result=%llu, v=%llu",
-			result->num_values, v->num_values);
+#ifdef DIAGNOSTICS
+	U64 bandwidth_before = sparse_mat_triplet_bandwidth(m);
+#endif
+
+	U64 *permutation = sparse_mat_rcm_permutation(arena, m, num_rows);
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	U64 *new_index = arena_push_n_no_zero(scratch.arena, U64, num_rows);
+	for (U64 i=0; i<num_rows; ++i) {
+		new_index[permutation[i]] = i;
+	}
+	for (U64 i=0; i<m->num_values; ++i) {
+		m->rows[i] = new_index[m->rows[i]];
+		m->cols[i] = new_index[m->cols[i]];
 	}
+	scratch_end(scratch);
+	m->permutation = permutation;
 
-	for (U64 i=0; i < v->num_values; ++i) {
-		if (v->precision == PRECISION_F32) {
-			result->valuesF32[i] = v->valuesF32[i] * (F32)scalar;
-		} else {
-			assert(v->precision == PRECISION_F64);
-			result->valuesF64[i] = v->valuesF64[i] * scalar;
+#ifdef DIAGNOSTICS
+	printf("reordering: bandwidth %llu -> %llu\n", bandwidth_before, sparse_mat_triplet_bandwidth(m));
+#endif
+	PROFILE_FUNCTION_END;
+}
+
+// NOTE(shaw): banded matrices like the ones generate_tests.py writes are a
+// handful of constant offset diagonals. storing the diagonals as dense
+// columns drops the 8 byte column index of every value and turns the product
+// into unit stride streams. the padding at the ends of the off-center
+// diagonals is stored too, so the layout is only picked when there are few
+// diagonals and they are mostly full
+#define DIAGONAL_MAX_DIAGONALS 64
+#define DIAGONAL_MAX_FILL 1.5 // stored slots per value of the matrix
+
+// converts m from compressed rows to diagonal storage if it fits, see the
+// NOTE above. returns false and leaves m untouched if not
+static bool sparse_mat_convert_diagonal(Arena *arena, SparseMatrix *m) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(m->layout == SPARSE_LAYOUT_CSR);
+	U64 n = m->num_rows;
+
+	S64 offsets[DIAGONAL_MAX_DIAGONALS];
+	U64 num_diagonals = 0;
+	bool fits = n > 0;
+	for (U64 row=0; row<n && fits; ++row) {
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			S64 offset = (S64)m->cols[i] - (S64)row;
+			U64 d = 0;
+			while (d < num_diagonals && offsets[d] != offset) ++d;
+			if (d == num_diagonals) {
+				if (num_diagonals == DIAGONAL_MAX_DIAGONALS || (F64)((num_diagonals + 1) * n) > DIAGONAL_MAX_FILL * (F64)m->num_values) {
+					fits = false;
+					break;
+				}
+				offsets[num_diagonals++] = offset;
+			}
 		}
 	}
+
+	if (fits) {
+		// ascending offsets, few enough for an insertion sort
+		for (U64 i=1; i<num_diagonals; ++i) {
+			S64 offset = offsets[i];
+			U64 j = i;
+			for (; j > 0 && offsets[j-1] > offset; --j) {
+				offsets[j] = offsets[j-1];
+			}
+			offsets[j] = offset;
+		}
+
+		m->diagonal_offsets = arena_push_n(arena, S64, num_diagonals);
+		memcpy(m->diagonal_offsets, offsets, num_diagonals * sizeof(S64));
+		U64 num_values = num_diagonals * n;
+		void *values = m->precision == PRECISION_F32 ? (void*)arena_push_n(arena, F32, num_values) : (void*)arena_push_n(arena, F64, num_values);
+		for (U64 row=0; row<n; ++row) {
+			for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+				S64 offset = (S64)m->cols[i] - (S64)row;
+				U64 d = 0;
+				while (offsets[d] != offset) ++d;
+				// duplicates are summed, like the kernels do
+				if (m->precision == PRECISION_F32) {
+					((F32*)values)[d * n + row] += m->valuesF32[i];
+				} else {
+					assert(m->precision == PRECISION_F64);
+					((F64*)values)[d * n + row] += m->valuesF64[i];
+				}
+			}
+		}
+
+		m->layout = SPARSE_LAYOUT_DIAGONAL;
+		m->num_diagonals = num_diagonals;
+		m->num_values = num_values;
+		m->valuesF64 = values;
+		m->cols = NULL;
+		m->rows = NULL;
+		m->row_offsets = NULL;
+	}
+
 	PROFILE_FUNCTION_END;
+	return fits;
 }
 
-static SparseMatrix *sparse_mat_alloc(Arena *arena, FloatPrecision precision, U64 num_values) {
+// NOTE(shaw): rows of 3 to 13 entries leave most lanes of a wide register
+// idle when the product works on one row at a time. sliced storage lets a
+// register hold one entry from each of chunk_height rows instead, so the
+// product runs the rows of a chunk in lockstep. sorting by length within the
+// window keeps rows of similar length in the same chunk, which is what keeps
+// the padding small, a window larger than the chunk only trades locality of
+// the result writes for less padding. the layout is never picked
+// automatically, the input has to ask for it with storage: sliced
+#define SLICED_MAX_CHUNK_HEIGHT 64
+#define SLICED_DEFAULT_CHUNK_HEIGHT 16
+#define SLICED_DEFAULT_SORT_WINDOW 256
+
+typedef struct {
+	U64 length;
+	U64 row;
+} SlicedRow;
+
+static int compare_sliced_rows(const void *a, const void *b) {
+	const SlicedRow *x = a, *y = b;
+	// longest first, ties keep the row order
+	if (x->length != y->length) return x->length < y->length ? 1 : -1;
+	return x->row < y->row ? -1 : x->row > y->row;
+}
+
+// the inverse of chunk_rows, for setup code that walks m by row
+static void sparse_mat_compute_row_slots(Arena *arena, SparseMatrix *m) {
+	m->row_slots = arena_push_n(arena, U64, m->num_rows);
+	for (U64 slot=0; slot<m->num_chunks * m->chunk_height; ++slot) {
+		if (m->chunk_rows[slot] < m->num_rows) {
+			m->row_slots[m->chunk_rows[slot]] = slot;
+		}
+	}
+}
+
+// converts m from compressed rows to sliced storage, see the NOTE above
+static void sparse_mat_convert_sliced(Arena *arena, SparseMatrix *m, U64 chunk_height, U64 sort_window) {
 	PROFILE_FUNCTION_BEGIN;
-	SparseMatrix *m = arena_push_n(arena, SparseMatrix, 1);
-	m->precision = precision;
+	assert(m->layout == SPARSE_LAYOUT_CSR);
+	assert(chunk_height > 0 && chunk_height <= SLICED_MAX_CHUNK_HEIGHT && sort_window > 0);
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	U64 n = m->num_rows;
+	U64 num_chunks = (n + chunk_height - 1) / chunk_height;
+	U64 num_slots = num_chunks * chunk_height;
+
+	SlicedRow *sorted = arena_push_n(scratch.arena, SlicedRow, n);
+	for (U64 row=0; row<n; ++row) {
+		sorted[row] = (SlicedRow){ m->row_offsets[row+1] - m->row_offsets[row], row };
+	}
+	for (U64 start=0; start<n; start += sort_window) {
+		qsort(sorted + start, MIN(sort_window, n - start), sizeof(SlicedRow), compare_sliced_rows);
+	}
+
+	U64 *chunk_rows = arena_push_n(arena, U64, num_slots);
+	U64 *chunk_offsets = arena_push_n(arena, U64, num_chunks + 1);
+	for (U64 slot=0; slot<num_slots; ++slot) {
+		chunk_rows[slot] = slot < n ? sorted[slot].row : n;
+	}
+	for (U64 c=0; c<num_chunks; ++c) {
+		U64 width = 0;
+		for (U64 slot=c * chunk_height; slot<MIN((c+1) * chunk_height, n); ++slot) {
+			width = MAX(width, sorted[slot].length);
+		}
+		chunk_offsets[c+1] = chunk_offsets[c] + width * chunk_height;
+	}
+
+	U64 num_values = chunk_offsets[num_chunks];
+	U64 *cols = arena_push_n(arena, U64, num_values);
+	void *values = m->precision == PRECISION_F32 ? (void*)arena_push_n(arena, F32, num_values) : (void*)arena_push_n(arena, F64, num_values);
+	for (U64 slot=0; slot<n; ++slot) {
+		U64 row = chunk_rows[slot];
+		U64 dst = chunk_offsets[slot / chunk_height] + slot % chunk_height;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i, dst += chunk_height) {
+			cols[dst] = m->cols[i];
+			if (m->precision == PRECISION_F32) {
+				((F32*)values)[dst] = m->valuesF32[i];
+			} else {
+				assert(m->precision == PRECISION_F64);
+				((F64*)values)[dst] = m->valuesF64[i];
+			}
+		}
+	}
+
+#ifdef DIAGNOSTICS
+	printf("sliced storage: C=%llu sigma=%llu, %llu of %llu slots are padding (%.1f%% overhead)\n",
+		chunk_height, sort_window, num_values - m->num_values, num_values,
+		m->num_values ? 100.0 * (F64)(num_values - m->num_values) / (F64)m->num_values : 0.0);
+#endif
+
+	m->layout = SPARSE_LAYOUT_SLICED;
+	m->chunk_height = chunk_height;
+	m->num_chunks = num_chunks;
+	m->chunk_offsets = chunk_offsets;
+	m->chunk_rows = chunk_rows;
 	m->num_values = num_values;
-	m->cols = arena_push_n(arena, U64, num_values);
-	m->rows = arena_push_n(arena, U64, num_values);
+	m->cols = cols;
+	m->valuesF64 = values;
+	m->rows = NULL;
+	m->row_offsets = NULL;
+	sparse_mat_compute_row_slots(arena, m);
 
-	if (precision == PRECISION_F32) {
-		m->valuesF32 = arena_push_n(arena, F32, num_values);
-	} else {
-		assert(precision == PRECISION_F64);
-		m->valuesF64 = arena_push_n(arena, F64, num_values);
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+}
+
+// NOTE(shaw): after the values the column indices are most of the bytes a
+// product streams, 8 per entry next to 4 or 8 for the value. once a matrix is
+// built sparse_mat_compact_indices moves them to a smaller encoding, 32 bits
+// whenever every column fits, or with SPARSE_INDEX_DELTA the difference to
+// the previous column of the row as a varint, one byte for most entries of a
+// banded or reordered matrix. decoding deltas is serial within a row and has
+// no vector form, so they only pay off where memory bandwidth is the limit,
+// and only general compressed rows use them, the other layouts get 32 bits.
+// diagonal storage has no column indices.
+
+// 32 bit indices are gathered as signed integers, so the columns must stay
+// below 2^31
+#define SPARSE_INDEX_U32_MAX_ROWS ((U64)INT32_MAX + 1)
+
+static U64 sparse_delta_zigzag(U64 col, U64 prev) {
+	S64 delta = (S64)(col - prev);
+	return ((U64)delta << 1) ^ (U64)(delta >> 63);
+}
+
+static U64 sparse_delta_size(U64 value) {
+	U64 size = 1;
+	for (; value >= 0x80; value >>= 7) ++size;
+	return size;
+}
+
+// delta encodes cols, the columns of the compressed rows of m, into arena,
+// see sparse_delta_next
+static void sparse_mat_encode_deltas(Arena *arena, SparseMatrix *m, U64 *cols) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 *offsets = arena_push_n_no_zero(arena, U64, m->num_rows + 1);
+	U64 size = 0;
+	for (U64 row=0; row<m->num_rows; ++row) {
+		offsets[row] = size;
+		U64 prev = row;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			size += sparse_delta_size(sparse_delta_zigzag(cols[i], prev));
+			prev = cols[i];
+		}
 	}
+	offsets[m->num_rows] = size;
 
+	U8 *bytes = arena_push_n_no_zero(arena, U8, size);
+	U8 *p = bytes;
+	for (U64 row=0; row<m->num_rows; ++row) {
+		U64 prev = row;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			U64 value = sparse_delta_zigzag(cols[i], prev);
+			for (; value >= 0x80; value >>= 7) {
+				*p++ = (U8)(value | 0x80);
+			}
+			*p++ = (U8)value;
+			prev = cols[i];
+		}
+	}
+	assert((U64)(p - bytes) == size);
+
+	m->index_encoding = SPARSE_INDEX_DELTA;
+	m->col_bytes = bytes;
+	m->col_byte_offsets = offsets;
+	m->cols = NULL;
+	m->cols32 = NULL;
 	PROFILE_FUNCTION_END;
-	return m;
 }
 
-static void sparse_mat_mul_vec(Vector *result, SparseMatrix *m, Vector *v) {
+// moves the column indices of m from cols to encoding, or to a wider one
+// where m cannot use it, see the note above
+static void sparse_mat_compact_indices(Arena *arena, SparseMatrix *m, SparseIndexEncoding encoding) {
 	PROFILE_FUNCTION_BEGIN;
-	if (m->precision != v->precision || v->precision != result->precision) {
-		fatal("sparse_mat_mul_vec: arguments have different float precision");
+	assert(m->index_encoding == SPARSE_INDEX_U64 && encoding < SPARSE_INDEX_COUNT);
+	if (encoding == SPARSE_INDEX_DELTA && m->layout != SPARSE_LAYOUT_CSR) {
+		encoding = SPARSE_INDEX_U32;
 	}
-	if (v->num_values != result->num_values) {
-		fatal("sparse_mat_mul_vec: vector arguments have different sizes: result=%llu, v=%llu",
-			result->num_values, v->num_values);
+	if (!m->cols || m->num_rows > SPARSE_INDEX_U32_MAX_ROWS) {
+		encoding = SPARSE_INDEX_U64;
 	}
+#ifdef DIAGNOSTICS
+	U64 bytes_before = m->cols ? m->num_values * sizeof(U64) : 0;
+#endif
 
-	// NOTE(shaw): result and v could alias, and since result needs to be
-	// zeroed before accumulating values this means we have to allocate a
-	// temporary vector to accumulate values into and then copy them out to
-	// result at the end
-	ArenaTemp scratch = scratch_begin(NULL, 0);
-	Vector *tmp = vec_alloc(scratch.arena, result->precision, result->num_values);
+	if (encoding == SPARSE_INDEX_U32) {
+		// in place, each index is written below the bytes of the ones not
+		// read yet. memcpy keeps the stores from aliasing the U64 loads
+		for (U64 i=0; i<m->num_values; ++i) {
+			U32 col = (U32)m->cols[i];
+			memcpy((U8*)m->cols + i * sizeof(U32), &col, sizeof(U32));
+		}
+		m->index_encoding = SPARSE_INDEX_U32;
+		m->cols32 = (U32*)m->cols;
+		m->cols = NULL;
+	} else if (encoding == SPARSE_INDEX_DELTA) {
+		sparse_mat_encode_deltas(arena, m, m->cols);
+	}
 
-	for (U64 i=0; i<m->num_values; ++i) {
-		U64 row = m->rows[i];
-		U64 v_index = m->cols[i];
+#ifdef DIAGNOSTICS
+	U64 bytes_after = m->index_encoding == SPARSE_INDEX_U64 ? bytes_before :
+		m->index_encoding == SPARSE_INDEX_U32 ? m->num_values * sizeof(U32) :
+		m->col_byte_offsets[m->num_rows] + (m->num_rows + 1) * sizeof(U64);
+	printf("column indices: %llu -> %llu bytes\n", bytes_before, bytes_after);
+#endif
+	PROFILE_FUNCTION_END;
+}
+
+// returns 1 / A[i][i] for every row of m, duplicate entries on the diagonal
+// are summed like the kernels do. rows without a positive diagonal get 1 so
+// the Jacobi preconditioner leaves them unscaled instead of dividing by zero
+// or flipping the sign of the search direction
+static Vector *sparse_mat_inverse_diagonal(Arena *arena, SparseMatrix *m) {
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	SparseEntry *entries = arena_push_n(scratch.arena, SparseEntry, sparse_mat_max_row_entries(m));
+	Vector *result = vec_alloc(arena, m->precision, m->num_rows);
+	for (U64 row=0; row<m->num_rows; ++row) {
+		F64 diagonal = 0;
+		U64 count = sparse_mat_row_entries(m, row, entries);
+		for (U64 i=0; i<count; ++i) {
+			if (entries[i].col == row) {
+				diagonal += entries[i].value;
+			}
+		}
+		F64 inverse = diagonal > 0 ? 1.0 / diagonal : 1.0;
+		if (m->precision == PRECISION_F32) {
+			result->valuesF32[row] = (F32)inverse;
+		} else {
+			assert(m->precision == PRECISION_F64);
+			result->valuesF64[row] = inverse;
+		}
+	}
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return result;
+}
+
+// NOTE(shaw): IC(0) can break down on SPD matrices when dropping the fill
+// makes a pivot non-positive. the factorization is then retried on
+// A + shift * diag(A) with the shift doubling from IC_INITIAL_SHIFT, which
+// succeeds once the shift makes the matrix diagonally dominant. the
+// shifted factor is a worse approximation of A but still a fine
+// preconditioner
+#define IC_INITIAL_SHIFT 0.001
+#define IC_MAX_SHIFTS 16
+
+// computes the incomplete Cholesky factor L of m, A ~ L * L^T, keeping only
+// the entries on the sparsity pattern of the lower triangle of m. L is
+// returned as a compressed row matrix with sorted columns and the diagonal
+// last in every row, it does not depend on the right hand side and can be
+// reused for any number of solves. only the lower triangle of m is read (the
+// stored upper one for symmetric storage), m is assumed to be symmetric.
+//
+// returns NULL if no shift makes the factorization succeed, which happens
+// when m has a non-positive diagonal entry. *shift is set to the diagonal
+// shift that was used
+static SparseMatrix *sparse_mat_incomplete_cholesky(Arena *arena, SparseMatrix *m, F64 *shift) {
+	PROFILE_FUNCTION_BEGIN;
+	U64 n = m->num_rows;
+	bool symmetric = m->layout == SPARSE_LAYOUT_SYMMETRIC;
+	*shift = 0;
+
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	SparseEntry *row_entries = arena_push_n(scratch.arena, SparseEntry, sparse_mat_max_row_entries(m));
+
+	// the lower triangle of m with sorted columns, duplicates summed and an
+	// explicit (possibly zero) diagonal at the end of every row. for
+	// symmetric storage that is the transpose of the stored upper triangle
+	U64 *bounds = arena_push_n(scratch.arena, U64, n + 1);
+	for (U64 row=0; row<n; ++row) {
+		++bounds[row + 1]; // room for the diagonal
+		U64 count = sparse_mat_row_entries(m, row, row_entries);
+		for (U64 i=0; i<count; ++i) {
+			U64 col = row_entries[i].col;
+			if (col == row || (!symmetric && col < row)) {
+				++bounds[row + 1];
+			} else if (symmetric) {
+				++bounds[col + 1];
+			}
+		}
+	}
+	for (U64 row=0; row<n; ++row) {
+		bounds[row + 1] += bounds[row];
+	}
+	SparseEntry *entries = arena_push_n_no_zero(scratch.arena, SparseEntry, bounds[n]);
+	U64 *counts = arena_push_n(scratch.arena, U64, n);
+	for (U64 row=0; row<n; ++row) {
+		U64 count = sparse_mat_row_entries(m, row, row_entries);
+		for (U64 i=0; i<count; ++i) {
+			U64 col = row_entries[i].col;
+			if (col == row || (!symmetric && col < row)) {
+				entries[bounds[row] + counts[row]++] = row_entries[i];
+			} else if (symmetric) {
+				entries[bounds[col] + counts[col]++] = (SparseEntry){ row, row_entries[i].value };
+			}
+		}
+	}
+
+	U64 *row_offsets = arena_push_n(arena, U64, n + 1);
+	bool positive_diagonal = true;
+	for (U64 row=0; row<n; ++row) {
+		SparseEntry *e = entries + bounds[row];
+		U64 count = sparse_row_sort_merge(e, counts[row]);
+		if (count == 0 || e[count-1].col != row) {
+			e[count++] = (SparseEntry){ row, 0 };
+		}
+		counts[row] = count;
+		positive_diagonal = positive_diagonal && e[count-1].value > 0;
+		row_offsets[row + 1] = row_offsets[row] + count;
+	}
+
+	U64 num_values = row_offsets[n];
+	U64 *cols = arena_push_n(arena, U64, num_values);
+	F64 *lower = arena_push_n(scratch.arena, F64, num_values);
+	for (U64 row=0; row<n; ++row) {
+		for (U64 i=0; i<counts[row]; ++i) {
+			cols[row_offsets[row] + i] = entries[bounds[row] + i].col;
+			lower[row_offsets[row] + i] = entries[bounds[row] + i].value;
+		}
+	}
 
-		assert(v_index < v->num_values);
-		assert(row < result->num_values);
+	F64 *factor = arena_push_n(scratch.arena, F64, num_values);
+	// no shift of the diagonal helps if it is not positive to begin with
+	bool success = false;
+	for (U64 attempt=0; attempt<=IC_MAX_SHIFTS && !success && positive_diagonal; ++attempt) {
+		F64 s = attempt == 0 ? 0 : IC_INITIAL_SHIFT * (F64)(1ull << (attempt - 1));
+		success = true;
+		for (U64 row=0; row<n && success; ++row) {
+			U64 start = row_offsets[row];
+			U64 diag = row_offsets[row+1] - 1;
+			for (U64 i=start; i<diag; ++i) {
+				// L[row][k] = (A[row][k] - sum_j L[row][j] * L[k][j]) / L[k][k]
+				// over the columns j < k both rows have
+				U64 k = cols[i];
+				F64 sum = lower[i];
+				U64 a = start, b = row_offsets[k], b_end = row_offsets[k+1] - 1;
+				while (a < i && b < b_end) {
+					if (cols[a] < cols[b]) {
+						++a;
+					} else if (cols[a] > cols[b]) {
+						++b;
+					} else {
+						sum -= factor[a++] * factor[b++];
+					}
+				}
+				factor[i] = sum / factor[b_end];
+			}
+			F64 pivot = lower[diag] * (1.0 + s);
+			for (U64 i=start; i<diag; ++i) {
+				pivot -= factor[i] * factor[i];
+			}
+			if (!(pivot > 0) || !isfinite(pivot)) {
+				success = false;
+			} else {
+				factor[diag] = sqrt(pivot);
+			}
+		}
+		*shift = s;
+	}
 
-		if (result->precision == PRECISION_F32) {
-			tmp->valuesF32[row] += v->valuesF32[v_index] * m->valuesF32[i];
+	SparseMatrix *result = NULL;
+	if (success) {
+		result = arena_push_n(arena, SparseMatrix, 1);
+		result->precision = m->precision;
+		result->num_values = num_values;
+		result->num_rows = n;
+		result->row_offsets = row_offsets;
+		result->cols = cols;
+		if (m->precision == PRECISION_F32) {
+			result->valuesF32 = arena_push_n(arena, F32, num_values);
+			for (U64 i=0; i<num_values; ++i) {
+				result->valuesF32[i] = (F32)factor[i];
+			}
 		} else {
-			tmp->valuesF64[row] += v->valuesF64[v_index] * m->valuesF64[i];
+			assert(m->precision == PRECISION_F64);
+			result->valuesF64 = arena_push_n(arena, F64, num_values);
+			memcpy(result->valuesF64, factor, num_values * sizeof(F64));
+		}
+	}
+
+	scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return result;
+}
+
+// ---------------------------------------------------------------------------
+// Precision Specialized Kernels
+// ---------------------------------------------------------------------------
+// the vectors and step sizes of pipelined conjugate gradients, see
+// solve_pipelined_conjugate_gradients. x is the solution, r the residual,
+// w = A * r, p the search direction, s = A * p, z = A * s and q = A * w
+typedef struct {
+	Vector *x;
+	Vector *r;
+	Vector *w;
+	Vector *p;
+	Vector *s;
+	Vector *z;
+	Vector *q;
+	F64 alpha;
+	F64 beta;
+} PipelinedCG;
+
+// the inputs of a kernel, each kernel documents which of these it reads
+typedef struct {
+	SparseMatrix *A;
+	Vector *result;
+	Vector *a;
+	Vector *b;
+	F64 scalar;
+
+	// symmetric kernels only. overflow is from sparse_overflow_alloc or NULL,
+	// run_sparse_kernel sets up the rest
+	Vector *overflow;
+	U64 overflow_ranges;
+
+	// block kernels only. the vectors hold `columns` interleaved columns,
+	// entry j of row r is at r * columns + j. scalars has one scalar per
+	// column, the sums of a range go to column_sums[range index * columns + j],
+	// see run_block_kernel
+	U64 columns;
+	F64 *scalars;
+	F64 *column_sums;
+
+	// pipelined_cg_update only. it has two sums, run it with run_block_kernel
+	// and columns = 2 to get them
+	PipelinedCG *pipelined;
+} KernelArgs;
+
+typedef struct {
+	U64 start;
+	U64 end;
+	U64 index; // of this range within the task
+	F64 sum; // partial result of reducing kernels
+} KernelRange;
+
+typedef void KernelFunc(KernelArgs *args, KernelRange *range);
+
+// one table per float precision, a solver looks up the table for its
+// precision once and then calls straight into the specialized loops
+typedef struct {
+	KernelFunc *vec_add;
+	KernelFunc *vec_sub;
+	KernelFunc *vec_dot;
+	KernelFunc *vec_scale;
+	KernelFunc *sparse_mat_mul_vec;
+
+	// fused kernels, each streams its vectors once for what would otherwise
+	// take several of the passes above
+	KernelFunc *vec_axpy;
+	KernelFunc *vec_xpay;
+	KernelFunc *vec_axpy_dot;
+	KernelFunc *sparse_mat_mul_vec_dot;
+	KernelFunc *sparse_mat_residual_dot;
+	KernelFunc *vec_mul_dot;
+	KernelFunc *pipelined_cg_update;
+
+	// sequential, only valid over the whole vector in a single range
+	KernelFunc *sparse_cholesky_solve_dot;
+
+	// symmetric storage, only valid through run_sparse_kernel. the scatter
+	// kernel is the first pass of every product, the others finish it the
+	// same way as their general counterparts above
+	KernelFunc *sparse_sym_mat_mul_vec_scatter;
+	KernelFunc *sparse_sym_mat_mul_vec;
+	KernelFunc *sparse_sym_mat_mul_vec_dot;
+	KernelFunc *sparse_sym_mat_residual_dot;
+
+	// diagonal storage, same contracts as the general versions
+	KernelFunc *sparse_dia_mat_mul_vec;
+	KernelFunc *sparse_dia_mat_mul_vec_dot;
+	KernelFunc *sparse_dia_mat_residual_dot;
+
+	// sliced storage, a range of rows covers the chunks that start in it
+	KernelFunc *sparse_sell_mat_mul_vec;
+	KernelFunc *sparse_sell_mat_mul_vec_dot;
+	KernelFunc *sparse_sell_mat_residual_dot;
+
+	// blocks of interleaved vectors, only valid through run_block_kernel.
+	// the same contracts as the single vector kernels, with a scalar and a
+	// sum per column
+	KernelFunc *block_axpy;
+	KernelFunc *block_xpay;
+	KernelFunc *block_axpy_dot;
+	KernelFunc *sparse_block_mul_vec_dot;
+	KernelFunc *sparse_block_residual_dot;
+
+	// the kernels above that read column indices, for SPARSE_INDEX_U32
+	KernelFunc *sparse_mat_mul_vec_u32;
+	KernelFunc *sparse_mat_mul_vec_dot_u32;
+	KernelFunc *sparse_mat_residual_dot_u32;
+	KernelFunc *sparse_sym_mat_mul_vec_scatter_u32;
+	KernelFunc *sparse_sell_mat_mul_vec_u32;
+	KernelFunc *sparse_sell_mat_mul_vec_dot_u32;
+	KernelFunc *sparse_sell_mat_residual_dot_u32;
+	KernelFunc *sparse_block_mul_vec_dot_u32;
+	KernelFunc *sparse_block_residual_dot_u32;
+
+	// compressed rows with SPARSE_INDEX_DELTA
+	KernelFunc *sparse_delta_mat_mul_vec;
+	KernelFunc *sparse_delta_mat_mul_vec_dot;
+	KernelFunc *sparse_delta_mat_residual_dot;
+} LinearAlgebraKernels;
+
+// the matrix products every layout has a kernel for, see run_sparse_kernel
+typedef enum {
+	SPARSE_OP_MUL_VEC,      // result = A * a
+	SPARSE_OP_MUL_VEC_DOT,  // result = A * a, sum = a . result
+	SPARSE_OP_RESIDUAL_DOT, // result = b - A * a, sum = result . result
+	SPARSE_OP_COUNT,
+} SparseOp;
+
+// the kernel doing op for m, picked by its layout and index encoding. for
+// symmetric storage this is the second pass, run_sparse_kernel runs the first
+static KernelFunc *sparse_kernel(LinearAlgebraKernels *k, SparseMatrix *m, SparseOp op) {
+	KernelFunc *kernels[SPARSE_LAYOUT_COUNT][SPARSE_OP_COUNT] = {
+		[SPARSE_LAYOUT_CSR]       = { k->sparse_mat_mul_vec,     k->sparse_mat_mul_vec_dot,     k->sparse_mat_residual_dot },
+		[SPARSE_LAYOUT_SYMMETRIC] = { k->sparse_sym_mat_mul_vec, k->sparse_sym_mat_mul_vec_dot, k->sparse_sym_mat_residual_dot },
+		[SPARSE_LAYOUT_DIAGONAL]  = { k->sparse_dia_mat_mul_vec, k->sparse_dia_mat_mul_vec_dot, k->sparse_dia_mat_residual_dot },
+		[SPARSE_LAYOUT_SLICED]    = { k->sparse_sell_mat_mul_vec, k->sparse_sell_mat_mul_vec_dot, k->sparse_sell_mat_residual_dot },
+	};
+	KernelFunc *kernels_u32[SPARSE_LAYOUT_COUNT][SPARSE_OP_COUNT] = {
+		[SPARSE_LAYOUT_CSR]       = { k->sparse_mat_mul_vec_u32, k->sparse_mat_mul_vec_dot_u32, k->sparse_mat_residual_dot_u32 },
+		[SPARSE_LAYOUT_SYMMETRIC] = { k->sparse_sym_mat_mul_vec, k->sparse_sym_mat_mul_vec_dot, k->sparse_sym_mat_residual_dot },
+		[SPARSE_LAYOUT_SLICED]    = { k->sparse_sell_mat_mul_vec_u32, k->sparse_sell_mat_mul_vec_dot_u32, k->sparse_sell_mat_residual_dot_u32 },
+	};
+	KernelFunc *kernels_delta[SPARSE_OP_COUNT] = {
+		k->sparse_delta_mat_mul_vec, k->sparse_delta_mat_mul_vec_dot, k->sparse_delta_mat_residual_dot,
+	};
+	assert(m->layout < SPARSE_LAYOUT_COUNT && op < SPARSE_OP_COUNT);
+	switch (m->index_encoding) {
+		case SPARSE_INDEX_U32:
+			return kernels_u32[m->layout][op];
+		case SPARSE_INDEX_DELTA:
+			assert(m->layout == SPARSE_LAYOUT_CSR);
+			return kernels_delta[op];
+		default:
+			return kernels[m->layout][op];
+	}
+}
+
+// NOTE(shaw): a block product loads every matrix entry and column index once
+// for all the columns of the block instead of once per column. the block
+// kernels keep a sum per column on the stack, wider blocks are split by the
+// caller. past 16 columns a block row of the vector is several cache lines
+// and the loads of a that miss cost more than the indices saved
+#define BLOCK_MAX_COLUMNS 16
+
+// the block kernel doing op for m, NULL if its layout has none, those solve
+// column by column. diagonal storage streams a vector with unit stride and
+// loads no indices so blocking saves little there, symmetric storage would
+// need a scatter window per column and sliced storage already spends its
+// registers on rows. delta encoded rows decode their columns one at a time
+// and have none either
+static KernelFunc *sparse_block_kernel(LinearAlgebraKernels *k, SparseMatrix *m, SparseOp op) {
+	KernelFunc *kernels[SPARSE_INDEX_COUNT][SPARSE_OP_COUNT] = {
+		[SPARSE_INDEX_U64] = { NULL, k->sparse_block_mul_vec_dot,     k->sparse_block_residual_dot },
+		[SPARSE_INDEX_U32] = { NULL, k->sparse_block_mul_vec_dot_u32, k->sparse_block_residual_dot_u32 },
+	};
+	assert(m->layout < SPARSE_LAYOUT_COUNT && m->index_encoding < SPARSE_INDEX_COUNT && op < SPARSE_OP_COUNT);
+	return m->layout == SPARSE_LAYOUT_CSR ? kernels[m->index_encoding][op] : NULL;
+}
+
+// NOTE(shaw): the diagonal kernels work on blocks of this many rows, so the
+// block of the result stays in L1 while every diagonal adds to it
+#define DIAGONAL_BLOCK_ROWS 512
+
+#define KERNEL_FLOAT F32
+#define KERNEL_VALUES valuesF32
+#define KERNEL(name) name##_F32
+#include "sparse_linear_algebra_kernels.c"
+
+#define KERNEL_FLOAT F64
+#define KERNEL_VALUES valuesF64
+#define KERNEL(name) name##_F64
+#include "sparse_linear_algebra_kernels.c"
+
+#include "sparse_linear_algebra_simd.c"
+
+static LinearAlgebraKernels *kernel_tables[SIMD_LEVEL_COUNT][2] = {
+	[SIMD_LEVEL_SCALAR] = { &kernels_F32,        &kernels_F64 },
+	[SIMD_LEVEL_SSE2]   = { &kernels_sse2_F32,   &kernels_sse2_F64 },
+	[SIMD_LEVEL_AVX2]   = { &kernels_avx2_F32,   &kernels_avx2_F64 },
+	[SIMD_LEVEL_AVX512] = { &kernels_avx512_F32, &kernels_avx512_F64 },
+};
+
+static SimdLevel kernel_simd_level;
+static bool kernels_initialized;
+
+// selects the kernels used by get_kernels, level is clamped to what the cpu
+// supports. if this is never called the widest supported kernels are used
+static void init_kernels(SimdLevel level) {
+	kernel_simd_level = MIN(level, cpu_simd_level());
+	kernels_initialized = true;
+}
+
+static LinearAlgebraKernels *get_kernels_for_level(FloatPrecision precision, SimdLevel level) {
+	assert(level < SIMD_LEVEL_COUNT);
+	switch (precision) {
+		case PRECISION_F32: return kernel_tables[level][0];
+		case PRECISION_F64: return kernel_tables[level][1];
+		default:
+			fatal("get_kernels: unknown float precision (enum value = %d)", precision);
+			return NULL;
+	}
+}
+
+static LinearAlgebraKernels *get_kernels(FloatPrecision precision) {
+	if (!kernels_initialized) {
+		init_kernels(SIMD_LEVEL_COUNT - 1);
+	}
+	return get_kernels_for_level(precision, kernel_simd_level);
+}
+
+// NOTE(shaw): below this many elements (or rows) per thread the cost of waking
+// the workers outweighs the work, small systems stay on the calling thread
+#define KERNEL_MIN_ITEMS_PER_THREAD 16384
+
+typedef struct {
+	KernelFunc *func;
+	KernelArgs *args;
+	KernelRange ranges[MAX_THREADS];
+} KernelTask;
+
+static void run_kernel_range(void *data, U64 range_index, U64 start, U64 end) {
+	KernelTask *task = data;
+	KernelRange *range = &task->ranges[range_index];
+	range->start = start;
+	range->end = end;
+	range->index = range_index;
+	range->sum = 0;
+	task->func(task->args, range);
+}
+
+// runs func over [0, count) on the thread pool. partial sums are combined in
+// range order so the result only depends on the thread count
+static F64 run_kernel(KernelFunc *func, KernelArgs *args, U64 count) {
+	PROFILE_FUNCTION_BEGIN;
+	KernelTask task;
+	task.func = func;
+	task.args = args;
+	U64 range_count = thread_pool_run(run_kernel_range, &task, count, KERNEL_MIN_ITEMS_PER_THREAD);
+
+	F64 sum = 0;
+	for (U64 i=0; i<range_count; ++i) {
+		sum += task.ranges[i].sum;
+	}
+	PROFILE_FUNCTION_END;
+	return sum;
+}
+
+// whether a matrix in compressed rows is narrow enough for symmetric storage
+// to pay off. every range but the last clears and adds an overflow window of
+// bandwidth rows per product, which for a wide matrix costs more than the
+// halved matrix saves
+static bool sparse_mat_symmetric_pays_off(SparseMatrix *m) {
+	assert(m->layout == SPARSE_LAYOUT_CSR);
+	U64 bandwidth = 0;
+	for (U64 row=0; row<m->num_rows; ++row) {
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			U64 col = m->cols[i];
+			bandwidth = MAX(bandwidth, col > row ? col - row : row - col);
 		}
 	}
+	U64 ranges = thread_pool_range_count(m->num_rows, KERNEL_MIN_ITEMS_PER_THREAD);
+	return (ranges - 1) * bandwidth <= m->num_rows / 8;
+}
+
+// NOTE(shaw): a symmetric product scatters every stored off-diagonal entry
+// into a later row, which can belong to another thread's range. the first
+// pass writes rows inside its own range directly and the rest into an
+// overflow window of the bandwidth rows following the range, the second pass
+// adds the windows in and finishes the kernel (dot product, residual). the
+// passes must use the same ranges, so both go through run_kernel with the
+// same count.
+//
+// solvers allocate the windows once with sparse_overflow_alloc and pass them
+// in args->overflow, so their iterations do not allocate. without them
+// run_sparse_kernel pushes the windows on the scratch arena for the call.
+//
+// the overflow windows of the products with A over its rows on the current
+// thread pool, NULL for layouts without them
+static Vector *sparse_overflow_alloc(Arena *arena, SparseMatrix *A) {
+	if (A->layout != SPARSE_LAYOUT_SYMMETRIC) return NULL;
+	U64 ranges = thread_pool_range_count(A->num_rows, KERNEL_MIN_ITEMS_PER_THREAD);
+	// the scatter pass clears the part of its window it uses
+	return vec_alloc_no_zero(arena, A->precision, ranges * A->bandwidth);
+}
+
+// runs op with the kernels for the layout and index encoding of args->A,
+// count is its number of rows
+static F64 run_sparse_kernel(LinearAlgebraKernels *k, SparseOp op, KernelArgs *args, U64 count) {
+	KernelFunc *func = sparse_kernel(k, args->A, op);
+	if (args->A->layout != SPARSE_LAYOUT_SYMMETRIC) {
+		return run_kernel(func, args, count);
+	}
+
+	PROFILE_FUNCTION_BEGIN;
+	ArenaTemp scratch = {0};
+	KernelArgs sym_args = *args;
+	sym_args.overflow_ranges = thread_pool_range_count(count, KERNEL_MIN_ITEMS_PER_THREAD);
+	if (!sym_args.overflow) {
+		scratch = scratch_begin(NULL, 0);
+		sym_args.overflow = sparse_overflow_alloc(scratch.arena, args->A);
+	}
+	assert(sym_args.overflow->num_values >= sym_args.overflow_ranges * args->A->bandwidth);
+
+	KernelFunc *scatter = args->A->index_encoding == SPARSE_INDEX_U32 ? k->sparse_sym_mat_mul_vec_scatter_u32 : k->sparse_sym_mat_mul_vec_scatter;
+	run_kernel(scatter, &sym_args, count);
+	F64 sum = run_kernel(func, &sym_args, count);
+
+	if (scratch.arena) scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+	return sum;
+}
+
+// room for the per range sums of block kernels over count rows, like
+// sparse_overflow_alloc it is allocated once per solve
+static F64 *block_sums_alloc(Arena *arena, U64 count, U64 columns) {
+	return arena_push_n_no_zero(arena, F64, thread_pool_range_count(count, KERNEL_MIN_ITEMS_PER_THREAD) * columns);
+}
+
+// runs a block kernel over count rows and writes the per column sums to sums
+// (args->columns of them), sums can be NULL for kernels that do not reduce.
+// args->column_sums is from block_sums_alloc or NULL, then the sums are
+// pushed on the scratch arena for the call
+static void run_block_kernel(KernelFunc *func, KernelArgs *args, U64 count, F64 *sums) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(args->columns > 0 && args->columns <= BLOCK_MAX_COLUMNS);
+	ArenaTemp scratch = {0};
+	KernelArgs block_args = *args;
+	U64 range_count = thread_pool_range_count(count, KERNEL_MIN_ITEMS_PER_THREAD);
+	if (!block_args.column_sums) {
+		scratch = scratch_begin(NULL, 0);
+		block_args.column_sums = block_sums_alloc(scratch.arena, count, args->columns);
+	}
+
+	run_kernel(func, &block_args, count);
+
+	// in range order, like run_kernel
+	if (sums) {
+		for (U64 j=0; j<args->columns; ++j) {
+			sums[j] = 0;
+		}
+		for (U64 r=0; r<range_count; ++r) {
+			for (U64 j=0; j<args->columns; ++j) {
+				sums[j] += block_args.column_sums[r * args->columns + j];
+			}
+		}
+	}
+	if (scratch.arena) scratch_end(scratch);
+	PROFILE_FUNCTION_END;
+}
+
+// ---------------------------------------------------------------------------
+// Mixed Precision Kernels
+// ---------------------------------------------------------------------------
+// NOTE(shaw): the only kernels that read one precision and write the other,
+// for iterative refinement. they do not fit the per precision tables, run
+// them with run_kernel directly
+
+// result (F32) = scalar * a (F64)
+static void vec_narrow_scaled(KernelArgs *args, KernelRange *range) {
+	F32 *y = args->result->valuesF32;
+	F64 *x = args->a->valuesF64;
+	F64 alpha = args->scalar;
+	for (U64 i=range->start; i < range->end; ++i) {
+		y[i] = (F32)(alpha * x[i]);
+	}
+}
+
+// result (F64) = result + scalar * a (F32)
+static void vec_widen_axpy(KernelArgs *args, KernelRange *range) {
+	F64 *y = args->result->valuesF64;
+	F32 *x = args->a->valuesF32;
+	F64 alpha = args->scalar;
+	for (U64 i=range->start; i < range->end; ++i) {
+		y[i] += alpha * (F64)x[i];
+	}
+}
+
+// a single precision copy of the double precision matrix m. only the values
+// are copied, the index arrays are shared with m and must outlive the copy
+static SparseMatrix *sparse_mat_narrow(Arena *arena, SparseMatrix *m) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(m->precision == PRECISION_F64);
+	SparseMatrix *result = arena_push_n(arena, SparseMatrix, 1);
+	*result = *m;
+	result->precision = PRECISION_F32;
+	result->valuesF32 = arena_push_n_no_zero(arena, F32, m->num_values);
+	for (U64 i=0; i<m->num_values; ++i) {
+		result->valuesF32[i] = (F32)m->valuesF64[i];
+	}
+	PROFILE_FUNCTION_END;
+	return result;
+}
 
-	if (result->precision == PRECISION_F32) {
-		memcpy(result->valuesF32, tmp->valuesF32, sizeof(F32) * tmp->num_values);
+// rows [start, end) of the compressed rows matrix m as a matrix of their own,
+// copied into arena. the columns keep their numbering in m, so a product
+// with the block reads the whole vector and writes end - start rows
+static SparseMatrix *sparse_mat_row_block(Arena *arena, SparseMatrix *m, U64 start, U64 end) {
+	PROFILE_FUNCTION_BEGIN;
+	assert(m->layout == SPARSE_LAYOUT_CSR && start <= end && end <= m->num_rows);
+	U64 first = m->row_offsets[start];
+	U64 num_values = m->row_offsets[end] - first;
+	U64 value_size = m->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+	SparseMatrix *result = arena_push_n(arena, SparseMatrix, 1);
+	result->precision = m->precision;
+	result->layout = SPARSE_LAYOUT_CSR;
+	result->num_rows = end - start;
+	result->num_values = num_values;
+	result->row_offsets = arena_push_n_no_zero(arena, U64, end - start + 1);
+	for (U64 row=start; row<=end; ++row) {
+		result->row_offsets[row - start] = m->row_offsets[row] - first;
+	}
+	result->index_encoding = m->index_encoding;
+	if (m->index_encoding == SPARSE_INDEX_U32) {
+		result->cols32 = arena_push_n_no_zero(arena, U32, num_values);
+		memcpy(result->cols32, m->cols32 + first, num_values * sizeof(U32));
+	} else if (m->index_encoding == SPARSE_INDEX_DELTA) {
+		// the first column of a row is stored relative to the row, which has
+		// another number in the block, so the rows are encoded again
+		ArenaTemp scratch = scratch_begin(&arena, 1);
+		U64 *cols = arena_push_n_no_zero(scratch.arena, U64, num_values);
+		SparseEntry *entries = arena_push_n_no_zero(scratch.arena, SparseEntry, sparse_mat_max_row_entries(m));
+		for (U64 row=start; row<end; ++row) {
+			U64 count = sparse_mat_row_entries(m, row, entries);
+			for (U64 i=0; i<count; ++i) {
+				cols[result->row_offsets[row - start] + i] = entries[i].col;
+			}
+		}
+		sparse_mat_encode_deltas(arena, result, cols);
+		scratch_end(scratch);
 	} else {
-		assert(result->precision == PRECISION_F64);
-		memcpy(result->valuesF64, tmp->valuesF64, sizeof(F64) * tmp->num_values);
+		result->cols = arena_push_n_no_zero(arena, U64, num_values);
+		memcpy(result->cols, m->cols + first, num_values * sizeof(U64));
 	}
+	result->valuesF64 = arena_push(arena, num_values * value_size, 8, false);
+	memcpy(result->valuesF64, (U8*)m->valuesF64 + first * value_size, num_values * value_size);
+	PROFILE_FUNCTION_END;
+	return result;
+}
 
-	scratch_end(scratch);
+// ---------------------------------------------------------------------------
+// Checked Operations
+// ---------------------------------------------------------------------------
+// NOTE(shaw): these validate their arguments and dispatch to the kernel table
+// on every call, prefer looking up the kernels once in hot loops
+
+static void vec_add(Vector *result, Vector *a, Vector *b) {
+	PROFILE_FUNCTION_BEGIN;
+	check_vector_arguments("vec_add", result, a, b);
+	run_kernel(get_kernels(a->precision)->vec_add, &(KernelArgs){ .result = result, .a = a, .b = b }, a->num_values);
+	PROFILE_FUNCTION_END;
+}
+
+static void vec_sub(Vector *result, Vector *a, Vector *b) {
+	PROFILE_FUNCTION_BEGIN;
+	check_vector_arguments("vec_sub", result, a, b);
+	run_kernel(get_kernels(a->precision)->vec_sub, &(KernelArgs){ .result = result, .a = a, .b = b }, a->num_values);
+	PROFILE_FUNCTION_END;
+}
+
+static F64 vec_dot(Vector *a, Vector *b) {
+	PROFILE_FUNCTION_BEGIN;
+	if (a->precision != b->precision) {
+		fatal("vec_dot: vector arguments have different float precision");
+	}
+	if (a->num_values != b->num_values) {
+		fatal("vec_dot: vector arguments have different sizes: a=%llu, b=%llu",
+			a->num_values, b->num_values);
+	}
+	F64 result = run_kernel(get_kernels(a->precision)->vec_dot, &(KernelArgs){ .a = a, .b = b }, a->num_values);
+	PROFILE_FUNCTION_END;
+	return result;
+}
+
+static void vec_scale(Vector *result, Vector *v, F64 scalar) {
+	PROFILE_FUNCTION_BEGIN;
+	if (result->precision != v->precision) {
+		fatal("vec_scale: vector arguments have different float precision");
+	}
+	if (result->num_values != v->num_values) {
+		fatal("vec_scale: vector arguments have different sizes: result=%llu, v=%llu",
+			result->num_values, v->num_values);
+	}
+	run_kernel(get_kernels(v->precision)->vec_scale, &(KernelArgs){ .result = result, .a = v, .scalar = scalar }, v->num_values);
+	PROFILE_FUNCTION_END;
+}
+
+static void check_sparse_mat_mul_vec_arguments(char *prefix, Vector *result, SparseMatrix *m, Vector *v) {
+	PROFILE_FUNCTION_BEGIN;
+	if (m->precision != v->precision || v->precision != result->precision) {
+		fatal("%s: arguments have different float precision", prefix);
+	}
+	if (!m->row_offsets && m->layout != SPARSE_LAYOUT_DIAGONAL && m->layout != SPARSE_LAYOUT_SLICED) {
+		fatal("%s: matrix is missing its compressed rows, call sparse_mat_build_csr first", prefix);
+	}
+	if (v->num_values != m->num_rows || result->num_values != m->num_rows) {
+		fatal("%s: vector arguments have different sizes: matrix=%llu, result=%llu, v=%llu",
+			prefix, m->num_rows, result->num_values, v->num_values);
+	}
+	if (result == v) {
+		fatal("%s: result and v must be distinct vectors", prefix);
+	}
+	PROFILE_FUNCTION_END;
+}
+
+// result and v must be distinct vectors, each row of result is written
+// exactly once from the compressed rows of m
+static void sparse_mat_mul_vec(Vector *result, SparseMatrix *m, Vector *v) {
+	PROFILE_FUNCTION_BEGIN;
+	check_sparse_mat_mul_vec_arguments("sparse_mat_mul_vec", result, m, v);
+	LinearAlgebraKernels *k = get_kernels(m->precision);
+	run_sparse_kernel(k, SPARSE_OP_MUL_VEC, &(KernelArgs){ .A = m, .result = result, .a = v }, m->num_rows);
 	PROFILE_FUNCTION_END;
 }
 
@@ -0,0 +1,221 @@
+// NOTE(shaw): this file is a template for the kernels that read the column
+// indices of a matrix, sparse_linear_algebra_kernels.c includes it once per
+// index width on top of its own float precision. The including file defines:
+//
+//   KERNEL_INDEX      element type of the column indices (U64 or U32)
+//   KERNEL_COLS       member of SparseMatrix holding them (cols or cols32)
+//   KERNEL_INDEXED(name)  name with the index width and precision appended
+//
+// see SparseIndexEncoding. Otherwise these follow the conventions at the top
+// of sparse_linear_algebra_kernels.c.
+
+// result = A * a, result and a must be distinct vectors
+static void KERNEL_INDEXED(sparse_mat_mul_vec)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *values = m->KERNEL_VALUES;
+	for (U64 row=range->start; row<range->end; ++row) {
+		KERNEL_FLOAT sum = 0;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			sum += values[i] * x[m->KERNEL_COLS[i]];
+		}
+		r[row] = sum;
+	}
+}
+
+// result = A * a, sum = a . result
+// result and a must be distinct vectors
+static void KERNEL_INDEXED(sparse_mat_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *values = m->KERNEL_VALUES;
+	F64 dot = 0;
+	for (U64 row=range->start; row<range->end; ++row) {
+		KERNEL_FLOAT sum = 0;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			sum += values[i] * x[m->KERNEL_COLS[i]];
+		}
+		r[row] = sum;
+		dot += (F64)x[row] * (F64)sum;
+	}
+	range->sum = dot;
+}
+
+// result = b - A * a, sum = result . result
+// result must be distinct from a and b
+static void KERNEL_INDEXED(sparse_mat_residual_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *bv = args->b->KERNEL_VALUES;
+	KERNEL_FLOAT *values = m->KERNEL_VALUES;
+	F64 dot = 0;
+	for (U64 row=range->start; row<range->end; ++row) {
+		KERNEL_FLOAT sum = 0;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			sum += values[i] * x[m->KERNEL_COLS[i]];
+		}
+		KERNEL_FLOAT value = bv[row] - sum;
+		r[row] = value;
+		dot += (F64)value * (F64)value;
+	}
+	range->sum = dot;
+}
+
+// first pass of result = A * a for symmetric storage, see run_sparse_kernel.
+// rows are walked backwards, so every row of the range is written before
+// the rows above it add their mirrored entries to it. the diagonal is
+// scattered into its own row too, which the final write of the row
+// overwrites
+static void KERNEL_INDEXED(sparse_sym_mat_mul_vec_scatter)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *values = m->KERNEL_VALUES;
+	KERNEL_FLOAT *overflow = args->overflow->KERNEL_VALUES + range->index * m->bandwidth;
+	memset(overflow, 0, MIN(m->bandwidth, m->num_rows - range->end) * sizeof(KERNEL_FLOAT));
+
+	for (U64 row=range->end; row-- > range->start;) {
+		KERNEL_FLOAT x_row = x[row];
+		KERNEL_FLOAT sum = 0;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			U64 col = m->KERNEL_COLS[i];
+			sum += values[i] * x[col];
+			if (col < range->end) {
+				r[col] += values[i] * x_row;
+			} else {
+				overflow[col - range->end] += values[i] * x_row;
+			}
+		}
+		r[row] = sum;
+	}
+}
+
+// the products of the rows of one chunk of a matrix in sliced storage, sums[i]
+// is the row in slot chunk * chunk_height + i
+static inline void KERNEL_INDEXED(sparse_sell_chunk)(SparseMatrix *m, KERNEL_FLOAT *x, U64 chunk, KERNEL_FLOAT *sums) {
+	U64 height = m->chunk_height;
+	KERNEL_FLOAT *values = m->KERNEL_VALUES;
+	KERNEL_INDEX *cols = m->KERNEL_COLS;
+	U64 end = m->chunk_offsets[chunk+1];
+	for (U64 i=0; i<height; ++i) {
+		KERNEL_FLOAT sum = 0;
+		for (U64 j=m->chunk_offsets[chunk] + i; j<end; j += height) {
+			sum += values[j] * x[cols[j]];
+		}
+		sums[i] = sum;
+	}
+}
+
+// result = A * a, sliced storage
+static void KERNEL_INDEXED(sparse_sell_mat_mul_vec)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT sums[SLICED_MAX_CHUNK_HEIGHT];
+	U64 height = m->chunk_height;
+	for (U64 c=(range->start + height - 1) / height; c*height < range->end; ++c) {
+		KERNEL_INDEXED(sparse_sell_chunk)(m, x, c, sums);
+		for (U64 i=0; i<height && c*height + i < m->num_rows; ++i) {
+			r[m->chunk_rows[c*height + i]] = sums[i];
+		}
+	}
+}
+
+// result = A * a, sum = a . result, sliced storage
+static void KERNEL_INDEXED(sparse_sell_mat_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT sums[SLICED_MAX_CHUNK_HEIGHT];
+	U64 height = m->chunk_height;
+	F64 dot = 0;
+	for (U64 c=(range->start + height - 1) / height; c*height < range->end; ++c) {
+		KERNEL_INDEXED(sparse_sell_chunk)(m, x, c, sums);
+		for (U64 i=0; i<height && c*height + i < m->num_rows; ++i) {
+			U64 row = m->chunk_rows[c*height + i];
+			r[row] = sums[i];
+			dot += (F64)x[row] * (F64)sums[i];
+		}
+	}
+	range->sum = dot;
+}
+
+// result = b - A * a, sum = result . result, sliced storage
+static void KERNEL_INDEXED(sparse_sell_mat_residual_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *bv = args->b->KERNEL_VALUES;
+	KERNEL_FLOAT sums[SLICED_MAX_CHUNK_HEIGHT];
+	U64 height = m->chunk_height;
+	F64 dot = 0;
+	for (U64 c=(range->start + height - 1) / height; c*height < range->end; ++c) {
+		KERNEL_INDEXED(sparse_sell_chunk)(m, x, c, sums);
+		for (U64 i=0; i<height && c*height + i < m->num_rows; ++i) {
+			U64 row = m->chunk_rows[c*height + i];
+			KERNEL_FLOAT value = bv[row] - sums[i];
+			r[row] = value;
+			dot += (F64)value * (F64)value;
+		}
+	}
+	range->sum = dot;
+}
+
+// one row of result = A * a for compressed rows, every entry of the row is
+// loaded once for all the columns
+static inline void KERNEL_INDEXED(sparse_block_row)(SparseMatrix *m, KERNEL_FLOAT *r, KERNEL_FLOAT *x, U64 columns, U64 row) {
+	KERNEL_FLOAT *values = m->KERNEL_VALUES;
+	KERNEL_FLOAT *out = r + row*columns;
+	for (U64 j=0; j<columns; ++j) {
+		out[j] = 0;
+	}
+	for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+		KERNEL_FLOAT value = values[i];
+		KERNEL_FLOAT *in = x + m->KERNEL_COLS[i]*columns;
+		for (U64 j=0; j<columns; ++j) {
+			out[j] += value * in[j];
+		}
+	}
+}
+
+// result = A * a, sums = a . result per column
+// result and a must be distinct vectors
+static void KERNEL_INDEXED(sparse_block_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	U64 columns = args->columns;
+	F64 sums[BLOCK_MAX_COLUMNS] = {0};
+	for (U64 row=range->start; row<range->end; ++row) {
+		KERNEL_INDEXED(sparse_block_row)(args->A, r, x, columns, row);
+		for (U64 j=0; j<columns; ++j) {
+			sums[j] += (F64)x[row*columns + j] * (F64)r[row*columns + j];
+		}
+	}
+	memcpy(args->column_sums + range->index * columns, sums, columns * sizeof(F64));
+}
+
+// result = b - A * a, sums = result . result per column
+// result and a must be distinct vectors
+static void KERNEL_INDEXED(sparse_block_residual_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *bv = args->b->KERNEL_VALUES;
+	U64 columns = args->columns;
+	F64 sums[BLOCK_MAX_COLUMNS] = {0};
+	for (U64 row=range->start; row<range->end; ++row) {
+		KERNEL_INDEXED(sparse_block_row)(args->A, r, x, columns, row);
+		for (U64 j=0; j<columns; ++j) {
+			KERNEL_FLOAT value = bv[row*columns + j] - r[row*columns + j];
+			r[row*columns + j] = value;
+			sums[j] += (F64)value * (F64)value;
+		}
+	}
+	memcpy(args->column_sums + range->index * columns, sums, columns * sizeof(F64));
+}
+
+#undef KERNEL_INDEX
+#undef KERNEL_COLS
+#undef KERNEL_INDEXED
@@ -0,0 +1,449 @@
+// NOTE(shaw): this file is a template that gets included once per float
+// precision by sparse_linear_algebra.c, so none of the loops below have to
+// branch on precision. The including file defines:
+//
+//   KERNEL_FLOAT   element type of the vectors and matrix (F32 or F64)
+//   KERNEL_VALUES  union member of Vector/SparseMatrix holding KERNEL_FLOAT values
+//   KERNEL(name)   name with the precision suffix appended
+//
+// Every kernel works on the range [range->start, range->end) of vector
+// elements (or matrix rows) so that run_kernel can hand disjoint ranges to
+// different threads. Kernels that reduce write their partial result to
+// range->sum. The kernels do not validate their arguments, callers are
+// expected to check sizes and precision once up front.
+
+// result = a + b
+static void KERNEL(vec_add)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *y = args->b->KERNEL_VALUES;
+	for (U64 i=range->start; i < range->end; ++i) {
+		r[i] = x[i] + y[i];
+	}
+}
+
+// result = a - b
+static void KERNEL(vec_sub)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *y = args->b->KERNEL_VALUES;
+	for (U64 i=range->start; i < range->end; ++i) {
+		r[i] = x[i] - y[i];
+	}
+}
+
+// sum = a . b, always accumulates in double precision
+static void KERNEL(vec_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *y = args->b->KERNEL_VALUES;
+	F64 result = 0;
+	for (U64 i=range->start; i < range->end; ++i) {
+		result += (F64)x[i] * (F64)y[i];
+	}
+	range->sum = result;
+}
+
+// result = a * scalar
+static void KERNEL(vec_scale)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT s = (KERNEL_FLOAT)args->scalar;
+	for (U64 i=range->start; i < range->end; ++i) {
+		r[i] = x[i] * s;
+	}
+}
+
+// result = result + scalar * a
+static void KERNEL(vec_axpy)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *y = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT alpha = (KERNEL_FLOAT)args->scalar;
+	for (U64 i=range->start; i < range->end; ++i) {
+		y[i] += alpha * x[i];
+	}
+}
+
+// result = a + scalar * result
+static void KERNEL(vec_xpay)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *y = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT beta = (KERNEL_FLOAT)args->scalar;
+	for (U64 i=range->start; i < range->end; ++i) {
+		y[i] = x[i] + beta * y[i];
+	}
+}
+
+// result = result + scalar * a, sum = result . result
+static void KERNEL(vec_axpy_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *y = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT alpha = (KERNEL_FLOAT)args->scalar;
+	F64 result = 0;
+	for (U64 i=range->start; i < range->end; ++i) {
+		KERNEL_FLOAT value = y[i] + alpha * x[i];
+		y[i] = value;
+		result += (F64)value * (F64)value;
+	}
+	range->sum = result;
+}
+
+// one step of pipelined conjugate gradients with alpha and beta from
+// args->pipelined:
+//   z = q + beta * z, s = w + beta * s, p = r + beta * p,
+//   x = x + alpha * p, r = r - alpha * s, w = w - alpha * z
+// the two sums are r . r and w . r of the new r and w, see PipelinedCG
+static void KERNEL(pipelined_cg_update)(KernelArgs *args, KernelRange *range) {
+	PipelinedCG *cg = args->pipelined;
+	KERNEL_FLOAT *x = cg->x->KERNEL_VALUES;
+	KERNEL_FLOAT *r = cg->r->KERNEL_VALUES;
+	KERNEL_FLOAT *w = cg->w->KERNEL_VALUES;
+	KERNEL_FLOAT *p = cg->p->KERNEL_VALUES;
+	KERNEL_FLOAT *s = cg->s->KERNEL_VALUES;
+	KERNEL_FLOAT *z = cg->z->KERNEL_VALUES;
+	KERNEL_FLOAT *q = cg->q->KERNEL_VALUES;
+	KERNEL_FLOAT alpha = (KERNEL_FLOAT)cg->alpha;
+	KERNEL_FLOAT beta = (KERNEL_FLOAT)cg->beta;
+	F64 gamma = 0;
+	F64 delta = 0;
+	for (U64 i=range->start; i < range->end; ++i) {
+		KERNEL_FLOAT zi = q[i] + beta * z[i];
+		KERNEL_FLOAT si = w[i] + beta * s[i];
+		KERNEL_FLOAT pi = r[i] + beta * p[i];
+		KERNEL_FLOAT ri = r[i] - alpha * si;
+		KERNEL_FLOAT wi = w[i] - alpha * zi;
+		z[i] = zi;
+		s[i] = si;
+		p[i] = pi;
+		x[i] += alpha * pi;
+		r[i] = ri;
+		w[i] = wi;
+		gamma += (F64)ri * (F64)ri;
+		delta += (F64)wi * (F64)ri;
+	}
+	args->column_sums[range->index * 2] = gamma;
+	args->column_sums[range->index * 2 + 1] = delta;
+}
+
+// result = a * b elementwise, sum = a . result
+static void KERNEL(vec_mul_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *y = args->b->KERNEL_VALUES;
+	F64 result = 0;
+	for (U64 i=range->start; i < range->end; ++i) {
+		KERNEL_FLOAT value = x[i] * y[i];
+		r[i] = value;
+		result += (F64)x[i] * (F64)value;
+	}
+	range->sum = result;
+}
+
+// result = (L * L^T)^-1 * a with L = A a lower triangular factor from
+// sparse_mat_incomplete_cholesky, sum = a . result. the triangular solves
+// carry a dependency from row to row, so this has to run over the whole
+// vector in a single range on one thread
+static void KERNEL(sparse_cholesky_solve_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *L = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *values = L->KERNEL_VALUES;
+
+	// forward substitution, L * y = a
+	for (U64 row=range->start; row<range->end; ++row) {
+		U64 diag = L->row_offsets[row+1] - 1;
+		KERNEL_FLOAT sum = x[row];
+		for (U64 i=L->row_offsets[row]; i<diag; ++i) {
+			sum -= values[i] * r[L->cols[i]];
+		}
+		r[row] = sum / values[diag];
+	}
+
+	// backward substitution, L^T * result = y, by columns of L^T
+	F64 dot = 0;
+	for (U64 row=range->end; row-- > range->start;) {
+		U64 diag = L->row_offsets[row+1] - 1;
+		KERNEL_FLOAT value = r[row] / values[diag];
+		r[row] = value;
+		for (U64 i=L->row_offsets[row]; i<diag; ++i) {
+			r[L->cols[i]] -= values[i] * value;
+		}
+		dot += (F64)x[row] * (F64)value;
+	}
+	range->sum = dot;
+}
+
+// adds the overflow windows the scatter pass left for the rows of range. only
+// the windows of earlier ranges that end less than the bandwidth before range
+// reach into it
+static void KERNEL(sparse_sym_add_overflow)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	U64 first_window = range->index;
+	while (first_window > 0) {
+		U64 start, end;
+		thread_pool_range(m->num_rows, args->overflow_ranges, first_window - 1, &start, &end);
+		if (end + m->bandwidth <= range->start) break;
+		--first_window;
+	}
+	for (U64 j=first_window; j<range->index; ++j) {
+		U64 start, end;
+		thread_pool_range(m->num_rows, args->overflow_ranges, j, &start, &end);
+		KERNEL_FLOAT *overflow = args->overflow->KERNEL_VALUES + j * m->bandwidth;
+		U64 first = MAX(range->start, end);
+		U64 last = MIN(range->end, end + m->bandwidth);
+		for (U64 row=first; row<last; ++row) {
+			r[row] += overflow[row - end];
+		}
+	}
+}
+
+// result = A * a, second pass for symmetric storage
+static void KERNEL(sparse_sym_mat_mul_vec)(KernelArgs *args, KernelRange *range) {
+	KERNEL(sparse_sym_add_overflow)(args, range);
+}
+
+// result = A * a, sum = a . result, second pass for symmetric storage
+static void KERNEL(sparse_sym_mat_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL(sparse_sym_add_overflow)(args, range);
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	F64 dot = 0;
+	for (U64 row=range->start; row<range->end; ++row) {
+		dot += (F64)x[row] * (F64)r[row];
+	}
+	range->sum = dot;
+}
+
+// result = b - A * a, sum = result . result, second pass for symmetric
+// storage
+static void KERNEL(sparse_sym_mat_residual_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL(sparse_sym_add_overflow)(args, range);
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *bv = args->b->KERNEL_VALUES;
+	F64 dot = 0;
+	for (U64 row=range->start; row<range->end; ++row) {
+		KERNEL_FLOAT value = bv[row] - r[row];
+		r[row] = value;
+		dot += (F64)value * (F64)value;
+	}
+	range->sum = dot;
+}
+
+// result = A * a for the rows [start, end) of a matrix in diagonal storage
+static inline void KERNEL(sparse_dia_block)(SparseMatrix *m, KERNEL_FLOAT *r, KERNEL_FLOAT *x, U64 start, U64 end) {
+	U64 n = m->num_rows;
+	for (U64 row=start; row<end; ++row) {
+		r[row] = 0;
+	}
+	for (U64 d=0; d<m->num_diagonals; ++d) {
+		S64 offset = m->diagonal_offsets[d];
+		KERNEL_FLOAT *values = m->KERNEL_VALUES + d * n;
+		// only the rows whose column row + offset is inside the matrix
+		U64 first = offset < 0 ? MAX(start, (U64)-offset) : start;
+		U64 last = offset > 0 ? MIN(end, n - (U64)offset) : end;
+		for (U64 row=first; row<last; ++row) {
+			r[row] += values[row] * x[row + offset];
+		}
+	}
+}
+
+// result = A * a, diagonal storage
+static void KERNEL(sparse_dia_mat_mul_vec)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	for (U64 start=range->start; start<range->end; start += DIAGONAL_BLOCK_ROWS) {
+		KERNEL(sparse_dia_block)(args->A, r, x, start, MIN(start + DIAGONAL_BLOCK_ROWS, range->end));
+	}
+}
+
+// result = A * a, sum = a . result, diagonal storage
+static void KERNEL(sparse_dia_mat_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	F64 dot = 0;
+	for (U64 start=range->start; start<range->end; start += DIAGONAL_BLOCK_ROWS) {
+		U64 end = MIN(start + DIAGONAL_BLOCK_ROWS, range->end);
+		KERNEL(sparse_dia_block)(args->A, r, x, start, end);
+		for (U64 row=start; row<end; ++row) {
+			dot += (F64)x[row] * (F64)r[row];
+		}
+	}
+	range->sum = dot;
+}
+
+// result = b - A * a, sum = result . result, diagonal storage
+static void KERNEL(sparse_dia_mat_residual_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *bv = args->b->KERNEL_VALUES;
+	F64 dot = 0;
+	for (U64 start=range->start; start<range->end; start += DIAGONAL_BLOCK_ROWS) {
+		U64 end = MIN(start + DIAGONAL_BLOCK_ROWS, range->end);
+		KERNEL(sparse_dia_block)(args->A, r, x, start, end);
+		for (U64 row=start; row<end; ++row) {
+			KERNEL_FLOAT value = bv[row] - r[row];
+			r[row] = value;
+			dot += (F64)value * (F64)value;
+		}
+	}
+	range->sum = dot;
+}
+
+// result = result + scalars * a, per column
+static void KERNEL(block_axpy)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *y = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	U64 columns = args->columns;
+	KERNEL_FLOAT alpha[BLOCK_MAX_COLUMNS];
+	for (U64 j=0; j<columns; ++j) {
+		alpha[j] = (KERNEL_FLOAT)args->scalars[j];
+	}
+	for (U64 row=range->start; row<range->end; ++row) {
+		for (U64 j=0; j<columns; ++j) {
+			y[row*columns + j] += alpha[j] * x[row*columns + j];
+		}
+	}
+}
+
+// result = a + scalars * result, per column
+static void KERNEL(block_xpay)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *y = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	U64 columns = args->columns;
+	KERNEL_FLOAT beta[BLOCK_MAX_COLUMNS];
+	for (U64 j=0; j<columns; ++j) {
+		beta[j] = (KERNEL_FLOAT)args->scalars[j];
+	}
+	for (U64 row=range->start; row<range->end; ++row) {
+		for (U64 j=0; j<columns; ++j) {
+			y[row*columns + j] = x[row*columns + j] + beta[j] * y[row*columns + j];
+		}
+	}
+}
+
+// result = result + scalars * a, sums = result . result, per column
+static void KERNEL(block_axpy_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *y = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	U64 columns = args->columns;
+	KERNEL_FLOAT alpha[BLOCK_MAX_COLUMNS];
+	F64 sums[BLOCK_MAX_COLUMNS] = {0};
+	for (U64 j=0; j<columns; ++j) {
+		alpha[j] = (KERNEL_FLOAT)args->scalars[j];
+	}
+	for (U64 row=range->start; row<range->end; ++row) {
+		for (U64 j=0; j<columns; ++j) {
+			KERNEL_FLOAT value = y[row*columns + j] + alpha[j] * x[row*columns + j];
+			y[row*columns + j] = value;
+			sums[j] += (F64)value * (F64)value;
+		}
+	}
+	memcpy(args->column_sums + range->index * columns, sums, columns * sizeof(F64));
+}
+
+#define KERNEL_INDEX U64
+#define KERNEL_COLS cols
+#define KERNEL_INDEXED(name) KERNEL(name)
+#include "sparse_linear_algebra_index_kernels.c"
+
+#define KERNEL_INDEX U32
+#define KERNEL_COLS cols32
+#define KERNEL_INDEXED(name) KERNEL(name##_u32)
+#include "sparse_linear_algebra_index_kernels.c"
+
+// dot product of one row of m with x, for delta encoded columns
+static inline KERNEL_FLOAT KERNEL(sparse_delta_row)(SparseMatrix *m, KERNEL_FLOAT *x, U64 row) {
+	KERNEL_FLOAT *values = m->KERNEL_VALUES;
+	U8 *bytes = m->col_bytes + m->col_byte_offsets[row];
+	U64 col = row;
+	KERNEL_FLOAT sum = 0;
+	for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+		col = sparse_delta_next(&bytes, col);
+		sum += values[i] * x[col];
+	}
+	return sum;
+}
+
+// result = A * a, compressed rows with delta encoded columns
+static void KERNEL(sparse_delta_mat_mul_vec)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	for (U64 row=range->start; row<range->end; ++row) {
+		r[row] = KERNEL(sparse_delta_row)(args->A, x, row);
+	}
+}
+
+// result = A * a, sum = a . result, compressed rows with delta encoded columns
+static void KERNEL(sparse_delta_mat_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	F64 dot = 0;
+	for (U64 row=range->start; row<range->end; ++row) {
+		KERNEL_FLOAT sum = KERNEL(sparse_delta_row)(args->A, x, row);
+		r[row] = sum;
+		dot += (F64)x[row] * (F64)sum;
+	}
+	range->sum = dot;
+}
+
+// result = b - A * a, sum = result . result, compressed rows with delta
+// encoded columns
+static void KERNEL(sparse_delta_mat_residual_dot)(KernelArgs *args, KernelRange *range) {
+	KERNEL_FLOAT *r = args->result->KERNEL_VALUES;
+	KERNEL_FLOAT *x = args->a->KERNEL_VALUES;
+	KERNEL_FLOAT *bv = args->b->KERNEL_VALUES;
+	F64 dot = 0;
+	for (U64 row=range->start; row<range->end; ++row) {
+		KERNEL_FLOAT value = bv[row] - KERNEL(sparse_delta_row)(args->A, x, row);
+		r[row] = value;
+		dot += (F64)value * (F64)value;
+	}
+	range->sum = dot;
+}
+
+static LinearAlgebraKernels KERNEL(kernels) = {
+	.vec_add = KERNEL(vec_add),
+	.vec_sub = KERNEL(vec_sub),
+	.vec_dot = KERNEL(vec_dot),
+	.vec_scale = KERNEL(vec_scale),
+	.sparse_mat_mul_vec = KERNEL(sparse_mat_mul_vec),
+	.vec_axpy = KERNEL(vec_axpy),
+	.vec_xpay = KERNEL(vec_xpay),
+	.vec_axpy_dot = KERNEL(vec_axpy_dot),
+	.sparse_mat_mul_vec_dot = KERNEL(sparse_mat_mul_vec_dot),
+	.sparse_mat_residual_dot = KERNEL(sparse_mat_residual_dot),
+	.vec_mul_dot = KERNEL(vec_mul_dot),
+	.pipelined_cg_update = KERNEL(pipelined_cg_update),
+	.sparse_cholesky_solve_dot = KERNEL(sparse_cholesky_solve_dot),
+	.sparse_sym_mat_mul_vec_scatter = KERNEL(sparse_sym_mat_mul_vec_scatter),
+	.sparse_sym_mat_mul_vec = KERNEL(sparse_sym_mat_mul_vec),
+	.sparse_sym_mat_mul_vec_dot = KERNEL(sparse_sym_mat_mul_vec_dot),
+	.sparse_sym_mat_residual_dot = KERNEL(sparse_sym_mat_residual_dot),
+	.sparse_dia_mat_mul_vec = KERNEL(sparse_dia_mat_mul_vec),
+	.sparse_dia_mat_mul_vec_dot = KERNEL(sparse_dia_mat_mul_vec_dot),
+	.sparse_dia_mat_residual_dot = KERNEL(sparse_dia_mat_residual_dot),
+	.sparse_sell_mat_mul_vec = KERNEL(sparse_sell_mat_mul_vec),
+	.sparse_sell_mat_mul_vec_dot = KERNEL(sparse_sell_mat_mul_vec_dot),
+	.sparse_sell_mat_residual_dot = KERNEL(sparse_sell_mat_residual_dot),
+	.block_axpy = KERNEL(block_axpy),
+	.block_xpay = KERNEL(block_xpay),
+	.block_axpy_dot = KERNEL(block_axpy_dot),
+	.sparse_block_mul_vec_dot = KERNEL(sparse_block_mul_vec_dot),
+	.sparse_block_residual_dot = KERNEL(sparse_block_residual_dot),
+	.sparse_mat_mul_vec_u32 = KERNEL(sparse_mat_mul_vec_u32),
+	.sparse_mat_mul_vec_dot_u32 = KERNEL(sparse_mat_mul_vec_dot_u32),
+	.sparse_mat_residual_dot_u32 = KERNEL(sparse_mat_residual_dot_u32),
+	.sparse_sym_mat_mul_vec_scatter_u32 = KERNEL(sparse_sym_mat_mul_vec_scatter_u32),
+	.sparse_sell_mat_mul_vec_u32 = KERNEL(sparse_sell_mat_mul_vec_u32),
+	.sparse_sell_mat_mul_vec_dot_u32 = KERNEL(sparse_sell_mat_mul_vec_dot_u32),
+	.sparse_sell_mat_residual_dot_u32 = KERNEL(sparse_sell_mat_residual_dot_u32),
+	.sparse_block_mul_vec_dot_u32 = KERNEL(sparse_block_mul_vec_dot_u32),
+	.sparse_block_residual_dot_u32 = KERNEL(sparse_block_residual_dot_u32),
+	.sparse_delta_mat_mul_vec = KERNEL(sparse_delta_mat_mul_vec),
+	.sparse_delta_mat_mul_vec_dot = KERNEL(sparse_delta_mat_mul_vec_dot),
+	.sparse_delta_mat_residual_dot = KERNEL(sparse_delta_mat_residual_dot),
+};
+
+#undef KERNEL_FLOAT
+#undef KERNEL_VALUES
+#undef KERNEL
@@ -0,0 +1,377 @@
+// ---------------------------------------------------------------------------
+// SIMD Kernels
+// ---------------------------------------------------------------------------
+// NOTE(shaw): every block below defines the primitives of one instruction set
+// and float precision and then instantiates sparse_linear_algebra_simd_kernels.c
+// with them. With gcc/clang the functions are compiled for their instruction
+// set through target attributes, so the whole program can still be built for
+// the sse2 baseline and pick the widest kernels at startup (see get_kernels).
+// msvc does not need the attributes to emit these intrinsics.
+
+#if _MSC_VER
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_SSE2   __attribute__((target("sse2")))
+#define TARGET_AVX2   __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+// ---------------------------------------------------------------------------
+// SSE2, F32
+// ---------------------------------------------------------------------------
+#define SIMD_FLOAT F32
+#define SIMD_VALUES valuesF32
+#define SIMD_VEC __m128
+#define SIMD_ACC SimdAcc_sse2_F32
+#define SIMD_WIDTH 4
+#define SIMD_TARGET TARGET_SSE2
+#define SIMD(name) name##_sse2_F32
+#define SIMD_SCALAR(name) name##_F32
+#define SIMD_GATHER 0
+
+typedef struct { __m128d lo, hi; } SimdAcc_sse2_F32;
+
+static SIMD_TARGET inline __m128 SIMD(simd_load)(F32 *p)             { return _mm_loadu_ps(p); }
+static SIMD_TARGET inline void   SIMD(simd_store)(F32 *p, __m128 v)  { _mm_storeu_ps(p, v); }
+static SIMD_TARGET inline __m128 SIMD(simd_set1)(F32 x)              { return _mm_set1_ps(x); }
+static SIMD_TARGET inline __m128 SIMD(simd_add)(__m128 a, __m128 b)  { return _mm_add_ps(a, b); }
+static SIMD_TARGET inline __m128 SIMD(simd_sub)(__m128 a, __m128 b)  { return _mm_sub_ps(a, b); }
+static SIMD_TARGET inline __m128 SIMD(simd_mul)(__m128 a, __m128 b)  { return _mm_mul_ps(a, b); }
+static SIMD_TARGET inline __m128 SIMD(simd_fmadd)(__m128 a, __m128 b, __m128 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+static SIMD_TARGET inline F32 SIMD(simd_reduce)(__m128 v) {
+	v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+static SIMD_TARGET inline SIMD_ACC SIMD(simd_acc_zero)(void) {
+	SIMD_ACC acc = { _mm_setzero_pd(), _mm_setzero_pd() };
+	return acc;
+}
+
+static SIMD_TARGET inline SIMD_ACC SIMD(simd_acc_fmadd)(SIMD_ACC acc, __m128 a, __m128 b) {
+	acc.lo = _mm_add_pd(acc.lo, _mm_mul_pd(_mm_cvtps_pd(a), _mm_cvtps_pd(b)));
+	acc.hi = _mm_add_pd(acc.hi, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(a, a)), _mm_cvtps_pd(_mm_movehl_ps(b, b))));
+	return acc;
+}
+
+static SIMD_TARGET inline F64 SIMD(simd_acc_reduce)(SIMD_ACC acc) {
+	__m128d v = _mm_add_pd(acc.lo, acc.hi);
+	return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+#include "sparse_linear_algebra_simd_kernels.c"
+
+// ---------------------------------------------------------------------------
+// SSE2, F64
+// ---------------------------------------------------------------------------
+#define SIMD_FLOAT F64
+#define SIMD_VALUES valuesF64
+#define SIMD_VEC __m128d
+#define SIMD_ACC __m128d
+#define SIMD_WIDTH 2
+#define SIMD_TARGET TARGET_SSE2
+#define SIMD(name) name##_sse2_F64
+#define SIMD_SCALAR(name) name##_F64
+#define SIMD_GATHER 0
+
+static SIMD_TARGET inline __m128d SIMD(simd_load)(F64 *p)              { return _mm_loadu_pd(p); }
+static SIMD_TARGET inline void    SIMD(simd_store)(F64 *p, __m128d v)  { _mm_storeu_pd(p, v); }
+static SIMD_TARGET inline __m128d SIMD(simd_set1)(F64 x)               { return _mm_set1_pd(x); }
+static SIMD_TARGET inline __m128d SIMD(simd_add)(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+static SIMD_TARGET inline __m128d SIMD(simd_sub)(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+static SIMD_TARGET inline __m128d SIMD(simd_mul)(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+static SIMD_TARGET inline __m128d SIMD(simd_fmadd)(__m128d a, __m128d b, __m128d c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+
+static SIMD_TARGET inline F64 SIMD(simd_reduce)(__m128d v) {
+	return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+static SIMD_TARGET inline __m128d SIMD(simd_acc_zero)(void)                             { return _mm_setzero_pd(); }
+static SIMD_TARGET inline __m128d SIMD(simd_acc_fmadd)(__m128d acc, __m128d a, __m128d b) { return _mm_add_pd(acc, _mm_mul_pd(a, b)); }
+static SIMD_TARGET inline F64     SIMD(simd_acc_reduce)(__m128d acc)                     { return SIMD(simd_reduce)(acc); }
+
+#include "sparse_linear_algebra_simd_kernels.c"
+
+// ---------------------------------------------------------------------------
+// AVX2 + FMA, F32
+// ---------------------------------------------------------------------------
+#define SIMD_FLOAT F32
+#define SIMD_VALUES valuesF32
+#define SIMD_VEC __m256
+#define SIMD_ACC SimdAcc_avx2_F32
+#define SIMD_WIDTH 8
+#define SIMD_TARGET TARGET_AVX2
+#define SIMD(name) name##_avx2_F32
+#define SIMD_SCALAR(name) name##_F32
+#define SIMD_GATHER 1
+
+typedef struct { __m256d lo, hi; } SimdAcc_avx2_F32;
+
+static SIMD_TARGET inline __m256 SIMD(simd_load)(F32 *p)             { return _mm256_loadu_ps(p); }
+static SIMD_TARGET inline void   SIMD(simd_store)(F32 *p, __m256 v)  { _mm256_storeu_ps(p, v); }
+static SIMD_TARGET inline __m256 SIMD(simd_set1)(F32 x)              { return _mm256_set1_ps(x); }
+static SIMD_TARGET inline __m256 SIMD(simd_add)(__m256 a, __m256 b)  { return _mm256_add_ps(a, b); }
+static SIMD_TARGET inline __m256 SIMD(simd_sub)(__m256 a, __m256 b)  { return _mm256_sub_ps(a, b); }
+static SIMD_TARGET inline __m256 SIMD(simd_mul)(__m256 a, __m256 b)  { return _mm256_mul_ps(a, b); }
+static SIMD_TARGET inline __m256 SIMD(simd_fmadd)(__m256 a, __m256 b, __m256 c) { return _mm256_fmadd_ps(a, b, c); }
+
+static SIMD_TARGET inline F32 SIMD(simd_reduce)(__m256 v) {
+	__m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+	x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+	return _mm_cvtss_f32(x);
+}
+
+static SIMD_TARGET inline SIMD_ACC SIMD(simd_acc_zero)(void) {
+	SIMD_ACC acc = { _mm256_setzero_pd(), _mm256_setzero_pd() };
+	return acc;
+}
+
+static SIMD_TARGET inline SIMD_ACC SIMD(simd_acc_fmadd)(SIMD_ACC acc, __m256 a, __m256 b) {
+	acc.lo = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(a)), _mm256_cvtps_pd(_mm256_castps256_ps128(b)), acc.lo);
+	acc.hi = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(b, 1)), acc.hi);
+	return acc;
+}
+
+static SIMD_TARGET inline F64 SIMD(simd_acc_reduce)(SIMD_ACC acc) {
+	__m256d v = _mm256_add_pd(acc.lo, acc.hi);
+	__m128d x = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+}
+
+// NOTE(shaw): indices are 64 bit, so a full register takes two gathers of 4
+static SIMD_TARGET inline __m256 SIMD(simd_gather)(F32 *base, U64 *indices) {
+	__m128 lo = _mm256_i64gather_ps(base, _mm256_loadu_si256((__m256i*)indices), 4);
+	__m128 hi = _mm256_i64gather_ps(base, _mm256_loadu_si256((__m256i*)(indices + 4)), 4);
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+static SIMD_TARGET inline __m256 SIMD(simd_load_partial)(F32 *p, U64 count) {
+	__m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	return _mm256_maskload_ps(p, mask);
+}
+
+static SIMD_TARGET inline __m128 SIMD(simd_gather_partial4)(F32 *base, U64 *indices, S64 count) {
+	__m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+	__m256i mask64 = _mm256_cmpgt_epi64(_mm256_set1_epi64x(count), lanes);
+	__m128 mask32 = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32((int)count), _mm_setr_epi32(0, 1, 2, 3)));
+	__m256i idx = _mm256_maskload_epi64((long long*)indices, mask64);
+	return _mm256_mask_i64gather_ps(_mm_setzero_ps(), base, idx, mask32, 4);
+}
+
+static SIMD_TARGET inline __m256 SIMD(simd_gather_partial)(F32 *base, U64 *indices, U64 count) {
+	__m128 lo = SIMD(simd_gather_partial4)(base, indices, (S64)count);
+	__m128 hi = count > 4 ? SIMD(simd_gather_partial4)(base, indices + 4, (S64)count - 4) : _mm_setzero_ps();
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+// 32 bit indices fill a register with one gather
+static SIMD_TARGET inline __m256 SIMD(simd_gather_u32)(F32 *base, U32 *indices) {
+	return _mm256_i32gather_ps(base, _mm256_loadu_si256((__m256i*)indices), 4);
+}
+
+static SIMD_TARGET inline __m256 SIMD(simd_gather_partial_u32)(F32 *base, U32 *indices, U64 count) {
+	__m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	__m256i idx = _mm256_maskload_epi32((int*)indices, mask);
+	return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, idx, _mm256_castsi256_ps(mask), 4);
+}
+
+#include "sparse_linear_algebra_simd_kernels.c"
+
+// ---------------------------------------------------------------------------
+// AVX2 + FMA, F64
+// ---------------------------------------------------------------------------
+#define SIMD_FLOAT F64
+#define SIMD_VALUES valuesF64
+#define SIMD_VEC __m256d
+#define SIMD_ACC __m256d
+#define SIMD_WIDTH 4
+#define SIMD_TARGET TARGET_AVX2
+#define SIMD(name) name##_avx2_F64
+#define SIMD_SCALAR(name) name##_F64
+#define SIMD_GATHER 1
+
+static SIMD_TARGET inline __m256d SIMD(simd_load)(F64 *p)              { return _mm256_loadu_pd(p); }
+static SIMD_TARGET inline void    SIMD(simd_store)(F64 *p, __m256d v)  { _mm256_storeu_pd(p, v); }
+static SIMD_TARGET inline __m256d SIMD(simd_set1)(F64 x)               { return _mm256_set1_pd(x); }
+static SIMD_TARGET inline __m256d SIMD(simd_add)(__m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+static SIMD_TARGET inline __m256d SIMD(simd_sub)(__m256d a, __m256d b) { return _mm256_sub_pd(a, b); }
+static SIMD_TARGET inline __m256d SIMD(simd_mul)(__m256d a, __m256d b) { return _mm256_mul_pd(a, b); }
+static SIMD_TARGET inline __m256d SIMD(simd_fmadd)(__m256d a, __m256d b, __m256d c) { return _mm256_fmadd_pd(a, b, c); }
+
+static SIMD_TARGET inline F64 SIMD(simd_reduce)(__m256d v) {
+	__m128d x = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+}
+
+static SIMD_TARGET inline __m256d SIMD(simd_acc_zero)(void)                             { return _mm256_setzero_pd(); }
+static SIMD_TARGET inline __m256d SIMD(simd_acc_fmadd)(__m256d acc, __m256d a, __m256d b) { return _mm256_fmadd_pd(a, b, acc); }
+static SIMD_TARGET inline F64     SIMD(simd_acc_reduce)(__m256d acc)                     { return SIMD(simd_reduce)(acc); }
+
+static SIMD_TARGET inline __m256d SIMD(simd_gather)(F64 *base, U64 *indices) {
+	return _mm256_i64gather_pd(base, _mm256_loadu_si256((__m256i*)indices), 8);
+}
+
+static SIMD_TARGET inline __m256i SIMD(simd_partial_mask)(U64 count) {
+	return _mm256_cmpgt_epi64(_mm256_set1_epi64x((S64)count), _mm256_setr_epi64x(0, 1, 2, 3));
+}
+
+static SIMD_TARGET inline __m256d SIMD(simd_load_partial)(F64 *p, U64 count) {
+	return _mm256_maskload_pd(p, SIMD(simd_partial_mask)(count));
+}
+
+static SIMD_TARGET inline __m256d SIMD(simd_gather_partial)(F64 *base, U64 *indices, U64 count) {
+	__m256i mask = SIMD(simd_partial_mask)(count);
+	__m256i idx = _mm256_maskload_epi64((long long*)indices, mask);
+	return _mm256_mask_i64gather_pd(_mm256_setzero_pd(), base, idx, _mm256_castsi256_pd(mask), 8);
+}
+
+static SIMD_TARGET inline __m256d SIMD(simd_gather_u32)(F64 *base, U32 *indices) {
+	return _mm256_i32gather_pd(base, _mm_loadu_si128((__m128i*)indices), 8);
+}
+
+static SIMD_TARGET inline __m256d SIMD(simd_gather_partial_u32)(F64 *base, U32 *indices, U64 count) {
+	__m128i mask32 = _mm_cmpgt_epi32(_mm_set1_epi32((int)count), _mm_setr_epi32(0, 1, 2, 3));
+	__m128i idx = _mm_maskload_epi32((int*)indices, mask32);
+	return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, idx, _mm256_castsi256_pd(SIMD(simd_partial_mask)(count)), 8);
+}
+
+#include "sparse_linear_algebra_simd_kernels.c"
+
+// ---------------------------------------------------------------------------
+// AVX-512, F32
+// ---------------------------------------------------------------------------
+#define SIMD_FLOAT F32
+#define SIMD_VALUES valuesF32
+#define SIMD_VEC __m512
+#define SIMD_ACC SimdAcc_avx512_F32
+#define SIMD_WIDTH 16
+#define SIMD_TARGET TARGET_AVX512
+#define SIMD(name) name##_avx512_F32
+#define SIMD_SCALAR(name) name##_F32
+#define SIMD_GATHER 1
+
+typedef struct { __m512d lo, hi; } SimdAcc_avx512_F32;
+
+static SIMD_TARGET inline __m512 SIMD(simd_load)(F32 *p)             { return _mm512_loadu_ps(p); }
+static SIMD_TARGET inline void   SIMD(simd_store)(F32 *p, __m512 v)  { _mm512_storeu_ps(p, v); }
+static SIMD_TARGET inline __m512 SIMD(simd_set1)(F32 x)              { return _mm512_set1_ps(x); }
+static SIMD_TARGET inline __m512 SIMD(simd_add)(__m512 a, __m512 b)  { return _mm512_add_ps(a, b); }
+static SIMD_TARGET inline __m512 SIMD(simd_sub)(__m512 a, __m512 b)  { return _mm512_sub_ps(a, b); }
+static SIMD_TARGET inline __m512 SIMD(simd_mul)(__m512 a, __m512 b)  { return _mm512_mul_ps(a, b); }
+static SIMD_TARGET inline __m512 SIMD(simd_fmadd)(__m512 a, __m512 b, __m512 c) { return _mm512_fmadd_ps(a, b, c); }
+static SIMD_TARGET inline F32    SIMD(simd_reduce)(__m512 v)         { return _mm512_reduce_add_ps(v); }
+
+// upper 8 lanes of a, only needs avx512f
+static SIMD_TARGET inline __m256 SIMD(simd_upper_half)(__m512 a) {
+	return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1));
+}
+
+static SIMD_TARGET inline __m512 SIMD(simd_combine)(__m256 lo, __m256 hi) {
+	return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lo)), _mm256_castps_pd(hi), 1));
+}
+
+static SIMD_TARGET inline SIMD_ACC SIMD(simd_acc_zero)(void) {
+	SIMD_ACC acc = { _mm512_setzero_pd(), _mm512_setzero_pd() };
+	return acc;
+}
+
+static SIMD_TARGET inline SIMD_ACC SIMD(simd_acc_fmadd)(SIMD_ACC acc, __m512 a, __m512 b) {
+	acc.lo = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(a)), _mm512_cvtps_pd(_mm512_castps512_ps256(b)), acc.lo);
+	acc.hi = _mm512_fmadd_pd(_mm512_cvtps_pd(SIMD(simd_upper_half)(a)), _mm512_cvtps_pd(SIMD(simd_upper_half)(b)), acc.hi);
+	return acc;
+}
+
+static SIMD_TARGET inline F64 SIMD(simd_acc_reduce)(SIMD_ACC acc) {
+	return _mm512_reduce_add_pd(_mm512_add_pd(acc.lo, acc.hi));
+}
+
+static SIMD_TARGET inline __m512 SIMD(simd_gather)(F32 *base, U64 *indices) {
+	__m256 lo = _mm512_i64gather_ps(_mm512_loadu_si512(indices), base, 4);
+	__m256 hi = _mm512_i64gather_ps(_mm512_loadu_si512(indices + 8), base, 4);
+	return SIMD(simd_combine)(lo, hi);
+}
+
+static SIMD_TARGET inline __m512 SIMD(simd_load_partial)(F32 *p, U64 count) {
+	return _mm512_maskz_loadu_ps((__mmask16)((1u << count) - 1), p);
+}
+
+static SIMD_TARGET inline __m512 SIMD(simd_gather_partial)(F32 *base, U64 *indices, U64 count) {
+	__mmask16 mask = (__mmask16)((1u << count) - 1);
+	__mmask8 mask_lo = (__mmask8)mask;
+	__mmask8 mask_hi = (__mmask8)(mask >> 8);
+	__m512i idx_lo = _mm512_maskz_loadu_epi64(mask_lo, indices);
+	__m512i idx_hi = _mm512_maskz_loadu_epi64(mask_hi, indices + 8);
+	__m256 lo = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), mask_lo, idx_lo, base, 4);
+	__m256 hi = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), mask_hi, idx_hi, base, 4);
+	return SIMD(simd_combine)(lo, hi);
+}
+
+static SIMD_TARGET inline __m512 SIMD(simd_gather_u32)(F32 *base, U32 *indices) {
+	return _mm512_i32gather_ps(_mm512_loadu_si512(indices), base, 4);
+}
+
+static SIMD_TARGET inline __m512 SIMD(simd_gather_partial_u32)(F32 *base, U32 *indices, U64 count) {
+	__mmask16 mask = (__mmask16)((1u << count) - 1);
+	__m512i idx = _mm512_maskz_loadu_epi32(mask, indices);
+	return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, idx, base, 4);
+}
+
+#include "sparse_linear_algebra_simd_kernels.c"
+
+// ---------------------------------------------------------------------------
+// AVX-512, F64
+// ---------------------------------------------------------------------------
+#define SIMD_FLOAT F64
+#define SIMD_VALUES valuesF64
+#define SIMD_VEC __m512d
+#define SIMD_ACC __m512d
+#define SIMD_WIDTH 8
+#define SIMD_TARGET TARGET_AVX512
+#define SIMD(name) name##_avx512_F64
+#define SIMD_SCALAR(name) name##_F64
+#define SIMD_GATHER 1
+
+static SIMD_TARGET inline __m512d SIMD(simd_load)(F64 *p)              { return _mm512_loadu_pd(p); }
+static SIMD_TARGET inline void    SIMD(simd_store)(F64 *p, __m512d v)  { _mm512_storeu_pd(p, v); }
+static SIMD_TARGET inline __m512d SIMD(simd_set1)(F64 x)               { return _mm512_set1_pd(x); }
+static SIMD_TARGET inline __m512d SIMD(simd_add)(__m512d a, __m512d b) { return _mm512_add_pd(a, b); }
+static SIMD_TARGET inline __m512d SIMD(simd_sub)(__m512d a, __m512d b) { return _mm512_sub_pd(a, b); }
+static SIMD_TARGET inline __m512d SIMD(simd_mul)(__m512d a, __m512d b) { return _mm512_mul_pd(a, b); }
+static SIMD_TARGET inline __m512d SIMD(simd_fmadd)(__m512d a, __m512d b, __m512d c) { return _mm512_fmadd_pd(a, b, c); }
+static SIMD_TARGET inline F64     SIMD(simd_reduce)(__m512d v)         { return _mm512_reduce_add_pd(v); }
+
+static SIMD_TARGET inline __m512d SIMD(simd_acc_zero)(void)                             { return _mm512_setzero_pd(); }
+static SIMD_TARGET inline __m512d SIMD(simd_acc_fmadd)(__m512d acc, __m512d a, __m512d b) { return _mm512_fmadd_pd(a, b, acc); }
+static SIMD_TARGET inline F64     SIMD(simd_acc_reduce)(__m512d acc)                     { return _mm512_reduce_add_pd(acc); }
+
+static SIMD_TARGET inline __m512d SIMD(simd_gather)(F64 *base, U64 *indices) {
+	return _mm512_i64gather_pd(_mm512_loadu_si512(indices), base, 8);
+}
+
+static SIMD_TARGET inline __m512d SIMD(simd_load_partial)(F64 *p, U64 count) {
+	return _mm512_maskz_loadu_pd((__mmask8)((1u << count) - 1), p);
+}
+
+static SIMD_TARGET inline __m512d SIMD(simd_gather_partial)(F64 *base, U64 *indices, U64 count) {
+	__mmask8 mask = (__mmask8)((1u << count) - 1);
+	__m512i idx = _mm512_maskz_loadu_epi64(mask, indices);
+	return _mm512_mask_i64gather_pd(_mm512_setzero_pd(), mask, idx, base, 8);
+}
+
+static SIMD_TARGET inline __m512d SIMD(simd_gather_u32)(F64 *base, U32 *indices) {
+	return _mm512_i32gather_pd(_mm256_loadu_si256((__m256i*)indices), base, 8);
+}
+
+// the 256 bit masked load needs avx512vl, load 16 lanes and keep the low 8
+static SIMD_TARGET inline __m512d SIMD(simd_gather_partial_u32)(F64 *base, U32 *indices, U64 count) {
+	__mmask8 mask = (__mmask8)((1u << count) - 1);
+	__m512i idx = _mm512_maskz_loadu_epi32((__mmask16)mask, indices);
+	return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), mask, _mm512_castsi512_si256(idx), base, 8);
+}
+
+#include "sparse_linear_algebra_simd_kernels.c"
@@ -0,0 +1,201 @@
+// NOTE(shaw): this file is a template for the SIMD kernels that read the
+// column indices of a matrix, sparse_linear_algebra_simd_kernels.c includes
+// it once per index width on top of its own instruction set and precision.
+// The including file defines:
+//
+//   SIMD_COLS        member of SparseMatrix holding the column indices
+//                    (cols or cols32)
+//   SIMD_INDEXED(name)  name with the index width, instruction set and
+//                       precision appended
+//
+// and SIMD_INDEXED(simd_gather) and SIMD_INDEXED(simd_gather_partial) when
+// SIMD_GATHER is set. 32 bit indices fill a register with half the index
+// bytes, and for single precision one gather instruction instead of two.
+
+// rows [start, end) of a block product, the columns of a row of a are
+// contiguous so this needs no gather
+static SIMD_TARGET inline void SIMD_INDEXED(sparse_block_rows)(SparseMatrix *m, SIMD_FLOAT *r, SIMD_FLOAT *x, U64 columns, U64 start, U64 end) {
+	SIMD_FLOAT *values = m->SIMD_VALUES;
+	memset(r + start*columns, 0, (end - start) * columns * sizeof(SIMD_FLOAT));
+	for (U64 row=start; row<end; ++row) {
+		SIMD_FLOAT *out = r + row*columns;
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			SIMD(block_row_fmadd)(out, values[i], x + m->SIMD_COLS[i]*columns, columns);
+		}
+	}
+}
+
+static SIMD_TARGET void SIMD_INDEXED(sparse_block_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	U64 columns = args->columns;
+	SIMD_VEC partial[BLOCK_MAX_COLUMNS];
+	F64 sums[BLOCK_MAX_COLUMNS] = {0};
+	for (U64 q=0; q<columns; ++q) {
+		partial[q] = SIMD(simd_set1)(0);
+	}
+	for (U64 start=range->start; start<range->end; start += BLOCK_STEP_ROWS) {
+		U64 end = MIN(start + BLOCK_STEP_ROWS, range->end);
+		SIMD_INDEXED(sparse_block_rows)(args->A, r, x, columns, start, end);
+		SIMD(block_dot)(x, r, columns, start, end, partial, sums);
+		SIMD(block_flush)(partial, sums, columns);
+	}
+	memcpy(args->column_sums + range->index * columns, sums, columns * sizeof(F64));
+}
+
+static SIMD_TARGET void SIMD_INDEXED(sparse_block_residual_dot)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT *bv = args->b->SIMD_VALUES;
+	U64 columns = args->columns;
+	SIMD_VEC partial[BLOCK_MAX_COLUMNS];
+	F64 sums[BLOCK_MAX_COLUMNS] = {0};
+	for (U64 q=0; q<columns; ++q) {
+		partial[q] = SIMD(simd_set1)(0);
+	}
+	for (U64 start=range->start; start<range->end; start += BLOCK_STEP_ROWS) {
+		U64 end = MIN(start + BLOCK_STEP_ROWS, range->end);
+		SIMD_INDEXED(sparse_block_rows)(args->A, r, x, columns, start, end);
+		SIMD(block_residual)(bv, r, columns, start, end, partial, sums);
+		SIMD(block_flush)(partial, sums, columns);
+	}
+	memcpy(args->column_sums + range->index * columns, sums, columns * sizeof(F64));
+}
+
+#if SIMD_GATHER
+// dot product of one compressed row of m with x
+static SIMD_TARGET inline SIMD_FLOAT SIMD_INDEXED(sparse_row_dot)(SparseMatrix *m, SIMD_FLOAT *x, U64 row) {
+	SIMD_FLOAT *values = m->SIMD_VALUES;
+	U64 i = m->row_offsets[row];
+	U64 end = m->row_offsets[row+1];
+	SIMD_VEC sum = SIMD(simd_set1)(0);
+	for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+		sum = SIMD(simd_fmadd)(SIMD(simd_load)(values + i), SIMD_INDEXED(simd_gather)(x, m->SIMD_COLS + i), sum);
+	}
+	if (i < end) {
+		U64 count = end - i;
+		sum = SIMD(simd_fmadd)(SIMD(simd_load_partial)(values + i, count), SIMD_INDEXED(simd_gather_partial)(x, m->SIMD_COLS + i, count), sum);
+	}
+	return SIMD(simd_reduce)(sum);
+}
+
+static SIMD_TARGET void SIMD_INDEXED(sparse_mat_mul_vec)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	for (U64 row=range->start; row<range->end; ++row) {
+		r[row] = SIMD_INDEXED(sparse_row_dot)(m, x, row);
+	}
+}
+
+static SIMD_TARGET void SIMD_INDEXED(sparse_mat_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	F64 dot = 0;
+	for (U64 row=range->start; row<range->end; ++row) {
+		SIMD_FLOAT sum = SIMD_INDEXED(sparse_row_dot)(m, x, row);
+		r[row] = sum;
+		dot += (F64)x[row] * (F64)sum;
+	}
+	range->sum = dot;
+}
+
+static SIMD_TARGET void SIMD_INDEXED(sparse_mat_residual_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT *bv = args->b->SIMD_VALUES;
+	F64 dot = 0;
+	for (U64 row=range->start; row<range->end; ++row) {
+		SIMD_FLOAT value = bv[row] - SIMD_INDEXED(sparse_row_dot)(m, x, row);
+		r[row] = value;
+		dot += (F64)value * (F64)value;
+	}
+	range->sum = dot;
+}
+
+// the rows of a chunk in lockstep, one register holds the next entry of
+// SIMD_WIDTH rows. the padding lanes of the last chunk are computed too,
+// their values are zero and their columns valid
+static SIMD_TARGET inline void SIMD_INDEXED(sparse_sell_chunk)(SparseMatrix *m, SIMD_FLOAT *x, U64 chunk, SIMD_FLOAT *sums) {
+	U64 height = m->chunk_height;
+	SIMD_FLOAT *values = m->SIMD_VALUES;
+	U64 start = m->chunk_offsets[chunk];
+	U64 end = m->chunk_offsets[chunk+1];
+	U64 i = 0;
+	for (; i + SIMD_WIDTH <= height; i += SIMD_WIDTH) {
+		SIMD_VEC sum = SIMD(simd_set1)(0);
+		for (U64 j=start + i; j<end; j += height) {
+			sum = SIMD(simd_fmadd)(SIMD(simd_load)(values + j), SIMD_INDEXED(simd_gather)(x, m->SIMD_COLS + j), sum);
+		}
+		SIMD(simd_store)(sums + i, sum);
+	}
+	if (i < height) {
+		U64 count = height - i;
+		SIMD_VEC sum = SIMD(simd_set1)(0);
+		for (U64 j=start + i; j<end; j += height) {
+			sum = SIMD(simd_fmadd)(SIMD(simd_load_partial)(values + j, count), SIMD_INDEXED(simd_gather_partial)(x, m->SIMD_COLS + j, count), sum);
+		}
+		SIMD_FLOAT lanes[SIMD_WIDTH];
+		SIMD(simd_store)(lanes, sum);
+		memcpy(sums + i, lanes, count * sizeof(SIMD_FLOAT));
+	}
+}
+
+static SIMD_TARGET void SIMD_INDEXED(sparse_sell_mat_mul_vec)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT sums[SLICED_MAX_CHUNK_HEIGHT];
+	U64 height = m->chunk_height;
+	for (U64 c=(range->start + height - 1) / height; c*height < range->end; ++c) {
+		SIMD_INDEXED(sparse_sell_chunk)(m, x, c, sums);
+		for (U64 i=0; i<height && c*height + i < m->num_rows; ++i) {
+			r[m->chunk_rows[c*height + i]] = sums[i];
+		}
+	}
+}
+
+static SIMD_TARGET void SIMD_INDEXED(sparse_sell_mat_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT sums[SLICED_MAX_CHUNK_HEIGHT];
+	U64 height = m->chunk_height;
+	F64 dot = 0;
+	for (U64 c=(range->start + height - 1) / height; c*height < range->end; ++c) {
+		SIMD_INDEXED(sparse_sell_chunk)(m, x, c, sums);
+		for (U64 i=0; i<height && c*height + i < m->num_rows; ++i) {
+			U64 row = m->chunk_rows[c*height + i];
+			r[row] = sums[i];
+			dot += (F64)x[row] * (F64)sums[i];
+		}
+	}
+	range->sum = dot;
+}
+
+static SIMD_TARGET void SIMD_INDEXED(sparse_sell_mat_residual_dot)(KernelArgs *args, KernelRange *range) {
+	SparseMatrix *m = args->A;
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT *bv = args->b->SIMD_VALUES;
+	SIMD_FLOAT sums[SLICED_MAX_CHUNK_HEIGHT];
+	U64 height = m->chunk_height;
+	F64 dot = 0;
+	for (U64 c=(range->start + height - 1) / height; c*height < range->end; ++c) {
+		SIMD_INDEXED(sparse_sell_chunk)(m, x, c, sums);
+		for (U64 i=0; i<height && c*height + i < m->num_rows; ++i) {
+			U64 row = m->chunk_rows[c*height + i];
+			SIMD_FLOAT value = bv[row] - sums[i];
+			r[row] = value;
+			dot += (F64)value * (F64)value;
+		}
+	}
+	range->sum = dot;
+}
+
+#endif // SIMD_GATHER
+
+#undef SIMD_COLS
+#undef SIMD_INDEXED
@@ -0,0 +1,512 @@
+// NOTE(shaw): this file is a template that gets included once per instruction
+// set and float precision by sparse_linear_algebra_simd.c. Each kernel has
+// the same contract as its scalar counterpart in
+// sparse_linear_algebra_kernels.c, only the inner loops use the primitives
+// the including file defines:
+//
+//   SIMD_FLOAT     element type (F32 or F64)
+//   SIMD_VALUES    union member of Vector/SparseMatrix holding SIMD_FLOAT values
+//   SIMD_VEC       register type holding SIMD_WIDTH elements
+//   SIMD_ACC       double precision accumulator for dot products
+//   SIMD_TARGET    function attribute enabling the instruction set
+//   SIMD(name)     name with the instruction set and precision suffix appended
+//   SIMD_SCALAR(name)  name of the scalar kernel of the same precision
+//   SIMD_GATHER    1 if the instruction set has a gather instruction
+//
+// and the SIMD(simd_*) functions used below. Streaming kernels handle the last
+// few elements of a range with scalar code, sparse rows use partial loads so
+// short rows still go through the vector path. Without a gather instruction
+// the sparse kernels fall back to the scalar ones, emulating the gather with
+// scalar loads is slower than the plain loop.
+
+static SIMD_TARGET void SIMD(vec_add)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT *y = args->b->SIMD_VALUES;
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		SIMD(simd_store)(r + i, SIMD(simd_add)(SIMD(simd_load)(x + i), SIMD(simd_load)(y + i)));
+	}
+	for (; i < range->end; ++i) {
+		r[i] = x[i] + y[i];
+	}
+}
+
+static SIMD_TARGET void SIMD(vec_sub)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT *y = args->b->SIMD_VALUES;
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		SIMD(simd_store)(r + i, SIMD(simd_sub)(SIMD(simd_load)(x + i), SIMD(simd_load)(y + i)));
+	}
+	for (; i < range->end; ++i) {
+		r[i] = x[i] - y[i];
+	}
+}
+
+static SIMD_TARGET void SIMD(vec_dot)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT *y = args->b->SIMD_VALUES;
+	SIMD_ACC acc = SIMD(simd_acc_zero)();
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		acc = SIMD(simd_acc_fmadd)(acc, SIMD(simd_load)(x + i), SIMD(simd_load)(y + i));
+	}
+	F64 result = SIMD(simd_acc_reduce)(acc);
+	for (; i < range->end; ++i) {
+		result += (F64)x[i] * (F64)y[i];
+	}
+	range->sum = result;
+}
+
+static SIMD_TARGET void SIMD(vec_scale)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT s = (SIMD_FLOAT)args->scalar;
+	SIMD_VEC vs = SIMD(simd_set1)(s);
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		SIMD(simd_store)(r + i, SIMD(simd_mul)(SIMD(simd_load)(x + i), vs));
+	}
+	for (; i < range->end; ++i) {
+		r[i] = x[i] * s;
+	}
+}
+
+static SIMD_TARGET void SIMD(vec_axpy)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *y = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT alpha = (SIMD_FLOAT)args->scalar;
+	SIMD_VEC valpha = SIMD(simd_set1)(alpha);
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		SIMD(simd_store)(y + i, SIMD(simd_fmadd)(valpha, SIMD(simd_load)(x + i), SIMD(simd_load)(y + i)));
+	}
+	for (; i < range->end; ++i) {
+		y[i] += alpha * x[i];
+	}
+}
+
+static SIMD_TARGET void SIMD(vec_xpay)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *y = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT beta = (SIMD_FLOAT)args->scalar;
+	SIMD_VEC vbeta = SIMD(simd_set1)(beta);
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		SIMD(simd_store)(y + i, SIMD(simd_fmadd)(vbeta, SIMD(simd_load)(y + i), SIMD(simd_load)(x + i)));
+	}
+	for (; i < range->end; ++i) {
+		y[i] = x[i] + beta * y[i];
+	}
+}
+
+static SIMD_TARGET void SIMD(vec_axpy_dot)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *y = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT alpha = (SIMD_FLOAT)args->scalar;
+	SIMD_VEC valpha = SIMD(simd_set1)(alpha);
+	SIMD_ACC acc = SIMD(simd_acc_zero)();
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		SIMD_VEC value = SIMD(simd_fmadd)(valpha, SIMD(simd_load)(x + i), SIMD(simd_load)(y + i));
+		SIMD(simd_store)(y + i, value);
+		acc = SIMD(simd_acc_fmadd)(acc, value, value);
+	}
+	F64 result = SIMD(simd_acc_reduce)(acc);
+	for (; i < range->end; ++i) {
+		SIMD_FLOAT value = y[i] + alpha * x[i];
+		y[i] = value;
+		result += (F64)value * (F64)value;
+	}
+	range->sum = result;
+}
+
+static SIMD_TARGET void SIMD(pipelined_cg_update)(KernelArgs *args, KernelRange *range) {
+	PipelinedCG *cg = args->pipelined;
+	SIMD_FLOAT *x = cg->x->SIMD_VALUES;
+	SIMD_FLOAT *r = cg->r->SIMD_VALUES;
+	SIMD_FLOAT *w = cg->w->SIMD_VALUES;
+	SIMD_FLOAT *p = cg->p->SIMD_VALUES;
+	SIMD_FLOAT *s = cg->s->SIMD_VALUES;
+	SIMD_FLOAT *z = cg->z->SIMD_VALUES;
+	SIMD_FLOAT *q = cg->q->SIMD_VALUES;
+	SIMD_FLOAT alpha = (SIMD_FLOAT)cg->alpha;
+	SIMD_FLOAT beta = (SIMD_FLOAT)cg->beta;
+	SIMD_VEC valpha = SIMD(simd_set1)(alpha);
+	SIMD_VEC vneg_alpha = SIMD(simd_set1)(-alpha);
+	SIMD_VEC vbeta = SIMD(simd_set1)(beta);
+	SIMD_ACC gamma_acc = SIMD(simd_acc_zero)();
+	SIMD_ACC delta_acc = SIMD(simd_acc_zero)();
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		SIMD_VEC vr = SIMD(simd_load)(r + i);
+		SIMD_VEC vw = SIMD(simd_load)(w + i);
+		SIMD_VEC vz = SIMD(simd_fmadd)(vbeta, SIMD(simd_load)(z + i), SIMD(simd_load)(q + i));
+		SIMD_VEC vs = SIMD(simd_fmadd)(vbeta, SIMD(simd_load)(s + i), vw);
+		SIMD_VEC vp = SIMD(simd_fmadd)(vbeta, SIMD(simd_load)(p + i), vr);
+		vr = SIMD(simd_fmadd)(vneg_alpha, vs, vr);
+		vw = SIMD(simd_fmadd)(vneg_alpha, vz, vw);
+		SIMD(simd_store)(z + i, vz);
+		SIMD(simd_store)(s + i, vs);
+		SIMD(simd_store)(p + i, vp);
+		SIMD(simd_store)(x + i, SIMD(simd_fmadd)(valpha, vp, SIMD(simd_load)(x + i)));
+		SIMD(simd_store)(r + i, vr);
+		SIMD(simd_store)(w + i, vw);
+		gamma_acc = SIMD(simd_acc_fmadd)(gamma_acc, vr, vr);
+		delta_acc = SIMD(simd_acc_fmadd)(delta_acc, vw, vr);
+	}
+	F64 gamma = SIMD(simd_acc_reduce)(gamma_acc);
+	F64 delta = SIMD(simd_acc_reduce)(delta_acc);
+	for (; i < range->end; ++i) {
+		SIMD_FLOAT zi = q[i] + beta * z[i];
+		SIMD_FLOAT si = w[i] + beta * s[i];
+		SIMD_FLOAT pi = r[i] + beta * p[i];
+		SIMD_FLOAT ri = r[i] - alpha * si;
+		SIMD_FLOAT wi = w[i] - alpha * zi;
+		z[i] = zi;
+		s[i] = si;
+		p[i] = pi;
+		x[i] += alpha * pi;
+		r[i] = ri;
+		w[i] = wi;
+		gamma += (F64)ri * (F64)ri;
+		delta += (F64)wi * (F64)ri;
+	}
+	args->column_sums[range->index * 2] = gamma;
+	args->column_sums[range->index * 2 + 1] = delta;
+}
+
+static SIMD_TARGET void SIMD(vec_mul_dot)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT *y = args->b->SIMD_VALUES;
+	SIMD_ACC acc = SIMD(simd_acc_zero)();
+	U64 i = range->start;
+	for (; i + SIMD_WIDTH <= range->end; i += SIMD_WIDTH) {
+		SIMD_VEC vx = SIMD(simd_load)(x + i);
+		SIMD_VEC value = SIMD(simd_mul)(vx, SIMD(simd_load)(y + i));
+		SIMD(simd_store)(r + i, value);
+		acc = SIMD(simd_acc_fmadd)(acc, vx, value);
+	}
+	F64 result = SIMD(simd_acc_reduce)(acc);
+	for (; i < range->end; ++i) {
+		SIMD_FLOAT value = x[i] * y[i];
+		r[i] = value;
+		result += (F64)x[i] * (F64)value;
+	}
+	range->sum = result;
+}
+
+// result = A * a for the rows [start, end) of a matrix in diagonal storage,
+// every diagonal is a unit stride stream so nothing needs a gather
+static SIMD_TARGET inline void SIMD(sparse_dia_block)(SparseMatrix *m, SIMD_FLOAT *r, SIMD_FLOAT *x, U64 start, U64 end) {
+	U64 n = m->num_rows;
+	SIMD_VEC zero = SIMD(simd_set1)(0);
+	U64 row = start;
+	for (; row + SIMD_WIDTH <= end; row += SIMD_WIDTH) {
+		SIMD(simd_store)(r + row, zero);
+	}
+	for (; row < end; ++row) {
+		r[row] = 0;
+	}
+	for (U64 d=0; d<m->num_diagonals; ++d) {
+		S64 offset = m->diagonal_offsets[d];
+		SIMD_FLOAT *values = m->SIMD_VALUES + d * n;
+		SIMD_FLOAT *shifted = x + offset;
+		U64 first = offset < 0 ? MAX(start, (U64)-offset) : start;
+		U64 last = offset > 0 ? MIN(end, n - (U64)offset) : end;
+		row = first;
+		for (; row + SIMD_WIDTH <= last; row += SIMD_WIDTH) {
+			SIMD_VEC sum = SIMD(simd_fmadd)(SIMD(simd_load)(values + row), SIMD(simd_load)(shifted + row), SIMD(simd_load)(r + row));
+			SIMD(simd_store)(r + row, sum);
+		}
+		for (; row < last; ++row) {
+			r[row] += values[row] * shifted[row];
+		}
+	}
+}
+
+static SIMD_TARGET void SIMD(sparse_dia_mat_mul_vec)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	for (U64 start=range->start; start<range->end; start += DIAGONAL_BLOCK_ROWS) {
+		SIMD(sparse_dia_block)(args->A, r, x, start, MIN(start + DIAGONAL_BLOCK_ROWS, range->end));
+	}
+}
+
+static SIMD_TARGET void SIMD(sparse_dia_mat_mul_vec_dot)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_ACC acc = SIMD(simd_acc_zero)();
+	F64 dot = 0;
+	for (U64 start=range->start; start<range->end; start += DIAGONAL_BLOCK_ROWS) {
+		U64 end = MIN(start + DIAGONAL_BLOCK_ROWS, range->end);
+		SIMD(sparse_dia_block)(args->A, r, x, start, end);
+		U64 row = start;
+		for (; row + SIMD_WIDTH <= end; row += SIMD_WIDTH) {
+			acc = SIMD(simd_acc_fmadd)(acc, SIMD(simd_load)(x + row), SIMD(simd_load)(r + row));
+		}
+		for (; row < end; ++row) {
+			dot += (F64)x[row] * (F64)r[row];
+		}
+	}
+	range->sum = dot + SIMD(simd_acc_reduce)(acc);
+}
+
+static SIMD_TARGET void SIMD(sparse_dia_mat_residual_dot)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *r = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	SIMD_FLOAT *bv = args->b->SIMD_VALUES;
+	SIMD_ACC acc = SIMD(simd_acc_zero)();
+	F64 dot = 0;
+	for (U64 start=range->start; start<range->end; start += DIAGONAL_BLOCK_ROWS) {
+		U64 end = MIN(start + DIAGONAL_BLOCK_ROWS, range->end);
+		SIMD(sparse_dia_block)(args->A, r, x, start, end);
+		U64 row = start;
+		for (; row + SIMD_WIDTH <= end; row += SIMD_WIDTH) {
+			SIMD_VEC value = SIMD(simd_sub)(SIMD(simd_load)(bv + row), SIMD(simd_load)(r + row));
+			SIMD(simd_store)(r + row, value);
+			acc = SIMD(simd_acc_fmadd)(acc, value, value);
+		}
+		for (; row < end; ++row) {
+			SIMD_FLOAT value = bv[row] - r[row];
+			r[row] = value;
+			dot += (F64)value * (F64)value;
+		}
+	}
+	range->sum = dot + SIMD(simd_acc_reduce)(acc);
+}
+
+// NOTE(shaw): a block of vectors interleaves its columns, so the values of
+// SIMD_WIDTH consecutive rows are columns * SIMD_WIDTH values that fill whole
+// registers whatever the column count. The per column scalars and sums are
+// laid out in that same pattern, a block of rows is then a run of plain
+// vector operations with no shuffles.
+#define BLOCK_PATTERN_SIZE (BLOCK_MAX_COLUMNS * SIMD_WIDTH)
+
+// float partial sums are widened into the column sums after this many
+// patterns, often enough to keep single precision sums accurate
+#define BLOCK_FLUSH_PATTERNS 16
+
+static SIMD_TARGET inline void SIMD(block_pattern)(SIMD_FLOAT *pattern, F64 *scalars, U64 columns) {
+	for (U64 t=0; t<columns*SIMD_WIDTH; ++t) {
+		pattern[t] = (SIMD_FLOAT)scalars[t % columns];
+	}
+}
+
+static SIMD_TARGET inline void SIMD(block_flush)(SIMD_VEC *partial, F64 *sums, U64 columns) {
+	SIMD_FLOAT lanes[SIMD_WIDTH];
+	for (U64 q=0; q<columns; ++q) {
+		SIMD(simd_store)(lanes, partial[q]);
+		for (U64 lane=0; lane<SIMD_WIDTH; ++lane) {
+			sums[(q*SIMD_WIDTH + lane) % columns] += lanes[lane];
+		}
+		partial[q] = SIMD(simd_set1)(0);
+	}
+}
+
+static SIMD_TARGET void SIMD(block_axpy)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *y = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	U64 columns = args->columns;
+	U64 size = columns * SIMD_WIDTH;
+	SIMD_FLOAT alpha[BLOCK_PATTERN_SIZE];
+	SIMD(block_pattern)(alpha, args->scalars, columns);
+	U64 i = range->start * columns;
+	U64 end = range->end * columns;
+	for (; i + size <= end; i += size) {
+		for (U64 t=0; t<size; t += SIMD_WIDTH) {
+			SIMD(simd_store)(y + i + t, SIMD(simd_fmadd)(SIMD(simd_load)(alpha + t), SIMD(simd_load)(x + i + t), SIMD(simd_load)(y + i + t)));
+		}
+	}
+	for (U64 t=0; i < end; ++i, ++t) {
+		y[i] += alpha[t] * x[i];
+	}
+}
+
+static SIMD_TARGET void SIMD(block_xpay)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *y = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	U64 columns = args->columns;
+	U64 size = columns * SIMD_WIDTH;
+	SIMD_FLOAT beta[BLOCK_PATTERN_SIZE];
+	SIMD(block_pattern)(beta, args->scalars, columns);
+	U64 i = range->start * columns;
+	U64 end = range->end * columns;
+	for (; i + size <= end; i += size) {
+		for (U64 t=0; t<size; t += SIMD_WIDTH) {
+			SIMD(simd_store)(y + i + t, SIMD(simd_fmadd)(SIMD(simd_load)(beta + t), SIMD(simd_load)(y + i + t), SIMD(simd_load)(x + i + t)));
+		}
+	}
+	for (U64 t=0; i < end; ++i, ++t) {
+		y[i] = x[i] + beta[t] * y[i];
+	}
+}
+
+static SIMD_TARGET void SIMD(block_axpy_dot)(KernelArgs *args, KernelRange *range) {
+	SIMD_FLOAT *y = args->result->SIMD_VALUES;
+	SIMD_FLOAT *x = args->a->SIMD_VALUES;
+	U64 columns = args->columns;
+	U64 size = columns * SIMD_WIDTH;
+	SIMD_FLOAT alpha[BLOCK_PATTERN_SIZE];
+	SIMD_VEC partial[BLOCK_MAX_COLUMNS];
+	F64 sums[BLOCK_MAX_COLUMNS] = {0};
+	SIMD(block_pattern)(alpha, args->scalars, columns);
+	for (U64 q=0; q<columns; ++q) {
+		partial[q] = SIMD(simd_set1)(0);
+	}
+	U64 i = range->start * columns;
+	U64 end = range->end * columns;
+	for (U64 count=1; i + size <= end; i += size, ++count) {
+		for (U64 t=0, q=0; t<size; t += SIMD_WIDTH, ++q) {
+			SIMD_VEC value = SIMD(simd_fmadd)(SIMD(simd_load)(alpha + t), SIMD(simd_load)(x + i + t), SIMD(simd_load)(y + i + t));
+			SIMD(simd_store)(y + i + t, value);
+			partial[q] = SIMD(simd_fmadd)(value, value, partial[q]);
+		}
+		if (count % BLOCK_FLUSH_PATTERNS == 0) {
+			SIMD(block_flush)(partial, sums, columns);
+		}
+	}
+	SIMD(block_flush)(partial, sums, columns);
+	for (U64 t=0; i < end; ++i, ++t) {
+		SIMD_FLOAT value = y[i] + alpha[t] * x[i];
+		y[i] = value;
+		sums[t % columns] += (F64)value * (F64)value;
+	}
+	memcpy(args->column_sums + range->index * columns, sums, columns * sizeof(F64));
+}
+
+// out[j] += value * in[j] over the columns of one block row, registers run
+// across the columns
+static SIMD_TARGET inline void SIMD(block_row_fmadd)(SIMD_FLOAT *out, SIMD_FLOAT value, SIMD_FLOAT *in, U64 columns) {
+	SIMD_VEC broadcast = SIMD(simd_set1)(value);
+	U64 j = 0;
+	for (; j + SIMD_WIDTH <= columns; j += SIMD_WIDTH) {
+		SIMD(simd_store)(out + j, SIMD(simd_fmadd)(broadcast, SIMD(simd_load)(in + j), SIMD(simd_load)(out + j)));
+	}
+	for (; j < columns; ++j) {
+		out[j] += value * in[j];
+	}
+}
+
+// sums = a . result per column over the rows [start, end)
+static SIMD_TARGET inline void SIMD(block_dot)(SIMD_FLOAT *x, SIMD_FLOAT *r, U64 columns, U64 start, U64 end, SIMD_VEC *partial, F64 *sums) {
+	U64 size = columns * SIMD_WIDTH;
+	U64 i = start * columns;
+	for (; i + size <= end * columns; i += size) {
+		for (U64 t=0, q=0; t<size; t += SIMD_WIDTH, ++q) {
+			partial[q] = SIMD(simd_fmadd)(SIMD(simd_load)(x + i + t), SIMD(simd_load)(r + i + t), partial[q]);
+		}
+	}
+	for (U64 t=0; i < end * columns; ++i, ++t) {
+		sums[t % columns] += (F64)x[i] * (F64)r[i];
+	}
+}
+
+// result = b - result, sums = result . result per column over the rows [start, end)
+static SIMD_TARGET inline void SIMD(block_residual)(SIMD_FLOAT *bv, SIMD_FLOAT *r, U64 columns, U64 start, U64 end, SIMD_VEC *partial, F64 *sums) {
+	U64 size = columns * SIMD_WIDTH;
+	U64 i = start * columns;
+	for (; i + size <= end * columns; i += size) {
+		for (U64 t=0, q=0; t<size; t += SIMD_WIDTH, ++q) {
+			SIMD_VEC value = SIMD(simd_sub)(SIMD(simd_load)(bv + i + t), SIMD(simd_load)(r + i + t));
+			SIMD(simd_store)(r + i + t, value);
+			partial[q] = SIMD(simd_fmadd)(value, value, partial[q]);
+		}
+	}
+	for (U64 t=0; i < end * columns; ++i, ++t) {
+		SIMD_FLOAT value = bv[i] - r[i];
+		r[i] = value;
+		sums[t % columns] += (F64)value * (F64)value;
+	}
+}
+
+// rows per step of the block product kernels, whole patterns so only the
+// last step of a range has a scalar tail
+#define BLOCK_STEP_ROWS (BLOCK_FLUSH_PATTERNS * SIMD_WIDTH)
+
+#define SIMD_COLS cols
+#define SIMD_INDEXED(name) SIMD(name)
+#include "sparse_linear_algebra_simd_index_kernels.c"
+
+#define SIMD_COLS cols32
+#define SIMD_INDEXED(name) SIMD(name##_u32)
+#include "sparse_linear_algebra_simd_index_kernels.c"
+
+#undef BLOCK_STEP_ROWS
+#undef BLOCK_FLUSH_PATTERNS
+#undef BLOCK_PATTERN_SIZE
+
+static LinearAlgebraKernels SIMD(kernels) = {
+	.vec_add = SIMD(vec_add),
+	.vec_sub = SIMD(vec_sub),
+	.vec_dot = SIMD(vec_dot),
+	.vec_scale = SIMD(vec_scale),
+	.vec_axpy = SIMD(vec_axpy),
+	.vec_xpay = SIMD(vec_xpay),
+	.vec_axpy_dot = SIMD(vec_axpy_dot),
+	.vec_mul_dot = SIMD(vec_mul_dot),
+	.pipelined_cg_update = SIMD(pipelined_cg_update),
+	.sparse_dia_mat_mul_vec = SIMD(sparse_dia_mat_mul_vec),
+	.sparse_dia_mat_mul_vec_dot = SIMD(sparse_dia_mat_mul_vec_dot),
+	.sparse_dia_mat_residual_dot = SIMD(sparse_dia_mat_residual_dot),
+	.sparse_block_mul_vec_dot = SIMD(sparse_block_mul_vec_dot),
+	.sparse_block_residual_dot = SIMD(sparse_block_residual_dot),
+	.sparse_block_mul_vec_dot_u32 = SIMD(sparse_block_mul_vec_dot_u32),
+	.sparse_block_residual_dot_u32 = SIMD(sparse_block_residual_dot_u32),
+	.block_axpy = SIMD(block_axpy),
+	.block_xpay = SIMD(block_xpay),
+	.block_axpy_dot = SIMD(block_axpy_dot),
+#if SIMD_GATHER
+	.sparse_mat_mul_vec = SIMD(sparse_mat_mul_vec),
+	.sparse_mat_mul_vec_dot = SIMD(sparse_mat_mul_vec_dot),
+	.sparse_mat_residual_dot = SIMD(sparse_mat_residual_dot),
+	.sparse_sell_mat_mul_vec = SIMD(sparse_sell_mat_mul_vec),
+	.sparse_sell_mat_mul_vec_dot = SIMD(sparse_sell_mat_mul_vec_dot),
+	.sparse_sell_mat_residual_dot = SIMD(sparse_sell_mat_residual_dot),
+	.sparse_mat_mul_vec_u32 = SIMD(sparse_mat_mul_vec_u32),
+	.sparse_mat_mul_vec_dot_u32 = SIMD(sparse_mat_mul_vec_dot_u32),
+	.sparse_mat_residual_dot_u32 = SIMD(sparse_mat_residual_dot_u32),
+	.sparse_sell_mat_mul_vec_u32 = SIMD(sparse_sell_mat_mul_vec_u32),
+	.sparse_sell_mat_mul_vec_dot_u32 = SIMD(sparse_sell_mat_mul_vec_dot_u32),
+	.sparse_sell_mat_residual_dot_u32 = SIMD(sparse_sell_mat_residual_dot_u32),
+#else
+	.sparse_mat_mul_vec = SIMD_SCALAR(sparse_mat_mul_vec),
+	.sparse_mat_mul_vec_dot = SIMD_SCALAR(sparse_mat_mul_vec_dot),
+	.sparse_mat_residual_dot = SIMD_SCALAR(sparse_mat_residual_dot),
+	.sparse_sell_mat_mul_vec = SIMD_SCALAR(sparse_sell_mat_mul_vec),
+	.sparse_sell_mat_mul_vec_dot = SIMD_SCALAR(sparse_sell_mat_mul_vec_dot),
+	.sparse_sell_mat_residual_dot = SIMD_SCALAR(sparse_sell_mat_residual_dot),
+	.sparse_mat_mul_vec_u32 = SIMD_SCALAR(sparse_mat_mul_vec_u32),
+	.sparse_mat_mul_vec_dot_u32 = SIMD_SCALAR(sparse_mat_mul_vec_dot_u32),
+	.sparse_mat_residual_dot_u32 = SIMD_SCALAR(sparse_mat_residual_dot_u32),
+	.sparse_sell_mat_mul_vec_u32 = SIMD_SCALAR(sparse_sell_mat_mul_vec_u32),
+	.sparse_sell_mat_mul_vec_dot_u32 = SIMD_SCALAR(sparse_sell_mat_mul_vec_dot_u32),
+	.sparse_sell_mat_residual_dot_u32 = SIMD_SCALAR(sparse_sell_mat_residual_dot_u32),
+#endif
+	// the next column of a delta encoded row depends on the one before it
+	.sparse_delta_mat_mul_vec = SIMD_SCALAR(sparse_delta_mat_mul_vec),
+	.sparse_delta_mat_mul_vec_dot = SIMD_SCALAR(sparse_delta_mat_mul_vec_dot),
+	.sparse_delta_mat_residual_dot = SIMD_SCALAR(sparse_delta_mat_residual_dot),
+	// each row of the triangular solves waits on the ones before it
+	.sparse_cholesky_solve_dot = SIMD_SCALAR(sparse_cholesky_solve_dot),
+	// the scatter into mirrored entries has no vector form without conflict
+	// detection, the second passes only stream vectors
+	.sparse_sym_mat_mul_vec_scatter = SIMD_SCALAR(sparse_sym_mat_mul_vec_scatter),
+	.sparse_sym_mat_mul_vec_scatter_u32 = SIMD_SCALAR(sparse_sym_mat_mul_vec_scatter_u32),
+	.sparse_sym_mat_mul_vec = SIMD_SCALAR(sparse_sym_mat_mul_vec),
+	.sparse_sym_mat_mul_vec_dot = SIMD_SCALAR(sparse_sym_mat_mul_vec_dot),
+	.sparse_sym_mat_residual_dot = SIMD_SCALAR(sparse_sym_mat_residual_dot),
+};
+
+#undef SIMD_FLOAT
+#undef SIMD_VALUES
+#undef SIMD_VEC
+#undef SIMD_ACC
+#undef SIMD_WIDTH
+#undef SIMD_TARGET
+#undef SIMD
+#undef SIMD_SCALAR
+#undef SIMD_GATHER
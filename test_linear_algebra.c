@@ -3,6 +3,7 @@
 #include <ctype.h>
 #include <float.h>
 #include <math.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <sys/stat.h>
@@ -10,23 +11,25 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <immintrin.h>
 
+#if _WIN32
 #pragma warning (push, 0)
+#define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #pragma warning (pop)
+#endif
 
 #include "common.c"
 #include "sparse_linear_algebra.c"
+#include "parse_number.c"
 #include "parse.c"
+#include "binary_format.c"
 #include "solver.c"
-#include "test_no_branching.c"
-
-typedef bool SolverFunc(SparseMatrix *A, Vector *b, Vector *result);
-
-typedef struct {
-	char *name;
-	SolverFunc *func;
-} TestFunc;
+#include "cache.c"
+#include "batch.c"
+#include "server.c"
+#include "multiprocess.c"
 
 // see https://randomascii.wordpress.com/2012/02/25/comparing-floating-point-numbers-2012-edition/
 static bool F32_equal(F32 a, F32 b, F32 max_diff) {
@@ -188,6 +191,7 @@ static void test_linear_algebra(void) {
 		mat_9->rows[i] = i / 3;
 		mat_9->cols[i] = i % 3;
 	}
+	sparse_mat_build_csr(scratch.arena, mat_9, 3);
 	vec_set(a, 0, 7);
 	vec_set(a, 1, 5);
 	vec_set(a, 2, 13);
@@ -202,6 +206,948 @@ static void test_linear_algebra(void) {
 	printf("test_linear_algebra: success\n");
 }
 
+// the fused kernels conjugate gradients runs on, checked against values
+// worked out by hand
+static void test_fused_kernels(void) {
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+
+	SparseMatrix *mat_9 = sparse_mat_alloc(scratch.arena, PRECISION_F32, 9);
+	Vector *a = vec_alloc(scratch.arena, PRECISION_F32, 3);
+	Vector *b = vec_alloc(scratch.arena, PRECISION_F32, 3);
+	Vector *actual = vec_alloc(scratch.arena, PRECISION_F32, 3);
+	Vector *expected = vec_alloc(scratch.arena, PRECISION_F32, 3);
+	F32 scalar;
+	F32 epsilon = 0.000001f;
+	LinearAlgebraKernels *k = get_kernels(PRECISION_F32);
+
+	for (U64 i=0; i<9; ++i) {
+		mat_9->valuesF32[i] = (F32)(i+1);
+		mat_9->rows[i] = i / 3;
+		mat_9->cols[i] = i % 3;
+	}
+	sparse_mat_build_csr(scratch.arena, mat_9, 3);
+
+	vec_set(a, 0, 1);
+	vec_set(a, 1, 2);
+	vec_set(a, 2, 3);
+	vec_set(b, 0, 4);
+	vec_set(b, 1, 5);
+	vec_set(b, 2, 6);
+	run_kernel(k->vec_axpy, &(KernelArgs){ .result = b, .a = a, .scalar = 2 }, 3);
+	vec_set(expected, 0, 6);
+	vec_set(expected, 1, 9);
+	vec_set(expected, 2, 12);
+	assert(vec_equal(b, expected));
+
+	run_kernel(k->vec_xpay, &(KernelArgs){ .result = b, .a = a, .scalar = 0.5 }, 3);
+	vec_set(expected, 0, 4);
+	vec_set(expected, 1, 6.5);
+	vec_set(expected, 2, 9);
+	assert(vec_equal(b, expected));
+
+	scalar = (F32)run_kernel(k->vec_axpy_dot, &(KernelArgs){ .result = b, .a = a, .scalar = -1 }, 3);
+	vec_set(expected, 0, 3);
+	vec_set(expected, 1, 4.5);
+	vec_set(expected, 2, 6);
+	assert(vec_equal(b, expected));
+	assert(F32_equal(scalar, 65.25f, epsilon));
+
+	vec_set(a, 0, 7);
+	vec_set(a, 1, 5);
+	vec_set(a, 2, 13);
+	scalar = (F32)run_kernel(k->sparse_mat_mul_vec_dot, &(KernelArgs){ .A = mat_9, .result = actual, .a = a }, 3);
+	vec_set(expected, 0, 56);
+	vec_set(expected, 1, 131);
+	vec_set(expected, 2, 206);
+	assert(vec_equal(actual, expected));
+	assert(F32_equal(scalar, 3725.0f, epsilon));
+
+	vec_set(b, 0, 60);
+	vec_set(b, 1, 130);
+	vec_set(b, 2, 200);
+	scalar = (F32)run_kernel(k->sparse_mat_residual_dot, &(KernelArgs){ .A = mat_9, .result = actual, .a = a, .b = b }, 3);
+	vec_set(expected, 0, 4);
+	vec_set(expected, 1, -1);
+	vec_set(expected, 2, -6);
+	assert(vec_equal(actual, expected));
+	assert(F32_equal(scalar, 53.0f, epsilon));
+
+	scratch_end(scratch);
+
+	printf("test_fused_kernels: success\n");
+}
+
+static U64 test_random_u64(U64 *state) {
+	// xorshift64
+	U64 x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+// uniform in [-1, 1)
+static F64 test_random_f64(U64 *state) {
+	return (F64)(test_random_u64(state) >> 11) / (F64)(1ull << 52) - 1.0;
+}
+
+static void vec_fill_random(Vector *v, U64 *rng) {
+	for (U64 i=0; i<v->num_values; ++i) {
+		vec_set(v, i, test_random_f64(rng));
+	}
+}
+
+static bool values_close(F64 actual, F64 expected, F64 tolerance) {
+	return fabs(actual - expected) <= tolerance * (1.0 + fabs(expected));
+}
+
+static bool vec_close(Vector *actual, Vector *expected, F64 tolerance) {
+	for (U64 i=0; i<actual->num_values; ++i) {
+		F64 x = actual->precision == PRECISION_F32 ? actual->valuesF32[i] : actual->valuesF64[i];
+		F64 y = expected->precision == PRECISION_F32 ? expected->valuesF32[i] : expected->valuesF64[i];
+		if (!values_close(x, y, tolerance)) return false;
+	}
+	return true;
+}
+
+// n x n matrix with ragged rows of 0 to 20 entries in random columns
+static SparseMatrix *test_random_sparse_mat(Arena *arena, FloatPrecision precision, U64 n, U64 *rng) {
+	ArenaTemp scratch = scratch_begin(&arena, 1);
+	U64 *row_lengths = arena_push_n(scratch.arena, U64, n);
+	U64 num_values = 0;
+	for (U64 row=0; row<n; ++row) {
+		row_lengths[row] = test_random_u64(rng) % 21;
+		num_values += row_lengths[row];
+	}
+
+	SparseMatrix *m = sparse_mat_alloc(arena, precision, num_values);
+	U64 i = 0;
+	for (U64 row=0; row<n; ++row) {
+		for (U64 j=0; j<row_lengths[row]; ++j, ++i) {
+			m->rows[i] = row;
+			m->cols[i] = test_random_u64(rng) % n;
+			if (precision == PRECISION_F32) {
+				m->valuesF32[i] = (F32)test_random_f64(rng);
+			} else {
+				m->valuesF64[i] = test_random_f64(rng);
+			}
+		}
+	}
+	sparse_mat_build_csr(arena, m, n);
+
+	scratch_end(scratch);
+	return m;
+}
+
+// runs every kernel of every simd level the cpu supports and compares the
+// results against the scalar kernels
+static void test_simd_kernels(void) {
+	struct { char *name; U64 offset; } kernels[] = {
+		{ "vec_add",                 offsetof(LinearAlgebraKernels, vec_add) },
+		{ "vec_sub",                 offsetof(LinearAlgebraKernels, vec_sub) },
+		{ "vec_dot",                 offsetof(LinearAlgebraKernels, vec_dot) },
+		{ "vec_scale",               offsetof(LinearAlgebraKernels, vec_scale) },
+		{ "sparse_mat_mul_vec",      offsetof(LinearAlgebraKernels, sparse_mat_mul_vec) },
+		{ "vec_axpy",                offsetof(LinearAlgebraKernels, vec_axpy) },
+		{ "vec_xpay",                offsetof(LinearAlgebraKernels, vec_xpay) },
+		{ "vec_axpy_dot",            offsetof(LinearAlgebraKernels, vec_axpy_dot) },
+		{ "sparse_mat_mul_vec_dot",  offsetof(LinearAlgebraKernels, sparse_mat_mul_vec_dot) },
+		{ "sparse_mat_residual_dot", offsetof(LinearAlgebraKernels, sparse_mat_residual_dot) },
+		{ "vec_mul_dot",             offsetof(LinearAlgebraKernels, vec_mul_dot) },
+	};
+	FloatPrecision precisions[] = { PRECISION_F32, PRECISION_F64 };
+	U64 sizes[] = { 1, 2, 7, 16, 33, 1001 };
+	U64 rng = 0x9e3779b97f4a7c15ull;
+	SimdLevel max_level = cpu_simd_level();
+	U64 num_failed = 0;
+
+	for (U64 p=0; p<ARRAY_COUNT(precisions); ++p) {
+		FloatPrecision precision = precisions[p];
+		F64 tolerance = precision == PRECISION_F32 ? 1e-4 : 1e-10;
+		LinearAlgebraKernels *reference = get_kernels_for_level(precision, SIMD_LEVEL_SCALAR);
+
+		for (SimdLevel level = SIMD_LEVEL_SSE2; level <= max_level; ++level) {
+			LinearAlgebraKernels *simd = get_kernels_for_level(precision, level);
+
+			for (U64 s=0; s<ARRAY_COUNT(sizes); ++s) {
+				ArenaTemp scratch = scratch_begin(NULL, 0);
+				U64 n = sizes[s];
+				SparseMatrix *m = test_random_sparse_mat(scratch.arena, precision, n, &rng);
+				Vector *a = vec_alloc(scratch.arena, precision, n);
+				Vector *b = vec_alloc(scratch.arena, precision, n);
+				Vector *initial = vec_alloc(scratch.arena, precision, n);
+				Vector *expected = vec_alloc(scratch.arena, precision, n);
+				Vector *actual = vec_alloc(scratch.arena, precision, n);
+				vec_fill_random(a, &rng);
+				vec_fill_random(b, &rng);
+				vec_fill_random(initial, &rng);
+
+				for (U64 j=0; j<ARRAY_COUNT(kernels); ++j) {
+					KernelFunc *reference_func = *(KernelFunc**)((U8*)reference + kernels[j].offset);
+					KernelFunc *simd_func = *(KernelFunc**)((U8*)simd + kernels[j].offset);
+
+					// start part way into the vectors so unaligned ranges are covered
+					KernelRange expected_range = { .start = n / 3, .end = n };
+					KernelRange actual_range = expected_range;
+
+					vec_copy_values(expected, initial);
+					vec_copy_values(actual, initial);
+					reference_func(&(KernelArgs){ .A = m, .result = expected, .a = a, .b = b, .scalar = 0.37 }, &expected_range);
+					simd_func(&(KernelArgs){ .A = m, .result = actual, .a = a, .b = b, .scalar = 0.37 }, &actual_range);
+
+					if (!vec_close(actual, expected, tolerance) || !values_close(actual_range.sum, expected_range.sum, tolerance)) {
+						printf("test_simd_kernels: %s (%s, %s, n=%llu) does not match the scalar kernel\n",
+							kernels[j].name, simd_level_names[level], precision == PRECISION_F32 ? "F32" : "F64", n);
+						++num_failed;
+					}
+				}
+
+				scratch_end(scratch);
+			}
+		}
+	}
+
+	assert(num_failed == 0);
+	printf("test_simd_kernels: success (up to %s)\n", simd_level_names[max_level]);
+}
+
+// checks parse_number against strtod/strtoll, which it has to match exactly
+static void test_parse_number(void) {
+	char *cases[] = {
+		"0", "-0", "0.0", "-0.0", "1", "-1", "007", "1.", "1.5e", "2e+", "3e-x",
+		"68.15673615685463", "-0.000123456789012345678", "1e22", "1e23", "9007199254740993.0",
+		"123456789012345678901234567890", "9223372036854775807", "9223372036854775808",
+		"-9223372036854775809", "2.2250738585072011e-308", "4.9e-324", "1e-400",
+		"1.7976931348623157e308", "1.8e308", "0.1e1", "1E5", "1e0005",
+		"9007199254740992.5", "179769313486231570000000000000000000000000000.0e-10",
+	};
+	U64 rng = 0x2545f4914f6cdd1dull;
+	U64 num_failed = 0;
+	char buffer[128];
+
+	for (U64 i=0; i<ARRAY_COUNT(cases) + 200000; ++i) {
+		char *str = buffer;
+		if (i < ARRAY_COUNT(cases)) {
+			str = cases[i];
+		} else {
+			// random doubles of random magnitude printed in different ways
+			F64 value = test_random_f64(&rng) * pow(10.0, (F64)(S64)(test_random_u64(&rng) % 80) - 40);
+			int precision = (int)(test_random_u64(&rng) % 20);
+			switch (test_random_u64(&rng) % 4) {
+			case 0: sprintf(buffer, "%.17g", value); break;
+			case 1: sprintf(buffer, "%.*e", precision, value); break;
+			case 2: sprintf(buffer, "%.*f", precision, value); break;
+			case 3: sprintf(buffer, "%lld", (long long)(test_random_u64(&rng) >> (test_random_u64(&rng) % 64))); break;
+			}
+		}
+
+		Number number;
+		char *end = parse_number(str, &number);
+		char *expected_end;
+		bool ok;
+		if (number.is_float) {
+			F64 expected = strtod(str, &expected_end);
+			ok = memcmp(&expected, &number.float_val, sizeof(expected)) == 0;
+		} else {
+			S64 expected = strtoll(str, &expected_end, 10);
+			ok = expected == number.int_val;
+		}
+		if (!ok || end != expected_end) {
+			printf("test_parse_number: '%s' does not match the c runtime\n", str);
+			++num_failed;
+		}
+	}
+
+	assert(num_failed == 0);
+	printf("test_parse_number: success\n");
+}
+
+// whether a and b store the same column indices in the same encoding
+static bool sparse_mat_cols_equal(SparseMatrix *a, SparseMatrix *b) {
+	if (a->index_encoding != b->index_encoding) return false;
+	switch (a->index_encoding) {
+		case SPARSE_INDEX_U32:
+			return memcmp(a->cols32, b->cols32, a->num_values * sizeof(U32)) == 0;
+		case SPARSE_INDEX_DELTA:
+			return memcmp(a->col_byte_offsets, b->col_byte_offsets, (a->num_rows + 1) * sizeof(U64)) == 0 &&
+				memcmp(a->col_bytes, b->col_bytes, a->col_byte_offsets[a->num_rows]) == 0;
+		default:
+			return memcmp(a->cols, b->cols, a->num_values * sizeof(U64)) == 0;
+	}
+}
+
+static bool parse_results_equal(ParseResult *a, ParseResult *b) {
+	SparseMatrix *ma = a->matrix;
+	SparseMatrix *mb = b->matrix;
+	U64 value_size = ma->precision == PRECISION_F32 ? sizeof(F32) : sizeof(F64);
+	bool same_structure;
+	if (ma->layout == SPARSE_LAYOUT_DIAGONAL) {
+		same_structure = ma->num_diagonals == mb->num_diagonals &&
+			memcmp(ma->diagonal_offsets, mb->diagonal_offsets, ma->num_diagonals * sizeof(S64)) == 0;
+	} else if (ma->layout == SPARSE_LAYOUT_SLICED) {
+		same_structure = ma->chunk_height == mb->chunk_height && ma->num_chunks == mb->num_chunks &&
+			memcmp(ma->chunk_offsets, mb->chunk_offsets, (ma->num_chunks + 1) * sizeof(U64)) == 0 &&
+			memcmp(ma->chunk_rows, mb->chunk_rows, ma->num_chunks * ma->chunk_height * sizeof(U64)) == 0 &&
+			sparse_mat_cols_equal(ma, mb);
+	} else {
+		same_structure = memcmp(ma->row_offsets, mb->row_offsets, (ma->num_rows + 1) * sizeof(U64)) == 0 &&
+			sparse_mat_cols_equal(ma, mb);
+	}
+	return a->solver == b->solver && a->num_vectors == b->num_vectors &&
+		ma->precision == mb->precision && ma->num_rows == mb->num_rows && ma->num_values == mb->num_values &&
+		ma->layout == mb->layout && same_structure &&
+		memcmp(ma->valuesF64, mb->valuesF64, ma->num_values * value_size) == 0 &&
+		a->vector->num_values == b->vector->num_values &&
+		memcmp(a->vector->valuesF64, b->vector->valuesF64, a->vector->num_values * value_size) == 0 &&
+		(a->initial_guess != NULL) == (b->initial_guess != NULL) &&
+		(!a->initial_guess || memcmp(a->initial_guess->valuesF64, b->initial_guess->valuesF64, a->initial_guess->num_values * value_size) == 0) &&
+		(ma->permutation != NULL) == (mb->permutation != NULL) &&
+		(!ma->permutation || memcmp(ma->permutation, mb->permutation, ma->num_rows * sizeof(U64)) == 0) &&
+		(a->solution != NULL) == (b->solution != NULL) &&
+		(!a->solution || memcmp(a->solution->valuesF64, b->solution->valuesF64, a->solution->num_values * value_size) == 0);
+}
+
+// converts some of the text tests to binary files and checks that loading
+// them gives back the same problem
+static void test_binary_format(void) {
+	char *binary_path = "tests/test_binary_format.bin";
+	U64 num_failed = 0;
+	for (U64 i=0; i<20; ++i) {
+		ArenaTemp scratch = scratch_begin(NULL, 0);
+		char path[256];
+		snprintf(path, sizeof(path), "tests/test_%llu.txt", i);
+
+		ParseResult text = parse_input(scratch.arena, path);
+		write_binary_file(binary_path, &text);
+		assert(is_binary_file(binary_path) && !is_binary_file(path));
+		ParseResult binary = load_binary_file(scratch.arena, binary_path);
+
+		bool same = parse_results_equal(&binary, &text);
+		if (!same) {
+			printf("test_binary_format: %s does not round trip\n", path);
+			++num_failed;
+		}
+
+		unload_binary_file(&binary);
+		scratch_end(scratch);
+	}
+	remove(binary_path);
+
+	assert(num_failed == 0);
+	printf("test_binary_format: success\n");
+}
+
+// writes a matrix large enough to be parsed in parallel, with blank lines,
+// windows line endings and a triplet split over two lines mixed in, and checks
+// that every entry comes out where it belongs
+// writes the matrix lines of test_parallel_parse, with the entry bad_entry
+// (if it is below n) replaced by a malformed line. returns the line number of
+// that entry
+static U64 test_write_parallel_parse(char *path, U64 n, U64 bad_entry) {
+	FILE *f = fopen(path, "wb");
+	assert(f);
+	fprintf(f, "format: double\nsolver: conjugate_gradients\nstorage: general\nmatrix: %llu\n", n);
+	U64 line = 5;
+	U64 bad_line = 0;
+	for (U64 i=0; i<n; ++i) {
+		if (i == n / 3) {
+			fprintf(f, "\n\n");
+			line += 2;
+		}
+		if (i == bad_entry) {
+			fprintf(f, "%llu %llu oops\n", i, n - 1 - i);
+			bad_line = line++;
+		} else if (i == 2 * n / 3) {
+			fprintf(f, "%llu %llu\n  %llu.25\r\n", i, n - 1 - i, i);
+			line += 2;
+		} else {
+			fprintf(f, "%llu %llu %llu.25%s\n", i, n - 1 - i, i, i % 7 == 0 ? "\r" : "");
+			++line;
+		}
+	}
+	fprintf(f, "vector: %llu\n", n);
+	for (U64 i=0; i<n; ++i) {
+		fprintf(f, "1\n");
+	}
+	fclose(f);
+	return bad_line;
+}
+
+static void test_parallel_parse(void) {
+	char *path = "tests/test_parallel_parse.txt";
+	U64 n = 500000;
+	test_write_parallel_parse(path, n, n);
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	ParseResult result = parse_input(scratch.arena, path);
+	SparseMatrix *m = result.matrix;
+	U64 num_failed = 0;
+	assert(m->num_values == n && m->num_rows == n);
+	for (U64 i=0; i<n; ++i) {
+		if (m->rows[i] != i || sparse_mat_col(m, i) != n - 1 - i || m->valuesF64[i] != (F64)i + 0.25) {
+			++num_failed;
+		}
+	}
+	scratch_end(scratch);
+
+	// a malformed line in the middle of the last chunk stops that chunk, the
+	// error still points at its line
+	U64 bad_line = test_write_parallel_parse(path, n, 5 * n / 6);
+	char expected[256];
+	snprintf(expected, sizeof(expected), "%s:%llu: ", path, bad_line);
+	scratch = scratch_begin(NULL, 0);
+	FatalHandler handler;
+	fatal_handler_begin(&handler);
+	if (setjmp(handler.jump) == 0) {
+		parse_input(scratch.arena, path);
+		assert(!"test_parallel_parse: the malformed line was accepted");
+	} else {
+		assert(strncmp(handler.message, expected, strlen(expected)) == 0);
+	}
+	fatal_handler = NULL;
+	scratch_end(scratch);
+	remove(path);
+
+	assert(num_failed == 0);
+	printf("test_parallel_parse: success\n");
+}
+
+// streams some of the text tests through buffers so small that most tokens
+// and lines are split between two of them
+static void test_stream_parse(void) {
+	U64 buffer_sizes[] = { 1, 61, 4096, PARSE_STREAM_BUFFER_SIZE };
+	U64 num_failed = 0;
+	for (U64 i=0; i<10; ++i) {
+		char path[256];
+		snprintf(path, sizeof(path), "tests/test_%llu.txt", i);
+		for (U64 j=0; j<ARRAY_COUNT(buffer_sizes); ++j) {
+			ArenaTemp scratch = scratch_begin(NULL, 0);
+			ParseResult expected = parse_input(scratch.arena, path);
+			ParseResult actual = parse_input_stream(scratch.arena, path, buffer_sizes[j]);
+			if (!parse_results_equal(&actual, &expected)) {
+				printf("test_stream_parse: %s parsed in buffers of %llu bytes does not match\n", path, buffer_sizes[j]);
+				++num_failed;
+			}
+			scratch_end(scratch);
+		}
+	}
+
+	assert(num_failed == 0);
+	printf("test_stream_parse: success\n");
+}
+
+static void test_push_entry(SparseMatrix *m, U64 *count, U64 row, U64 col, F64 value) {
+	m->rows[*count] = row;
+	m->cols[*count] = col;
+	if (m->precision == PRECISION_F32) {
+		m->valuesF32[*count] = (F32)value;
+	} else {
+		m->valuesF64[*count] = value;
+	}
+	++*count;
+}
+
+// symmetric matrix with a band and a few long range entries, so the scatter
+// windows of the symmetric product cross several thread ranges
+static SparseMatrix *test_symmetric_sparse_mat(Arena *arena, FloatPrecision precision, U64 n, U64 *rng) {
+	U64 band = 4;
+	U64 far = n / 3;
+	SparseMatrix *m = sparse_mat_alloc(arena, precision, n * (2*band + 4));
+	U64 count = 0;
+	for (U64 row=0; row<n; ++row) {
+		for (U64 j=1; j<=band && row + j < n; ++j) {
+			F64 value = test_random_f64(rng);
+			test_push_entry(m, &count, row, row + j, value);
+			test_push_entry(m, &count, row + j, row, value);
+		}
+		if (row % 1000 == 0 && row + far < n) {
+			test_push_entry(m, &count, row, row + far, 0.5);
+			test_push_entry(m, &count, row + far, row, 0.5);
+		}
+		// the diagonal in two halves
+		test_push_entry(m, &count, row, row, 6);
+		test_push_entry(m, &count, row, row, 5);
+	}
+	m->num_values = count;
+	sparse_mat_build_csr(arena, m, n);
+	return m;
+}
+
+// compares the symmetric kernels against the general ones on the same
+// matrix, and checks that both ways of getting symmetric storage from a text
+// file agree
+static void test_symmetric_storage(void) {
+	FloatPrecision precisions[] = { PRECISION_F32, PRECISION_F64 };
+	U64 sizes[] = { 7, 100000 };
+	U64 rng = 0xda942042e4dd58b5ull;
+	for (U64 p=0; p<ARRAY_COUNT(precisions); ++p) {
+		FloatPrecision precision = precisions[p];
+		F64 tolerance = precision == PRECISION_F32 ? 1e-4 : 1e-10;
+		LinearAlgebraKernels *k = get_kernels(precision);
+		for (U64 s=0; s<ARRAY_COUNT(sizes); ++s) {
+			ArenaTemp scratch = scratch_begin(NULL, 0);
+			U64 n = sizes[s];
+			U64 state = rng;
+			SparseMatrix *general = test_symmetric_sparse_mat(scratch.arena, precision, n, &state);
+			state = rng;
+			SparseMatrix *symmetric = test_symmetric_sparse_mat(scratch.arena, precision, n, &rng);
+			assert(sparse_mat_convert_symmetric(symmetric));
+			assert(symmetric->layout == SPARSE_LAYOUT_SYMMETRIC && symmetric->num_values < general->num_values);
+			// detection keeps compressed rows for the large one, its far
+			// entries would make every thread clear and add a third of the rows
+			// as overflow. the small one runs as a single range without any
+			assert(sparse_mat_symmetric_pays_off(general) == (n < KERNEL_MIN_ITEMS_PER_THREAD));
+
+			Vector *a = vec_alloc(scratch.arena, precision, n);
+			Vector *b = vec_alloc(scratch.arena, precision, n);
+			Vector *expected = vec_alloc(scratch.arena, precision, n);
+			Vector *actual = vec_alloc(scratch.arena, precision, n);
+			vec_fill_random(a, &rng);
+			vec_fill_random(b, &rng);
+
+			sparse_mat_mul_vec(expected, general, a);
+			sparse_mat_mul_vec(actual, symmetric, a);
+			assert(vec_close(actual, expected, tolerance));
+
+			F64 expected_sum = run_sparse_kernel(k, SPARSE_OP_MUL_VEC_DOT, &(KernelArgs){ .A = general, .result = expected, .a = a }, n);
+			F64 actual_sum = run_sparse_kernel(k, SPARSE_OP_MUL_VEC_DOT, &(KernelArgs){ .A = symmetric, .result = actual, .a = a }, n);
+			assert(vec_close(actual, expected, tolerance) && values_close(actual_sum, expected_sum, tolerance));
+
+			expected_sum = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = general, .result = expected, .a = a, .b = b }, n);
+			actual_sum = run_sparse_kernel(k, SPARSE_OP_RESIDUAL_DOT, &(KernelArgs){ .A = symmetric, .result = actual, .a = a, .b = b }, n);
+			assert(vec_close(actual, expected, tolerance) && values_close(actual_sum, expected_sum, tolerance));
+
+			// one entry off its mirror keeps the general storage
+			U64 i = general->row_offsets[n/2];
+			if (general->cols[i] == n/2) ++i;
+			if (precision == PRECISION_F32) {
+				general->valuesF32[i] += 1;
+			} else {
+				general->valuesF64[i] += 1;
+			}
+			assert(!sparse_mat_convert_symmetric(general) && general->layout == SPARSE_LAYOUT_CSR);
+
+			scratch_end(scratch);
+		}
+	}
+
+	char *full_path = "tests/test_symmetric_full.txt";
+	char *half_path = "tests/test_symmetric_half.txt";
+	FILE *f = fopen(full_path, "wb");
+	assert(f);
+	fprintf(f, "format: double\nsolver: conjugate_gradients\nmatrix: 7\n"
+		"0 0 4\n0 2 1\n2 0 1\n1 1 3\n1 2 -1\n2 1 -1\n2 2 5\nvector: 3\n1 2 3\n");
+	fclose(f);
+	f = fopen(half_path, "wb");
+	assert(f);
+	fprintf(f, "format: double\nsolver: conjugate_gradients\nstorage: symmetric\nmatrix: 5\n"
+		"0 0 4\n2 0 1\n1 1 3\n1 2 -1\n2 2 5\nvector: 3\n1 2 3\n");
+	fclose(f);
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	ParseResult full = parse_input(scratch.arena, full_path);
+	ParseResult half = parse_input(scratch.arena, half_path);
+	assert(full.matrix->layout == SPARSE_LAYOUT_SYMMETRIC && full.matrix->num_values == 5 && full.matrix->bandwidth == 2);
+	assert(parse_results_equal(&full, &half));
+	scratch_end(scratch);
+	remove(full_path);
+	remove(half_path);
+
+	printf("test_symmetric_storage: success\n");
+}
+
+// a few random diagonals, with the main diagonal split into two duplicates
+static SparseMatrix *test_banded_sparse_mat(Arena *arena, FloatPrecision precision, U64 n, U64 *rng) {
+	S64 offsets[] = { -7, -1, 0, 0, 1, 3 };
+	SparseMatrix *m = sparse_mat_alloc(arena, precision, n * ARRAY_COUNT(offsets));
+	U64 count = 0;
+	for (U64 row=0; row<n; ++row) {
+		for (U64 d=0; d<ARRAY_COUNT(offsets); ++d) {
+			S64 col = (S64)row + offsets[d];
+			if (col < 0 || col >= (S64)n) continue;
+			test_push_entry(m, &count, row, (U64)col, offsets[d] == 0 ? 4 + test_random_f64(rng) : test_random_f64(rng));
+		}
+	}
+	m->num_values = count;
+	sparse_mat_build_csr(arena, m, n);
+	return m;
+}
+
+// n x n matrix with diagonal on the main diagonal and -1 next to it, like a
+// one dimensional laplacian. from row wide_start on the rows (and columns)
+// reach two entries to each side instead of one, pass n to keep it
+// tridiagonal
+static SparseMatrix *test_laplacian_sparse_mat(Arena *arena, FloatPrecision precision, U64 n, F64 diagonal, U64 wide_start) {
+	SparseMatrix *m = sparse_mat_alloc(arena, precision, 5*n);
+	U64 count = 0;
+	for (U64 row=0; row<n; ++row) {
+		S64 reach = row < wide_start ? 1 : 2;
+		for (S64 d=-reach; d<=reach; ++d) {
+			S64 col = (S64)row + d;
+			if (col < 0 || col >= (S64)n) continue;
+			if (((U64)col < wide_start ? 1 : 2) < (d < 0 ? -d : d)) continue;
+			test_push_entry(m, &count, row, (U64)col, d == 0 ? diagonal : -1);
+		}
+	}
+	m->num_values = count;
+	sparse_mat_build_csr(arena, m, n);
+	return m;
+}
+
+// a text input with the double precision matrix A in general storage, then
+// for every section the columns of n values of its vector, each under a
+// "section: n" line of its own
+static char *test_input_text(Arena *arena, char *solver, SparseMatrix *A, U64 n, char **sections, Vector **values, U64 count, U64 *size) {
+	U64 cap = 256 + 64 * A->num_values;
+	for (U64 s=0; s<count; ++s) {
+		cap += 64 + 32 * values[s]->num_values;
+	}
+	char *text = arena_push_n(arena, char, cap);
+	U64 used = snprintf(text, cap, "format: double\nsolver: %s\nstorage: general\nmatrix: %llu\n", solver, A->num_values);
+	for (U64 i=0; i<A->num_values; ++i) {
+		used += snprintf(text + used, cap - used, "%llu %llu %.17g\n", A->rows[i], A->cols[i], A->valuesF64[i]);
+	}
+	for (U64 s=0; s<count; ++s) {
+		for (U64 j=0; j<values[s]->num_values / n; ++j) {
+			used += snprintf(text + used, cap - used, "%s: %llu\n", sections[s], n);
+			for (U64 i=0; i<n; ++i) {
+				used += snprintf(text + used, cap - used, "%.17g\n", values[s]->valuesF64[j*n + i]);
+			}
+		}
+	}
+	assert(used < cap);
+	*size = used;
+	return text;
+}
+
+// compares the diagonal kernels of every simd level against the scalar
+// compressed row kernels on the same matrix, and checks that matrices which
+// are not banded keep compressed rows
+static void test_diagonal_storage(void) {
+	FloatPrecision precisions[] = { PRECISION_F32, PRECISION_F64 };
+	SparseOp ops[] = { SPARSE_OP_MUL_VEC, SPARSE_OP_MUL_VEC_DOT, SPARSE_OP_RESIDUAL_DOT };
+	U64 sizes[] = { 1, 7, 33, 1001, 5000 };
+	U64 rng = 0x8c1b5f0e7a3d2b49ull;
+	SimdLevel max_level = cpu_simd_level();
+	U64 num_failed = 0;
+
+	for (U64 p=0; p<ARRAY_COUNT(precisions); ++p) {
+		FloatPrecision precision = precisions[p];
+		F64 tolerance = precision == PRECISION_F32 ? 1e-4 : 1e-10;
+		LinearAlgebraKernels *reference = get_kernels_for_level(precision, SIMD_LEVEL_SCALAR);
+		for (U64 s=0; s<ARRAY_COUNT(sizes); ++s) {
+			ArenaTemp scratch = scratch_begin(NULL, 0);
+			U64 n = sizes[s];
+			U64 state = rng;
+			SparseMatrix *general = test_banded_sparse_mat(scratch.arena, precision, n, &state);
+			SparseMatrix *diagonal = test_banded_sparse_mat(scratch.arena, precision, n, &rng);
+			assert(sparse_mat_convert_diagonal(scratch.arena, diagonal));
+			assert(diagonal->layout == SPARSE_LAYOUT_DIAGONAL && diagonal->num_diagonals <= 5);
+
+			Vector *a = vec_alloc(scratch.arena, precision, n);
+			Vector *b = vec_alloc(scratch.arena, precision, n);
+			Vector *initial = vec_alloc(scratch.arena, precision, n);
+			Vector *expected = vec_alloc(scratch.arena, precision, n);
+			Vector *actual = vec_alloc(scratch.arena, precision, n);
+			vec_fill_random(a, &rng);
+			vec_fill_random(b, &rng);
+			vec_fill_random(initial, &rng);
+
+			for (SimdLevel level = SIMD_LEVEL_SCALAR; level <= max_level; ++level) {
+				LinearAlgebraKernels *k = get_kernels_for_level(precision, level);
+				for (U64 j=0; j<ARRAY_COUNT(ops); ++j) {
+					// start part way into the vectors so unaligned ranges are covered
+					KernelRange expected_range = { .start = n / 3, .end = n };
+					KernelRange actual_range = expected_range;
+					vec_copy_values(expected, initial);
+					vec_copy_values(actual, initial);
+					sparse_kernel(reference, general, ops[j])(&(KernelArgs){ .A = general, .result = expected, .a = a, .b = b }, &expected_range);
+					sparse_kernel(k, diagonal, ops[j])(&(KernelArgs){ .A = diagonal, .result = actual, .a = a, .b = b }, &actual_range);
+					if (!vec_close(actual, expected, tolerance) || !values_close(actual_range.sum, expected_range.sum, tolerance)) {
+						printf("test_diagonal_storage: op %u (%s, %s, n=%llu) does not match the compressed row kernel\n",
+							ops[j], simd_level_names[level], precision == PRECISION_F32 ? "F32" : "F64", n);
+						++num_failed;
+					}
+				}
+			}
+
+			// the whole product through the thread pool
+			sparse_mat_mul_vec(expected, general, a);
+			sparse_mat_mul_vec(actual, diagonal, a);
+			if (!vec_close(actual, expected, tolerance)) {
+				printf("test_diagonal_storage: sparse_mat_mul_vec (n=%llu) does not match\n", n);
+				++num_failed;
+			}
+
+			// random columns are far too many diagonals
+			SparseMatrix *scattered = test_random_sparse_mat(scratch.arena, precision, 1001, &rng);
+			assert(!sparse_mat_convert_diagonal(scratch.arena, scattered) && scattered->layout == SPARSE_LAYOUT_CSR);
+
+			scratch_end(scratch);
+		}
+	}
+	assert(num_failed == 0);
+
+	// a tridiagonal text input is detected, solves with every conjugate
+	// gradient solver and keeps compressed rows when asked to
+	char *path = "tests/test_diagonal.txt";
+	char *general_path = "tests/test_diagonal_general.txt";
+	char *body = "matrix: 13\n"
+		"0 0 4\n0 1 -1\n1 0 -1\n1 1 4\n1 2 -1\n2 1 -1\n2 2 4\n2 3 -1\n3 2 -1\n3 3 4\n3 4 -1\n4 3 -1\n4 4 4\n"
+		"vector: 5\n3 2 2 2 3\nsolution: 5\n1 1 1 1 1\n";
+	FILE *f = fopen(path, "wb");
+	assert(f);
+	fprintf(f, "format: double\nsolver: conjugate_gradients\n%s", body);
+	fclose(f);
+	f = fopen(general_path, "wb");
+	assert(f);
+	fprintf(f, "format: double\nsolver: conjugate_gradients\nstorage: general\n%s", body);
+	fclose(f);
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	ParseResult input = parse_input(scratch.arena, path);
+	ParseResult general = parse_input(scratch.arena, general_path);
+	assert(input.matrix->layout == SPARSE_LAYOUT_DIAGONAL && input.matrix->num_diagonals == 3);
+	assert(general.matrix->layout == SPARSE_LAYOUT_CSR);
+	SolverKind solvers[] = {
+		SOLVER_CONJUGATE_GRADIENTS, SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS, SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS,
+	};
+	for (U64 i=0; i<ARRAY_COUNT(solvers); ++i) {
+		Vector *actual = vec_alloc(scratch.arena, PRECISION_F64, 5);
+		assert(solve(solvers[i], input.matrix, input.vector, actual));
+		assert(vec_close(actual, input.solution, 1e-10));
+	}
+	scratch_end(scratch);
+	remove(path);
+	remove(general_path);
+
+	printf("test_diagonal_storage: success\n");
+}
+
+// compares the sliced kernels of every simd level against the scalar
+// compressed row kernels for a few chunk heights and sort windows. the
+// product is split into two ranges at a row that is not a chunk boundary, each
+// chunk must be done by exactly one of them
+static void test_sliced_storage(void) {
+	FloatPrecision precisions[] = { PRECISION_F32, PRECISION_F64 };
+	SparseOp ops[] = { SPARSE_OP_MUL_VEC, SPARSE_OP_MUL_VEC_DOT, SPARSE_OP_RESIDUAL_DOT };
+	U64 sizes[] = { 1, 7, 33, 1001 };
+	struct { U64 chunk_height, sort_window; } configs[] = { { 1, 1 }, { 3, 1 }, { 8, 64 }, { 16, 1000 }, { 64, 64 } };
+	U64 rng = 0x3c6ef372fe94f82bull;
+	SimdLevel max_level = cpu_simd_level();
+	U64 num_failed = 0;
+
+	for (U64 p=0; p<ARRAY_COUNT(precisions); ++p) {
+		FloatPrecision precision = precisions[p];
+		F64 tolerance = precision == PRECISION_F32 ? 1e-4 : 1e-10;
+		LinearAlgebraKernels *reference = get_kernels_for_level(precision, SIMD_LEVEL_SCALAR);
+		for (U64 s=0; s<ARRAY_COUNT(sizes); ++s) {
+			for (U64 c=0; c<ARRAY_COUNT(configs); ++c) {
+				ArenaTemp scratch = scratch_begin(NULL, 0);
+				U64 n = sizes[s];
+				U64 state = rng;
+				SparseMatrix *general = test_random_sparse_mat(scratch.arena, precision, n, &state);
+				SparseMatrix *sliced = test_random_sparse_mat(scratch.arena, precision, n, &rng);
+				U64 num_entries = sliced->num_values;
+				sparse_mat_convert_sliced(scratch.arena, sliced, configs[c].chunk_height, configs[c].sort_window);
+				assert(sliced->layout == SPARSE_LAYOUT_SLICED && sliced->num_values >= num_entries);
+				assert(configs[c].chunk_height > 1 || sliced->num_values == num_entries);
+
+				Vector *a = vec_alloc(scratch.arena, precision, n);
+				Vector *b = vec_alloc(scratch.arena, precision, n);
+				Vector *expected = vec_alloc(scratch.arena, precision, n);
+				Vector *actual = vec_alloc(scratch.arena, precision, n);
+				vec_fill_random(a, &rng);
+				vec_fill_random(b, &rng);
+
+				for (SimdLevel level = SIMD_LEVEL_SCALAR; level <= max_level; ++level) {
+					LinearAlgebraKernels *k = get_kernels_for_level(precision, level);
+					for (U64 j=0; j<ARRAY_COUNT(ops); ++j) {
+						KernelRange expected_range = { .start = 0, .end = n };
+						KernelRange first = { .start = 0, .end = n / 3 + 1 };
+						KernelRange second = { .start = n / 3 + 1, .end = n };
+						vec_zero(expected);
+						vec_zero(actual);
+						sparse_kernel(reference, general, ops[j])(&(KernelArgs){ .A = general, .result = expected, .a = a, .b = b }, &expected_range);
+						KernelFunc *func = sparse_kernel(k, sliced, ops[j]);
+						func(&(KernelArgs){ .A = sliced, .result = actual, .a = a, .b = b }, &first);
+						func(&(KernelArgs){ .A = sliced, .result = actual, .a = a, .b = b }, &second);
+						if (!vec_close(actual, expected, tolerance) || !values_close(first.sum + second.sum, expected_range.sum, tolerance)) {
+							printf("test_sliced_storage: op %u (%s, %s, n=%llu, C=%llu, sigma=%llu) does not match the compressed row kernel\n",
+								ops[j], simd_level_names[level], precision == PRECISION_F32 ? "F32" : "F64", n,
+								configs[c].chunk_height, configs[c].sort_window);
+							++num_failed;
+						}
+					}
+				}
+
+				scratch_end(scratch);
+			}
+		}
+	}
+	assert(num_failed == 0);
+
+	// text input asking for sliced storage solves with every conjugate
+	// gradient solver and survives a round trip through the binary format
+	char *path = "tests/test_sliced.txt";
+	char *binary_path = "tests/test_sliced.bin";
+	FILE *f = fopen(path, "wb");
+	assert(f);
+	fprintf(f, "format: double\nsolver: conjugate_gradients\nstorage: sliced\nmatrix: 13\n"
+		"0 0 4\n0 4 -1\n4 0 -1\n1 1 4\n1 2 -1\n2 1 -1\n2 2 4\n2 3 -1\n3 2 -1\n3 3 4\n4 4 4\n0 3 -1\n3 0 -1\n"
+		"vector: 5\n2 3 2 2 3\nsolution: 5\n1 1 1 1 1\n");
+	fclose(f);
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	ParseResult input = parse_input(scratch.arena, path);
+	assert(input.matrix->layout == SPARSE_LAYOUT_SLICED && input.matrix->chunk_height == sliced_chunk_height);
+	write_binary_file(binary_path, &input);
+	ParseResult binary = load_binary_file(scratch.arena, binary_path);
+	assert(parse_results_equal(&binary, &input));
+	SolverKind solvers[] = {
+		SOLVER_CONJUGATE_GRADIENTS, SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS, SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS,
+	};
+	for (U64 i=0; i<ARRAY_COUNT(solvers); ++i) {
+		Vector *actual = vec_alloc(scratch.arena, PRECISION_F64, 5);
+		assert(solve(solvers[i], binary.matrix, binary.vector, actual));
+		assert(vec_close(actual, input.solution, 1e-10));
+	}
+	unload_binary_file(&binary);
+	scratch_end(scratch);
+	remove(path);
+	remove(binary_path);
+
+	printf("test_sliced_storage: success\n");
+}
+
+// compares the block kernels of every simd level against the single vector
+// scalar kernels run once per column, then solves several right hand sides
+// at once in every layout
+static void test_block_conjugate_gradients(void) {
+	FloatPrecision precisions[] = { PRECISION_F32, PRECISION_F64 };
+	SparseOp ops[] = { SPARSE_OP_MUL_VEC_DOT, SPARSE_OP_RESIDUAL_DOT };
+	U64 column_counts[] = { 1, 3, 8, 13, 16 };
+	U64 n = 1001;
+	U64 rng = 0x6a09e667f3bcc908ull;
+	SimdLevel max_level = cpu_simd_level();
+	U64 num_failed = 0;
+
+	for (U64 p=0; p<ARRAY_COUNT(precisions); ++p) {
+		FloatPrecision precision = precisions[p];
+		F64 tolerance = precision == PRECISION_F32 ? 1e-4 : 1e-10;
+		LinearAlgebraKernels *reference = get_kernels_for_level(precision, SIMD_LEVEL_SCALAR);
+		for (U64 c=0; c<ARRAY_COUNT(column_counts); ++c) {
+			ArenaTemp scratch = scratch_begin(NULL, 0);
+			U64 columns = column_counts[c];
+			SparseMatrix *A = test_random_sparse_mat(scratch.arena, precision, n, &rng);
+
+			Vector *a = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *b = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *block_a = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *block_b = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *block_actual = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *expected = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *actual = vec_alloc(scratch.arena, precision, n * columns);
+			vec_fill_random(a, &rng);
+			vec_fill_random(b, &rng);
+			vec_transpose(block_a, a, columns, n);
+			vec_transpose(block_b, b, columns, n);
+
+			for (U64 j=0; j<ARRAY_COUNT(ops); ++j) {
+				F64 expected_sums[BLOCK_MAX_COLUMNS];
+				for (U64 col=0; col<columns; ++col) {
+					Vector column_a = vec_slice(a, col * n, n);
+					Vector column_b = vec_slice(b, col * n, n);
+					Vector column_expected = vec_slice(expected, col * n, n);
+					expected_sums[col] = run_sparse_kernel(reference, ops[j],
+						&(KernelArgs){ .A = A, .result = &column_expected, .a = &column_a, .b = &column_b }, n);
+				}
+				for (SimdLevel level = SIMD_LEVEL_SCALAR; level <= max_level; ++level) {
+					LinearAlgebraKernels *k = get_kernels_for_level(precision, level);
+					F64 actual_sums[BLOCK_MAX_COLUMNS];
+					run_block_kernel(sparse_block_kernel(k, A, ops[j]),
+						&(KernelArgs){ .A = A, .result = block_actual, .a = block_a, .b = block_b, .columns = columns }, n, actual_sums);
+					vec_transpose(actual, block_actual, n, columns);
+					bool same = vec_close(actual, expected, tolerance);
+					for (U64 col=0; col<columns; ++col) {
+						same = same && values_close(actual_sums[col], expected_sums[col], tolerance);
+					}
+					if (!same) {
+						printf("test_block_conjugate_gradients: op %u (%s, %s, columns=%llu) does not match the single vector kernels\n",
+							ops[j], simd_level_names[level],
+							precision == PRECISION_F32 ? "F32" : "F64", columns);
+						++num_failed;
+					}
+				}
+			}
+			scratch_end(scratch);
+		}
+	}
+	assert(num_failed == 0);
+
+	// L = tridiag(-1, 2.5, -1) with five right hand sides, one of them zero,
+	// solved in compressed rows, diagonal and symmetric storage (the last
+	// two column by column)
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	U64 size = 3000;
+	U64 columns = 5;
+	Vector *expected = vec_alloc(scratch.arena, PRECISION_F64, size * columns);
+	Vector *b = vec_alloc(scratch.arena, PRECISION_F64, size * columns);
+	Vector *actual = vec_alloc(scratch.arena, PRECISION_F64, size * columns);
+	vec_fill_random(expected, &rng);
+	for (U64 i=0; i<size; ++i) {
+		expected->valuesF64[2 * size + i] = 0;
+	}
+	for (U64 layout=0; layout<3; ++layout) {
+		SparseMatrix *A = sparse_mat_alloc(scratch.arena, PRECISION_F64, 3*size - 2);
+		U64 count = 0;
+		for (U64 row=0; row<size; ++row) {
+			for (U64 col=(row > 0 ? row-1 : 0); col<=row+1 && col<size; ++col) {
+				test_push_entry(A, &count, row, col, row == col ? 2.5 : -1.0);
+			}
+		}
+		sparse_mat_build_csr(scratch.arena, A, size);
+		if (layout == 1) assert(sparse_mat_convert_diagonal(scratch.arena, A));
+		if (layout == 2) assert(sparse_mat_convert_symmetric(A));
+		for (U64 col=0; col<columns; ++col) {
+			Vector column_b = vec_slice(b, col * size, size);
+			Vector column_expected = vec_slice(expected, col * size, size);
+			sparse_mat_mul_vec(&column_b, A, &column_expected);
+		}
+		assert(solve(SOLVER_CONJUGATE_GRADIENTS, A, b, actual));
+		assert(vec_close(actual, expected, 1e-4));
+		assert(solve(SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS, A, b, actual));
+		assert(vec_close(actual, expected, 1e-4));
+	}
+	scratch_end(scratch);
+
+	// several vector sections in a text input, through the binary format
+	char *path = "tests/test_block.txt";
+	char *binary_path = "tests/test_block.bin";
+	FILE *f = fopen(path, "wb");
+	assert(f);
+	fprintf(f, "format: double\nsolver: conjugate_gradients\nmatrix: 7\n"
+		"0 0 4\n0 1 -1\n1 0 -1\n1 1 4\n1 2 -1\n2 1 -1\n2 2 4\n"
+		"vector: 3\n3 2 3\nvector: 3\n4 -2 4\nsolution: 3\n1 1 1\nsolution: 3\n1 0 1\n");
+	fclose(f);
+	scratch = scratch_begin(NULL, 0);
+	ParseResult input = parse_input(scratch.arena, path);
+	assert(input.num_vectors == 2 && input.vector->num_values == 6 && input.matrix->layout == SPARSE_LAYOUT_DIAGONAL);
+	write_binary_file(binary_path, &input);
+	ParseResult binary = load_binary_file(scratch.arena, binary_path);
+	assert(parse_results_equal(&binary, &input));
+	actual = vec_alloc(scratch.arena, PRECISION_F64, 6);
+	assert(solve(binary.solver, binary.matrix, binary.vector, actual));
+	assert(vec_close(actual, input.solution, 1e-10));
+	unload_binary_file(&binary);
+	scratch_end(scratch);
+	remove(path);
+	remove(binary_path);
+
+	printf("test_block_conjugate_gradients: success\n");
+}
+
 static void test_conjugate_gradients(void) {
 	U64 sum_success = 0;
 	U64 num_tests = 1000;
@@ -234,61 +1180,156 @@ fail:
 	printf("\nSummary: %llu / %llu tests succeeded.\n", sum_success, num_tests);
 }
 
-static F64 seconds_from_cpu_time(F64 cpu_time, U64 cpu_timer_freq) {
-	F64 seconds = 0.0;
-	if (cpu_timer_freq) {
-		seconds = cpu_time / (F64)cpu_timer_freq;
+// A = S * L * S with L = tridiag(-1, 2.5, -1) and S a diagonal of scales
+// between 1 and 100. the scaling wrecks the condition number, the Jacobi
+// preconditioner undoes it
+static void test_preconditioned_conjugate_gradients(void) {
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	U64 n = 2000;
+	U64 rng = 0x2545f4914f6cdd1dull;
+
+	F64 *scales = arena_push_n(scratch.arena, F64, n);
+	for (U64 i=0; i<n; ++i) {
+		scales[i] = pow(10.0, 1.0 + test_random_f64(&rng));
 	}
-	return seconds;
-}
 
-static void test_branching(void) {
-	U64 num_iterations = 10000;
-	U64 min, max, sum;
-	U64 cpu_timer_freq = estimate_cpu_freq();
-	
-	TestFunc test_funcs[] = {
-		{ .name = "solver with branching", .func = solve_conjugate_gradients },
-		{ .name = "solver without branching", .func = solver_no_branch },
-	};
+	SparseMatrix *A = sparse_mat_alloc(scratch.arena, PRECISION_F64, 3*n - 2);
+	U64 count = 0;
+	for (U64 row=0; row<n; ++row) {
+		for (U64 col=(row > 0 ? row-1 : 0); col<=row+1 && col<n; ++col) {
+			A->rows[count] = row;
+			A->cols[count] = col;
+			A->valuesF64[count] = (row == col ? 2.5 : -1.0) * scales[row] * scales[col];
+			++count;
+		}
+	}
+	assert(count == A->num_values);
+	sparse_mat_build_csr(scratch.arena, A, n);
 
-	ArenaTemp scratch = scratch_begin(NULL, 0);
-	ParseResult parse_result = parse_input(scratch.arena, "tests/test_100.txt");
-	Vector *result = vec_alloc(scratch.arena, parse_result.vector->precision, parse_result.vector->num_values);
+	Vector *expected = vec_alloc(scratch.arena, PRECISION_F64, n);
+	Vector *b = vec_alloc(scratch.arena, PRECISION_F64, n);
+	Vector *actual = vec_alloc(scratch.arena, PRECISION_F64, n);
+	vec_fill_random(expected, &rng);
+	sparse_mat_mul_vec(b, A, expected);
 
-	U64 pos = arena_pos(scratch.arena);
+	bool converged = solve(SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS, A, b, actual);
+	assert(converged);
+	assert(vec_close(actual, expected, 1e-4));
 
-	for (U64 i=0; i<ARRAY_COUNT(test_funcs); ++i) {
-		min = UINT64_MAX;
-		max = 0;
-		sum = 0;
-		printf("\n--- %s ---\n", test_funcs[i].name);
-		for (U64 j=0; j<num_iterations; ++j) {
-
-			U64 ticks_start = read_cpu_timer();
-			if (!test_funcs[i].func(parse_result.matrix, parse_result.vector, result)) {
-				printf("Solver failed to produce a solution\n");
-				exit(1);
-			}
-			U64 ticks_stop = read_cpu_timer();
-			U64 ticks = ticks_stop - ticks_start;
+	scratch_end(scratch);
+	printf("test_preconditioned_conjugate_gradients: success\n");
+}
 
-			if (ticks < min) min = ticks;
-			if (ticks > max) max = ticks;
-			sum += ticks;
+static SparseMatrix *test_dense_to_sparse(Arena *arena, F64 *dense, U64 n) {
+	U64 num_values = 0;
+	for (U64 i=0; i<n*n; ++i) {
+		if (dense[i] != 0) ++num_values;
+	}
+	SparseMatrix *m = sparse_mat_alloc(arena, PRECISION_F64, num_values);
+	U64 count = 0;
+	for (U64 i=0; i<n*n; ++i) {
+		if (dense[i] == 0) continue;
+		m->rows[count] = i / n;
+		m->cols[count] = i % n;
+		m->valuesF64[count] = dense[i];
+		++count;
+	}
+	sparse_mat_build_csr(arena, m, n);
+	return m;
+}
 
-			arena_pop_to(scratch.arena, pos);
+static void test_incomplete_cholesky(void) {
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	U64 rng = 0x5851f42d4c957f2dull;
+
+	// shifted 2d laplacian on a 40x40 grid, stored with shuffled entries and the
+	// diagonal split into two duplicates
+	U64 side = 40;
+	U64 n = side * side;
+	SparseMatrix *A = sparse_mat_alloc(scratch.arena, PRECISION_F64, 6*n);
+	U64 count = 0;
+	for (U64 row=0; row<n; ++row) {
+		U64 x = row % side, y = row / side;
+		U64 neighbors[] = { row - 1, row + 1, row - side, row + side };
+		bool valid[] = { x > 0, x + 1 < side, y > 0, y + 1 < side };
+		for (U64 j=0; j<ARRAY_COUNT(neighbors); ++j) {
+			if (!valid[j]) continue;
+			A->rows[count] = row; A->cols[count] = neighbors[j]; A->valuesF64[count] = -1; ++count;
 		}
-
-		F64 avg = (F64)sum / (F64)num_iterations;
-		printf("min: %llu (%fms)\n", min, 1000.0f * seconds_from_cpu_time((F64)min, cpu_timer_freq));
-		printf("max: %llu (%fms)\n", max, 1000.0f * seconds_from_cpu_time((F64)max, cpu_timer_freq));
-		printf("avg: %.0f (%fms)\n", avg, 1000.0f * seconds_from_cpu_time(avg, cpu_timer_freq));
+		A->rows[count] = row; A->cols[count] = row; A->valuesF64[count] = 1.5; ++count;
+		A->rows[count] = row; A->cols[count] = row; A->valuesF64[count] = 3.5; ++count;
+	}
+	A->num_values = count;
+	for (U64 i=count-1; i>0; --i) {
+		U64 j = test_random_u64(&rng) % (i + 1);
+		U64 row = A->rows[i], col = A->cols[i]; F64 value = A->valuesF64[i];
+		A->rows[i] = A->rows[j]; A->cols[i] = A->cols[j]; A->valuesF64[i] = A->valuesF64[j];
+		A->rows[j] = row; A->cols[j] = col; A->valuesF64[j] = value;
+	}
+	sparse_mat_build_csr(scratch.arena, A, n);
+
+	F64 shift;
+	SparseMatrix *L = sparse_mat_incomplete_cholesky(scratch.arena, A, &shift);
+	assert(L && shift == 0);
+	assert(L->num_values == n + (A->num_values - 2*n) / 2);
+
+	// the factor is reused for several right hand sides
+	Vector *expected = vec_alloc(scratch.arena, PRECISION_F64, n);
+	Vector *b = vec_alloc(scratch.arena, PRECISION_F64, n);
+	Vector *actual = vec_alloc(scratch.arena, PRECISION_F64, n);
+	for (U64 i=0; i<3; ++i) {
+		vec_fill_random(expected, &rng);
+		sparse_mat_mul_vec(b, A, expected);
+		bool converged = solve_incomplete_cholesky_conjugate_gradients(A, L, b, actual);
+		assert(converged);
+		assert(vec_close(actual, expected, 1e-3));
 	}
 
+	// symmetric storage gives the same factor from the upper triangle
+	assert(sparse_mat_convert_symmetric(A));
+	SparseMatrix *upper_L = sparse_mat_incomplete_cholesky(scratch.arena, A, &shift);
+	assert(upper_L && shift == 0 && upper_L->num_values == L->num_values);
+	assert(memcmp(upper_L->cols, L->cols, L->num_values * sizeof(U64)) == 0);
+	assert(memcmp(upper_L->valuesF64, L->valuesF64, L->num_values * sizeof(F64)) == 0);
+
+	// Kershaw's matrix is positive definite but IC(0) breaks down on it
+	F64 kershaw[] = {
+		 3, -2,  0,  2,
+		-2,  3, -2,  0,
+		 0, -2,  3, -2,
+		 2,  0, -2,  3,
+	};
+	SparseMatrix *K = test_dense_to_sparse(scratch.arena, kershaw, 4);
+	L = sparse_mat_incomplete_cholesky(scratch.arena, K, &shift);
+	assert(L && shift > 0);
+	expected = vec_alloc(scratch.arena, PRECISION_F64, 4);
+	b = vec_alloc(scratch.arena, PRECISION_F64, 4);
+	actual = vec_alloc(scratch.arena, PRECISION_F64, 4);
+	vec_fill_random(expected, &rng);
+	sparse_mat_mul_vec(b, K, expected);
+	bool converged = solve(SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS, K, b, actual);
+	assert(converged);
+	assert(vec_close(actual, expected, 1e-3));
+
+	// no shift helps a zero on the diagonal
+	F64 singular[] = {
+		0, 1,
+		1, 2,
+	};
+	L = sparse_mat_incomplete_cholesky(scratch.arena, test_dense_to_sparse(scratch.arena, singular, 2), &shift);
+	assert(!L);
+
 	scratch_end(scratch);
+	printf("test_incomplete_cholesky: success\n");
 }
 
+static F64 seconds_from_cpu_time(F64 cpu_time, U64 cpu_timer_freq) {
+	F64 seconds = 0.0;
+	if (cpu_timer_freq) {
+		seconds = cpu_time / (F64)cpu_timer_freq;
+	}
+	return seconds;
+}
 
 typedef struct {
 	char *name;
@@ -349,18 +1390,928 @@ static void test_float_vs_double(void) {
 	scratch_end(scratch);
 }
 
+// solves a directory holding a good, a malformed and a non-converging input,
+// then the same inputs through a manifest
+static void test_batch(void) {
+	char *input_dir = "tests/batch_inputs";
+	char *output_dir = "tests/batch_outputs";
+	char *manifest_path = "tests/batch_manifest.txt";
+	char *names[] = { "good.txt", "malformed.txt", "indefinite.txt" };
+	char *sources[] = {
+		"format: double\nsolver: conjugate_gradients\nmatrix: 4\n0 0 3\n0 1 2\n1 0 2\n1 1 6\nvector: 2\n2\n-8\n",
+		"format: double\nsolver: conjugate_gradients\nmatrix: 4\n0 0 3\n0 1\n",
+		"format: double\nsolver: conjugate_gradients\nmatrix: 2\n0 0 1\n1 1 -1\nvector: 2\n1\n1\n",
+	};
+	BatchStatus expected[] = { BATCH_SOLVED, BATCH_FAILED, BATCH_NOT_CONVERGED };
+	assert(os_make_directory(input_dir));
+	FILE *manifest = fopen(manifest_path, "wb");
+	assert(manifest);
+	fprintf(manifest, "# inputs\n\n");
+	char path[256];
+	for (U64 i=0; i<ARRAY_COUNT(names); ++i) {
+		snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+		FILE *f = fopen(path, "wb");
+		assert(f);
+		fputs(sources[i], f);
+		fclose(f);
+		fprintf(manifest, "  %s\n", path);
+	}
+	fclose(manifest);
+
+	char *batch_inputs[] = { input_dir, manifest_path };
+	for (U64 run=0; run<ARRAY_COUNT(batch_inputs); ++run) {
+		assert(solve_batch(batch_inputs[run], output_dir) == 2);
+
+		// the summary lists the inputs in order, the directory sorted by name,
+		// with the outputs numbered by position
+		snprintf(path, sizeof(path), "%s/summary.txt", output_dir);
+		ArenaTemp scratch = scratch_begin(NULL, 0);
+		char *summary;
+		U64 size;
+		assert(read_entire_file(scratch.arena, path, &summary, &size));
+		U64 order[] = { 0, 2, 1 };
+		char *line = summary;
+		for (U64 i=0; i<ARRAY_COUNT(names); ++i) {
+			U64 index = run == 0 ? order[i] : i;
+			snprintf(path, sizeof(path), "%s/%s %s ", input_dir, names[index], batch_status_names[expected[index]]);
+			assert(strncmp(line, path, strlen(path)) == 0);
+			char *end = strchr(line, '\n');
+			if (expected[index] != BATCH_FAILED) {
+				snprintf(path, sizeof(path), " output=%llu_%s.out\n", i, names[index]);
+				assert(strncmp(end - strlen(path) + 1, path, strlen(path)) == 0);
+			}
+			line = end + 1;
+		}
+		assert(strncmp(line, "total: 3 systems, 1 solved, 1 not converged, 1 failed", 53) == 0);
+
+		char *solution;
+		snprintf(path, sizeof(path), "%s/0_good.txt.out", output_dir);
+		assert(read_entire_file(scratch.arena, path, &solution, &size));
+		assert(strcmp(solution, "{ 2 -2 }\n") == 0);
+		scratch_end(scratch);
+	}
+
+	// inputs of the same name in different directories keep their own output
+	char *other_dir = "tests/batch_inputs/other";
+	assert(os_make_directory(other_dir));
+	snprintf(path, sizeof(path), "%s/good.txt", other_dir);
+	FILE *other = fopen(path, "wb");
+	assert(other);
+	fputs("format: double\nsolver: conjugate_gradients\nmatrix: 2\n0 0 2\n1 1 4\nvector: 2\n2\n2\n", other);
+	fclose(other);
+	manifest = fopen(manifest_path, "wb");
+	assert(manifest);
+	fprintf(manifest, "%s/good.txt\n%s/good.txt\n", input_dir, other_dir);
+	fclose(manifest);
+	assert(solve_batch(manifest_path, output_dir) == 0);
+	{
+		ArenaTemp scratch = scratch_begin(NULL, 0);
+		char *solution;
+		U64 size;
+		snprintf(path, sizeof(path), "%s/0_good.txt.out", output_dir);
+		assert(read_entire_file(scratch.arena, path, &solution, &size));
+		assert(strcmp(solution, "{ 2 -2 }\n") == 0);
+		snprintf(path, sizeof(path), "%s/1_good.txt.out", output_dir);
+		assert(read_entire_file(scratch.arena, path, &solution, &size));
+		assert(strcmp(solution, "{ 1 0.5 }\n") == 0);
+		scratch_end(scratch);
+	}
+	snprintf(path, sizeof(path), "%s/good.txt", other_dir);
+	remove(path);
+
+	for (U64 i=0; i<ARRAY_COUNT(names); ++i) {
+		snprintf(path, sizeof(path), "%s/%s", input_dir, names[i]);
+		remove(path);
+		for (U64 j=0; j<ARRAY_COUNT(names); ++j) {
+			snprintf(path, sizeof(path), "%s/%llu_%s.out", output_dir, j, names[i]);
+			remove(path);
+		}
+	}
+	snprintf(path, sizeof(path), "%s/summary.txt", output_dir);
+	remove(path);
+	remove(manifest_path);
+
+	printf("test_batch: success\n");
+}
+
+// a time step like sequence: the same system solved from zero and from a
+// guess close to the solution, which has to take fewer iterations, and from
+// the exact solution, which takes none. the guesses come from the
+// initial_guess sections of the input and survive the binary format
+static void test_initial_guess(void) {
+	char *binary_path = "tests/test_initial_guess.bin";
+	U64 n = 200;
+	U64 rng = 7;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+
+	SparseMatrix *A = test_laplacian_sparse_mat(scratch.arena, PRECISION_F64, n, 2.5, n);
+
+	// two right hand sides, the first guess is exact, the second one a bit off
+	Vector *expected = vec_alloc(scratch.arena, PRECISION_F64, 2*n);
+	Vector *b = vec_alloc(scratch.arena, PRECISION_F64, 2*n);
+	Vector *guess = vec_alloc(scratch.arena, PRECISION_F64, 2*n);
+	vec_fill_random(expected, &rng);
+	for (U64 j=0; j<2; ++j) {
+		Vector column_b = vec_slice(b, j*n, n);
+		Vector column_expected = vec_slice(expected, j*n, n);
+		sparse_mat_mul_vec(&column_b, A, &column_expected);
+	}
+	vec_fill_random(guess, &rng);
+	for (U64 i=0; i<2*n; ++i) {
+		guess->valuesF64[i] = expected->valuesF64[i] + (i < n ? 0 : 1e-3 * guess->valuesF64[i]);
+	}
+
+	char *sections[] = { "vector", "initial_guess" };
+	Vector *values[] = { b, guess };
+	U64 size;
+	char *text = test_input_text(scratch.arena, "conjugate_gradients", A, n, sections, values, ARRAY_COUNT(sections), &size);
+
+	ParseResult input = parse_input_memory(scratch.arena, "test_initial_guess", text, size);
+	assert(input.num_vectors == 2 && input.initial_guess && !input.solution);
+	assert(memcmp(input.initial_guess->valuesF64, guess->valuesF64, 2*n * sizeof(F64)) == 0);
+	write_binary_file(binary_path, &input);
+	ParseResult binary = load_binary_file(scratch.arena, binary_path);
+	assert(parse_results_equal(&binary, &input));
+	unload_binary_file(&binary);
+	remove(binary_path);
+
+	// both the block path (plain conjugate gradients on compressed rows) and
+	// the one column at a time path (Jacobi)
+	SolverKind solvers[] = { SOLVER_CONJUGATE_GRADIENTS, SOLVER_PRECONDITIONED_CONJUGATE_GRADIENTS };
+	Vector *actual = vec_alloc(scratch.arena, PRECISION_F64, 2*n);
+	for (U64 i=0; i<ARRAY_COUNT(solvers); ++i) {
+		PreparedSystem prepared = prepare_system(scratch.arena, solvers[i], input.matrix);
+		assert(solve_prepared(&prepared, input.vector, NULL, actual));
+		U64 cold_iterations = solver_stats.iterations;
+		assert(vec_close(actual, expected, 1e-3));
+
+		assert(solve_prepared(&prepared, input.vector, input.initial_guess, actual));
+		assert(solver_stats.iterations < cold_iterations);
+		assert(vec_close(actual, expected, 1e-3));
+
+		// the exact solution is already converged, result may be the guess
+		Vector first_b = vec_slice(input.vector, 0, n);
+		Vector first_actual = vec_slice(actual, 0, n);
+		Vector first_expected = vec_slice(expected, 0, n);
+		vec_copy_values(&first_actual, &first_expected);
+		assert(solve_prepared(&prepared, &first_b, &first_actual, &first_actual));
+		assert(solver_stats.iterations == 0);
+	}
+
+	scratch_end(scratch);
+	printf("test_initial_guess: success\n");
+}
+
+// (b - A * x) . (b - A * x) in double precision
+static F64 test_residual_dot(SparseMatrix *A, Vector *b, Vector *x) {
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	Vector *product = vec_alloc(scratch.arena, PRECISION_F64, b->num_values);
+	sparse_mat_mul_vec(product, A, x);
+	F64 delta = 0;
+	for (U64 i=0; i<b->num_values; ++i) {
+		F64 r = b->valuesF64[i] - product->valuesF64[i];
+		delta += r * r;
+	}
+	scratch_end(scratch);
+	return delta;
+}
+
+static void test_mixed_precision(void) {
+	U64 n = 500;
+	U64 rng = 11;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+
+	SparseMatrix *A = test_laplacian_sparse_mat(scratch.arena, PRECISION_F64, n, 2.5, n);
+
+	// a large solution, rounding it to single precision alone leaves a
+	// residual . residual far above TOLERANCE
+	Vector *expected = vec_alloc(scratch.arena, PRECISION_F64, n);
+	Vector *b = vec_alloc(scratch.arena, PRECISION_F64, n);
+	vec_fill_random(expected, &rng);
+	for (U64 i=0; i<n; ++i) {
+		expected->valuesF64[i] *= 1000;
+	}
+	sparse_mat_mul_vec(b, A, expected);
+
+	char *sections[] = { "vector" };
+	Vector *values[] = { b };
+	U64 size;
+	char *text = test_input_text(scratch.arena, "mixed_precision_conjugate_gradients", A, n, sections, values, ARRAY_COUNT(sections), &size);
+
+	ParseResult input = parse_input_memory(scratch.arena, "test_mixed_precision", text, size);
+	assert(input.solver == SOLVER_MIXED_PRECISION_CONJUGATE_GRADIENTS);
+	PreparedSystem prepared = prepare_system(scratch.arena, input.solver, input.matrix);
+	assert(prepared.kind == SOLVER_MIXED_PRECISION_CONJUGATE_GRADIENTS && prepared.A32);
+	assert(prepared.A32->precision == PRECISION_F32 && prepared.A32->cols32 == input.matrix->cols32);
+
+	Vector *actual = vec_alloc(scratch.arena, PRECISION_F64, n);
+	assert(solve_prepared(&prepared, input.vector, NULL, actual));
+	assert(solver_stats.residual <= TOLERANCE);
+	assert(vec_close(actual, expected, 1e-6));
+
+	// the residual reported is the double precision one
+	assert(test_residual_dot(input.matrix, input.vector, actual) <= TOLERANCE);
+
+	// single precision conjugate gradients stops once its own residual is
+	// small enough, the double precision one is still far off
+	Vector *b32 = vec_alloc(scratch.arena, PRECISION_F32, n);
+	Vector *actual32 = vec_alloc(scratch.arena, PRECISION_F32, n);
+	Vector *widened = vec_alloc(scratch.arena, PRECISION_F64, n);
+	for (U64 i=0; i<n; ++i) {
+		b32->valuesF32[i] = (F32)b->valuesF64[i];
+	}
+	solve(SOLVER_CONJUGATE_GRADIENTS, prepared.A32, b32, actual32);
+	for (U64 i=0; i<n; ++i) {
+		widened->valuesF64[i] = actual32->valuesF32[i];
+	}
+	assert(test_residual_dot(input.matrix, input.vector, widened) > TOLERANCE);
+	assert(!vec_close(widened, expected, 1e-6));
+
+	// a single precision matrix falls back to plain conjugate gradients
+	PreparedSystem fallback = prepare_system(scratch.arena, SOLVER_MIXED_PRECISION_CONJUGATE_GRADIENTS, prepared.A32);
+	assert(fallback.kind == SOLVER_CONJUGATE_GRADIENTS && !fallback.A32);
+
+	scratch_end(scratch);
+	printf("test_mixed_precision: success\n");
+}
+
+// runs pipelined_cg_update of every simd level on random vectors against the
+// scalar kernel, it does not fit the single result contract of
+// test_simd_kernels
+static void test_pipelined_cg_update_kernels(FloatPrecision precision, U64 n, U64 *rng) {
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	F64 tolerance = precision == PRECISION_F32 ? 1e-4 : 1e-10;
+	Vector *initial[7];
+	for (U64 v=0; v<ARRAY_COUNT(initial); ++v) {
+		initial[v] = vec_alloc(scratch.arena, precision, n);
+		vec_fill_random(initial[v], rng);
+	}
+	for (SimdLevel level = SIMD_LEVEL_SSE2; level <= cpu_simd_level(); ++level) {
+		Vector *vectors[2][ARRAY_COUNT(initial)];
+		F64 sums[2][2];
+		for (U64 t=0; t<2; ++t) {
+			for (U64 v=0; v<ARRAY_COUNT(initial); ++v) {
+				vectors[t][v] = vec_alloc(scratch.arena, precision, n);
+				vec_copy_values(vectors[t][v], initial[v]);
+			}
+			PipelinedCG cg = {
+				.x = vectors[t][0], .r = vectors[t][1], .w = vectors[t][2], .p = vectors[t][3],
+				.s = vectors[t][4], .z = vectors[t][5], .q = vectors[t][6],
+				.alpha = 0.37, .beta = 0.61,
+			};
+			LinearAlgebraKernels *k = get_kernels_for_level(precision, t == 0 ? SIMD_LEVEL_SCALAR : level);
+			// start part way into the vectors so unaligned ranges are covered
+			KernelRange range = { .start = n / 3, .end = n };
+			k->pipelined_cg_update(&(KernelArgs){ .pipelined = &cg, .column_sums = sums[t] }, &range);
+		}
+		for (U64 v=0; v<ARRAY_COUNT(initial); ++v) {
+			assert(vec_close(vectors[1][v], vectors[0][v], tolerance));
+		}
+		assert(values_close(sums[1][0], sums[0][0], tolerance) && values_close(sums[1][1], sums[0][1], tolerance));
+	}
+	scratch_end(scratch);
+}
+
+static void test_pipelined_conjugate_gradients(void) {
+	U64 kernel_sizes[] = { 1, 7, 33, 1001 };
+	U64 kernel_rng = 17;
+	for (U64 s=0; s<ARRAY_COUNT(kernel_sizes); ++s) {
+		test_pipelined_cg_update_kernels(PRECISION_F32, kernel_sizes[s], &kernel_rng);
+		test_pipelined_cg_update_kernels(PRECISION_F64, kernel_sizes[s], &kernel_rng);
+	}
+
+	// large enough for several threads and well over
+	// ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE iterations
+	U64 n = 100000;
+	U64 rng = 13;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+
+	SparseLayout layouts[] = { SPARSE_LAYOUT_CSR, SPARSE_LAYOUT_SYMMETRIC, SPARSE_LAYOUT_DIAGONAL };
+	for (U64 l=0; l<ARRAY_COUNT(layouts); ++l) {
+		for (FloatPrecision precision=PRECISION_F32; precision<=PRECISION_F64; ++precision) {
+			SparseMatrix *A = test_laplacian_sparse_mat(scratch.arena, precision, n, 2.02, n);
+			if (layouts[l] == SPARSE_LAYOUT_SYMMETRIC) {
+				assert(sparse_mat_convert_symmetric(A));
+			} else if (layouts[l] == SPARSE_LAYOUT_DIAGONAL) {
+				assert(sparse_mat_convert_diagonal(scratch.arena, A));
+			}
+
+			Vector *expected = vec_alloc(scratch.arena, precision, n);
+			Vector *b = vec_alloc(scratch.arena, precision, n);
+			vec_fill_random(expected, &rng);
+			sparse_mat_mul_vec(b, A, expected);
+
+			Vector *classic = vec_alloc(scratch.arena, precision, n);
+			Vector *pipelined = vec_alloc(scratch.arena, precision, n);
+			bool classic_converged = solve(SOLVER_CONJUGATE_GRADIENTS, A, b, classic);
+			U64 classic_iterations = solver_stats.iterations;
+			bool pipelined_converged = solve(SOLVER_PIPELINED_CONJUGATE_GRADIENTS, A, b, pipelined);
+			U64 pipelined_iterations = solver_stats.iterations;
+
+			// the same iteration up to rounding. in single precision the
+			// residual replacements cost a few iterations
+			assert(classic_converged && pipelined_converged);
+			assert(pipelined_iterations > ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE);
+			assert(pipelined_iterations <= classic_iterations + 10);
+			assert(vec_close(pipelined, expected, 1e-2));
+			if (precision == PRECISION_F64) {
+				assert(vec_close(pipelined, classic, 1e-6));
+			}
+		}
+	}
+
+	scratch_end(scratch);
+	printf("test_pipelined_conjugate_gradients: success\n");
+}
+
+static void test_processes(void) {
+	U64 n = 30000;
+	U64 rng = 19;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+
+	// rows of different lengths, so the split by entries is not a split by
+	// rows, and more than ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE iterations
+	SparseMatrix *A = test_laplacian_sparse_mat(scratch.arena, PRECISION_F64, n, 4.05, n/2);
+
+	Vector *expected = vec_alloc(scratch.arena, PRECISION_F64, 2*n);
+	Vector *b = vec_alloc(scratch.arena, PRECISION_F64, 2*n);
+	vec_fill_random(expected, &rng);
+	for (U64 j=0; j<2; ++j) {
+		Vector column_b = vec_slice(b, j*n, n);
+		Vector column_expected = vec_slice(expected, j*n, n);
+		sparse_mat_mul_vec(&column_b, A, &column_expected);
+	}
+
+	PreparedSystem prepared = prepare_system(scratch.arena, SOLVER_CONJUGATE_GRADIENTS, A);
+	Vector *single = vec_alloc(scratch.arena, PRECISION_F64, 2*n);
+	Vector *split = vec_alloc(scratch.arena, PRECISION_F64, 2*n);
+	assert(solve_prepared(&prepared, b, NULL, single));
+	U64 single_iterations = solver_stats.iterations;
+	assert(single_iterations > ITERATIONS_BEFORE_RESIDUAL_RECOMPUTE);
+
+	U64 process_counts[] = { 2, 3, 7 };
+	for (U64 i=0; i<ARRAY_COUNT(process_counts); ++i) {
+		assert(solve_processes(&prepared, b, NULL, split, process_counts[i]));
+		assert(solver_stats.residual <= TOLERANCE);
+		assert(solver_stats.iterations <= single_iterations + 2);
+		assert(vec_close(split, expected, 1e-4));
+		assert(vec_close(split, single, 1e-6));
+	}
+
+	// the solution is already converged
+	assert(solve_processes(&prepared, b, split, split, 3));
+	assert(solver_stats.iterations == 0);
+
+	scratch_end(scratch);
+	printf("test_processes: success\n");
+}
+
+static U64 test_csr_bandwidth(SparseMatrix *m) {
+	U64 bandwidth = 0;
+	for (U64 row=0; row<m->num_rows; ++row) {
+		for (U64 i=m->row_offsets[row]; i<m->row_offsets[row+1]; ++i) {
+			U64 col = sparse_mat_col(m, i);
+			bandwidth = MAX(bandwidth, row > col ? row - col : col - row);
+		}
+	}
+	return bandwidth;
+}
+
+// a grid laplacian with its nodes numbered at random, parsed as it is and
+// reordered. reordering brings the bandwidth down to about the width of the
+// grid, the solutions come back in the numbering of the input
+static void test_reorder(void) {
+	char *binary_path = "tests/test_reorder.bin";
+	U64 side = 30;
+	U64 n = side * side;
+	U64 rng = 23;
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+
+	U64 *labels = arena_push_n(scratch.arena, U64, n);
+	for (U64 i=0; i<n; ++i) {
+		labels[i] = i;
+	}
+	for (U64 i=n-1; i>0; --i) {
+		U64 j = test_random_u64(&rng) % (i + 1);
+		U64 label = labels[i];
+		labels[i] = labels[j];
+		labels[j] = label;
+	}
+
+	SparseMatrix *A = sparse_mat_alloc(scratch.arena, PRECISION_F64, 5*n);
+	U64 count = 0;
+	for (U64 y=0; y<side; ++y) {
+		for (U64 x=0; x<side; ++x) {
+			S64 neighbors[5][2] = { {0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1} };
+			for (U64 k=0; k<ARRAY_COUNT(neighbors); ++k) {
+				S64 nx = (S64)x + neighbors[k][0];
+				S64 ny = (S64)y + neighbors[k][1];
+				if (nx < 0 || ny < 0 || nx >= (S64)side || ny >= (S64)side) continue;
+				A->rows[count] = labels[y*side + x];
+				A->cols[count] = labels[ny*side + nx];
+				A->valuesF64[count++] = k == 0 ? 4.05 : -1;
+			}
+		}
+	}
+	A->num_values = count;
+	sparse_mat_build_csr(scratch.arena, A, n);
+
+	Vector *expected = vec_alloc(scratch.arena, PRECISION_F64, n);
+	Vector *b = vec_alloc(scratch.arena, PRECISION_F64, n);
+	vec_fill_random(expected, &rng);
+	sparse_mat_mul_vec(b, A, expected);
+
+	char *sections[] = { "vector", "solution" };
+	Vector *values[] = { b, expected };
+	U64 size;
+	char *text = test_input_text(scratch.arena, "conjugate_gradients", A, n, sections, values, ARRAY_COUNT(sections), &size);
+
+	ParseResult plain = parse_input_memory(scratch.arena, "test_reorder", text, size);
+	reorder_rows = true;
+	ParseResult input = parse_input_memory(scratch.arena, "test_reorder", text, size);
+	reorder_rows = false;
+	assert(!plain.matrix->permutation && input.matrix->permutation);
+	assert(test_csr_bandwidth(plain.matrix) > 10 * side);
+	assert(test_csr_bandwidth(input.matrix) <= 2 * side);
+	assert(memcmp(input.vector->valuesF64, b->valuesF64, n * sizeof(F64)) == 0);
+
+	write_binary_file(binary_path, &input);
+	ParseResult binary = load_binary_file(scratch.arena, binary_path);
+	assert(parse_results_equal(&binary, &input));
+
+	Vector *plain_x = vec_alloc(scratch.arena, PRECISION_F64, n);
+	Vector *actual = vec_alloc(scratch.arena, PRECISION_F64, n);
+	PreparedSystem plain_system = prepare_system(scratch.arena, SOLVER_CONJUGATE_GRADIENTS, plain.matrix);
+	assert(solve_prepared(&plain_system, plain.vector, NULL, plain_x));
+	ParseResult *reordered[] = { &input, &binary };
+	SolverKind solvers[] = { SOLVER_CONJUGATE_GRADIENTS, SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS };
+	for (U64 r=0; r<ARRAY_COUNT(reordered); ++r) {
+		for (U64 i=0; i<ARRAY_COUNT(solvers); ++i) {
+			PreparedSystem prepared = prepare_system(scratch.arena, solvers[i], reordered[r]->matrix);
+			assert(solve_prepared(&prepared, reordered[r]->vector, NULL, actual));
+			assert(vec_close(actual, expected, 1e-3));
+			// conjugate gradients does not depend on the numbering up to
+			// rounding, the incomplete Cholesky factor does
+			assert(vec_close(actual, plain_x, solvers[i] == SOLVER_CONJUGATE_GRADIENTS ? 1e-9 : 1e-3));
+
+			// the guess is moved into the reordered numbering too, the
+			// exact solution is already converged
+			assert(solve_prepared(&prepared, reordered[r]->vector, reordered[r]->solution, actual));
+			assert(solver_stats.iterations == 0);
+		}
+
+		PreparedSystem prepared = prepare_system(scratch.arena, SOLVER_CONJUGATE_GRADIENTS, reordered[r]->matrix);
+		assert(solve_processes(&prepared, reordered[r]->vector, NULL, actual, 3));
+		assert(vec_close(actual, expected, 1e-3));
+		assert(solve_processes(&prepared, reordered[r]->vector, reordered[r]->solution, actual, 3));
+		assert(solver_stats.iterations == 0);
+	}
+	unload_binary_file(&binary);
+	remove(binary_path);
+
+	// an arrowhead, its first row and column are full and listed twice, and a
+	// dense matrix. a node can have every other node as its neighbour
+	U64 arrow_sizes[] = { 6, 200 };
+	for (U64 t=0; t<ARRAY_COUNT(arrow_sizes); ++t) {
+		U64 m = arrow_sizes[t];
+		bool dense = t == 1;
+		SparseMatrix *arrow = sparse_mat_alloc(scratch.arena, PRECISION_F64, dense ? m*m : 5*m);
+		U64 arrow_count = 0;
+		for (U64 row=0; row<m; ++row) {
+			for (U64 col=0; col<m; ++col) {
+				if (row == col) {
+					test_push_entry(arrow, &arrow_count, row, col, dense ? 2.0 * m : m + 1.0);
+				} else if (dense) {
+					test_push_entry(arrow, &arrow_count, row, col, 1.0 / (1 + row + col));
+				} else if (row == 0 || col == 0) {
+					test_push_entry(arrow, &arrow_count, row, col, -0.5);
+					test_push_entry(arrow, &arrow_count, row, col, -0.5);
+				}
+			}
+		}
+		arrow->num_values = arrow_count;
+		sparse_mat_build_csr(scratch.arena, arrow, m);
+
+		Vector *arrow_expected = vec_alloc(scratch.arena, PRECISION_F64, m);
+		Vector *arrow_b = vec_alloc(scratch.arena, PRECISION_F64, m);
+		vec_fill_random(arrow_expected, &rng);
+		sparse_mat_mul_vec(arrow_b, arrow, arrow_expected);
+		char *arrow_sections[] = { "vector" };
+		Vector *arrow_values[] = { arrow_b };
+		U64 arrow_size;
+		char *arrow_text = test_input_text(scratch.arena, "conjugate_gradients", arrow, m, arrow_sections, arrow_values, ARRAY_COUNT(arrow_sections), &arrow_size);
+
+		reorder_rows = true;
+		ParseResult arrow_input = parse_input_memory(scratch.arena, "test_reorder_arrowhead", arrow_text, arrow_size);
+		reorder_rows = false;
+		assert(arrow_input.matrix->permutation);
+		Vector *arrow_actual = vec_alloc(scratch.arena, PRECISION_F64, m);
+		PreparedSystem arrow_system = prepare_system(scratch.arena, SOLVER_CONJUGATE_GRADIENTS, arrow_input.matrix);
+		assert(solve_prepared(&arrow_system, arrow_input.vector, NULL, arrow_actual));
+		assert(vec_close(arrow_actual, arrow_expected, 1e-3));
+	}
+
+	scratch_end(scratch);
+	printf("test_reorder: success\n");
+}
+
+// compares the kernels for 32 bit and delta encoded columns of every simd
+// level against the scalar kernels for 64 bit columns on the same matrices,
+// in every layout that has column indices and for block products and row
+// blocks. then solves some of the text tests with delta encoded columns,
+// loaded from text and binary files and split over processes
+static void test_index_encodings(void) {
+	char *binary_path = "tests/test_index_encodings.bin";
+	char *encoding_names[SPARSE_INDEX_COUNT] = { "u64", "u32", "delta" };
+	FloatPrecision precisions[] = { PRECISION_F32, PRECISION_F64 };
+	SparseOp ops[] = { SPARSE_OP_MUL_VEC, SPARSE_OP_MUL_VEC_DOT, SPARSE_OP_RESIDUAL_DOT };
+	U64 sizes[] = { 1, 7, 1001, 100000 };
+	U64 columns = 3;
+	U64 rng = 0x3f29d4c1b87e6a05ull;
+	SimdLevel max_level = cpu_simd_level();
+	U64 num_failed = 0;
+
+	for (U64 p=0; p<ARRAY_COUNT(precisions); ++p) {
+		FloatPrecision precision = precisions[p];
+		F64 tolerance = precision == PRECISION_F32 ? 1e-4 : 1e-10;
+		LinearAlgebraKernels *reference = get_kernels_for_level(precision, SIMD_LEVEL_SCALAR);
+		for (U64 s=0; s<ARRAY_COUNT(sizes); ++s) {
+			ArenaTemp scratch = scratch_begin(NULL, 0);
+			U64 n = sizes[s];
+
+			// pairs of the same matrix with 64 bit and with compact columns,
+			// delta encoding falls back to 32 bits outside of compressed rows
+			enum { pair_count = 4 };
+			SparseMatrix *wide[pair_count];
+			SparseMatrix *narrow[pair_count];
+			SparseIndexEncoding encodings[pair_count] = { SPARSE_INDEX_U32, SPARSE_INDEX_DELTA, SPARSE_INDEX_DELTA, SPARSE_INDEX_DELTA };
+			for (U64 i=0; i<pair_count; ++i) {
+				SparseMatrix *pair[2];
+				for (U64 j=0; j<2; ++j) {
+					U64 state = rng;
+					pair[j] = i < 2 ? test_random_sparse_mat(scratch.arena, precision, n, &state) : test_symmetric_sparse_mat(scratch.arena, precision, n, &state);
+					if (i == 2) {
+						sparse_mat_convert_sliced(scratch.arena, pair[j], 8, 32);
+					} else if (i == 3) {
+						assert(sparse_mat_convert_symmetric(pair[j]));
+					}
+				}
+				wide[i] = pair[0];
+				narrow[i] = pair[1];
+				sparse_mat_compact_indices(scratch.arena, narrow[i], encodings[i]);
+				assert(narrow[i]->index_encoding == (i == 1 ? SPARSE_INDEX_DELTA : SPARSE_INDEX_U32) && !narrow[i]->cols);
+			}
+			test_random_u64(&rng);
+
+			Vector *a = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *b = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *expected = vec_alloc(scratch.arena, precision, n * columns);
+			Vector *actual = vec_alloc(scratch.arena, precision, n * columns);
+			vec_fill_random(a, &rng);
+			vec_fill_random(b, &rng);
+			Vector column_a = vec_slice(a, 0, n);
+			Vector column_b = vec_slice(b, 0, n);
+			Vector column_expected = vec_slice(expected, 0, n);
+			Vector column_actual = vec_slice(actual, 0, n);
+
+			for (SimdLevel level = SIMD_LEVEL_SCALAR; level <= max_level; ++level) {
+				LinearAlgebraKernels *k = get_kernels_for_level(precision, level);
+				for (U64 i=0; i<pair_count; ++i) {
+					for (U64 j=0; j<ARRAY_COUNT(ops); ++j) {
+						F64 expected_sum = run_sparse_kernel(reference, ops[j], &(KernelArgs){ .A = wide[i], .result = &column_expected, .a = &column_a, .b = &column_b }, n);
+						F64 actual_sum = run_sparse_kernel(k, ops[j], &(KernelArgs){ .A = narrow[i], .result = &column_actual, .a = &column_a, .b = &column_b }, n);
+						if (!vec_close(&column_actual, &column_expected, tolerance) || !values_close(actual_sum, expected_sum, tolerance)) {
+							printf("test_index_encodings: op %u (%s, %s, layout %u, %s, n=%llu) does not match 64 bit columns\n",
+								ops[j], encoding_names[narrow[i]->index_encoding], simd_level_names[level], narrow[i]->layout,
+								precision == PRECISION_F32 ? "F32" : "F64", n);
+							++num_failed;
+						}
+					}
+				}
+
+				// block products, of which delta encoded rows have none
+				assert(!sparse_block_kernel(k, narrow[1], SPARSE_OP_MUL_VEC_DOT));
+				for (U64 j=1; j<ARRAY_COUNT(ops); ++j) {
+					F64 expected_sums[BLOCK_MAX_COLUMNS];
+					F64 actual_sums[BLOCK_MAX_COLUMNS];
+					run_block_kernel(sparse_block_kernel(reference, wide[0], ops[j]),
+						&(KernelArgs){ .A = wide[0], .result = expected, .a = a, .b = b, .columns = columns }, n, expected_sums);
+					run_block_kernel(sparse_block_kernel(k, narrow[0], ops[j]),
+						&(KernelArgs){ .A = narrow[0], .result = actual, .a = a, .b = b, .columns = columns }, n, actual_sums);
+					bool same = vec_close(actual, expected, tolerance);
+					for (U64 col=0; col<columns; ++col) {
+						same = same && values_close(actual_sums[col], expected_sums[col], tolerance);
+					}
+					if (!same) {
+						printf("test_index_encodings: block op %u (%s, %s, n=%llu) does not match 64 bit columns\n",
+							ops[j], simd_level_names[level], precision == PRECISION_F32 ? "F32" : "F64", n);
+						++num_failed;
+					}
+				}
+			}
+
+			// a row block keeps the encoding, delta encoded rows are encoded
+			// again for their new row numbers
+			U64 start = n / 3;
+			U64 end = n - n / 4;
+			SparseMatrix *wide_block = sparse_mat_row_block(scratch.arena, wide[0], start, end);
+			Vector block_expected = vec_slice(expected, 0, end - start);
+			Vector block_actual = vec_slice(actual, 0, end - start);
+			reference->sparse_mat_mul_vec(&(KernelArgs){ .A = wide_block, .result = &block_expected, .a = &column_a }, &(KernelRange){ .start = 0, .end = end - start });
+			for (U64 i=0; i<2; ++i) {
+				SparseMatrix *block = sparse_mat_row_block(scratch.arena, narrow[i], start, end);
+				assert(block->index_encoding == narrow[i]->index_encoding);
+				sparse_kernel(get_kernels(precision), block, SPARSE_OP_MUL_VEC)(&(KernelArgs){ .A = block, .result = &block_actual, .a = &column_a }, &(KernelRange){ .start = 0, .end = end - start });
+				if (!vec_close(&block_actual, &block_expected, tolerance)) {
+					printf("test_index_encodings: row block (%s, n=%llu) does not match 64 bit columns\n", encoding_names[block->index_encoding], n);
+					++num_failed;
+				}
+			}
+			scratch_end(scratch);
+		}
+	}
+
+	for (U64 i=0; i<10; ++i) {
+		ArenaTemp scratch = scratch_begin(NULL, 0);
+		char path[256];
+		snprintf(path, sizeof(path), "tests/test_%llu.txt", i);
+		detect_storage = false;
+		index_encoding = SPARSE_INDEX_DELTA;
+		ParseResult text = parse_input(scratch.arena, path);
+		detect_storage = true;
+		index_encoding = SPARSE_INDEX_U32;
+		assert(text.matrix->index_encoding == SPARSE_INDEX_DELTA);
+
+		write_binary_file(binary_path, &text);
+		ParseResult binary = load_binary_file(scratch.arena, binary_path);
+		assert(parse_results_equal(&binary, &text));
+
+		Vector *actual = vec_alloc(scratch.arena, text.vector->precision, text.vector->num_values);
+		ParseResult *inputs[] = { &text, &binary };
+		for (U64 j=0; j<ARRAY_COUNT(inputs); ++j) {
+			PreparedSystem prepared = prepare_system(scratch.arena, inputs[j]->solver, inputs[j]->matrix);
+			if (!solve_prepared(&prepared, inputs[j]->vector, NULL, actual) || !vec_equal(actual, text.solution)) {
+				printf("test_index_encodings: %s does not solve with delta encoded columns\n", path);
+				++num_failed;
+			}
+			prepared = prepare_system(scratch.arena, SOLVER_CONJUGATE_GRADIENTS, inputs[j]->matrix);
+			if (!solve_processes(&prepared, inputs[j]->vector, NULL, actual, 3) || !vec_equal(actual, text.solution)) {
+				printf("test_index_encodings: %s does not solve in several processes with delta encoded columns\n", path);
+				++num_failed;
+			}
+		}
+		unload_binary_file(&binary);
+		scratch_end(scratch);
+	}
+	remove(binary_path);
+
+	assert(num_failed == 0);
+	printf("test_index_encodings: success (up to %s)\n", simd_level_names[max_level]);
+}
+
+static void test_cache_remove_entry(void *data, char *name) {
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", (char*)data, name);
+	remove(path);
+}
+
+static void test_cache_corrupt_entry(void *data, char *name) {
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", (char*)data, name);
+	FILE *f = fopen(path, "r+b");
+	assert(f);
+	fseek(f, 8, SEEK_SET); // the version
+	fputc(0xff, f);
+	fclose(f);
+}
+
+// the same input parsed three times: stored in the cache, taken from it, and
+// parsed again once the entry is damaged
+static void test_cache(void) {
+	char *path = "tests/cache_input.txt";
+	cache_dir = "tests/cache";
+	assert(os_make_directory(cache_dir));
+	FILE *f = fopen(path, "wb");
+	assert(f);
+	fputs("format: double\nsolver: incomplete_cholesky_conjugate_gradients\nmatrix: 4\n0 0 3\n0 1 2\n1 0 2\n1 1 6\n"
+	      "vector: 2\n2\n-8\nvector: 2\n3\n2\n", f);
+	fclose(f);
+	F64 expected[] = { 2, -2, 1, 0 };
+
+	for (U64 run=0; run<3; ++run) {
+		if (run == 2) {
+			assert(os_list_directory(cache_dir, test_cache_corrupt_entry, cache_dir));
+		}
+		ArenaTemp scratch = scratch_begin(NULL, 0);
+		U64 hits = cache_hits, misses = cache_misses;
+		PreparedSystem prepared;
+		ParseResult input = parse_input_cached(scratch.arena, path, &prepared);
+		bool hit = run == 1;
+		assert(cache_hits == hits + hit && cache_misses == misses + !hit);
+		assert((input.mapping != NULL) == hit);
+		assert(prepared.kind == SOLVER_INCOMPLETE_CHOLESKY_CONJUGATE_GRADIENTS && prepared.L);
+		assert(input.num_vectors == 2 && input.matrix->num_rows == 2);
+
+		Vector *solution = vec_alloc(scratch.arena, PRECISION_F64, 4);
+		assert(solve_prepared(&prepared, input.vector, NULL, solution));
+		for (U64 i=0; i<ARRAY_COUNT(expected); ++i) {
+			assert(F64_equal(solution->valuesF64[i], expected[i], 1e-6));
+		}
+		if (input.mapping) {
+			unload_binary_file(&input);
+		}
+		scratch_end(scratch);
+	}
+
+	assert(os_list_directory(cache_dir, test_cache_remove_entry, cache_dir));
+	remove(path);
+	cache_dir = NULL;
+	printf("test_cache: success\n");
+}
+
+static void test_server_send(OSSocket s, void *data, U64 size) {
+	assert(os_socket_write(s, data, size));
+}
+
+static void test_server_read_line(OSSocket s, char *line, U64 cap) {
+	for (U64 length = 0; length + 1 < cap; ++length) {
+		assert(os_socket_read(s, &line[length], 1) == 1);
+		if (line[length] == '\n') {
+			line[length] = 0;
+			return;
+		}
+	}
+	assert(!"reply line too long");
+}
+
+static void test_server_read_solution(OSSocket s, F64 *expected, U64 count) {
+	char line[256];
+	int converged;
+	U64 iterations, size;
+	F64 residual;
+	test_server_read_line(s, line, sizeof(line));
+	assert(sscanf(line, "ok %d %llu %lg %llu", &converged, &iterations, &residual, &size) == 4);
+	assert(converged && iterations > 0 && residual <= TOLERANCE && size == count * sizeof(F64));
+	F64 values[8];
+	assert(count <= ARRAY_COUNT(values));
+	for (U8 *p = (U8*)values, *end = p + size; p < end;) {
+		S64 bytes_read = os_socket_read(s, p, end - p);
+		assert(bytes_read > 0);
+		p += bytes_read;
+	}
+	for (U64 i=0; i<count; ++i) {
+		assert(F64_equal(values[i], expected[i], 1e-6));
+	}
+}
+
+typedef struct {
+	char *socket_path;
+	char *source;
+	char *binary; // source in the binary format
+	U64 binary_size;
+	OSSemaphore done;
+} TestServerClient;
+
+// talks to the server like a client would: loads a system as text and as
+// binary, solves new right hand sides against it, and checks that failed
+// requests leave the connection usable
+static void test_server_client(void *data) {
+	TestServerClient *client = data;
+	OSSocket s = OS_INVALID_SOCKET;
+	for (U64 attempt=0; attempt<10000000 && s == OS_INVALID_SOCKET; ++attempt) {
+		s = os_socket_connect(client->socket_path);
+	}
+	assert(s != OS_INVALID_SOCKET);
+
+	char line[256];
+	U64 handle, rows, value_size;
+	// commands without a payload on a fresh connection, which carries on
+	test_server_send(s, "free 99\n", 8);
+	test_server_read_line(s, line, sizeof(line));
+	assert(strcmp(line, "error unknown handle 99") == 0);
+
+	snprintf(line, sizeof(line), "load %llu\n", (U64)strlen(client->source));
+	test_server_send(s, line, strlen(line));
+	test_server_send(s, client->source, strlen(client->source));
+	test_server_read_line(s, line, sizeof(line));
+	assert(sscanf(line, "ok %llu %llu %llu", &handle, &rows, &value_size) == 3);
+	assert(rows == 2 && value_size == sizeof(F64));
+	test_server_read_solution(s, (F64[]){ 2, -2 }, 2);
+
+	// two right hand sides against the resident system, sent in one go
+	F64 rhs[] = { 3, 2, 5, 8 };
+	snprintf(line, sizeof(line), "solve %llu %llu\n", handle, (U64)sizeof(rhs));
+	test_server_send(s, line, strlen(line));
+	test_server_send(s, rhs, sizeof(rhs));
+	test_server_read_solution(s, (F64[]){ 1, 0, 1, 1 }, 4);
+
+	U64 binary_handle;
+	snprintf(line, sizeof(line), "load %llu\n", client->binary_size);
+	test_server_send(s, line, strlen(line));
+	test_server_send(s, client->binary, client->binary_size);
+	test_server_read_line(s, line, sizeof(line));
+	assert(sscanf(line, "ok %llu %llu %llu", &binary_handle, &rows, &value_size) == 3);
+	assert(binary_handle != handle && rows == 2);
+	test_server_read_solution(s, (F64[]){ 2, -2 }, 2);
+
+	// failures reply an error and the connection carries on
+	char *malformed = "format: double\nmatrix: 4\n0 0 3\n";
+	snprintf(line, sizeof(line), "load %llu\n", (U64)strlen(malformed));
+	test_server_send(s, line, strlen(line));
+	test_server_send(s, malformed, strlen(malformed));
+	test_server_read_line(s, line, sizeof(line));
+	assert(strncmp(line, "error ", 6) == 0);
+
+	snprintf(line, sizeof(line), "solve %llu %llu\n", handle, (U64)sizeof(F64));
+	test_server_send(s, line, strlen(line));
+	test_server_send(s, rhs, sizeof(F64));
+	test_server_read_line(s, line, sizeof(line));
+	assert(strncmp(line, "error ", 6) == 0);
+
+	snprintf(line, sizeof(line), "free %llu\n", handle);
+	test_server_send(s, line, strlen(line));
+	test_server_read_line(s, line, sizeof(line));
+	assert(strcmp(line, "ok") == 0);
+
+	snprintf(line, sizeof(line), "solve %llu %llu\n", handle, (U64)(2 * sizeof(F64)));
+	test_server_send(s, line, strlen(line));
+	test_server_send(s, rhs, 2 * sizeof(F64));
+	test_server_read_line(s, line, sizeof(line));
+	assert(strncmp(line, "error unknown handle", 20) == 0);
+
+	snprintf(line, sizeof(line), "solve %llu %llu\n", binary_handle, (U64)(2 * sizeof(F64)));
+	test_server_send(s, line, strlen(line));
+	test_server_send(s, rhs, 2 * sizeof(F64));
+	test_server_read_solution(s, (F64[]){ 1, 0 }, 2);
+
+	test_server_send(s, "shutdown\n", 9);
+	test_server_read_line(s, line, sizeof(line));
+	assert(strcmp(line, "ok") == 0);
+	os_socket_close(s);
+	os_semaphore_signal(&client->done);
+}
+
+// the server runs on this thread until the client on another thread shuts
+// it down
+static void test_server(void) {
+	char *binary_path = "tests/server_system.bin";
+	TestServerClient client = {
+		.socket_path = "tests/server.sock",
+		.source = "format: double\nsolver: incomplete_cholesky_conjugate_gradients\nmatrix: 4\n0 0 3\n0 1 2\n1 0 2\n1 1 6\nvector: 2\n2\n-8\n",
+	};
+	assert(os_semaphore_init(&client.done, 0));
+
+	ArenaTemp scratch = scratch_begin(NULL, 0);
+	U64 source_size = strlen(client.source);
+	char *text = arena_push_n(scratch.arena, char, source_size + 1);
+	memcpy(text, client.source, source_size + 1);
+	ParseResult input = parse_input_memory(scratch.arena, "test_server", text, source_size);
+	write_binary_file(binary_path, &input);
+	assert(read_entire_file(scratch.arena, binary_path, &client.binary, &client.binary_size));
+	remove(binary_path);
+
+	assert(os_thread_create(test_server_client, &client));
+	serve(client.socket_path);
+	os_semaphore_wait(&client.done);
+	scratch_end(scratch);
+
+	printf("test_server: success\n");
+}
+
 int main(int argc, char **argv) {
 	(void)argc; (void)argv;
 	
 	profile_begin();
 
 	init_scratch();
+	// at least a few threads so the parallel code paths run on small machines too
+	thread_pool_init(MAX(4, os_get_processor_count()));
 
 	// test_linear_algebra();
+	test_fused_kernels();
+	test_simd_kernels();
+	test_parse_number();
+	test_binary_format();
+	test_parallel_parse();
+	test_stream_parse();
+	test_preconditioned_conjugate_gradients();
+	test_incomplete_cholesky();
+	test_symmetric_storage();
+	test_diagonal_storage();
+	test_sliced_storage();
+	test_block_conjugate_gradients();
+	test_batch();
+	test_server();
+	test_cache();
+	test_initial_guess();
+	test_mixed_precision();
+	test_pipelined_conjugate_gradients();
+	test_processes();
+	test_reorder();
+	test_index_encodings();
 
 	test_conjugate_gradients();
 
-	// test_branching();
 	// test_float_vs_double();
 
 	profile_end();